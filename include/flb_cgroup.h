@@ -0,0 +1,97 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_CGROUP_H
+#define FLB_CGROUP_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "flb_proc.h"
+
+#define FLB_CGROUP_ROOT  "/sys/fs/cgroup"
+
+/* Counters of a cgroup v2, files of a disabled controller read as zero */
+struct flb_cgroup_stat {
+    /* cpu.stat, microseconds */
+    uint64_t usage_usec;
+    uint64_t user_usec;
+    uint64_t system_usec;
+    uint64_t nr_periods;
+    uint64_t nr_throttled;
+    uint64_t throttled_usec;
+
+    /* memory.current, memory.peak, memory.max and memory.stat, bytes */
+    uint64_t mem_current;
+    uint64_t mem_peak;
+    uint64_t mem_max;           /* 0 = no limit */
+    uint64_t anon;
+    uint64_t file;              /* page cache charged to the cgroup */
+    uint64_t kernel;
+    uint64_t sock;
+    uint64_t pgmajfault;
+
+    /* memory.events */
+    uint64_t oom;
+    uint64_t oom_kill;
+
+    /* io.stat, every device */
+    uint64_t rbytes;
+    uint64_t wbytes;
+    uint64_t rios;
+    uint64_t wios;
+};
+
+/* Control files of a cgroup, kept open and read with pread() */
+struct flb_cgroup {
+    char *path;
+    pid_t pid;                  /* process used for sockets, threads  */
+    int fd_cpu;
+    int fd_current;
+    int fd_peak;
+    int fd_max;
+    int fd_stat;
+    int fd_events;
+    int fd_io;
+};
+
+/*
+ * 'path' is absolute or relative to /sys/fs/cgroup. 'pid' is the process
+ * flb_cgroup_task() answers for, the first one of the group if -1.
+ */
+struct flb_cgroup *flb_cgroup_create(char *path, pid_t pid);
+void flb_cgroup_destroy(struct flb_cgroup *cg);
+int flb_cgroup_read(struct flb_cgroup *cg, struct flb_cgroup_stat *st);
+
+/* First process listed in cgroup.procs, -1 if the group is empty */
+pid_t flb_cgroup_pid(char *path);
+
+/*
+ * Fill 't' with the CPU time (converted to clock ticks) and the memory
+ * of the first cgroup created, if it answers for 'pid'. Used by
+ * flb_proc_stat_create(), returns -1 otherwise.
+ */
+int flb_cgroup_task(pid_t pid, struct flb_proc_task *t);
+
+/* Same conversion for a sample already read */
+void flb_cgroup_to_task(struct flb_cgroup *cg, struct flb_cgroup_stat *st,
+                        struct flb_proc_task *t);
+
+#endif
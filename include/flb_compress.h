@@ -0,0 +1,42 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_COMPRESS_H
+#define FLB_COMPRESS_H
+
+#include <stddef.h>
+
+#define FLB_COMPRESS_NONE    0
+#define FLB_COMPRESS_GZIP    1
+#define FLB_COMPRESS_SNAPPY  2    /* raw block format, no framing */
+#define FLB_COMPRESS_ZSTD    3    /* only when built with FLB_HAVE_ZSTD */
+
+int flb_compress_type(char *name);
+char *flb_compress_name(int type);
+
+/* Compress 'in' into a new allocated buffer, caller must free() it */
+int flb_compress(int type, const void *in, size_t in_len,
+                 void **out, size_t *out_len);
+
+/* Reverse of flb_compress(), used by receivers */
+int flb_decompress(int type, const void *in, size_t in_len,
+                   void **out, size_t *out_len);
+
+#endif
@@ -25,5 +25,6 @@ int flb_data_file_load(char *path, char **out_buf, size_t *out_size);
 void flb_data_file_unload(void *map, size_t size);
 int flb_data_file_offset_records(int n_records, char *buf,
                                  size_t size, off_t *offset);
+int flb_data_file_index(char *buf, size_t size, size_t **offsets);
 
 #endif
@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_HISTOGRAM_H
+#define FLB_HISTOGRAM_H
+
+#include <stdint.h>
+
+/*
+ * HDR style log-linear histogram: every power of two range is split in
+ * FLB_HIST_SUB_HALF linear buckets, that gives ~3% of relative error for
+ * any recorded value with a fixed memory footprint.
+ */
+#define FLB_HIST_SUB_BITS   5
+#define FLB_HIST_SUB        (1 << FLB_HIST_SUB_BITS)
+#define FLB_HIST_SUB_HALF   (FLB_HIST_SUB / 2)
+#define FLB_HIST_BUCKETS    (FLB_HIST_SUB + \
+                             ((64 - FLB_HIST_SUB_BITS) * FLB_HIST_SUB_HALF))
+
+struct flb_histogram {
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    double sum;
+    uint64_t buckets[FLB_HIST_BUCKETS];
+};
+
+struct flb_histogram *flb_histogram_create();
+void flb_histogram_destroy(struct flb_histogram *h);
+void flb_histogram_reset(struct flb_histogram *h);
+void flb_histogram_record(struct flb_histogram *h, uint64_t val);
+void flb_histogram_merge(struct flb_histogram *dst, struct flb_histogram *src);
+uint64_t flb_histogram_percentile(struct flb_histogram *h, double pct);
+
+/* Print a summary, values are expected in microseconds */
+void flb_histogram_print(struct flb_histogram *h, int fd, char *title);
+
+#endif
@@ -0,0 +1,82 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_HTTP_H
+#define FLB_HTTP_H
+
+#include <sys/types.h>
+
+/* Parsed response metadata */
+struct flb_http_response {
+    int status;             /* HTTP status code          */
+    int close;              /* 'Connection: close' found */
+    size_t header_len;      /* bytes of status + headers */
+    size_t body_len;        /* bytes of the body         */
+};
+
+/* Parsed request metadata, pointers refer to the parsed buffer */
+struct flb_http_request {
+    const char *method;
+    size_t method_len;
+    const char *uri;
+    size_t uri_len;
+    int close;              /* HTTP/1.0 or 'Connection: close'   */
+    int chunked;            /* body uses chunked transfer coding */
+    size_t header_len;      /* bytes of request line + headers   */
+    size_t body_len;        /* bytes of the (encoded) body       */
+};
+
+/*
+ * Compose a full HTTP/1.1 request, 'headers' is an optional set of extra
+ * preformatted header lines ("Key: Value\r\n"). The returned buffer must
+ * be released with free().
+ */
+char *flb_http_request_create(char *method, char *host, char *port,
+                              char *uri, char *content_type, char *headers,
+                              const char *body, size_t body_len,
+                              size_t *out_len);
+
+/*
+ * Parse a response at the beginning of 'buf'. Returns the total length of
+ * the response when it's complete, zero if more data is needed or -1 if
+ * the content is not valid.
+ */
+ssize_t flb_http_response_parse(const char *buf, size_t len,
+                                struct flb_http_response *res);
+
+/*
+ * Lookup a header in a parsed request or response, 'header_len' comes from
+ * the parser. Returns the value (not NULL terminated) or NULL.
+ */
+const char *flb_http_header_get(const char *buf, size_t header_len,
+                                char *name, size_t *val_len);
+
+/*
+ * Decode a complete chunked body into a new buffer released with free(),
+ * chunk extensions and trailers are dropped. Returns 0 or -1 on error.
+ */
+int flb_http_chunked_decode(const char *buf, size_t len,
+                            char **out, size_t *out_len);
+
+/* Same as flb_http_response_parse() for requests received by a sink */
+ssize_t flb_http_request_parse(const char *buf, size_t len,
+                               struct flb_http_request *req);
+
+#endif
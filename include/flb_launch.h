@@ -0,0 +1,91 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_LAUNCH_H
+#define FLB_LAUNCH_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+
+/* Readiness conditions */
+#define FLB_LAUNCH_READY_NONE    0  /* ready once it's running          */
+#define FLB_LAUNCH_READY_LISTEN  1  /* a listening TCP socket appears   */
+#define FLB_LAUNCH_READY_READ    2  /* the first byte of a file is read */
+
+/* Time allowed to become ready and to exit after SIGTERM, milliseconds */
+#define FLB_LAUNCH_READY_TIMEOUT 60000
+#define FLB_LAUNCH_TERM_TIMEOUT  5000
+
+/*
+ * A target started by the tool. The command runs in its own process group
+ * and a watcher thread polls it every millisecond from the fork() until it
+ * is ready, recording the startup cost. On destroy the whole group gets
+ * SIGTERM, then SIGKILL if it does not exit in time.
+ */
+struct flb_launch {
+    pid_t pid;
+    char *cmd;
+    int ready;              /* FLB_LAUNCH_READY_*                     */
+    int port;               /* listen: port to wait for, 0 = any, the
+                             * first one found once ready          */
+    char *path;             /* read: file consumed by the target      */
+    struct timespec start;  /* CLOCK_MONOTONIC, before fork()         */
+    pthread_t thread;
+    int running;
+
+    /* Set by the watcher, read once 'done' is set */
+    int done;               /* ready or exited                        */
+    int exited;
+    int status;             /* waitpid() status when exited           */
+    double exec_ms;         /* fork() to exec()                       */
+    double ready_ms;        /* fork() to ready, -1 if never ready     */
+    uint64_t samples;       /* /proc/PID/stat polls until ready       */
+    long peak_rss;          /* bytes, during the startup              */
+    long ready_rss;         /* bytes, when ready                      */
+    unsigned long ready_cpu_ms;
+    unsigned long ready_minflt;
+    unsigned long ready_majflt;
+};
+
+/*
+ * Parse a --ready spec: 'none', 'listen', 'listen:PORT' or 'read:PATH'.
+ * Returns 0 or -1 if it's invalid.
+ */
+int flb_launch_ready_parse(char *spec, int *ready, int *port, char **path);
+
+/* Fork and exec 'cmd', simple commands run directly, others with sh -c */
+struct flb_launch *flb_launch_create(char *cmd, int ready, int port,
+                                     char *path);
+
+/*
+ * Block until the target is ready. Returns 0, or -1 if it exited or did
+ * not become ready in 'timeout' milliseconds.
+ */
+int flb_launch_wait(struct flb_launch *l, int timeout);
+
+/* Stop the target and its process group, then release the context */
+void flb_launch_destroy(struct flb_launch *l);
+
+/* The launched target of this process, or NULL */
+struct flb_launch *flb_launch_get();
+
+#endif
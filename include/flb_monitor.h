@@ -0,0 +1,105 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_MONITOR_H
+#define FLB_MONITOR_H
+
+/*
+ * Options shared by every tool that monitors a target process. They are
+ * long options only, so they never clash with the tools own short ones:
+ *
+ *   static const struct option long_opts[] = {
+ *       ...
+ *       FLB_MONITOR_LONG_OPTS,
+ *       { NULL, 0, NULL, 0 },
+ *   };
+ *
+ * and the 'default' case of the getopt switch hands them to
+ * flb_monitor_option(). The values are process wide, the report and the
+ * /proc readers pick them up.
+ */
+struct flb_monitor {
+    int sample_hz;          /* background sampler frequency, 0 = off */
+    int threads;            /* per-thread CPU breakdown              */
+    int memory;             /* PSS, peak RSS and anon/file split     */
+    int smaps;              /* top N mappings by PSS, 0 = off        */
+    int io;                 /* syscalls, I/O, context switches, faults */
+    int tree;               /* sum the target and its descendants    */
+    int tree_top;           /* top N processes in the summary, 0 = off */
+    char *cgroup;           /* cgroup v2 totals instead of the process */
+    int perf;               /* perf_event_open() counters            */
+    char *profile;          /* folded stacks directory, NULL = off   */
+    int profile_first;      /* rounds profiled, 1 based              */
+    int profile_last;       /* 0 = until the end                     */
+    int schedstat;          /* ns CPU time and run queue delay       */
+    int sockets;            /* sock_diag columns of the TCP writers  */
+    char *launch;           /* command started as the target         */
+    int ready;              /* FLB_LAUNCH_READY_* of the launch      */
+    int ready_port;
+    char *ready_path;
+};
+
+/* --sample-hz without a rate, the sampler is off by default */
+#define FLB_MONITOR_DEFAULT_HZ    100
+
+/* getopt values, above any short option character */
+#define FLB_MONITOR_OPT_SAMPLE_HZ 0x100
+#define FLB_MONITOR_OPT_THREADS   0x101
+#define FLB_MONITOR_OPT_MEMORY    0x102
+#define FLB_MONITOR_OPT_SMAPS     0x103
+#define FLB_MONITOR_OPT_IO        0x104
+#define FLB_MONITOR_OPT_TREE      0x105
+#define FLB_MONITOR_OPT_CGROUP    0x106
+#define FLB_MONITOR_OPT_PERF      0x107
+#define FLB_MONITOR_OPT_PROFILE   0x108
+#define FLB_MONITOR_OPT_ROUNDS    0x109
+#define FLB_MONITOR_OPT_SCHEDSTAT 0x10a
+#define FLB_MONITOR_OPT_LAUNCH    0x10b
+#define FLB_MONITOR_OPT_READY     0x10c
+#define FLB_MONITOR_OPT_SOCKETS   0x10d
+
+#define FLB_MONITOR_LONG_OPTS                                           \
+    { "sample-hz", optional_argument, NULL, FLB_MONITOR_OPT_SAMPLE_HZ }, \
+    { "threads"  , no_argument      , NULL, FLB_MONITOR_OPT_THREADS   }, \
+    { "memory"   , no_argument      , NULL, FLB_MONITOR_OPT_MEMORY    }, \
+    { "smaps"    , optional_argument, NULL, FLB_MONITOR_OPT_SMAPS     }, \
+    { "io"       , no_argument      , NULL, FLB_MONITOR_OPT_IO        }, \
+    { "tree"     , optional_argument, NULL, FLB_MONITOR_OPT_TREE      }, \
+    { "cgroup"   , required_argument, NULL, FLB_MONITOR_OPT_CGROUP    }, \
+    { "perf"     , no_argument      , NULL, FLB_MONITOR_OPT_PERF      }, \
+    { "profile"  , required_argument, NULL, FLB_MONITOR_OPT_PROFILE   }, \
+    { "profile-rounds", required_argument, NULL, FLB_MONITOR_OPT_ROUNDS }, \
+    { "schedstat", no_argument      , NULL, FLB_MONITOR_OPT_SCHEDSTAT }, \
+    { "launch"   , required_argument, NULL, FLB_MONITOR_OPT_LAUNCH    }, \
+    { "ready"    , required_argument, NULL, FLB_MONITOR_OPT_READY     }, \
+    { "sockets"  , no_argument      , NULL, FLB_MONITOR_OPT_SOCKETS   }
+
+struct flb_monitor *flb_monitor_get();
+int flb_monitor_option(int opt, char *arg);
+
+/*
+ * PID to monitor once the options are parsed: 'pid' if it was given,
+ * otherwise the first process of --cgroup, the --launch command once it's
+ * ready, or -1. A launched target is stopped at exit().
+ */
+int flb_monitor_target(int pid);
+void flb_monitor_help();
+
+#endif
@@ -0,0 +1,101 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_MSGPACK_H
+#define FLB_MSGPACK_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Unpack return values */
+#define FLB_MP_OK           0
+#define FLB_MP_INCOMPLETE   1
+#define FLB_MP_ERROR       -1
+
+/* Object types returned by flb_mp_unpack_next() */
+#define FLB_MP_NIL          0
+#define FLB_MP_BOOL         1
+#define FLB_MP_INT          2
+#define FLB_MP_UINT         3
+#define FLB_MP_FLOAT        4
+#define FLB_MP_STR          5
+#define FLB_MP_BIN          6
+#define FLB_MP_ARRAY        7
+#define FLB_MP_MAP          8
+#define FLB_MP_EXT          9
+
+/*
+ * A tiny msgpack packer: we only need to produce Forward protocol chunks
+ * out of the JSON data file, so there is no need for a full library.
+ */
+struct flb_mp_buf {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+int flb_mp_buf_init(struct flb_mp_buf *b, size_t size);
+void flb_mp_buf_destroy(struct flb_mp_buf *b);
+
+int flb_mp_pack_raw(struct flb_mp_buf *b, const void *data, size_t len);
+int flb_mp_pack_nil(struct flb_mp_buf *b);
+int flb_mp_pack_bool(struct flb_mp_buf *b, int val);
+int flb_mp_pack_int(struct flb_mp_buf *b, int64_t val);
+int flb_mp_pack_uint(struct flb_mp_buf *b, uint64_t val);
+int flb_mp_pack_double(struct flb_mp_buf *b, double val);
+int flb_mp_pack_str(struct flb_mp_buf *b, const char *str, size_t len);
+int flb_mp_pack_bin(struct flb_mp_buf *b, const void *data, size_t len);
+int flb_mp_pack_array(struct flb_mp_buf *b, uint32_t n);
+int flb_mp_pack_map(struct flb_mp_buf *b, uint32_t n);
+int flb_mp_pack_event_time(struct flb_mp_buf *b, uint32_t sec, uint32_t nsec);
+
+/*
+ * One unpacked object: for containers 'n' is the number of children, the
+ * children follow in the buffer and must be unpacked by the caller.
+ */
+struct flb_mp_obj {
+    int type;
+    int ext_type;
+    union {
+        int boolean;
+        int64_t i64;
+        uint64_t u64;
+        double f64;
+        uint32_t n;
+        struct {
+            const char *ptr;
+            uint32_t size;
+        } raw;
+    } via;
+};
+
+/* Convert one JSON value (e.g: a data file line) to msgpack */
+int flb_mp_pack_json(struct flb_mp_buf *b, const char *json, size_t len);
+
+/* Minimal unpackers, 'off' is advanced only on FLB_MP_OK */
+int flb_mp_unpack_map(const char *buf, size_t len, size_t *off, uint32_t *n);
+int flb_mp_unpack_array(const char *buf, size_t len, size_t *off, uint32_t *n);
+int flb_mp_unpack_str(const char *buf, size_t len, size_t *off,
+                      const char **str, size_t *str_len);
+int flb_mp_unpack_next(const char *buf, size_t len, size_t *off,
+                       struct flb_mp_obj *obj);
+int flb_mp_skip(const char *buf, size_t len, size_t *off);
+
+#endif
@@ -27,9 +27,40 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <stdint.h>
 #include <netdb.h>
 
+/* Send paths for in-memory buffers */
+#define FLB_NET_SEND_WRITEV      0   /* plain writev(2), data is copied      */
+#define FLB_NET_SEND_ZEROCOPY    1   /* sendmsg(2) + MSG_ZEROCOPY            */
+#define FLB_NET_SEND_SPLICE      2   /* vmsplice(2) to a pipe + splice(2)    */
+
+struct flb_net_sender {
+    int fd;
+    int mode;
+
+    /* MSG_ZEROCOPY: every successful sendmsg() gets a sequential id */
+    uint32_t zc_sent;         /* number of zerocopy sends              */
+    uint32_t zc_done;         /* completions reported by the kernel    */
+    uint64_t zc_copied;       /* completions where the kernel copied   */
+
+    /* splice */
+    int pipe[2];
+    size_t pipe_size;
+};
+
 int flb_net_socket_create(int family);
 int flb_net_tcp_connect(char *host, char *port);
+int flb_net_udp_connect(char *host, char *port);
+int flb_net_server(char *host, char *port, int reuse_port);
+
+int flb_net_send_mode(char *name);
+char *flb_net_send_mode_name(int mode);
+int flb_net_sender_init(struct flb_net_sender *s, int fd, int mode);
+ssize_t flb_net_sender_send(struct flb_net_sender *s,
+                            struct iovec *iov, int iovcnt);
+int flb_net_sender_flush(struct flb_net_sender *s);
+void flb_net_sender_destroy(struct flb_net_sender *s);
 
 #endif
@@ -0,0 +1,42 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_OTLP_H
+#define FLB_OTLP_H
+
+#include "flb_protobuf.h"
+
+/* A data file line to be encoded as a LogRecord */
+struct flb_otlp_record {
+    const char *json;
+    size_t len;
+};
+
+/*
+ * Encode the records as an OTLP ExportLogsServiceRequest. Records are
+ * spread round-robin across 'resources' ResourceLogs, each one with
+ * 'scopes' ScopeLogs, so the cardinality seen by the receiver can be
+ * controlled.
+ */
+int flb_otlp_logs_encode(struct flb_pb_buf *b,
+                         struct flb_otlp_record *records, int n,
+                         int resources, int scopes);
+
+#endif
@@ -0,0 +1,67 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PERF_H
+#define FLB_PERF_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Events of a set, hardware or software */
+#define FLB_PERF_EVENTS  5
+
+/* Hardware set */
+#define FLB_PERF_CYCLES        0
+#define FLB_PERF_INSTRUCTIONS  1
+#define FLB_PERF_CACHE_REFS    2
+#define FLB_PERF_CACHE_MISSES  3
+#define FLB_PERF_BRANCH_MISSES 4
+
+/* Software set, used when the PMU is not available (VMs, containers) */
+#define FLB_PERF_TASK_CLOCK    0    /* nanoseconds */
+#define FLB_PERF_CTX_SWITCHES  1
+#define FLB_PERF_MIGRATIONS    2
+#define FLB_PERF_PAGE_FAULTS   3
+#define FLB_PERF_ALIGN_FAULTS  4
+
+/*
+ * Counter groups attached to every thread of a process, with 'inherit'
+ * set so threads created later are counted by their creator's group.
+ * Counters are read one by one and scaled when the kernel multiplexed
+ * them (more events than PMU counters).
+ */
+struct flb_perf {
+    pid_t pid;
+    int hw;                 /* hardware set, software set otherwise */
+    int n_threads;
+    int *fds;               /* n_threads * FLB_PERF_EVENTS, -1 = n/a */
+    double scaled;          /* lowest running / enabled ratio read  */
+};
+
+struct flb_perf *flb_perf_create(pid_t pid);
+void flb_perf_destroy(struct flb_perf *p);
+
+/* Sum of every thread, 'values' has FLB_PERF_EVENTS entries */
+int flb_perf_read(struct flb_perf *p, uint64_t *values);
+
+/* Name of an event of the active set */
+const char *flb_perf_name(struct flb_perf *p, int event);
+
+#endif
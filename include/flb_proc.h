@@ -28,6 +28,9 @@
 #ifndef FLB_PROC_H
 #define FLB_PROC_H
 
+#include <stdint.h>
+#include <sys/types.h>
+
 #define PROC_PID_SIZE      1024
 #define PROC_STAT_BUF_SIZE 1024
 
@@ -38,10 +41,19 @@ struct flb_proc_task {
 
     /* Process data */
     char name[256];
+    pid_t ppid;               /* %d  */
+    unsigned long minflt;     /* %lu */
+    unsigned long majflt;     /* %lu */
     unsigned long utime;	  /* %lu */
     unsigned long stime; 	  /* %lu */
+    unsigned long long starttime; /* %llu, ticks after boot */
     long rss;		  	      /* %ld */
 
+    /* schedstat of every thread, zero when it's not sampled */
+    uint64_t run_ns;            /* on CPU                     */
+    uint64_t wait_ns;           /* runnable, in the run queue */
+    uint64_t timeslices;
+
     /* Internal resource conversion */
     long  r_rss;                /* bytes = (rss * PAGESIZE)        */
     unsigned long r_utime_s;    /* seconds = (utime / _SC_CLK_TCK) */
@@ -51,7 +63,144 @@ struct flb_proc_task {
 };
 
 struct flb_proc_task *flb_proc_stat_create(pid_t pid);
+int flb_proc_stat_parse(const char *buf, size_t len, struct flb_proc_task *t);
+
+/* CPU time of one thread, from /proc/PID/task/TID/stat */
+struct flb_proc_thread {
+    pid_t tid;
+    char name[64];
+    unsigned long utime;
+    unsigned long stime;
+};
+
+/*
+ * List the threads of a process, returns the number of entries stored in
+ * 'out' (released with free()) or -1 on error.
+ */
+int flb_proc_threads(pid_t pid, struct flb_proc_thread **out);
+
+/* One thread of a flb_proc_sched, from /proc/PID/task/TID/schedstat */
+struct flb_proc_sched_thread {
+    pid_t tid;
+    int fd;
+    uint64_t run_ns;
+    uint64_t wait_ns;
+    uint64_t timeslices;
+};
+
+/*
+ * Nanosecond CPU time and run queue delay of every thread of a process.
+ * Thread files stay open, flb_proc_sched_scan() adds the new ones. When
+ * a thread exits its last values stay in the totals, so they never go
+ * backwards.
+ */
+struct flb_proc_sched {
+    pid_t pid;
+    int n;
+    int size;
+    struct flb_proc_sched_thread *threads;
+    uint64_t gone_run_ns;
+    uint64_t gone_wait_ns;
+    uint64_t gone_timeslices;
+};
+
+struct flb_proc_sched *flb_proc_sched_create(pid_t pid);
+void flb_proc_sched_destroy(struct flb_proc_sched *s);
+int flb_proc_sched_scan(struct flb_proc_sched *s);
+
+/* Read every thread and store the totals in 't', returns -1 on error */
+int flb_proc_sched_read(struct flb_proc_sched *s, struct flb_proc_task *t);
+
+/*
+ * Scan and read the first flb_proc_sched created if it follows 'pid',
+ * used by flb_proc_stat_create(). Returns -1 if there is none.
+ */
+int flb_proc_sched_task(pid_t pid, struct flb_proc_task *t);
+
+/* Context switches of one thread, from /proc/PID/task/TID/status */
+struct flb_proc_ctxsw_thread {
+    pid_t tid;
+    int fd;
+    unsigned long vol_cs;
+    unsigned long invol_cs;
+};
+
+/*
+ * Context switches of every thread of a process: /proc/PID/status only
+ * has the ones of the main thread. Same walk as flb_proc_sched, the files
+ * stay open and the counters of exited threads stay in the totals.
+ */
+struct flb_proc_ctxsw {
+    pid_t pid;
+    int n;
+    int size;
+    struct flb_proc_ctxsw_thread *threads;
+    unsigned long gone_vol_cs;
+    unsigned long gone_invol_cs;
+};
+
+struct flb_proc_ctxsw *flb_proc_ctxsw_create(pid_t pid);
+void flb_proc_ctxsw_destroy(struct flb_proc_ctxsw *c);
+
+/* I/O and scheduling counters, /proc/PID/io and the thread status files */
+struct flb_proc_io {
+    unsigned long rchar;    /* bytes read by syscalls, any source      */
+    unsigned long wchar;    /* bytes written by syscalls               */
+    unsigned long syscr;    /* read syscalls                           */
+    unsigned long syscw;    /* write syscalls                          */
+    unsigned long read_bytes;   /* bytes fetched from storage          */
+    unsigned long write_bytes;  /* bytes sent to storage               */
+    unsigned long vol_cs;   /* voluntary context switches (blocking)   */
+    unsigned long invol_cs; /* involuntary context switches (preempted) */
+};
+
+/*
+ * 'io_fd' and 'cs' are kept by the caller, new threads are added to 'cs'
+ * on every read. Returns 0 on success.
+ */
+int flb_proc_io_read(int io_fd, struct flb_proc_ctxsw *cs,
+                     struct flb_proc_io *io);
+
+/* Memory accounting beyond RSS, all values in bytes */
+struct flb_proc_mem {
+    long pss;               /* smaps_rollup */
+    long pss_anon;
+    long pss_file;
+    long pss_shmem;
+    long swap;
+    long hwm;               /* status: VmHWM, peak RSS */
+    long rss_anon;
+    long rss_file;
+    long rss_shmem;
+};
+
+/*
+ * Read /proc/PID/status and /proc/PID/smaps_rollup, both descriptors are
+ * kept open by the caller and read with pread(). Returns 0 on success.
+ */
+int flb_proc_mem_read(int status_fd, int rollup_fd, struct flb_proc_mem *m);
+
+/* Memory of the mappings sharing a name: a file, [heap], [anon], etc */
+struct flb_proc_mapping {
+    char name[128];
+    long rss;
+    long pss;
+    long anon;
+};
+
+/*
+ * Walk /proc/PID/smaps from an open descriptor and group the mappings by
+ * name. Returns the number of entries in 'out' (free() it) or -1.
+ */
+int flb_proc_smaps_read(int smaps_fd, struct flb_proc_mapping **out);
 void flb_proc_stat_destroy(struct flb_proc_task *t);
 void flb_proc_stat_print(struct flb_proc_task *t);
 
+/*
+ * Read offset of the file 'path' opened by the process (the highest one if
+ * it's opened many times), taken from /proc/PID/fdinfo. Returns -1 if the
+ * process has not opened the file.
+ */
+off_t flb_proc_file_offset(pid_t pid, const char *path);
+
 #endif
@@ -0,0 +1,112 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PROFILE_H
+#define FLB_PROFILE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Sampling frequency, off the usual 100Hz timers */
+#define FLB_PROFILE_HZ      99
+
+/* Ring buffer of a thread: 2^N data pages */
+#define FLB_PROFILE_PAGES   64
+
+/* Deepest callchain kept */
+#define FLB_PROFILE_DEPTH   127
+
+/* Function symbols of an ELF file, sorted by address */
+struct flb_profile_sym {
+    uint64_t addr;
+    uint64_t size;
+    const char *name;
+};
+
+struct flb_profile_elf {
+    char *path;
+    int n_syms;
+    struct flb_profile_sym *syms;
+    char *strtab;
+    int n_loads;
+    uint64_t load_off[8];       /* PT_LOAD segments: file offset */
+    uint64_t load_vaddr[8];     /* and virtual address           */
+    uint64_t load_size[8];
+    struct flb_profile_elf *next;
+};
+
+/* Executable mapping of the target, from /proc/PID/maps */
+struct flb_profile_map {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    struct flb_profile_elf *elf;    /* NULL if it can't be read */
+    char name[128];
+};
+
+struct flb_profile_thread {
+    pid_t tid;
+    int fd;
+    void *ring;                 /* metadata page + data pages */
+};
+
+/*
+ * Sampling profiler: a perf_event_open() sampling event with callchains
+ * on every thread of the target (hardware cycles, CPU clock without a
+ * PMU), enabled only for the selected rounds. Inherited events can't be
+ * mmap'ed, new threads are picked up when a round ends. Stacks are symbolized with
+ * /proc/PID/maps and the ELF symbol tables and written as collapsed
+ * stacks, one file per round: DIR/round-NNN.folded.
+ */
+struct flb_profile {
+    pid_t pid;
+    char *dir;
+    int first;                  /* rounds profiled, 1 based */
+    int last;                   /* 0 = until the end        */
+    int hw;
+    int user_only;              /* perf_event_paranoid >= 2 */
+    int n_threads;
+    int size_threads;
+    struct flb_profile_thread *threads;
+    int n_maps;
+    struct flb_profile_map *maps;
+    struct flb_profile_elf *elfs;
+
+    /* stacks of the round, folded when it ends */
+    int n_stacks;
+    int size_stacks;
+    char **stacks;
+
+    uint64_t samples;
+    uint64_t lost;
+    int rounds;
+};
+
+struct flb_profile *flb_profile_create(pid_t pid, char *dir,
+                                       int first, int last);
+void flb_profile_destroy(struct flb_profile *p);
+
+/*
+ * Called when round 'round' ends: drain the samples, write its folded
+ * stacks if it was profiled, and arm the events for the next one.
+ */
+int flb_profile_round(struct flb_profile *p, int round);
+
+#endif
@@ -0,0 +1,44 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PROM_H
+#define FLB_PROM_H
+
+#include <stdint.h>
+
+#include "flb_protobuf.h"
+
+/* One sample of a synthetic series */
+struct flb_prom_sample {
+    uint32_t series;        /* series id, used as the 'series' label */
+    double value;
+    int64_t timestamp;      /* milliseconds since epoch */
+};
+
+/*
+ * Encode the samples as a Prometheus remote-write WriteRequest, every
+ * sample becomes a TimeSeries with the labels __name__=<name>,
+ * job=flb-perf and series=<id>. The result must be snappy compressed
+ * before sending it.
+ */
+int flb_prom_write_request(struct flb_pb_buf *b, char *name,
+                           struct flb_prom_sample *samples, int n);
+
+#endif
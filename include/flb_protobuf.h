@@ -0,0 +1,64 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PROTOBUF_H
+#define FLB_PROTOBUF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Wire types */
+#define FLB_PB_VARINT      0
+#define FLB_PB_FIXED64     1
+#define FLB_PB_LEN         2
+#define FLB_PB_FIXED32     5
+
+/*
+ * A minimal protobuf encoder: messages are written in place, nested
+ * messages are opened with flb_pb_begin() and their length is patched
+ * by flb_pb_end() once the content is known.
+ */
+struct flb_pb_buf {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+int flb_pb_buf_init(struct flb_pb_buf *b, size_t size);
+void flb_pb_buf_destroy(struct flb_pb_buf *b);
+
+int flb_pb_varint(struct flb_pb_buf *b, uint64_t val);
+int flb_pb_tag(struct flb_pb_buf *b, uint32_t field, int wire_type);
+
+int flb_pb_uint64(struct flb_pb_buf *b, uint32_t field, uint64_t val);
+int flb_pb_int64(struct flb_pb_buf *b, uint32_t field, int64_t val);
+int flb_pb_bool(struct flb_pb_buf *b, uint32_t field, int val);
+int flb_pb_fixed64(struct flb_pb_buf *b, uint32_t field, uint64_t val);
+int flb_pb_fixed32(struct flb_pb_buf *b, uint32_t field, uint32_t val);
+int flb_pb_double(struct flb_pb_buf *b, uint32_t field, double val);
+int flb_pb_bytes(struct flb_pb_buf *b, uint32_t field,
+                 const void *data, size_t len);
+int flb_pb_string(struct flb_pb_buf *b, uint32_t field, const char *str);
+
+/* Nested messages */
+int flb_pb_begin(struct flb_pb_buf *b, uint32_t field, size_t *mark);
+int flb_pb_end(struct flb_pb_buf *b, size_t mark);
+
+#endif
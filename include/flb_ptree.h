@@ -0,0 +1,104 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_PTREE_H
+#define FLB_PTREE_H
+
+#include <time.h>
+#include <sys/types.h>
+
+#include "flb_proc.h"
+
+/* Extra /proc files kept open for every process of the tree */
+#define FLB_PTREE_MEM   1       /* status and smaps_rollup */
+#define FLB_PTREE_IO    2       /* io and thread status    */
+
+struct flb_ptree_proc {
+    pid_t pid;
+    pid_t ppid;
+    char name[64];
+    int alive;
+    int seen;                   /* found by the last scan        */
+    int fd_stat;
+    int fd_status;
+    int fd_rollup;
+    int fd_io;
+    struct flb_proc_ctxsw *cs;  /* switches of every thread      */
+    unsigned long long starttime;
+    unsigned long first_ticks;  /* utime + stime when found      */
+    unsigned long utime;        /* last values, kept on exit     */
+    unsigned long stime;
+    unsigned long minflt;
+    unsigned long majflt;
+    long r_rss;
+    struct flb_proc_io io;
+    struct flb_proc_mem mem;
+};
+
+/*
+ * A process and its descendants. Members are found through
+ * /proc/PID/task/TID/children, or by matching the parent PID of every
+ * process in /proc when the kernel lacks that file. Exited members are
+ * kept: their last CPU, fault and I/O counters still count in the sums,
+ * so the totals never go backwards when a worker exits.
+ */
+struct flb_ptree {
+    pid_t root;
+    int flags;
+    int children;               /* children files are available  */
+    int interval_ms;            /* min time between two scans    */
+    struct timespec last_scan;
+    int n;
+    int size;
+    int alive;
+    int max_alive;
+    struct flb_ptree_proc *procs;
+};
+
+struct flb_ptree *flb_ptree_create(pid_t root, int flags);
+void flb_ptree_destroy(struct flb_ptree *t);
+
+/*
+ * Look for new and exited members, calls sooner than the scan interval
+ * (100ms, 1s with the /proc wide scan) return right away. Returns the
+ * number of live members.
+ */
+int flb_ptree_refresh(struct flb_ptree *t);
+
+/*
+ * Read the stat file of every live member and sum them in 't': CPU time
+ * and faults include exited members, RSS only live ones. The name is the
+ * root one. Returns -1 if the root process is gone.
+ */
+int flb_ptree_read(struct flb_ptree *t, struct flb_proc_task *task);
+
+/* Memory of the live members, needs FLB_PTREE_MEM */
+int flb_ptree_mem(struct flb_ptree *t, struct flb_proc_mem *m);
+
+/* I/O counters of every member, needs FLB_PTREE_IO */
+int flb_ptree_io(struct flb_ptree *t, struct flb_proc_io *io);
+
+/*
+ * Refresh and read the first tree created if its root is 'pid', used by
+ * flb_proc_stat_create(). Returns -1 if there is no such tree.
+ */
+int flb_ptree_task(pid_t pid, struct flb_proc_task *task);
+
+#endif
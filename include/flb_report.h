@@ -25,7 +25,41 @@
 #define FLB_REPORT_MARKDOWN  1
 #define FLB_REPORT_CSV       2
 
+#include <stdint.h>
 #include "flb_proc.h"
+#include "flb_sampler.h"
+#include "flb_ptree.h"
+#include "flb_cgroup.h"
+#include "flb_perf.h"
+#include "flb_profile.h"
+
+/* Max number of tool specific columns appended to every report row */
+#define FLB_REPORT_MAX_COLS  32
+
+/* Samples of the window used for the sub-second CPU peak (100ms at 1KHz) */
+#define FLB_REPORT_PEAK_WIN 100
+
+struct flb_report_col {
+    char *name;          /* column title, no spaces */
+    int width;           /* text format width */
+    int precision;       /* number of decimals */
+    double value;        /* value for the current row */
+};
+
+/* Target threads, their CPU usage is grouped by thread name */
+struct flb_report_thread {
+    pid_t tid;
+    int name_id;             /* entry in the names table   */
+    unsigned long ticks;     /* last utime + stime         */
+};
+
+struct flb_report_thread_name {
+    char name[64];
+    int threads;             /* threads seen with the name */
+    unsigned long total;     /* ticks used by the test     */
+    unsigned long round;     /* ticks used in this round   */
+    double peak;             /* highest %CPU of a round    */
+};
 
 struct flb_report {
     int format;          /* report output format */
@@ -46,10 +80,108 @@ struct flb_report {
     int sum_cpu_count;   /* CPU snapshots summarized */
     double sum_cpu;      /* total %CPU usage */
     double sum_duration; /* total elapsed time of tests */
+    long sum_cpu_ms;     /* total user + system time */
+
+    /* Logical (uncompressed) bytes, when it differs from the wire size */
+    int col_logical;
+    size_t sum_logical;
+
+    /* Target TCP sockets, first socket column or -1 */
+    int col_sockets;
+    uint64_t sock_drops;        /* last totals, rows print deltas */
+    uint64_t sock_retrans;
+    uint64_t sum_sock_drops;
+    uint64_t sum_sock_retrans;
+    uint32_t max_recv_q;
+    uint32_t max_accept_q;
+
+    /* cgroup v2 totals, also returned by flb_proc_stat_create() */
+    struct flb_cgroup *cgroup;
+    int col_cgroup;
+    struct flb_cgroup_stat cg_first;
+    struct flb_cgroup_stat cg_last;
+    uint64_t cg_max_mem;
+
+    /* Target plus descendants, summed by flb_proc_stat_create() */
+    struct flb_ptree *tree;
+    int col_tree;
+
+    /* schedstat: ns CPU time, run queue delay */
+    struct flb_proc_sched *sched;
+    int col_sched;
+    uint64_t sum_run_ns;
+    uint64_t sum_wait_ns;
+    uint64_t sum_timeslices;
+    uint64_t max_wait_ns;
+    int max_wait_round;
+
+    /* Background sampler, sub-second peaks of every round */
+    struct flb_sampler *sampler;
+    int col_peaks;
+    int win_size;
+    int win_len;
+    int win_pos;
+    struct flb_sample win[FLB_REPORT_PEAK_WIN];
+    double peak_cpu;
+    long peak_rss;
+
+    /* Per thread CPU */
+    int col_threads;
+    int n_threads;
+    int size_threads;
+    int n_names;
+    int size_names;
+    struct flb_report_thread *threads;
+    struct flb_report_thread_name *names;
+
+    /* Extended memory, /proc files kept open */
+    int col_mem;
+    int fd_status;
+    int fd_rollup;
+    int fd_smaps;
+    int mem_rounds;
+    double sum_pss;
+    long max_pss;
+    struct flb_proc_mem mem;
+    int n_maps_first;
+    int n_maps_last;
+    struct flb_proc_mapping *maps_first;
+    struct flb_proc_mapping *maps_last;
+
+    /* I/O, context switches and page faults */
+    int col_io;
+    int fd_io;
+    struct flb_proc_ctxsw *io_cs;   /* switches of every thread */
+    struct flb_proc_io io_first;
+    struct flb_proc_io io_last;
+    unsigned long sum_minflt;
+    unsigned long sum_majflt;
+    size_t io_records;
+    size_t io_bytes;
+
+    /* perf_event_open() counters, hardware or software set */
+    struct flb_perf *perf;
+    int col_perf;
+    uint64_t perf_first[FLB_PERF_EVENTS];
+    uint64_t perf_last[FLB_PERF_EVENTS];
+    size_t perf_records;
+
+    /* Sampling profiler, folded stacks per round */
+    struct flb_profile *profile;
 
+    /* Extra columns */
+    int header;          /* header already printed ? */
+    int n_cols;
+    struct flb_report_col cols[FLB_REPORT_MAX_COLS];
 };
 
 struct flb_report *flb_report_create(char *out, int format, int pid, int wait);
+int flb_report_column_add(struct flb_report *r, char *name,
+                          int width, int precision);
+void flb_report_column_set(struct flb_report *r, int id, double value);
+int flb_report_logical_enable(struct flb_report *r);
+void flb_report_logical_set(struct flb_report *r, size_t bytes);
+int flb_report_sockets_enable(struct flb_report *r);
 int flb_report_stats(struct flb_report *r, int records,
                      size_t bytes,
                      struct flb_proc_task *t1, struct flb_proc_task *t2);
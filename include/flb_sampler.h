@@ -0,0 +1,95 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_SAMPLER_H
+#define FLB_SAMPLER_H
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "flb_proc.h"
+#include "flb_ptree.h"
+#include "flb_cgroup.h"
+
+/* flb_sampler_create() flags */
+#define FLB_SAMPLER_TREE   1    /* sum the process tree           */
+#define FLB_SAMPLER_SCHED  2    /* nanosecond CPU from schedstat  */
+
+/* Ring capacity, a power of two: 4 seconds at the max rate */
+#define FLB_SAMPLER_RING  4096
+
+/* One /proc/PID/stat snapshot */
+struct flb_sample {
+    struct timespec ts;     /* CLOCK_REALTIME, as flb_proc_task */
+    unsigned long utime;    /* clock ticks */
+    unsigned long stime;
+    unsigned long minflt;
+    unsigned long majflt;
+    uint64_t run_ns;        /* schedstat, zero if not sampled */
+    uint64_t wait_ns;
+    uint64_t timeslices;
+    long r_rss;             /* bytes */
+};
+
+/*
+ * Background thread sampling the target at a fixed rate. /proc/PID/stat
+ * stays open and is read with pread(), samples are pushed to a single
+ * producer / single consumer ring the reporter drains every round. When
+ * the ring is full new samples are dropped and counted.
+ */
+struct flb_sampler {
+    pid_t pid;
+    int fd;
+    int hz;
+    int running;
+    char name[256];
+    pthread_t thread;
+    struct flb_ptree *tree; /* sum of the process tree, or NULL */
+    struct flb_cgroup *cgroup;  /* cgroup totals, or NULL       */
+    struct flb_proc_sched *sched;   /* per thread schedstat, or NULL */
+
+    uint64_t head;          /* next slot to write, sampler thread */
+    uint64_t tail;          /* next slot to read, reporter        */
+    uint64_t samples;
+    uint64_t dropped;
+    struct flb_sample ring[FLB_SAMPLER_RING];
+};
+
+/*
+ * With FLB_SAMPLER_TREE every sample is the sum of the process and its
+ * descendants, with 'cgroup' (a path) the totals of that cgroup, and
+ * FLB_SAMPLER_SCHED adds the schedstat times of the process threads. The
+ * sampler thread owns its own flb_ptree, flb_cgroup or flb_proc_sched.
+ */
+struct flb_sampler *flb_sampler_create(pid_t pid, int hz, int flags,
+                                       char *cgroup);
+void flb_sampler_destroy(struct flb_sampler *s);
+
+/* Pop the oldest sample, returns 1 if there was one */
+int flb_sampler_pop(struct flb_sampler *s, struct flb_sample *sample);
+
+/*
+ * Fill 't' with the latest sample of 'pid' if a sampler is running for it,
+ * so periodic snapshots never wait on procfs. Returns -1 otherwise.
+ */
+int flb_sampler_task(pid_t pid, struct flb_proc_task *t);
+
+#endif
@@ -0,0 +1,55 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_SOCKDIAG_H
+#define FLB_SOCKDIAG_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+/* Listening ports reported, the count has no limit */
+#define FLB_SOCKDIAG_PORTS  16
+
+/*
+ * TCP sockets of a monitored process as seen by NETLINK_SOCK_DIAG. Only
+ * the listening sockets and the connections accepted by them are counted,
+ * that is where the agent receives the load.
+ */
+struct flb_sockdiag {
+    int listeners;          /* listening sockets                        */
+    int accepted;           /* connections accepted by the listeners    */
+    uint32_t accept_q;      /* connections waiting to be accepted       */
+    uint64_t recv_q;        /* bytes received, not read by the process  */
+    uint64_t send_q;        /* bytes sent, not acked by the peer        */
+    uint32_t max_recv_q;    /* largest recv-Q of a single connection    */
+    uint64_t drops;         /* packets dropped by the sockets           */
+    uint64_t retrans;       /* tcp_info total retransmits               */
+    uint32_t rcv_space;     /* smallest tcp_info receive space (bytes)  */
+    int n_ports;
+    uint16_t ports[FLB_SOCKDIAG_PORTS];    /* listening ports           */
+};
+
+/*
+ * Sample the sockets owned by 'pid', it must live in the same network
+ * namespace. Returns 0 on success or -1 on error.
+ */
+int flb_sockdiag_sample(pid_t pid, struct flb_sockdiag *sd);
+
+#endif
@@ -0,0 +1,86 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_STAMP_H
+#define FLB_STAMP_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "flb_histogram.h"
+
+/*
+ * Records are stamped with a sequence number and the send time in
+ * microseconds, both as the first keys of the JSON map:
+ *
+ *   {"_flb_seq":                   1,"_flb_ts":    1700000000000000,...
+ *
+ * Values are right aligned with spaces (valid JSON) so the stamp has a
+ * fixed size and pre-composed buffers can be patched in place.
+ */
+#define FLB_STAMP_SEQ_KEY    "\"_flb_seq\":"
+#define FLB_STAMP_TS_KEY     "\"_flb_ts\":"
+#define FLB_STAMP_DIGITS     20
+#define FLB_STAMP_SIZE       (sizeof(FLB_STAMP_SEQ_KEY) - 1 + FLB_STAMP_DIGITS + \
+                              1 + sizeof(FLB_STAMP_TS_KEY) - 1 +            \
+                              FLB_STAMP_DIGITS + 1)
+
+/*
+ * Highest sequence number tracked, 4G records (a 512MB bitmap). Larger
+ * values can only come from a corrupted stamp and are counted as invalid.
+ */
+#define FLB_STAMP_SEQ_MAX    (1ULL << 32)
+
+/* Delivery tracking on the receiving side */
+struct flb_stamp_stats {
+    uint64_t received;      /* stamped records received        */
+    uint64_t unique;        /* distinct sequence numbers       */
+    uint64_t dups;          /* sequence numbers seen again     */
+    uint64_t reordered;     /* arrived after a higher sequence */
+    uint64_t max_seq;       /* highest sequence number seen    */
+    uint64_t invalid;       /* above FLB_STAMP_SEQ_MAX, ignored */
+
+    /* seen sequence numbers */
+    size_t bits_size;
+    uint8_t *bits;
+
+    /* delivery latency in microseconds */
+    struct flb_histogram *hist;
+};
+
+uint64_t flb_stamp_now();
+
+/* Sender side */
+void flb_stamp_write(char *dst, uint64_t seq, uint64_t ts);
+size_t flb_stamp_record(char *dst, const char *rec, size_t len,
+                        uint64_t seq, uint64_t ts);
+
+/* Receiver side */
+int flb_stamp_find(const char *buf, size_t len, size_t *off,
+                   uint64_t *seq, uint64_t *ts);
+int flb_stamp_find_mp(const char *buf, size_t len, size_t *off,
+                      uint64_t *seq, uint64_t *ts);
+int flb_stamp_stats_init(struct flb_stamp_stats *st);
+void flb_stamp_stats_destroy(struct flb_stamp_stats *st);
+int flb_stamp_track(struct flb_stamp_stats *st, uint64_t seq, uint64_t ts,
+                    uint64_t now);
+void flb_stamp_print(struct flb_stamp_stats *st, int fd, uint64_t expected);
+
+#endif
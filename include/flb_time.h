@@ -0,0 +1,37 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#ifndef FLB_TIME_H
+#define FLB_TIME_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Monotonic clock helpers shared by the tools rounds and timers */
+uint64_t flb_time_now_us();
+uint64_t flb_time_diff_us(struct timespec *t1, struct timespec *t2);
+
+/*
+ * Sleep until 'ms' milliseconds after 'start' (CLOCK_MONOTONIC). Returns 0
+ * once the time is reached or -1 if a signal interrupted the sleep.
+ */
+int flb_time_sleep_until(struct timespec *start, int ms);
+
+#endif
@@ -0,0 +1,1272 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <sys/sendfile.h>
+#include <time.h>
+
+/* local headers */
+#include "mk_list.h"
+#include "flb_data_file.h"
+#include "flb_proc.h"
+#include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_network.h"
+#include "flb_msgpack.h"
+#include "flb_compress.h"
+#include "flb_histogram.h"
+#include "flb_time.h"
+
+/* Default values */
+#define DEFAULT_RECORDS           1000  /* 1000 records per second     */
+#define DEFAULT_INC_BY               0  /* no increase                 */
+#define DEFAULT_SECONDS             10  /* test time: 10 seconds       */
+#define DEFAULT_CONCURRENCY          1  /* one active connection       */
+#define DEFAULT_BATCH              500  /* records per Forward chunk   */
+#define DEFAULT_WINDOW              16  /* in-flight chunks per conn   */
+#define DEFAULT_ACK_TIMEOUT       5000  /* milliseconds to wait an ack */
+#define DEFAULT_TAG         "flb.perf"
+
+/* Default network host and port */
+#define DEFAULT_PORT           "24224"
+#define DEFAULT_HOST       "127.0.0.1"
+
+/* Forward protocol modes */
+#define FWD_MODE_FORWARD             0
+#define FWD_MODE_PACKED              1
+#define FWD_MODE_COMPRESSED          2
+
+/* Chunk IDs are fixed length hex strings: connection + sequence */
+#define FWD_ACK_ID_SIZE             24
+
+/* A pre-encoded chunk stored in the memory file */
+struct fwd_chunk {
+    off_t offset;         /* chunk offset in the memory file       */
+    size_t size;          /* full chunk size, including options    */
+    size_t prefix;        /* bytes before the options map          */
+    size_t logical;       /* uncompressed size of the entries      */
+    int records;          /* number of entries in the chunk        */
+};
+
+/* In-flight chunk waiting for an ack */
+struct fwd_ack {
+    char id[FWD_ACK_ID_SIZE + 1];
+    int done;
+    struct timespec ts;
+};
+
+struct fwd_conn {
+    int id;
+    int fd;
+    uint64_t seq;
+
+    /* in-flight ring */
+    int head;
+    int inflight;
+    struct fwd_ack *acks;
+
+    /* ack read buffer */
+    size_t rlen;
+    char rbuf[1024];
+
+    struct mk_list _head;
+};
+
+struct fwd_ctx {
+    int mode;
+    int compress;         /* compression type in compressed mode   */
+    int ack;
+    int window;
+
+    /* pre-encoded chunks */
+    int mem_fd;
+    char *map;
+    size_t map_size;
+    int n_chunks;
+    struct fwd_chunk *chunks;
+
+    /* ack stats */
+    uint64_t ack_timeouts;
+    struct flb_histogram *ack_hist;
+};
+
+static void fwd_conn_destroy(struct mk_list *list)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct fwd_conn *conn;
+
+    mk_list_foreach_safe(head, tmp, list) {
+        conn = mk_list_entry(head, struct fwd_conn, _head);
+        mk_list_del(&conn->_head);
+        if (conn->fd > 0) {
+            close(conn->fd);
+        }
+        free(conn->acks);
+        free(conn);
+    }
+
+    free(list);
+}
+
+static struct mk_list *fwd_conn_create(int connections, int window,
+                                       char *host, char *port)
+{
+    int i;
+    struct mk_list *list;
+    struct fwd_conn *conn;
+
+    list = malloc(sizeof(struct mk_list));
+    if (!list) {
+        perror("malloc");
+        return NULL;
+    }
+    mk_list_init(list);
+
+    for (i = 0; i < connections; i++) {
+        conn = calloc(1, sizeof(struct fwd_conn));
+        if (!conn) {
+            perror("calloc");
+            fwd_conn_destroy(list);
+            return NULL;
+        }
+        mk_list_add(&conn->_head, list);
+        conn->id = i;
+
+        conn->acks = calloc(window, sizeof(struct fwd_ack));
+        if (!conn->acks) {
+            perror("calloc");
+            fwd_conn_destroy(list);
+            return NULL;
+        }
+
+        conn->fd = flb_net_tcp_connect(host, port);
+        if (conn->fd == -1) {
+            fprintf(stderr, "error creating connection #%i to %s:%s\n",
+                    i, host, port);
+            fwd_conn_destroy(list);
+            return NULL;
+        }
+    }
+
+    return list;
+}
+
+/*
+ * Convert every line of the data file into a Forward entry [time, record].
+ * Lines that are not valid JSON are wrapped as {"log": "line"}.
+ */
+static int fwd_entries_create(char *data_buf, size_t data_size,
+                              struct flb_mp_buf *entries, size_t **out_offs,
+                              int *out_count)
+{
+    int n = 0;
+    int size = 1024;
+    int invalid = 0;
+    char *p;
+    char *end;
+    char *eol;
+    size_t *offs;
+    size_t *tmp;
+    struct timespec ts;
+
+    offs = malloc(sizeof(size_t) * size);
+    if (!offs) {
+        perror("malloc");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    p = data_buf;
+    end = data_buf + data_size;
+
+    while (p < end) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+        if (eol == p) {
+            p++;
+            continue;
+        }
+
+        if (n + 1 >= size) {
+            size *= 2;
+            tmp = realloc(offs, sizeof(size_t) * size);
+            if (!tmp) {
+                perror("realloc");
+                free(offs);
+                return -1;
+            }
+            offs = tmp;
+        }
+        offs[n++] = entries->len;
+
+        flb_mp_pack_array(entries, 2);
+        flb_mp_pack_event_time(entries, ts.tv_sec, ts.tv_nsec);
+        if (flb_mp_pack_json(entries, p, eol - p) == -1) {
+            invalid++;
+            flb_mp_pack_map(entries, 1);
+            flb_mp_pack_str(entries, "log", 3);
+            flb_mp_pack_str(entries, p, eol - p);
+        }
+        p = eol + 1;
+    }
+    offs[n] = entries->len;
+
+    if (invalid > 0) {
+        fprintf(stderr, "warn: %i lines are not valid JSON, packed as "
+                "{\"log\": line}\n", invalid);
+    }
+
+    *out_offs = offs;
+    *out_count = n;
+    return 0;
+}
+
+/*
+ * Encode all the chunks once: the whole set is written to an anonymous
+ * memory file so rounds are dispatched with sendfile(2) without any extra
+ * work on our side.
+ */
+static int fwd_chunks_create(struct fwd_ctx *ctx, char *tag, int batch,
+                             char *data_buf, size_t data_size)
+{
+    int i;
+    int ret;
+    int n;
+    int count;
+    int first;
+    size_t *offs;
+    size_t len;
+    size_t c_len;
+    void *c_buf;
+    char *entries_buf;
+    struct flb_mp_buf entries;
+    struct flb_mp_buf out;
+    struct fwd_chunk *chunk;
+
+    if (flb_mp_buf_init(&entries, data_size) == -1) {
+        return -1;
+    }
+
+    ret = fwd_entries_create(data_buf, data_size, &entries, &offs, &count);
+    if (ret == -1 || count == 0) {
+        fprintf(stderr, "error: no records found in data file\n");
+        flb_mp_buf_destroy(&entries);
+        return -1;
+    }
+
+    ctx->n_chunks = (count + batch - 1) / batch;
+    ctx->chunks = calloc(ctx->n_chunks, sizeof(struct fwd_chunk));
+    if (!ctx->chunks) {
+        perror("calloc");
+        free(offs);
+        flb_mp_buf_destroy(&entries);
+        return -1;
+    }
+
+    if (flb_mp_buf_init(&out, entries.len + (ctx->n_chunks * 64)) == -1) {
+        free(offs);
+        flb_mp_buf_destroy(&entries);
+        return -1;
+    }
+
+    for (i = 0; i < ctx->n_chunks; i++) {
+        chunk = &ctx->chunks[i];
+        first = i * batch;
+        n = (count - first) < batch ? (count - first) : batch;
+        entries_buf = entries.data + offs[first];
+        len = offs[first + n] - offs[first];
+
+        chunk->offset = out.len;
+        chunk->records = n;
+        chunk->logical = len;
+
+        if (ctx->mode == FWD_MODE_FORWARD && !ctx->ack) {
+            flb_mp_pack_array(&out, 2);
+        }
+        else {
+            flb_mp_pack_array(&out, 3);
+        }
+        flb_mp_pack_str(&out, tag, strlen(tag));
+
+        if (ctx->mode == FWD_MODE_FORWARD) {
+            flb_mp_pack_array(&out, n);
+            flb_mp_pack_raw(&out, entries_buf, len);
+        }
+        else if (ctx->mode == FWD_MODE_PACKED) {
+            flb_mp_pack_bin(&out, entries_buf, len);
+        }
+        else {
+            ret = flb_compress(ctx->compress, entries_buf, len,
+                               &c_buf, &c_len);
+            if (ret == -1) {
+                free(offs);
+                flb_mp_buf_destroy(&entries);
+                flb_mp_buf_destroy(&out);
+                return -1;
+            }
+            flb_mp_pack_bin(&out, c_buf, c_len);
+            free(c_buf);
+        }
+        chunk->prefix = out.len - chunk->offset;
+
+        /* Options: in ack mode the 'chunk' key is appended on send */
+        if (ctx->mode == FWD_MODE_PACKED) {
+            flb_mp_pack_map(&out, 1);
+            flb_mp_pack_str(&out, "size", 4);
+            flb_mp_pack_uint(&out, n);
+        }
+        else if (ctx->mode == FWD_MODE_COMPRESSED) {
+            flb_mp_pack_map(&out, 2);
+            flb_mp_pack_str(&out, "size", 4);
+            flb_mp_pack_uint(&out, n);
+            flb_mp_pack_str(&out, "compressed", 10);
+            flb_mp_pack_str(&out, flb_compress_name(ctx->compress),
+                            strlen(flb_compress_name(ctx->compress)));
+        }
+        else if (ctx->ack) {
+            flb_mp_pack_map(&out, 0);
+        }
+        chunk->size = out.len - chunk->offset;
+    }
+
+    free(offs);
+    flb_mp_buf_destroy(&entries);
+
+    /* Move the encoded chunks to the memory file */
+    ctx->mem_fd = memfd_create("flb-forward-chunks", 0);
+    if (ctx->mem_fd == -1) {
+        perror("memfd_create");
+        flb_mp_buf_destroy(&out);
+        return -1;
+    }
+
+    len = 0;
+    while (len < out.len) {
+        ret = write(ctx->mem_fd, out.data + len, out.len - len);
+        if (ret == -1) {
+            perror("write");
+            flb_mp_buf_destroy(&out);
+            return -1;
+        }
+        len += ret;
+    }
+    ctx->map_size = out.len;
+    flb_mp_buf_destroy(&out);
+
+    ctx->map = mmap(NULL, ctx->map_size, PROT_READ, MAP_SHARED,
+                    ctx->mem_fd, 0);
+    if (ctx->map == MAP_FAILED) {
+        perror("mmap");
+        ctx->map = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+static void fwd_chunks_destroy(struct fwd_ctx *ctx)
+{
+    if (ctx->map) {
+        munmap(ctx->map, ctx->map_size);
+    }
+    if (ctx->mem_fd > 0) {
+        close(ctx->mem_fd);
+    }
+    free(ctx->chunks);
+}
+
+static int sendfile_all(int out_fd, int in_fd, off_t off, size_t len)
+{
+    ssize_t bytes;
+
+    while (len > 0) {
+        bytes = sendfile(out_fd, in_fd, &off, len);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("sendfile");
+            return -1;
+        }
+        len -= bytes;
+    }
+    return 0;
+}
+
+static int writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t bytes;
+
+    while (iovcnt > 0) {
+        bytes = writev(fd, iov, iovcnt);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("writev");
+            return -1;
+        }
+
+        while (iovcnt > 0 && bytes >= iov->iov_len) {
+            bytes -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + bytes;
+            iov->iov_len -= bytes;
+        }
+    }
+    return 0;
+}
+
+/* Register an ack response, returns 0 if it matched an in-flight chunk */
+static int fwd_ack_register(struct fwd_ctx *ctx, struct fwd_conn *conn,
+                            const char *id, size_t len)
+{
+    int i;
+    int idx;
+    struct fwd_ack *ack;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    for (i = 0; i < conn->inflight; i++) {
+        idx = (conn->head + i) % ctx->window;
+        ack = &conn->acks[idx];
+        if (ack->done || len != FWD_ACK_ID_SIZE ||
+            memcmp(ack->id, id, len) != 0) {
+            continue;
+        }
+
+        ack->done = 1;
+        flb_histogram_record(ctx->ack_hist, flb_time_diff_us(&ack->ts, &now));
+
+        /* Release completed chunks at the head of the ring */
+        while (conn->inflight > 0 && conn->acks[conn->head].done) {
+            conn->head = (conn->head + 1) % ctx->window;
+            conn->inflight--;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+/* Consume and process ack responses available in the read buffer */
+static int fwd_ack_parse(struct fwd_ctx *ctx, struct fwd_conn *conn)
+{
+    int ret;
+    uint32_t i;
+    uint32_t n;
+    size_t off = 0;
+    size_t next;
+    size_t key_len;
+    size_t val_len;
+    const char *key;
+    const char *val;
+
+    while (off < conn->rlen) {
+        next = off;
+        ret = flb_mp_unpack_map(conn->rbuf, conn->rlen, &next, &n);
+        for (i = 0; ret == FLB_MP_OK && i < n; i++) {
+            ret = flb_mp_unpack_str(conn->rbuf, conn->rlen, &next,
+                                    &key, &key_len);
+            if (ret != FLB_MP_OK) {
+                break;
+            }
+            ret = flb_mp_unpack_str(conn->rbuf, conn->rlen, &next,
+                                    &val, &val_len);
+            if (ret == FLB_MP_OK && key_len == 3 &&
+                strncmp(key, "ack", 3) == 0) {
+                fwd_ack_register(ctx, conn, val, val_len);
+            }
+        }
+
+        if (ret == FLB_MP_INCOMPLETE) {
+            break;
+        }
+        else if (ret == FLB_MP_ERROR) {
+            fprintf(stderr, "error: invalid ack response on connection #%i\n",
+                    conn->id);
+            conn->rlen = 0;
+            return -1;
+        }
+        off = next;
+    }
+
+    memmove(conn->rbuf, conn->rbuf + off, conn->rlen - off);
+    conn->rlen -= off;
+    return 0;
+}
+
+static int fwd_ack_read(struct fwd_ctx *ctx, struct fwd_conn *conn)
+{
+    ssize_t bytes;
+
+    bytes = read(conn->fd, conn->rbuf + conn->rlen,
+                 sizeof(conn->rbuf) - conn->rlen);
+    if (bytes <= 0) {
+        if (bytes == -1 && errno == EINTR) {
+            return 0;
+        }
+        fprintf(stderr, "error: connection #%i closed while waiting acks\n",
+                conn->id);
+        return -1;
+    }
+    conn->rlen += bytes;
+    return fwd_ack_parse(ctx, conn);
+}
+
+/*
+ * Drop in one pass every in-flight chunk sent before 'deadline' whose ack
+ * never arrived, the ring is ordered by send time.
+ */
+static void fwd_ack_expire(struct fwd_ctx *ctx, struct fwd_conn *conn,
+                           struct timespec *deadline)
+{
+    struct fwd_ack *ack;
+
+    while (conn->inflight > 0) {
+        ack = &conn->acks[conn->head];
+        if (!ack->done && (int64_t) flb_time_diff_us(&ack->ts, deadline) < 0) {
+            break;
+        }
+        if (!ack->done) {
+            ctx->ack_timeouts++;
+        }
+        conn->head = (conn->head + 1) % ctx->window;
+        conn->inflight--;
+    }
+}
+
+/* Block until the connection has room in its in-flight window */
+static int fwd_ack_window(struct fwd_ctx *ctx, struct fwd_conn *conn)
+{
+    int ret;
+    int64_t wait;
+    struct pollfd pfd;
+    struct timespec now;
+    struct timespec deadline;
+
+    pfd.fd = conn->fd;
+    pfd.events = POLLIN;
+
+    while (conn->inflight >= ctx->window) {
+        /* the oldest chunk sets the wait, not a full timeout per ack */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline = now;
+        deadline.tv_sec -= DEFAULT_ACK_TIMEOUT / 1000;
+        deadline.tv_nsec -= (DEFAULT_ACK_TIMEOUT % 1000) * 1000000;
+        if (deadline.tv_nsec < 0) {
+            deadline.tv_sec--;
+            deadline.tv_nsec += 1000000000;
+        }
+        wait = DEFAULT_ACK_TIMEOUT - (int64_t)
+            flb_time_diff_us(&conn->acks[conn->head].ts, &now) / 1000;
+        if (wait <= 0) {
+            fwd_ack_expire(ctx, conn, &deadline);
+            continue;
+        }
+
+        ret = poll(&pfd, 1, wait);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        else if (ret == -1) {
+            perror("poll");
+            return -1;
+        }
+        else if (ret == 0) {
+            continue;
+        }
+
+        if (fwd_ack_read(ctx, conn) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Wait for acks on every connection for 'ms' milliseconds. If 'drain' is
+ * set, it returns as soon as there are no more in-flight chunks.
+ */
+static void fwd_ack_wait(struct fwd_ctx *ctx, struct mk_list *connections,
+                         int n_cons, int ms, int drain)
+{
+    int i;
+    int ret;
+    int pending;
+    int timeout;
+    struct pollfd *pfds;
+    struct fwd_conn *conns[n_cons];
+    struct mk_list *head;
+    struct timespec start;
+    struct timespec now;
+
+    pfds = calloc(n_cons, sizeof(struct pollfd));
+    if (!pfds) {
+        perror("calloc");
+        return;
+    }
+
+    i = 0;
+    mk_list_foreach(head, connections) {
+        conns[i] = mk_list_entry(head, struct fwd_conn, _head);
+        pfds[i].fd = conns[i]->fd;
+        pfds[i].events = POLLIN;
+        i++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (1) {
+        pending = 0;
+        for (i = 0; i < n_cons; i++) {
+            pending += conns[i]->inflight;
+        }
+        if (drain && pending == 0) {
+            break;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        timeout = ms - (flb_time_diff_us(&start, &now) / 1000);
+        if (timeout <= 0) {
+            break;
+        }
+
+        ret = poll(pfds, n_cons, timeout);
+        if (ret <= 0) {
+            continue;
+        }
+
+        for (i = 0; i < n_cons; i++) {
+            if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (fwd_ack_read(ctx, conns[i]) == -1) {
+                    /* stop polling a broken connection */
+                    pfds[i].fd = -1;
+                }
+            }
+        }
+    }
+
+    free(pfds);
+}
+
+/* Send a chunk requesting an ack, the options map gets the 'chunk' id */
+static int fwd_send_ack_chunk(struct fwd_ctx *ctx, struct fwd_conn *conn,
+                              struct fwd_chunk *chunk)
+{
+    int ret;
+    uint32_t pairs;
+    size_t opt_len;
+    size_t bytes;
+    struct fwd_ack *ack;
+    struct iovec iov[2];
+    struct flb_mp_buf opts;
+    char *opt_buf;
+
+    if (fwd_ack_window(ctx, conn) == -1) {
+        return -1;
+    }
+
+    ack = &conn->acks[(conn->head + conn->inflight) % ctx->window];
+    snprintf(ack->id, sizeof(ack->id), "%08x%016lx",
+             conn->id, conn->seq++);
+    ack->done = 0;
+
+    /* Options map: static pairs follow the one byte fixmap header */
+    opt_buf = ctx->map + chunk->offset + chunk->prefix;
+    opt_len = chunk->size - chunk->prefix;
+    pairs = opt_buf[0] & 0x0f;
+
+    if (flb_mp_buf_init(&opts, 64) == -1) {
+        return -1;
+    }
+    flb_mp_pack_map(&opts, pairs + 1);
+    flb_mp_pack_raw(&opts, opt_buf + 1, opt_len - 1);
+    flb_mp_pack_str(&opts, "chunk", 5);
+    flb_mp_pack_str(&opts, ack->id, FWD_ACK_ID_SIZE);
+
+    iov[0].iov_base = ctx->map + chunk->offset;
+    iov[0].iov_len = chunk->prefix;
+    iov[1].iov_base = opts.data;
+    iov[1].iov_len = opts.len;
+
+    bytes = chunk->prefix + opts.len;
+
+    clock_gettime(CLOCK_MONOTONIC, &ack->ts);
+    ret = writev_all(conn->fd, iov, 2);
+    flb_mp_buf_destroy(&opts);
+
+    if (ret == -1) {
+        return -1;
+    }
+    conn->inflight++;
+    return bytes;
+}
+
+/*
+ * Send chunks to a connection until 'target' records are written. Returns
+ * the number of bytes sent, the records in 'out_records' and the size of
+ * the uncompressed entries in 'out_logical'.
+ */
+static ssize_t fwd_send_records(struct fwd_ctx *ctx, struct fwd_conn *conn,
+                                int *cursor, int target, int *out_records,
+                                size_t *out_logical)
+{
+    int first;
+    int records = 0;
+    ssize_t ret;
+    ssize_t bytes = 0;
+    size_t len;
+    size_t logical = 0;
+    struct fwd_chunk *chunk;
+
+    while (records < target) {
+        if (ctx->ack) {
+            chunk = &ctx->chunks[*cursor];
+            ret = fwd_send_ack_chunk(ctx, conn, chunk);
+            if (ret == -1) {
+                break;
+            }
+            bytes += ret;
+            records += chunk->records;
+            logical += chunk->logical;
+            *cursor = (*cursor + 1) % ctx->n_chunks;
+            continue;
+        }
+
+        /* Contiguous chunks are dispatched with a single sendfile(2) */
+        first = *cursor;
+        len = 0;
+        while (records < target) {
+            chunk = &ctx->chunks[*cursor];
+            len += chunk->size;
+            records += chunk->records;
+            logical += chunk->logical;
+            *cursor = (*cursor + 1) % ctx->n_chunks;
+            if (*cursor == 0) {
+                break;
+            }
+        }
+
+        if (sendfile_all(conn->fd, ctx->mem_fd,
+                         ctx->chunks[first].offset, len) == -1) {
+            fprintf(stderr, "error: exception on writing records chunk\n");
+            break;
+        }
+        bytes += len;
+    }
+
+    *out_records = records;
+    *out_logical = logical;
+    return bytes;
+}
+
+static int flb_help(int rc)
+{
+    printf("Usage: flb-forward-writer [OPTIONS]\n\n");
+    printf("Available options\n");
+    printf("  -c, --concurrency=N\t\tconcurrency level (default: %i)\n",
+           DEFAULT_CONCURRENCY);
+    printf("  -d, --datafile=PATH\t\tspecify source data file (JSON lines)\n");
+    printf("  -p  --pid=FLB_PID\t\tFluent Bit PID used gather metrics\n");
+    printf("  -o, --output=HOST:PORT\tset remote Forward Host and Port\n");
+    printf("  -i, --increase_by=N\t\tincrease N number of records per second (default: %i)\n",
+           DEFAULT_INC_BY);
+    printf("  -r, --records=RECORDS\t\trecords per second (default: %i)\n",
+           DEFAULT_RECORDS);
+    printf("  -s, --seconds=SECONDS\t\ttotal test time meassured in seconds (default: %i)\n",
+           DEFAULT_SECONDS);
+    printf("  -m, --mode=MODE\t\tforward, packed (default) or compressed\n");
+    printf("  -z, --compress=TYPE\t\tcompressed mode algorithm: gzip (default) or zstd\n");
+    printf("  -b, --batch=N\t\t\trecords per chunk (default: %i)\n",
+           DEFAULT_BATCH);
+    printf("  -t, --tag=TAG\t\t\trecords tag (default: %s)\n", DEFAULT_TAG);
+    printf("  -a, --ack\t\t\trequest chunk acks and measure their latency\n");
+    printf("  -w, --window=N\t\tmax in-flight chunks per connection in ack mode (default: %i)\n",
+           DEFAULT_WINDOW);
+    printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
+    printf("  -F, --format\t\t\treport format: text (default), markdown or csv\n");
+    printf("  -h, --help\t\t\tprint this help");
+    printf("\n\n");
+    flb_monitor_help();
+    exit(rc);
+}
+
+static int run_forward_writer(pid_t pid,
+                              char *report,
+                              int fmt_report,
+                              char *in_data_file,
+                              char *host, char *port,
+                              int n_cons,
+                              int records, int increase_by,
+                              int seconds,
+                              struct fwd_ctx *ctx, char *tag, int batch)
+{
+    int i;
+    int in_fd;
+    int cursor = 0;
+    int conn_records;
+    int sent_records;
+    int round_records;
+    int wait_time = 3;
+    size_t round_bytes;
+    size_t round_logical;
+    size_t logical;
+    char *data_buf;
+    size_t data_size;
+    ssize_t bytes;
+    size_t total_records = 0;
+    uint64_t unacked = 0;
+    struct flb_proc_task *t1 = NULL;
+    struct flb_proc_task *t2;
+    struct flb_report *r = NULL;
+    struct mk_list *head;
+    struct mk_list *connections;
+    struct fwd_conn *conn;
+
+    /* Report file for process monitoring */
+    if (pid >= 0) {
+        r = flb_report_create(report, fmt_report, pid, wait_time);
+        if (!r) {
+            fprintf(stderr, "error: cannot initialize report");
+            return -1;
+        }
+
+        /* the target decompresses the chunks, report the real volume */
+        if (ctx->mode == FWD_MODE_COMPRESSED) {
+            flb_report_logical_enable(r);
+        }
+        flb_report_sockets_enable(r);
+    }
+
+    /* Load input data file and encode the Forward chunks */
+    in_fd = flb_data_file_load(in_data_file, &data_buf, &data_size);
+    if (in_fd == -1) {
+        fprintf(stderr, "error: cannot load input data file '%s'\n",
+                in_data_file);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    if (fwd_chunks_create(ctx, tag, batch, data_buf, data_size) == -1) {
+        fprintf(stderr, "error: cannot encode Forward chunks\n");
+        flb_data_file_unload(data_buf, data_size);
+        close(in_fd);
+        fwd_chunks_destroy(ctx);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+    flb_data_file_unload(data_buf, data_size);
+    close(in_fd);
+
+    if (ctx->ack) {
+        ctx->ack_hist = flb_histogram_create();
+        if (!ctx->ack_hist) {
+            fwd_chunks_destroy(ctx);
+            if (r) {
+                flb_report_destroy(r);
+            }
+            return -1;
+        }
+    }
+
+    /* Create TCP connections */
+    connections = fwd_conn_create(n_cons, ctx->window, host, port);
+    if (!connections) {
+        fwd_chunks_destroy(ctx);
+        flb_histogram_destroy(ctx->ack_hist);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    /* Get the number of records that will be send per connection */
+    conn_records = (records / n_cons);
+
+    for (i = 0; i < seconds; i++) {
+        round_bytes = 0;
+        round_logical = 0;
+        round_records = 0;
+
+        if (pid >= 0 && !t1) {
+            t1 = flb_proc_stat_create(pid);
+            if (!t1) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+            }
+        }
+
+        mk_list_foreach(head, connections) {
+            conn = mk_list_entry(head, struct fwd_conn, _head);
+            bytes = fwd_send_records(ctx, conn, &cursor,
+                                     conn_records + (increase_by * i),
+                                     &sent_records, &logical);
+            total_records += sent_records;
+            round_records += sent_records;
+            round_bytes += bytes;
+            round_logical += logical;
+        }
+
+        /* Collect acks while waiting for the next round */
+        if (ctx->ack) {
+            fwd_ack_wait(ctx, connections, n_cons, 1000, 0);
+        }
+        else {
+            sleep(1);
+        }
+
+        /* Get stats */
+        if (pid >= 0 && t1) {
+            t2 = flb_proc_stat_create(pid);
+            if (!t2) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+                continue;
+            }
+            flb_report_logical_set(r, round_logical);
+            flb_report_stats(r, round_records, round_bytes, t1, t2);
+            flb_proc_stat_destroy(t1);
+            t1 = t2;
+        }
+    }
+
+    if (t1) {
+        flb_proc_stat_destroy(t1);
+    }
+
+    /* Give the remaining in-flight chunks a chance to be acknowledged */
+    if (ctx->ack) {
+        fwd_ack_wait(ctx, connections, n_cons, DEFAULT_ACK_TIMEOUT, 1);
+        mk_list_foreach(head, connections) {
+            conn = mk_list_entry(head, struct fwd_conn, _head);
+            unacked += conn->inflight;
+        }
+    }
+
+    /*
+     * Create continuos snapshots until resources consumption (CPU) stabilize,
+     * we assume that after three seconds without deltas in user time the
+     * process finished processing our records.
+     */
+    if (pid >= 0) {
+        int count = 0;
+
+        while (1) {
+            t1 = flb_proc_stat_create(pid);
+            sleep(1);
+            t2 = flb_proc_stat_create(pid);
+            if (!t1 || !t2) {
+                break;
+            }
+            flb_report_stats(r, 0, 0, t1, t2);
+
+            if ((t2->r_utime_ms - t1->r_utime_ms) == 0) {
+                count++;
+            }
+            else {
+                count = 0;
+            }
+
+            flb_proc_stat_destroy(t1);
+            flb_proc_stat_destroy(t2);
+
+            if (count >= wait_time) {
+                break;
+            }
+        }
+        r->sum_records = total_records;
+        flb_report_summary(r);
+    }
+
+    if (ctx->ack) {
+        flb_histogram_print(ctx->ack_hist, r ? r->fd : STDOUT_FILENO,
+                            "Ack Latency");
+        dprintf(r ? r->fd : STDOUT_FILENO,
+                "  - Timeouts    : %lu\n"
+                "  - Unacked     : %lu\n",
+                ctx->ack_timeouts, unacked);
+        flb_histogram_destroy(ctx->ack_hist);
+    }
+
+    if (r) {
+        flb_report_destroy(r);
+    }
+
+    fwd_conn_destroy(connections);
+    fwd_chunks_destroy(ctx);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int opt;
+    int concurrency = DEFAULT_CONCURRENCY;
+    int records = DEFAULT_RECORDS;
+    int seconds = DEFAULT_SECONDS;
+    int increase_by = DEFAULT_INC_BY;
+    int batch = DEFAULT_BATCH;
+    int pid = -1;
+    int fmt_report = FLB_REPORT_TXT;
+    char *format = NULL;
+    char *report = NULL;
+    char *out_host = NULL;
+    char *data_file = NULL;
+    char *mode = NULL;
+    char *compress = NULL;
+    char *tag = NULL;
+    char *host = NULL;
+    char *port = NULL;
+    char *p;
+    struct fwd_ctx ctx;
+
+    /* Setup long-options */
+    static const struct option long_opts[] = {
+        { "concurrency",   required_argument, NULL, 'c' },
+        { "datafile"   ,   required_argument, NULL, 'd' },
+        { "pid"        ,   required_argument, NULL, 'p' },
+        { "output"     ,   required_argument, NULL, 'o' },
+        { "records"    ,   required_argument, NULL, 'r' },
+        { "increase_by",   required_argument, NULL, 'i' },
+        { "seconds"    ,   required_argument, NULL, 's' },
+        { "mode"       ,   required_argument, NULL, 'm' },
+        { "compress"   ,   required_argument, NULL, 'z' },
+        { "batch"      ,   required_argument, NULL, 'b' },
+        { "tag"        ,   required_argument, NULL, 't' },
+        { "ack"        ,   no_argument      , NULL, 'a' },
+        { "window"     ,   required_argument, NULL, 'w' },
+        { "report"     ,   required_argument, NULL, 'R' },
+        { "format"     ,   required_argument, NULL, 'F' },
+        { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
+    };
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.mode = FWD_MODE_PACKED;
+    ctx.compress = FLB_COMPRESS_GZIP;
+    ctx.window = DEFAULT_WINDOW;
+
+    while ((opt = getopt_long(argc, argv,
+                              "c:d:p:o:r:i:s:m:z:b:t:aw:R:F:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'c':
+            concurrency = atoi(optarg);
+            break;
+        case 'd':
+            data_file = strdup(optarg);
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'o':
+            out_host = strdup(optarg);
+            break;
+        case 'r':
+            records = atoi(optarg);
+            break;
+        case 'i':
+            increase_by = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'm':
+            mode = strdup(optarg);
+            break;
+        case 'z':
+            compress = strdup(optarg);
+            break;
+        case 'b':
+            batch = atoi(optarg);
+            break;
+        case 't':
+            tag = strdup(optarg);
+            break;
+        case 'a':
+            ctx.ack = 1;
+            break;
+        case 'w':
+            ctx.window = atoi(optarg);
+            break;
+        case 'R':
+            report = strdup(optarg);
+            break;
+        case 'F':
+            format = strdup(optarg);
+            break;
+        case 'h':
+            flb_help(EXIT_SUCCESS);
+            break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
+        };
+    };
+
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    if (!data_file) {
+        fprintf(stderr, "error: no data file specified\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (records < 1) {
+        fprintf(stderr, "error: invalid number of records '%i'\n", records);
+        exit(EXIT_FAILURE);
+    }
+
+    if (seconds < 1) {
+        fprintf(stderr, "error: invalid number of seconds '%i'\n", seconds);
+        exit(EXIT_FAILURE);
+    }
+
+    if (concurrency < 1) {
+        fprintf(stderr, "error: invalid concurrency '%i'\n", concurrency);
+        exit(EXIT_FAILURE);
+    }
+
+    if (batch < 1) {
+        fprintf(stderr, "error: invalid batch size '%i'\n", batch);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ctx.window < 1) {
+        fprintf(stderr, "error: invalid ack window '%i'\n", ctx.window);
+        exit(EXIT_FAILURE);
+    }
+
+    if (mode) {
+        if (strcasecmp(mode, "forward") == 0) {
+            ctx.mode = FWD_MODE_FORWARD;
+        }
+        else if (strcasecmp(mode, "packed") == 0) {
+            ctx.mode = FWD_MODE_PACKED;
+        }
+        else if (strcasecmp(mode, "compressed") == 0) {
+            ctx.mode = FWD_MODE_COMPRESSED;
+        }
+        else {
+            fprintf(stderr, "error: invalid mode '%s'\n", mode);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* Forward only defines compressed entries for gzip and zstd */
+    if (compress) {
+        ctx.compress = flb_compress_type(compress);
+        if (ctx.compress != FLB_COMPRESS_GZIP &&
+            ctx.compress != FLB_COMPRESS_ZSTD) {
+            fprintf(stderr, "error: invalid Forward compression '%s'\n",
+                    compress);
+            exit(EXIT_FAILURE);
+        }
+        if (!mode) {
+            ctx.mode = FWD_MODE_COMPRESSED;
+        }
+        else if (ctx.mode != FWD_MODE_COMPRESSED) {
+            fprintf(stderr, "error: compression requires compressed mode\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!out_host) {
+        host = strdup(DEFAULT_HOST);
+        port = strdup(DEFAULT_PORT);
+    }
+    else {
+        p = strchr(out_host, ':');
+        if (!p) {
+            host = strdup(out_host);
+            port = strdup(DEFAULT_PORT);
+        }
+        else {
+            host = strndup(out_host, p - out_host);
+            p++;
+            port = strdup(*p ? p : DEFAULT_PORT);
+        }
+    }
+
+    if (format) {
+        if (strcasecmp(format, "markdown") == 0) {
+            fmt_report = FLB_REPORT_MARKDOWN;
+        }
+        else if (strcasecmp(format, "text") == 0) {
+            fmt_report = FLB_REPORT_TXT;
+        }
+        else if (strcasecmp(format, "csv") == 0) {
+            fmt_report = FLB_REPORT_CSV;
+        }
+        else {
+            fprintf(stderr, "error: invalid format type");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    ret = run_forward_writer(pid, report, fmt_report, data_file,
+                             host, port,
+                             concurrency, records, increase_by, seconds,
+                             &ctx, tag ? tag : DEFAULT_TAG, batch);
+
+    free(report);
+    free(format);
+    free(data_file);
+    free(out_host);
+    free(mode);
+    free(compress);
+    free(tag);
+    free(host);
+    free(port);
+
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,1211 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+
+/* local headers */
+#include "mk_list.h"
+#include "flb_data_file.h"
+#include "flb_proc.h"
+#include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_network.h"
+#include "flb_http.h"
+#include "flb_compress.h"
+#include "flb_histogram.h"
+#include "flb_protobuf.h"
+#include "flb_otlp.h"
+#include "flb_stamp.h"
+#include "flb_time.h"
+
+/* Default values */
+#define DEFAULT_RECORDS           1000  /* 1000 records per second       */
+#define DEFAULT_INC_BY               0  /* no increase                   */
+#define DEFAULT_SECONDS             10  /* test time: 10 seconds         */
+#define DEFAULT_CONCURRENCY          1  /* one active connection         */
+#define DEFAULT_BATCH              100  /* records per request body      */
+#define DEFAULT_PIPELINE             1  /* no pipelining                 */
+#define DEFAULT_TIMEOUT           5000  /* milliseconds to get responses */
+#define DEFAULT_SEND_RETRIES         3  /* attempts to write a request   */
+#define DEFAULT_URI                "/"
+#define DEFAULT_OTLP_URI    "/v1/logs"
+#define DEFAULT_RESOURCES            1  /* OTLP resources per request    */
+#define DEFAULT_SCOPES               1  /* OTLP scopes per resource      */
+
+/* Default network host and port (in_http) */
+#define DEFAULT_PORT            "9880"
+#define DEFAULT_HOST       "127.0.0.1"
+
+/* Body formats */
+#define HTTP_BODY_JSON               0  /* JSON array of records      */
+#define HTTP_BODY_NDJSON             1  /* newline delimited records  */
+#define HTTP_BODY_OTLP               2  /* OTLP ExportLogsServiceRequest */
+
+static char *http_content_types[] = {
+    "application/json",
+    "application/x-ndjson",
+    "application/x-protobuf"
+};
+
+#define HTTP_READ_SIZE           65536
+
+/* A pre-composed request: headers and body */
+struct http_request {
+    size_t offset;
+    size_t size;
+    size_t logical;              /* size with the uncompressed body */
+    int records;
+    int stamp_first;             /* first entry in ctx->stamps */
+    int n_stamps;
+};
+
+struct http_conn {
+    int id;
+    int fd;
+    int round_left;              /* records pending in the current round */
+
+    /* pipelined requests waiting for a response */
+    int head;
+    int inflight;
+    struct timespec *pending;
+    int *pending_records;
+
+    /* response buffer */
+    size_t rlen;
+    size_t rsize;
+    char *rbuf;
+
+    struct mk_list _head;
+};
+
+struct http_ctx {
+    int format;
+    int compress;                /* body Content-Encoding */
+    int depth;
+    int resources;
+    int scopes;
+    char *host;
+    char *port;
+
+    /* pre-composed requests */
+    char *buf;
+    size_t buf_size;
+    int cursor;
+    int n_requests;
+    struct http_request *requests;
+
+    /* logical bytes sent in the round */
+    size_t round_logical;
+
+    /*
+     * Stamped records: offsets of the placeholders in 'buf', patched with
+     * a new sequence and the send time right before each request goes out.
+     */
+    int stamp;
+    uint64_t seq;
+    int n_stamps;
+    int stamps_size;
+    size_t *stamps;
+    int body_stamps;             /* placeholders in the last body */
+    size_t *body_offs;           /* their offsets within the body */
+
+    /* response stats */
+    uint64_t responses;
+    uint64_t non_2xx;
+    uint64_t round_non_2xx;
+    uint64_t errors;
+    uint64_t reconnects;
+    uint64_t dropped;            /* records given up on */
+    uint64_t status[600];
+    struct flb_histogram *hist;
+    struct flb_histogram *round_hist;
+};
+
+static void http_conn_destroy(struct mk_list *list)
+{
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct http_conn *conn;
+
+    mk_list_foreach_safe(head, tmp, list) {
+        conn = mk_list_entry(head, struct http_conn, _head);
+        mk_list_del(&conn->_head);
+        if (conn->fd > 0) {
+            close(conn->fd);
+        }
+        free(conn->pending);
+        free(conn->pending_records);
+        free(conn->rbuf);
+        free(conn);
+    }
+
+    free(list);
+}
+
+static struct mk_list *http_conn_create(struct http_ctx *ctx, int connections)
+{
+    int i;
+    struct mk_list *list;
+    struct http_conn *conn;
+
+    list = malloc(sizeof(struct mk_list));
+    if (!list) {
+        perror("malloc");
+        return NULL;
+    }
+    mk_list_init(list);
+
+    for (i = 0; i < connections; i++) {
+        conn = calloc(1, sizeof(struct http_conn));
+        if (!conn) {
+            perror("calloc");
+            http_conn_destroy(list);
+            return NULL;
+        }
+        mk_list_add(&conn->_head, list);
+        conn->id = i;
+
+        conn->pending = calloc(ctx->depth, sizeof(struct timespec));
+        conn->pending_records = calloc(ctx->depth, sizeof(int));
+        conn->rsize = HTTP_READ_SIZE;
+        conn->rbuf = malloc(conn->rsize);
+        if (!conn->pending || !conn->pending_records || !conn->rbuf) {
+            perror("calloc");
+            http_conn_destroy(list);
+            return NULL;
+        }
+
+        conn->fd = flb_net_tcp_connect(ctx->host, ctx->port);
+        if (conn->fd == -1) {
+            fprintf(stderr, "error creating connection #%i to %s:%s\n",
+                    i, ctx->host, ctx->port);
+            http_conn_destroy(list);
+            return NULL;
+        }
+    }
+
+    return list;
+}
+
+/* Re-open a connection closed by the server, in-flight requests are lost */
+static int http_conn_reset(struct http_ctx *ctx, struct http_conn *conn)
+{
+    int i;
+
+    for (i = 0; i < conn->inflight; i++) {
+        ctx->dropped += conn->pending_records[(conn->head + i) % ctx->depth];
+    }
+    ctx->errors += conn->inflight;
+    ctx->reconnects++;
+    conn->inflight = 0;
+    conn->head = 0;
+    conn->rlen = 0;
+
+    close(conn->fd);
+    conn->fd = flb_net_tcp_connect(ctx->host, ctx->port);
+    if (conn->fd == -1) {
+        fprintf(stderr, "error: cannot reconnect #%i to %s:%s\n",
+                conn->id, ctx->host, ctx->port);
+        return -1;
+    }
+    return 0;
+}
+
+/* Compose a request body with the given records */
+static int http_body_create(struct http_ctx *ctx,
+                            struct flb_otlp_record *recs, int n,
+                            struct flb_pb_buf *body)
+{
+    int i;
+    char sep;
+
+    body->len = 0;
+
+    if (ctx->format == HTTP_BODY_OTLP) {
+        return flb_otlp_logs_encode(body, recs, n,
+                                    ctx->resources, ctx->scopes);
+    }
+
+    /* JSON array or NDJSON, the buffer is only used as raw storage */
+    sep = (ctx->format == HTTP_BODY_JSON) ? ',' : '\n';
+    if (ctx->format == HTTP_BODY_JSON) {
+        body->data[body->len++] = '[';
+    }
+    ctx->body_stamps = 0;
+    for (i = 0; i < n; i++) {
+        if (ctx->stamp &&
+            flb_stamp_record(body->data + body->len, recs[i].json,
+                             recs[i].len, 0, 0) > 0) {
+            ctx->body_offs[ctx->body_stamps++] = body->len +
+                ((char *) memchr(recs[i].json, '{', recs[i].len) -
+                 recs[i].json) + 1;
+            body->len += recs[i].len + FLB_STAMP_SIZE;
+        }
+        else {
+            memcpy(body->data + body->len, recs[i].json, recs[i].len);
+            body->len += recs[i].len;
+        }
+        if (ctx->format == HTTP_BODY_NDJSON || i + 1 < n) {
+            body->data[body->len++] = sep;
+        }
+    }
+    if (ctx->format == HTTP_BODY_JSON) {
+        body->data[body->len++] = ']';
+    }
+    return 0;
+}
+
+static int http_request_add(struct http_ctx *ctx, char *uri, char *headers,
+                            struct flb_pb_buf *body, int records, int *size)
+{
+    int i;
+    size_t req_len;
+    size_t wire_len = body->len;
+    void *wire = body->data;
+    char *req;
+    char *tmp;
+    size_t *offs;
+    struct http_request *r;
+
+    /* the body is compressed once here, rounds only send bytes */
+    if (ctx->compress != FLB_COMPRESS_NONE) {
+        if (flb_compress(ctx->compress, body->data, body->len,
+                         &wire, &wire_len) == -1) {
+            return -1;
+        }
+    }
+
+    req = flb_http_request_create("POST", ctx->host, ctx->port, uri,
+                                  http_content_types[ctx->format], headers,
+                                  wire, wire_len, &req_len);
+    if (wire != body->data) {
+        free(wire);
+    }
+    if (!req) {
+        return -1;
+    }
+
+    if (ctx->n_requests == *size) {
+        *size *= 2;
+        r = realloc(ctx->requests, sizeof(struct http_request) * *size);
+        if (!r) {
+            perror("realloc");
+            free(req);
+            return -1;
+        }
+        ctx->requests = r;
+    }
+
+    r = &ctx->requests[ctx->n_requests];
+    r->offset = 0;
+    if (ctx->n_requests > 0) {
+        r->offset = ctx->requests[ctx->n_requests - 1].offset +
+            ctx->requests[ctx->n_requests - 1].size;
+    }
+    r->size = req_len;
+    r->logical = req_len - wire_len + body->len;
+    r->records = records;
+
+    if (r->offset + req_len > ctx->buf_size) {
+        ctx->buf_size = (r->offset + req_len) * 2;
+        tmp = realloc(ctx->buf, ctx->buf_size);
+        if (!tmp) {
+            perror("realloc");
+            free(req);
+            return -1;
+        }
+        ctx->buf = tmp;
+    }
+    memcpy(ctx->buf + r->offset, req, req_len);
+    free(req);
+
+    /* placeholders position in the composed request */
+    r->stamp_first = ctx->n_stamps;
+    r->n_stamps = ctx->body_stamps;
+    if (ctx->n_stamps + ctx->body_stamps > ctx->stamps_size) {
+        ctx->stamps_size = (ctx->n_stamps + ctx->body_stamps) * 2;
+        offs = realloc(ctx->stamps, sizeof(size_t) * ctx->stamps_size);
+        if (!offs) {
+            perror("realloc");
+            return -1;
+        }
+        ctx->stamps = offs;
+    }
+    for (i = 0; i < ctx->body_stamps; i++) {
+        ctx->stamps[ctx->n_stamps++] = r->offset + (req_len - wire_len) +
+            ctx->body_offs[i];
+    }
+
+    ctx->n_requests++;
+    return 0;
+}
+
+/*
+ * Compose every request once at startup: each one carries 'batch' records
+ * from the data file as a JSON array, NDJSON or an OTLP protobuf message.
+ */
+static int http_requests_create(struct http_ctx *ctx, char *uri,
+                                char *headers, int batch,
+                                char *data_buf, size_t data_size)
+{
+    int n = 0;
+    int size = 64;
+    int ret = 0;
+    char *p;
+    char *end;
+    char *eol;
+    size_t len;
+    char *enc = NULL;
+    struct flb_pb_buf body;
+    struct flb_otlp_record *recs;
+
+    /* append the Content-Encoding to the user headers */
+    if (ctx->compress != FLB_COMPRESS_NONE) {
+        len = (headers ? strlen(headers) : 0) + 64;
+        enc = malloc(len);
+        if (!enc) {
+            perror("malloc");
+            return -1;
+        }
+        snprintf(enc, len, "%sContent-Encoding: %s\r\n",
+                 headers ? headers : "", flb_compress_name(ctx->compress));
+        headers = enc;
+    }
+
+    recs = calloc(batch, sizeof(struct flb_otlp_record));
+    ctx->requests = calloc(size, sizeof(struct http_request));
+    ctx->buf_size = data_size * 2;
+    ctx->buf = malloc(ctx->buf_size);
+    if (!recs || !ctx->requests || !ctx->buf) {
+        perror("malloc");
+        free(recs);
+        free(enc);
+        return -1;
+    }
+
+    if (ctx->stamp) {
+        ctx->body_offs = malloc(sizeof(size_t) * batch);
+        if (!ctx->body_offs) {
+            perror("malloc");
+            free(recs);
+            free(enc);
+            return -1;
+        }
+    }
+
+    if (flb_pb_buf_init(&body, data_size + batch + 2 +
+                        (ctx->stamp ? batch * FLB_STAMP_SIZE : 0)) == -1) {
+        free(recs);
+        free(enc);
+        return -1;
+    }
+
+    p = data_buf;
+    end = data_buf + data_size;
+    while (p < end) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+        if (eol > p) {
+            recs[n].json = p;
+            recs[n].len = eol - p;
+            n++;
+        }
+        p = eol + 1;
+
+        if (n == batch || (p >= end && n > 0)) {
+            ret = http_body_create(ctx, recs, n, &body);
+            if (ret == 0) {
+                ret = http_request_add(ctx, uri, headers, &body, n, &size);
+            }
+            if (ret == -1) {
+                break;
+            }
+            n = 0;
+        }
+    }
+
+    free(recs);
+    free(enc);
+    flb_pb_buf_destroy(&body);
+
+    if (ret == -1) {
+        return -1;
+    }
+
+    if (ctx->n_requests == 0) {
+        fprintf(stderr, "error: no records found in data file\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int send_all(int fd, char *buf, size_t len)
+{
+    ssize_t bytes;
+
+    while (len > 0) {
+        bytes = write(fd, buf, len);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return -1;
+        }
+        buf += bytes;
+        len -= bytes;
+    }
+    return 0;
+}
+
+/* Read and process the available responses of a connection */
+static int http_conn_read(struct http_ctx *ctx, struct http_conn *conn)
+{
+    int close_conn = 0;
+    ssize_t ret;
+    size_t off = 0;
+    uint64_t latency;
+    char *tmp;
+    struct timespec now;
+    struct flb_http_response res;
+
+    if (conn->rlen == conn->rsize) {
+        tmp = realloc(conn->rbuf, conn->rsize * 2);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        conn->rbuf = tmp;
+        conn->rsize *= 2;
+    }
+
+    ret = read(conn->fd, conn->rbuf + conn->rlen, conn->rsize - conn->rlen);
+    if (ret == -1 && errno == EINTR) {
+        return 0;
+    }
+    else if (ret <= 0) {
+        return http_conn_reset(ctx, conn);
+    }
+    conn->rlen += ret;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    while (off < conn->rlen) {
+        ret = flb_http_response_parse(conn->rbuf + off, conn->rlen - off, &res);
+        if (ret == 0) {
+            break;
+        }
+        else if (ret == -1) {
+            fprintf(stderr, "error: invalid HTTP response on connection #%i\n",
+                    conn->id);
+            return http_conn_reset(ctx, conn);
+        }
+        off += ret;
+
+        if (conn->inflight == 0) {
+            /* unexpected response */
+            ctx->errors++;
+            continue;
+        }
+
+        latency = flb_time_diff_us(&conn->pending[conn->head], &now);
+        flb_histogram_record(ctx->hist, latency);
+        flb_histogram_record(ctx->round_hist, latency);
+        conn->head = (conn->head + 1) % ctx->depth;
+        conn->inflight--;
+
+        ctx->responses++;
+        if (res.status >= 0 && res.status < 600) {
+            ctx->status[res.status]++;
+        }
+        if (res.status < 200 || res.status > 299) {
+            ctx->non_2xx++;
+            ctx->round_non_2xx++;
+        }
+        if (res.close) {
+            close_conn = 1;
+            break;
+        }
+    }
+
+    memmove(conn->rbuf, conn->rbuf + off, conn->rlen - off);
+    conn->rlen -= off;
+
+    if (close_conn) {
+        return http_conn_reset(ctx, conn);
+    }
+    return 0;
+}
+
+/*
+ * Fill the connection pipeline with the pending requests of the round, a
+ * request that cannot be written after DEFAULT_SEND_RETRIES reconnects is
+ * given up on.
+ */
+static ssize_t http_conn_send(struct http_ctx *ctx, struct http_conn *conn,
+                              int *out_records)
+{
+    int i;
+    int idx;
+    int attempts = 0;
+    ssize_t bytes = 0;
+    uint64_t now;
+    struct http_request *req;
+
+    *out_records = 0;
+    while (conn->round_left > 0 && conn->inflight < ctx->depth) {
+        req = &ctx->requests[ctx->cursor];
+
+        idx = (conn->head + conn->inflight) % ctx->depth;
+        clock_gettime(CLOCK_MONOTONIC, &conn->pending[idx]);
+
+        if (req->n_stamps > 0) {
+            now = flb_stamp_now();
+            for (i = 0; i < req->n_stamps; i++) {
+                flb_stamp_write(ctx->buf + ctx->stamps[req->stamp_first + i],
+                                ctx->seq++, now);
+            }
+        }
+
+        if (send_all(conn->fd, ctx->buf + req->offset, req->size) == -1) {
+            fprintf(stderr, "error: exception on writing request\n");
+            if (http_conn_reset(ctx, conn) == -1) {
+                return -1;
+            }
+            if (++attempts < DEFAULT_SEND_RETRIES) {
+                continue;
+            }
+            fprintf(stderr, "warn: giving up on a request of %i records "
+                    "on connection #%i\n", req->records, conn->id);
+            ctx->dropped += req->records;
+            conn->round_left -= req->records;
+            ctx->cursor = (ctx->cursor + 1) % ctx->n_requests;
+            attempts = 0;
+            continue;
+        }
+        attempts = 0;
+
+        conn->pending_records[idx] = req->records;
+        conn->inflight++;
+        conn->round_left -= req->records;
+        ctx->cursor = (ctx->cursor + 1) % ctx->n_requests;
+        *out_records += req->records;
+        bytes += req->size;
+        ctx->round_logical += req->logical;
+    }
+
+    return bytes;
+}
+
+/*
+ * Dispatch one round: keep every connection pipeline full until all the
+ * records are sent and every response arrived.
+ */
+static int http_round(struct http_ctx *ctx, struct mk_list *connections,
+                      int n_cons, size_t *round_bytes, int *round_records)
+{
+    int i;
+    int ret;
+    int done;
+    int records;
+    ssize_t bytes;
+    struct pollfd pfds[n_cons];
+    struct http_conn *conns[n_cons];
+    struct mk_list *head;
+
+    i = 0;
+    mk_list_foreach(head, connections) {
+        conns[i++] = mk_list_entry(head, struct http_conn, _head);
+    }
+
+    while (1) {
+        done = 1;
+        for (i = 0; i < n_cons; i++) {
+            bytes = http_conn_send(ctx, conns[i], &records);
+            if (bytes == -1) {
+                return -1;
+            }
+            *round_bytes += bytes;
+            *round_records += records;
+
+            if (conns[i]->round_left > 0 || conns[i]->inflight > 0) {
+                done = 0;
+            }
+            pfds[i].fd = conns[i]->inflight > 0 ? conns[i]->fd : -1;
+            pfds[i].events = POLLIN;
+            pfds[i].revents = 0;
+        }
+
+        if (done) {
+            break;
+        }
+
+        ret = poll(pfds, n_cons, DEFAULT_TIMEOUT);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        else if (ret <= 0) {
+            fprintf(stderr, "warn: timeout waiting for HTTP responses\n");
+            for (i = 0; i < n_cons; i++) {
+                if (conns[i]->inflight > 0 &&
+                    http_conn_reset(ctx, conns[i]) == -1) {
+                    return -1;
+                }
+            }
+            continue;
+        }
+
+        for (i = 0; i < n_cons; i++) {
+            if (pfds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (http_conn_read(ctx, conns[i]) == -1) {
+                    return -1;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void http_summary(struct http_ctx *ctx, int fd)
+{
+    int i;
+
+    flb_histogram_print(ctx->hist, fd, "HTTP Responses");
+    dprintf(fd, "  - Non-2xx     : %lu\n", ctx->non_2xx);
+    dprintf(fd, "  - Errors      : %lu\n", ctx->errors);
+    dprintf(fd, "  - Reconnects  : %lu\n", ctx->reconnects);
+    dprintf(fd, "  - Dropped     : %lu records\n", ctx->dropped);
+    for (i = 0; i < 600; i++) {
+        if (ctx->status[i] > 0) {
+            dprintf(fd, "  - Status %3i  : %lu\n", i, ctx->status[i]);
+        }
+    }
+}
+
+static int flb_help(int rc)
+{
+    printf("Usage: flb-http-writer [OPTIONS]\n\n");
+    printf("Available options\n");
+    printf("  -c, --concurrency=N\t\tconcurrency level (default: %i)\n",
+           DEFAULT_CONCURRENCY);
+    printf("  -d, --datafile=PATH\t\tspecify source data file (JSON lines)\n");
+    printf("  -p  --pid=FLB_PID\t\tFluent Bit PID used gather metrics\n");
+    printf("  -o, --output=HOST:PORT\tset remote HTTP Host and Port\n");
+    printf("  -u, --uri=URI\t\t\trequest URI (default: %s)\n", DEFAULT_URI);
+    printf("  -H, --header='KEY: VALUE'\tadd a request header, can be used many times\n");
+    printf("  -f, --body=FORMAT\t\tbody format: json (default), ndjson or otlp\n");
+    printf("  -z, --compress=TYPE\t\tbody Content-Encoding: gzip, zstd or snappy\n");
+    printf("  -T, --stamp\t\t\tembed sequence and send time stamps (see flb-sink)\n");
+    printf("  -e, --resources=N\t\tOTLP resources per request (default: %i)\n",
+           DEFAULT_RESOURCES);
+    printf("  -S, --scopes=N\t\tOTLP scopes per resource (default: %i)\n",
+           DEFAULT_SCOPES);
+    printf("  -b, --batch=N\t\t\trecords per request (default: %i)\n",
+           DEFAULT_BATCH);
+    printf("  -P, --pipeline=N\t\tmax pipelined requests per connection (default: %i)\n",
+           DEFAULT_PIPELINE);
+    printf("  -i, --increase_by=N\t\tincrease N number of records per second (default: %i)\n",
+           DEFAULT_INC_BY);
+    printf("  -r, --records=RECORDS\t\trecords per second (default: %i)\n",
+           DEFAULT_RECORDS);
+    printf("  -s, --seconds=SECONDS\t\ttotal test time meassured in seconds (default: %i)\n",
+           DEFAULT_SECONDS);
+    printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
+    printf("  -F, --format\t\t\treport format: text (default), markdown or csv\n");
+    printf("  -h, --help\t\t\tprint this help");
+    printf("\n\n");
+    flb_monitor_help();
+    exit(rc);
+}
+
+static int run_http_writer(pid_t pid,
+                           char *report,
+                           int fmt_report,
+                           char *in_data_file,
+                           char *uri, char *headers,
+                           int n_cons,
+                           int records, int increase_by,
+                           int seconds, int batch,
+                           struct http_ctx *ctx)
+{
+    int i;
+    int ret;
+    int in_fd;
+    int conn_records;
+    int round_records;
+    int wait_time = 3;
+    int col_p50 = -1;
+    int col_p99 = -1;
+    int col_non2xx = -1;
+    size_t round_bytes;
+    char *data_buf;
+    size_t data_size;
+    size_t total_records = 0;
+    struct flb_proc_task *t1 = NULL;
+    struct flb_proc_task *t2;
+    struct flb_report *r = NULL;
+    struct mk_list *head;
+    struct mk_list *connections;
+    struct http_conn *conn;
+    struct timespec round_start;
+
+    /* Report file for process monitoring */
+    if (pid >= 0) {
+        r = flb_report_create(report, fmt_report, pid, wait_time);
+        if (!r) {
+            fprintf(stderr, "error: cannot initialize report");
+            return -1;
+        }
+        col_p50 = flb_report_column_add(r, "p50_ms", 8, 2);
+        col_p99 = flb_report_column_add(r, "p99_ms", 8, 2);
+        col_non2xx = flb_report_column_add(r, "non2xx", 7, 0);
+        if (ctx->compress != FLB_COMPRESS_NONE) {
+            flb_report_logical_enable(r);
+        }
+        flb_report_sockets_enable(r);
+    }
+
+    /* Load input data file and compose the requests */
+    in_fd = flb_data_file_load(in_data_file, &data_buf, &data_size);
+    if (in_fd == -1) {
+        fprintf(stderr, "error: cannot load input data file '%s'\n",
+                in_data_file);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    ret = http_requests_create(ctx, uri, headers, batch, data_buf, data_size);
+    flb_data_file_unload(data_buf, data_size);
+    close(in_fd);
+    if (ret == -1) {
+        fprintf(stderr, "error: cannot compose HTTP requests\n");
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    ctx->hist = flb_histogram_create();
+    ctx->round_hist = flb_histogram_create();
+    if (!ctx->hist || !ctx->round_hist) {
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    /* Create keep-alive connections */
+    connections = http_conn_create(ctx, n_cons);
+    if (!connections) {
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    /* Get the number of records that will be send per connection */
+    conn_records = (records / n_cons);
+
+    for (i = 0; i < seconds; i++) {
+        round_bytes = 0;
+        round_records = 0;
+        flb_histogram_reset(ctx->round_hist);
+        ctx->round_non_2xx = 0;
+        ctx->round_logical = 0;
+
+        if (pid >= 0 && !t1) {
+            t1 = flb_proc_stat_create(pid);
+            if (!t1) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &round_start);
+        mk_list_foreach(head, connections) {
+            conn = mk_list_entry(head, struct http_conn, _head);
+            conn->round_left = conn_records + (increase_by * i);
+        }
+
+        ret = http_round(ctx, connections, n_cons,
+                         &round_bytes, &round_records);
+        total_records += round_records;
+        if (ret == -1) {
+            break;
+        }
+
+        /* Wait for the rest of the second */
+        flb_time_sleep_until(&round_start, 1000);
+
+        /* Get stats */
+        if (pid >= 0 && t1) {
+            t2 = flb_proc_stat_create(pid);
+            if (!t2) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+                continue;
+            }
+            flb_report_column_set(r, col_p50,
+                    flb_histogram_percentile(ctx->round_hist, 50.0) / 1000.0);
+            flb_report_column_set(r, col_p99,
+                    flb_histogram_percentile(ctx->round_hist, 99.0) / 1000.0);
+            flb_report_column_set(r, col_non2xx, ctx->round_non_2xx);
+            flb_report_logical_set(r, ctx->round_logical);
+            flb_report_stats(r, round_records, round_bytes, t1, t2);
+            flb_proc_stat_destroy(t1);
+            t1 = t2;
+        }
+    }
+
+    if (t1) {
+        flb_proc_stat_destroy(t1);
+    }
+
+    /*
+     * Create continuos snapshots until resources consumption (CPU) stabilize,
+     * we assume that after three seconds without deltas in user time the
+     * process finished processing our records.
+     */
+    if (pid >= 0) {
+        int count = 0;
+
+        while (1) {
+            t1 = flb_proc_stat_create(pid);
+            sleep(1);
+            t2 = flb_proc_stat_create(pid);
+            if (!t1 || !t2) {
+                break;
+            }
+            flb_report_stats(r, 0, 0, t1, t2);
+
+            if ((t2->r_utime_ms - t1->r_utime_ms) == 0) {
+                count++;
+            }
+            else {
+                count = 0;
+            }
+
+            flb_proc_stat_destroy(t1);
+            flb_proc_stat_destroy(t2);
+
+            if (count >= wait_time) {
+                break;
+            }
+        }
+        r->sum_records = total_records;
+        flb_report_summary(r);
+    }
+
+    http_summary(ctx, r ? r->fd : STDOUT_FILENO);
+
+    if (r) {
+        flb_report_destroy(r);
+    }
+
+    http_conn_destroy(connections);
+    flb_histogram_destroy(ctx->hist);
+    flb_histogram_destroy(ctx->round_hist);
+    free(ctx->requests);
+    free(ctx->buf);
+    free(ctx->stamps);
+    free(ctx->body_offs);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int opt;
+    int concurrency = DEFAULT_CONCURRENCY;
+    int records = DEFAULT_RECORDS;
+    int seconds = DEFAULT_SECONDS;
+    int increase_by = DEFAULT_INC_BY;
+    int batch = DEFAULT_BATCH;
+    int pid = -1;
+    int fmt_report = FLB_REPORT_TXT;
+    size_t len;
+    char *format = NULL;
+    char *report = NULL;
+    char *out_host = NULL;
+    char *data_file = NULL;
+    char *body = NULL;
+    char *compress = NULL;
+    char *uri = NULL;
+    char *headers = NULL;
+    char *tmp;
+    char *p;
+    struct http_ctx ctx;
+
+    /* Setup long-options */
+    static const struct option long_opts[] = {
+        { "concurrency",   required_argument, NULL, 'c' },
+        { "datafile"   ,   required_argument, NULL, 'd' },
+        { "pid"        ,   required_argument, NULL, 'p' },
+        { "output"     ,   required_argument, NULL, 'o' },
+        { "uri"        ,   required_argument, NULL, 'u' },
+        { "header"     ,   required_argument, NULL, 'H' },
+        { "body"       ,   required_argument, NULL, 'f' },
+        { "compress"   ,   required_argument, NULL, 'z' },
+        { "stamp"      ,   no_argument      , NULL, 'T' },
+        { "resources"  ,   required_argument, NULL, 'e' },
+        { "scopes"     ,   required_argument, NULL, 'S' },
+        { "batch"      ,   required_argument, NULL, 'b' },
+        { "pipeline"   ,   required_argument, NULL, 'P' },
+        { "records"    ,   required_argument, NULL, 'r' },
+        { "increase_by",   required_argument, NULL, 'i' },
+        { "seconds"    ,   required_argument, NULL, 's' },
+        { "report"     ,   required_argument, NULL, 'R' },
+        { "format"     ,   required_argument, NULL, 'F' },
+        { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
+    };
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.format = HTTP_BODY_JSON;
+    ctx.depth = DEFAULT_PIPELINE;
+    ctx.resources = DEFAULT_RESOURCES;
+    ctx.scopes = DEFAULT_SCOPES;
+
+    while ((opt = getopt_long(argc, argv,
+                              "c:d:p:o:u:H:f:z:Te:S:b:P:r:i:s:R:F:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'c':
+            concurrency = atoi(optarg);
+            break;
+        case 'd':
+            data_file = strdup(optarg);
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'o':
+            out_host = strdup(optarg);
+            break;
+        case 'u':
+            uri = strdup(optarg);
+            break;
+        case 'H':
+            /* append as a preformatted header line */
+            len = (headers ? strlen(headers) : 0) + strlen(optarg) + 3;
+            tmp = realloc(headers, len);
+            if (!tmp) {
+                perror("realloc");
+                exit(EXIT_FAILURE);
+            }
+            if (!headers) {
+                tmp[0] = '\0';
+            }
+            headers = tmp;
+            strcat(headers, optarg);
+            strcat(headers, "\r\n");
+            break;
+        case 'f':
+            body = strdup(optarg);
+            break;
+        case 'z':
+            compress = strdup(optarg);
+            break;
+        case 'T':
+            ctx.stamp = 1;
+            break;
+        case 'e':
+            ctx.resources = atoi(optarg);
+            break;
+        case 'S':
+            ctx.scopes = atoi(optarg);
+            break;
+        case 'b':
+            batch = atoi(optarg);
+            break;
+        case 'P':
+            ctx.depth = atoi(optarg);
+            break;
+        case 'r':
+            records = atoi(optarg);
+            break;
+        case 'i':
+            increase_by = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'R':
+            report = strdup(optarg);
+            break;
+        case 'F':
+            format = strdup(optarg);
+            break;
+        case 'h':
+            flb_help(EXIT_SUCCESS);
+            break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
+        };
+    };
+
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    if (!data_file) {
+        fprintf(stderr, "error: no data file specified\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (records < 1) {
+        fprintf(stderr, "error: invalid number of records '%i'\n", records);
+        exit(EXIT_FAILURE);
+    }
+
+    if (seconds < 1) {
+        fprintf(stderr, "error: invalid number of seconds '%i'\n", seconds);
+        exit(EXIT_FAILURE);
+    }
+
+    if (concurrency < 1) {
+        fprintf(stderr, "error: invalid concurrency '%i'\n", concurrency);
+        exit(EXIT_FAILURE);
+    }
+
+    if (batch < 1) {
+        fprintf(stderr, "error: invalid batch size '%i'\n", batch);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ctx.resources < 1 || ctx.scopes < 1) {
+        fprintf(stderr, "error: invalid OTLP resources/scopes\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (ctx.depth < 1) {
+        fprintf(stderr, "error: invalid pipeline depth '%i'\n", ctx.depth);
+        exit(EXIT_FAILURE);
+    }
+
+    if (body) {
+        if (strcasecmp(body, "json") == 0) {
+            ctx.format = HTTP_BODY_JSON;
+        }
+        else if (strcasecmp(body, "ndjson") == 0) {
+            ctx.format = HTTP_BODY_NDJSON;
+        }
+        else if (strcasecmp(body, "otlp") == 0) {
+            ctx.format = HTTP_BODY_OTLP;
+        }
+        else {
+            fprintf(stderr, "error: invalid body format '%s'\n", body);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (compress) {
+        ctx.compress = flb_compress_type(compress);
+        if (ctx.compress == -1) {
+            fprintf(stderr, "error: invalid compression '%s'\n", compress);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* placeholders are patched in place, the body must stay as is */
+    if (ctx.stamp && (ctx.format == HTTP_BODY_OTLP ||
+                      ctx.compress != FLB_COMPRESS_NONE)) {
+        fprintf(stderr, "error: stamps require an uncompressed JSON body\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!out_host) {
+        ctx.host = strdup(DEFAULT_HOST);
+        ctx.port = strdup(DEFAULT_PORT);
+    }
+    else {
+        p = strchr(out_host, ':');
+        if (!p) {
+            ctx.host = strdup(out_host);
+            ctx.port = strdup(DEFAULT_PORT);
+        }
+        else {
+            ctx.host = strndup(out_host, p - out_host);
+            p++;
+            ctx.port = strdup(*p ? p : DEFAULT_PORT);
+        }
+    }
+
+    if (format) {
+        if (strcasecmp(format, "markdown") == 0) {
+            fmt_report = FLB_REPORT_MARKDOWN;
+        }
+        else if (strcasecmp(format, "text") == 0) {
+            fmt_report = FLB_REPORT_TXT;
+        }
+        else if (strcasecmp(format, "csv") == 0) {
+            fmt_report = FLB_REPORT_CSV;
+        }
+        else {
+            fprintf(stderr, "error: invalid format type");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    ret = run_http_writer(pid, report, fmt_report, data_file,
+                          uri ? uri : (ctx.format == HTTP_BODY_OTLP ?
+                                       DEFAULT_OTLP_URI : DEFAULT_URI),
+                          headers,
+                          concurrency, records, increase_by, seconds, batch,
+                          &ctx);
+
+    free(report);
+    free(format);
+    free(data_file);
+    free(out_host);
+    free(body);
+    free(compress);
+    free(uri);
+    free(headers);
+    free(ctx.host);
+    free(ctx.port);
+
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,769 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/* local headers */
+#include "flb_proc.h"
+#include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_network.h"
+#include "flb_protobuf.h"
+#include "flb_compress.h"
+#include "flb_http.h"
+#include "flb_prom.h"
+#include "flb_time.h"
+
+/* Default values */
+#define DEFAULT_RECORDS           1000  /* 1000 samples per second  */
+#define DEFAULT_INC_BY               0  /* no increase              */
+#define DEFAULT_SECONDS             10  /* test time: 10 seconds    */
+#define DEFAULT_SERIES            1000  /* distinct series          */
+#define DEFAULT_GROWTH               0  /* all series from the start */
+#define DEFAULT_BATCH              500  /* samples per request      */
+
+/* Default network host, ports and remote-write URI */
+#define DEFAULT_HOST       "127.0.0.1"
+#define DEFAULT_STATSD_PORT     "8125"
+#define DEFAULT_PROM_PORT       "8080"
+#define DEFAULT_PROM_URI        "/api/prom/push"
+
+/* Metric name prefix */
+#define METRIC_NAME      "flb_perf_metric"
+
+/* Safe StatsD datagram payload size and datagrams per sendmmsg(2) */
+#define STATSD_DGRAM_SIZE         1432
+#define STATSD_VLEN                 64
+
+#define METRICS_STATSD               0
+#define METRICS_PROM                 1
+
+struct metrics_ctx {
+    int type;
+    int fd;
+    char *host;
+    char *port;
+    char *uri;
+    int batch;
+
+    /* series */
+    int series;             /* max number of series         */
+    int growth;             /* new series per second        */
+    int active;             /* series active this round     */
+    uint32_t cursor;        /* next series to sample        */
+
+    /* StatsD datagrams */
+    int n_dgrams;
+    size_t dgram_len[STATSD_VLEN];
+    char dgrams[STATSD_VLEN][STATSD_DGRAM_SIZE];
+
+    /* remote-write */
+    struct flb_prom_sample *samples;
+    struct flb_pb_buf pb;
+    size_t rsize;
+    char *rbuf;
+    size_t round_logical;   /* bytes before snappy compression */
+
+    /* counters */
+    uint64_t sent;          /* datagrams or requests        */
+    uint64_t errors;
+    uint64_t non_2xx;
+    uint64_t round_non_2xx;
+    uint64_t reconnects;
+};
+
+static int flb_help(int rc)
+{
+    printf("Usage: flb-metrics-writer [OPTIONS]\n\n");
+    printf("Available options\n");
+    printf("  -t, --type=TYPE\t\tstatsd (default, UDP) or prometheus (remote-write)\n");
+    printf("  -p  --pid=FLB_PID\t\tFluent Bit PID used gather metrics\n");
+    printf("  -o, --output=HOST:PORT\tset remote Host and Port (default port: %s/%s)\n",
+           DEFAULT_STATSD_PORT, DEFAULT_PROM_PORT);
+    printf("  -u, --uri=URI\t\t\tremote-write URI (default: %s)\n",
+           DEFAULT_PROM_URI);
+    printf("  -n, --series=N\t\tnumber of distinct series (default: %i)\n",
+           DEFAULT_SERIES);
+    printf("  -g, --growth=N\t\tnew active series per second, 0 for all (default: %i)\n",
+           DEFAULT_GROWTH);
+    printf("  -b, --batch=N\t\t\tsamples per remote-write request (default: %i)\n",
+           DEFAULT_BATCH);
+    printf("  -i, --increase_by=N\t\tincrease N number of samples per second (default: %i)\n",
+           DEFAULT_INC_BY);
+    printf("  -r, --records=SAMPLES\t\tsamples per second (default: %i)\n",
+           DEFAULT_RECORDS);
+    printf("  -s, --seconds=SECONDS\t\ttotal test time meassured in seconds (default: %i)\n",
+           DEFAULT_SECONDS);
+    printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
+    printf("  -F, --format\t\t\treport format: text (default), markdown or csv\n");
+    printf("  -h, --help\t\t\tprint this help");
+    printf("\n\n");
+    flb_monitor_help();
+    exit(rc);
+}
+
+static uint32_t metrics_next_series(struct metrics_ctx *ctx)
+{
+    uint32_t id;
+
+    id = ctx->cursor % ctx->active;
+    ctx->cursor = id + 1;
+    return id;
+}
+
+/* Flush the pending StatsD datagrams with a single system call */
+static int statsd_flush(struct metrics_ctx *ctx, size_t *bytes)
+{
+    int i;
+    int ret;
+    int off = 0;
+    struct iovec iov[STATSD_VLEN];
+    struct mmsghdr msgs[STATSD_VLEN];
+
+    memset(msgs, 0, sizeof(struct mmsghdr) * ctx->n_dgrams);
+    for (i = 0; i < ctx->n_dgrams; i++) {
+        iov[i].iov_base = ctx->dgrams[i];
+        iov[i].iov_len = ctx->dgram_len[i];
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        *bytes += ctx->dgram_len[i];
+    }
+
+    while (off < ctx->n_dgrams) {
+        ret = sendmmsg(ctx->fd, msgs + off, ctx->n_dgrams - off, 0);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            /* nobody listening yet (ICMP unreachable), not fatal */
+            if (errno == ECONNREFUSED) {
+                ctx->errors++;
+                off++;
+                continue;
+            }
+            perror("sendmmsg");
+            ctx->n_dgrams = 0;
+            return -1;
+        }
+        off += ret;
+        ctx->sent += ret;
+    }
+
+    ctx->n_dgrams = 0;
+    return 0;
+}
+
+static int statsd_round(struct metrics_ctx *ctx, int n, size_t *bytes)
+{
+    int i;
+    int len;
+    int round;
+    uint32_t id;
+    char *p;
+    char line[128];
+    static char *types[] = { "c", "g", "ms" };
+
+    round = (int) time(NULL);
+    for (i = 0; i < n; i++) {
+        id = metrics_next_series(ctx);
+
+        /* counters, gauges and timers, the type is fixed per series */
+        len = snprintf(line, sizeof(line), "%s_%u:%u|%s",
+                       METRIC_NAME, id, (round + id) % 1000, types[id % 3]);
+
+        if (ctx->n_dgrams > 0 &&
+            ctx->dgram_len[ctx->n_dgrams - 1] + len + 1 <= STATSD_DGRAM_SIZE) {
+            /* append to the current datagram */
+            p = ctx->dgrams[ctx->n_dgrams - 1];
+            p[ctx->dgram_len[ctx->n_dgrams - 1]] = '\n';
+            memcpy(p + ctx->dgram_len[ctx->n_dgrams - 1] + 1, line, len);
+            ctx->dgram_len[ctx->n_dgrams - 1] += len + 1;
+            continue;
+        }
+
+        if (ctx->n_dgrams == STATSD_VLEN) {
+            if (statsd_flush(ctx, bytes) == -1) {
+                return -1;
+            }
+        }
+        memcpy(ctx->dgrams[ctx->n_dgrams], line, len);
+        ctx->dgram_len[ctx->n_dgrams] = len;
+        ctx->n_dgrams++;
+    }
+
+    if (ctx->n_dgrams > 0) {
+        return statsd_flush(ctx, bytes);
+    }
+    return 0;
+}
+
+static int send_all(int fd, char *buf, size_t len)
+{
+    ssize_t bytes;
+
+    while (len > 0) {
+        bytes = write(fd, buf, len);
+        if (bytes == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("write");
+            return -1;
+        }
+        buf += bytes;
+        len -= bytes;
+    }
+    return 0;
+}
+
+static int prom_reconnect(struct metrics_ctx *ctx)
+{
+    if (ctx->fd >= 0) {
+        close(ctx->fd);
+    }
+
+    ctx->reconnects++;
+    ctx->fd = flb_net_tcp_connect(ctx->host, ctx->port);
+    if (ctx->fd == -1) {
+        fprintf(stderr, "error: cannot reconnect to %s:%s\n",
+                ctx->host, ctx->port);
+        return -1;
+    }
+    return 0;
+}
+
+/* Wait for the response of the last request */
+static int prom_response(struct metrics_ctx *ctx)
+{
+    size_t len = 0;
+    ssize_t ret;
+    char *tmp;
+    struct flb_http_response res;
+
+    while (1) {
+        if (len == ctx->rsize) {
+            tmp = realloc(ctx->rbuf, ctx->rsize * 2);
+            if (!tmp) {
+                perror("realloc");
+                return -1;
+            }
+            ctx->rbuf = tmp;
+            ctx->rsize *= 2;
+        }
+
+        ret = read(ctx->fd, ctx->rbuf + len, ctx->rsize - len);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        else if (ret <= 0) {
+            return -1;
+        }
+        len += ret;
+
+        ret = flb_http_response_parse(ctx->rbuf, len, &res);
+        if (ret == -1) {
+            fprintf(stderr, "error: invalid HTTP response\n");
+            return -1;
+        }
+        else if (ret > 0) {
+            break;
+        }
+    }
+
+    if (res.status < 200 || res.status > 299) {
+        ctx->non_2xx++;
+        ctx->round_non_2xx++;
+    }
+
+    if (res.close) {
+        return prom_reconnect(ctx);
+    }
+    return 0;
+}
+
+static int prom_request(struct metrics_ctx *ctx, int n, size_t *bytes)
+{
+    int ret;
+    size_t len;
+    size_t wire_len;
+    void *wire;
+    char *req;
+
+    ctx->pb.len = 0;
+    if (flb_prom_write_request(&ctx->pb, METRIC_NAME, ctx->samples, n) == -1) {
+        fprintf(stderr, "error: cannot encode remote-write request\n");
+        return -1;
+    }
+
+    if (flb_compress(FLB_COMPRESS_SNAPPY, ctx->pb.data, ctx->pb.len,
+                     &wire, &wire_len) == -1) {
+        return -1;
+    }
+
+    req = flb_http_request_create("POST", ctx->host, ctx->port, ctx->uri,
+                                  "application/x-protobuf",
+                                  "Content-Encoding: snappy\r\n"
+                                  "X-Prometheus-Remote-Write-Version: 0.1.0\r\n",
+                                  wire, wire_len, &len);
+    free(wire);
+    if (!req) {
+        return -1;
+    }
+
+    ret = send_all(ctx->fd, req, len);
+    if (ret == 0) {
+        ret = prom_response(ctx);
+    }
+    free(req);
+
+    if (ret == -1) {
+        ctx->errors++;
+        return prom_reconnect(ctx);
+    }
+
+    ctx->sent++;
+    *bytes += len;
+    ctx->round_logical += len - wire_len + ctx->pb.len;
+    return 0;
+}
+
+static int prom_round(struct metrics_ctx *ctx, int n, size_t *bytes)
+{
+    int i;
+    int c = 0;
+    struct timespec now;
+    int64_t ts;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    ts = (int64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+
+    for (i = 0; i < n; i++) {
+        ctx->samples[c].series = metrics_next_series(ctx);
+        ctx->samples[c].value = (double) ((now.tv_sec + i) % 1000);
+        ctx->samples[c].timestamp = ts;
+        c++;
+
+        if (c == ctx->batch || i == n - 1) {
+            if (prom_request(ctx, c, bytes) == -1) {
+                return -1;
+            }
+            c = 0;
+        }
+    }
+
+    return 0;
+}
+
+static int run_metrics_writer(pid_t pid,
+                              char *report,
+                              int fmt_report,
+                              int records, int increase_by,
+                              int seconds,
+                              struct metrics_ctx *ctx)
+{
+    int i;
+    int n;
+    int ret = 0;
+    int wait_time = 3;
+    int col_series = -1;
+    int col_non2xx = -1;
+    int fd_out;
+    size_t round_bytes;
+    size_t total_records = 0;
+    struct flb_proc_task *t1 = NULL;
+    struct flb_proc_task *t2;
+    struct flb_report *r = NULL;
+    struct timespec round_start;
+
+    /* Report file for process monitoring */
+    if (pid >= 0) {
+        r = flb_report_create(report, fmt_report, pid, wait_time);
+        if (!r) {
+            fprintf(stderr, "error: cannot initialize report");
+            return -1;
+        }
+
+        /* memory must be read against the number of active series */
+        col_series = flb_report_column_add(r, "series", 8, 0);
+        if (ctx->type == METRICS_PROM) {
+            col_non2xx = flb_report_column_add(r, "non2xx", 7, 0);
+            flb_report_logical_enable(r);
+            flb_report_sockets_enable(r);
+        }
+    }
+
+    if (ctx->type == METRICS_STATSD) {
+        ctx->fd = flb_net_udp_connect(ctx->host, ctx->port);
+    }
+    else {
+        ctx->fd = flb_net_tcp_connect(ctx->host, ctx->port);
+        ctx->samples = malloc(sizeof(struct flb_prom_sample) * ctx->batch);
+        ctx->rsize = 4096;
+        ctx->rbuf = malloc(ctx->rsize);
+        if (!ctx->samples || !ctx->rbuf ||
+            flb_pb_buf_init(&ctx->pb, ctx->batch * 64) == -1) {
+            perror("malloc");
+            ret = -1;
+        }
+    }
+
+    if (ctx->fd == -1 || ret == -1) {
+        fprintf(stderr, "error: cannot connect to %s:%s\n",
+                ctx->host, ctx->port);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    for (i = 0; i < seconds; i++) {
+        round_bytes = 0;
+        ctx->round_non_2xx = 0;
+        ctx->round_logical = 0;
+
+        if (pid >= 0 && !t1) {
+            t1 = flb_proc_stat_create(pid);
+            if (!t1) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+            }
+        }
+
+        /* series become active progressively when growth is set */
+        ctx->active = ctx->series;
+        if (ctx->growth > 0 && ctx->growth * (i + 1) < ctx->series) {
+            ctx->active = ctx->growth * (i + 1);
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &round_start);
+
+        n = records + (increase_by * i);
+        if (ctx->type == METRICS_STATSD) {
+            ret = statsd_round(ctx, n, &round_bytes);
+        }
+        else {
+            ret = prom_round(ctx, n, &round_bytes);
+        }
+        if (ret == -1) {
+            fprintf(stderr, "error: exception on writing samples\n");
+            break;
+        }
+        total_records += n;
+
+        /* Wait for the rest of the second */
+        flb_time_sleep_until(&round_start, 1000);
+
+        /* Get stats */
+        if (pid >= 0 && t1) {
+            t2 = flb_proc_stat_create(pid);
+            if (!t2) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+                continue;
+            }
+            flb_report_column_set(r, col_series, ctx->active);
+            if (col_non2xx >= 0) {
+                flb_report_column_set(r, col_non2xx, ctx->round_non_2xx);
+                flb_report_logical_set(r, ctx->round_logical);
+            }
+            flb_report_stats(r, n, round_bytes, t1, t2);
+            flb_proc_stat_destroy(t1);
+            t1 = t2;
+        }
+    }
+
+    if (t1) {
+        flb_proc_stat_destroy(t1);
+    }
+
+    /*
+     * Create continuos snapshots until resources consumption (CPU) stabilize,
+     * we assume that after three seconds without deltas in user time the
+     * process finished processing our samples.
+     */
+    if (pid >= 0) {
+        int count = 0;
+
+        while (1) {
+            t1 = flb_proc_stat_create(pid);
+            sleep(1);
+            t2 = flb_proc_stat_create(pid);
+            if (!t1 || !t2) {
+                break;
+            }
+            flb_report_column_set(r, col_series, ctx->active);
+            flb_report_stats(r, 0, 0, t1, t2);
+
+            if ((t2->r_utime_ms - t1->r_utime_ms) == 0) {
+                count++;
+            }
+            else {
+                count = 0;
+            }
+
+            flb_proc_stat_destroy(t1);
+            flb_proc_stat_destroy(t2);
+
+            if (count >= wait_time) {
+                break;
+            }
+        }
+        r->sum_records = total_records;
+        flb_report_summary(r);
+    }
+
+    fd_out = r ? r->fd : STDOUT_FILENO;
+    dprintf(fd_out,
+            "- Metrics (%s)\n"
+            "  - Series      : %i active, %i max\n"
+            "  - %-12s: %lu\n"
+            "  - Errors      : %lu\n",
+            ctx->type == METRICS_STATSD ? "statsd" : "prometheus",
+            ctx->active, ctx->series,
+            ctx->type == METRICS_STATSD ? "Datagrams" : "Requests",
+            ctx->sent, ctx->errors);
+    if (ctx->type == METRICS_PROM) {
+        dprintf(fd_out,
+                "  - Non-2xx     : %lu\n"
+                "  - Reconnects  : %lu\n",
+                ctx->non_2xx, ctx->reconnects);
+    }
+
+    if (r) {
+        flb_report_destroy(r);
+    }
+
+    if (ctx->fd >= 0) {
+        close(ctx->fd);
+    }
+    if (ctx->type == METRICS_PROM) {
+        flb_pb_buf_destroy(&ctx->pb);
+        free(ctx->samples);
+        free(ctx->rbuf);
+    }
+
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int opt;
+    int records = DEFAULT_RECORDS;
+    int seconds = DEFAULT_SECONDS;
+    int increase_by = DEFAULT_INC_BY;
+    int pid = -1;
+    int fmt_report = FLB_REPORT_TXT;
+    char *format = NULL;
+    char *report = NULL;
+    char *out_host = NULL;
+    char *type = NULL;
+    char *uri = NULL;
+    char *p;
+    struct metrics_ctx *ctx;
+
+    /* Setup long-options */
+    static const struct option long_opts[] = {
+        { "type"       ,   required_argument, NULL, 't' },
+        { "pid"        ,   required_argument, NULL, 'p' },
+        { "output"     ,   required_argument, NULL, 'o' },
+        { "uri"        ,   required_argument, NULL, 'u' },
+        { "series"     ,   required_argument, NULL, 'n' },
+        { "growth"     ,   required_argument, NULL, 'g' },
+        { "batch"      ,   required_argument, NULL, 'b' },
+        { "records"    ,   required_argument, NULL, 'r' },
+        { "increase_by",   required_argument, NULL, 'i' },
+        { "seconds"    ,   required_argument, NULL, 's' },
+        { "report"     ,   required_argument, NULL, 'R' },
+        { "format"     ,   required_argument, NULL, 'F' },
+        { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
+    };
+
+    /* the datagram buffers make the context too big for the stack */
+    ctx = calloc(1, sizeof(struct metrics_ctx));
+    if (!ctx) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+    ctx->fd = -1;
+    ctx->type = METRICS_STATSD;
+    ctx->series = DEFAULT_SERIES;
+    ctx->growth = DEFAULT_GROWTH;
+    ctx->batch = DEFAULT_BATCH;
+
+    while ((opt = getopt_long(argc, argv,
+                              "t:p:o:u:n:g:b:r:i:s:R:F:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 't':
+            type = strdup(optarg);
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'o':
+            out_host = strdup(optarg);
+            break;
+        case 'u':
+            uri = strdup(optarg);
+            break;
+        case 'n':
+            ctx->series = atoi(optarg);
+            break;
+        case 'g':
+            ctx->growth = atoi(optarg);
+            break;
+        case 'b':
+            ctx->batch = atoi(optarg);
+            break;
+        case 'r':
+            records = atoi(optarg);
+            break;
+        case 'i':
+            increase_by = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'R':
+            report = strdup(optarg);
+            break;
+        case 'F':
+            format = strdup(optarg);
+            break;
+        case 'h':
+            flb_help(EXIT_SUCCESS);
+            break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
+        };
+    };
+
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    if (records < 1) {
+        fprintf(stderr, "error: invalid number of samples '%i'\n", records);
+        exit(EXIT_FAILURE);
+    }
+
+    if (seconds < 1) {
+        fprintf(stderr, "error: invalid number of seconds '%i'\n", seconds);
+        exit(EXIT_FAILURE);
+    }
+
+    if (ctx->series < 1 || ctx->growth < 0) {
+        fprintf(stderr, "error: invalid series configuration\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (ctx->batch < 1) {
+        fprintf(stderr, "error: invalid batch size '%i'\n", ctx->batch);
+        exit(EXIT_FAILURE);
+    }
+
+    if (type) {
+        if (strcasecmp(type, "statsd") == 0) {
+            ctx->type = METRICS_STATSD;
+        }
+        else if (strcasecmp(type, "prometheus") == 0) {
+            ctx->type = METRICS_PROM;
+        }
+        else {
+            fprintf(stderr, "error: invalid metrics type '%s'\n", type);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!out_host) {
+        ctx->host = strdup(DEFAULT_HOST);
+        ctx->port = NULL;
+    }
+    else {
+        p = strchr(out_host, ':');
+        if (!p) {
+            ctx->host = strdup(out_host);
+        }
+        else {
+            ctx->host = strndup(out_host, p - out_host);
+            p++;
+            if (*p) {
+                ctx->port = strdup(p);
+            }
+        }
+    }
+    if (!ctx->port) {
+        ctx->port = strdup(ctx->type == METRICS_STATSD ?
+                           DEFAULT_STATSD_PORT : DEFAULT_PROM_PORT);
+    }
+    ctx->uri = uri ? uri : DEFAULT_PROM_URI;
+
+    if (format) {
+        if (strcasecmp(format, "markdown") == 0) {
+            fmt_report = FLB_REPORT_MARKDOWN;
+        }
+        else if (strcasecmp(format, "text") == 0) {
+            fmt_report = FLB_REPORT_TXT;
+        }
+        else if (strcasecmp(format, "csv") == 0) {
+            fmt_report = FLB_REPORT_CSV;
+        }
+        else {
+            fprintf(stderr, "error: invalid format type");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    ret = run_metrics_writer(pid, report, fmt_report,
+                             records, increase_by, seconds, ctx);
+
+    free(report);
+    free(format);
+    free(out_host);
+    free(type);
+    free(uri);
+    free(ctx->host);
+    free(ctx->port);
+    free(ctx);
+
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
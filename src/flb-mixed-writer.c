@@ -0,0 +1,878 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/* local headers */
+#include "mk_list.h"
+#include "flb_data_file.h"
+#include "flb_proc.h"
+#include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_network.h"
+#include "flb_http.h"
+#include "flb_histogram.h"
+#include "flb_time.h"
+
+/* Default values */
+#define DEFAULT_RECORDS           1000  /* 1000 records per second */
+#define DEFAULT_INC_BY               0  /* no increase             */
+#define DEFAULT_SECONDS             10  /* test time: 10 seconds   */
+#define DEFAULT_BATCH              100  /* records per HTTP request */
+
+/* The main thread reads the counters right before the sources wake up */
+#define MIX_SAMPLE_ADVANCE_MS        5
+
+/* Default network hosts and ports */
+#define DEFAULT_HOST       "127.0.0.1"
+#define DEFAULT_TCP_PORT        "5170"
+#define DEFAULT_HTTP_PORT       "9880"
+#define DEFAULT_URI                "/"
+
+#define MIX_SOURCE_TAIL              0
+#define MIX_SOURCE_TCP               1
+#define MIX_SOURCE_HTTP              2
+
+static char *mix_source_types[] = { "tail", "tcp", "http" };
+
+/* Shared in-memory records */
+struct mix_ctx {
+    char *buf;
+    size_t size;
+    int n_records;
+    size_t *offsets;
+    int seconds;
+    struct timespec start;
+};
+
+/* A load source running in its own thread */
+struct mix_source {
+    int id;
+    int type;
+    char name[16];
+    char *target;           /* path or HOST:PORT            */
+    char *host;
+    char *port;
+    char *uri;
+    int records;
+    int increase_by;
+    int batch;
+
+    /* runtime */
+    int fd;
+    int cursor;
+    int iov_size;
+    struct iovec *iov;
+    size_t rsize;
+    char *rbuf;
+    pthread_t tid;
+    struct mix_ctx *ctx;
+    struct flb_histogram *hist;
+
+    /* round counters, read and reset by the main thread */
+    uint64_t round_records;
+    uint64_t round_bytes;
+
+    /* totals */
+    uint64_t total_records;
+    uint64_t total_bytes;
+    uint64_t errors;
+    uint64_t non_2xx;
+
+    int col;                /* report column */
+    struct mk_list _head;
+};
+
+static int flb_help(int rc)
+{
+    printf("Usage: flb-mixed-writer [OPTIONS]\n\n");
+    printf("Available options\n");
+    printf("  -d, --datafile=PATH\t\tspecify source data file (JSON lines)\n");
+    printf("  -p  --pid=FLB_PID\t\tFluent Bit PID used gather metrics\n");
+    printf("  -S, --source=SPEC\t\tadd a load source, can be used many times\n");
+    printf("  -s, --seconds=SECONDS\t\ttotal test time meassured in seconds (default: %i)\n",
+           DEFAULT_SECONDS);
+    printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
+    printf("  -F, --format\t\t\treport format: text (default), markdown or csv\n");
+    printf("  -h, --help\t\t\tprint this help");
+    printf("\n\n");
+    flb_monitor_help();
+    printf("Source specification: TYPE:TARGET[,key=value...]\n\n");
+    printf("  tail:PATH\t\t\tappend records to a file\n");
+    printf("  tcp:HOST:PORT\t\t\twrite records over a TCP connection\n");
+    printf("  http:HOST:PORT\t\tpost NDJSON requests over a keep-alive connection\n\n");
+    printf("  keys: records=N (default: %i), increase_by=N, batch=N (http, default: %i), uri=URI (http)\n\n",
+           DEFAULT_RECORDS, DEFAULT_BATCH);
+    printf("  e.g: -S tail:/tmp/perf.log,records=5000 -S http:127.0.0.1:9880,batch=500");
+    printf("\n\n");
+    exit(rc);
+}
+
+static void mix_source_destroy(struct mix_source *src)
+{
+    if (src->fd >= 0) {
+        close(src->fd);
+    }
+    if (src->hist) {
+        flb_histogram_destroy(src->hist);
+    }
+    free(src->target);
+    free(src->host);
+    free(src->port);
+    free(src->uri);
+    free(src->iov);
+    free(src->rbuf);
+    free(src);
+}
+
+/* Parse 'TYPE:TARGET[,key=value...]' */
+static struct mix_source *mix_source_create(char *spec, int id)
+{
+    char *p;
+    char *tmp;
+    char *key;
+    char *val;
+    char *save;
+    struct mix_source *src;
+
+    src = calloc(1, sizeof(struct mix_source));
+    if (!src) {
+        perror("calloc");
+        return NULL;
+    }
+    src->id = id;
+    src->fd = -1;
+    src->records = DEFAULT_RECORDS;
+    src->increase_by = DEFAULT_INC_BY;
+    src->batch = DEFAULT_BATCH;
+
+    tmp = strdup(spec);
+    p = strchr(tmp, ':');
+    if (!p) {
+        fprintf(stderr, "error: invalid source '%s'\n", spec);
+        free(tmp);
+        mix_source_destroy(src);
+        return NULL;
+    }
+    *p++ = '\0';
+
+    if (strcasecmp(tmp, "tail") == 0) {
+        src->type = MIX_SOURCE_TAIL;
+    }
+    else if (strcasecmp(tmp, "tcp") == 0) {
+        src->type = MIX_SOURCE_TCP;
+    }
+    else if (strcasecmp(tmp, "http") == 0) {
+        src->type = MIX_SOURCE_HTTP;
+    }
+    else {
+        fprintf(stderr, "error: invalid source type '%s'\n", tmp);
+        free(tmp);
+        mix_source_destroy(src);
+        return NULL;
+    }
+
+    /* target, then the optional properties */
+    key = strtok_r(p, ",", &save);
+    src->target = strdup(key ? key : "");
+    while ((key = strtok_r(NULL, ",", &save))) {
+        val = strchr(key, '=');
+        if (!val) {
+            fprintf(stderr, "error: invalid source property '%s'\n", key);
+            free(tmp);
+            mix_source_destroy(src);
+            return NULL;
+        }
+        *val++ = '\0';
+
+        if (strcasecmp(key, "records") == 0) {
+            src->records = atoi(val);
+        }
+        else if (strcasecmp(key, "increase_by") == 0) {
+            src->increase_by = atoi(val);
+        }
+        else if (strcasecmp(key, "batch") == 0) {
+            src->batch = atoi(val);
+        }
+        else if (strcasecmp(key, "uri") == 0) {
+            src->uri = strdup(val);
+        }
+        else {
+            fprintf(stderr, "error: unknown source property '%s'\n", key);
+            free(tmp);
+            mix_source_destroy(src);
+            return NULL;
+        }
+    }
+    free(tmp);
+
+    if (src->records < 1 || src->batch < 1 || src->target[0] == '\0') {
+        fprintf(stderr, "error: invalid source '%s'\n", spec);
+        mix_source_destroy(src);
+        return NULL;
+    }
+
+    if (src->type != MIX_SOURCE_TAIL) {
+        p = strrchr(src->target, ':');
+        if (p) {
+            src->host = strndup(src->target, p - src->target);
+            src->port = strdup(p + 1);
+        }
+        else {
+            src->host = strdup(src->target);
+            src->port = strdup(src->type == MIX_SOURCE_TCP ?
+                               DEFAULT_TCP_PORT : DEFAULT_HTTP_PORT);
+        }
+    }
+    if (src->type == MIX_SOURCE_HTTP && !src->uri) {
+        src->uri = strdup(DEFAULT_URI);
+    }
+
+    snprintf(src->name, sizeof(src->name), "%s%i",
+             mix_source_types[src->type], id);
+
+    src->iov_size = 16;
+    src->iov = malloc(sizeof(struct iovec) * src->iov_size);
+    if (!src->iov) {
+        perror("malloc");
+        mix_source_destroy(src);
+        return NULL;
+    }
+
+    return src;
+}
+
+static int mix_source_open(struct mix_source *src)
+{
+    if (src->type == MIX_SOURCE_TAIL) {
+        src->fd = open(src->target, O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (src->fd == -1) {
+            perror("open");
+            fprintf(stderr, "error: cannot open '%s'\n", src->target);
+            return -1;
+        }
+        return 0;
+    }
+
+    src->fd = flb_net_tcp_connect(src->host, src->port);
+    if (src->fd == -1) {
+        fprintf(stderr, "error: source %s cannot connect to %s:%s\n",
+                src->name, src->host, src->port);
+        return -1;
+    }
+
+    if (src->type == MIX_SOURCE_HTTP) {
+        src->rsize = 4096;
+        src->rbuf = malloc(src->rsize);
+        src->hist = flb_histogram_create();
+        if (!src->rbuf || !src->hist) {
+            perror("malloc");
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Map the next 'n' records of the shared ring into the source iovec array,
+ * the first slot is left free for a protocol header. Returns the number of
+ * entries used and the payload length in 'len'.
+ */
+static int mix_records_iov(struct mix_source *src, int n, size_t *len)
+{
+    int c = 1;
+    int take;
+    struct iovec *tmp;
+    struct mix_ctx *ctx = src->ctx;
+
+    *len = 0;
+    while (n > 0) {
+        if (c == src->iov_size) {
+            tmp = realloc(src->iov, sizeof(struct iovec) * src->iov_size * 2);
+            if (!tmp) {
+                perror("realloc");
+                return -1;
+            }
+            src->iov = tmp;
+            src->iov_size *= 2;
+        }
+
+        take = ctx->n_records - src->cursor;
+        if (take > n) {
+            take = n;
+        }
+
+        src->iov[c].iov_base = ctx->buf + ctx->offsets[src->cursor];
+        src->iov[c].iov_len = ctx->offsets[src->cursor + take] -
+            ctx->offsets[src->cursor];
+        *len += src->iov[c].iov_len;
+        c++;
+
+        n -= take;
+        src->cursor = (src->cursor + take) % ctx->n_records;
+    }
+
+    return c;
+}
+
+static int writev_all(int fd, struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+
+    while (iovcnt > 0) {
+        ret = writev(fd, iov, iovcnt > IOV_MAX ? IOV_MAX : iovcnt);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("writev");
+            return -1;
+        }
+
+        while (iovcnt > 0 && ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (char *) iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+    return 0;
+}
+
+/* Wait for the response of the last request */
+static int mix_http_response(struct mix_source *src)
+{
+    size_t len = 0;
+    ssize_t ret;
+    char *tmp;
+    struct flb_http_response res;
+
+    while (1) {
+        if (len == src->rsize) {
+            tmp = realloc(src->rbuf, src->rsize * 2);
+            if (!tmp) {
+                perror("realloc");
+                return -1;
+            }
+            src->rbuf = tmp;
+            src->rsize *= 2;
+        }
+
+        ret = read(src->fd, src->rbuf + len, src->rsize - len);
+        if (ret == -1 && errno == EINTR) {
+            continue;
+        }
+        else if (ret <= 0) {
+            return -1;
+        }
+        len += ret;
+
+        ret = flb_http_response_parse(src->rbuf, len, &res);
+        if (ret == -1) {
+            fprintf(stderr, "error: invalid HTTP response\n");
+            return -1;
+        }
+        else if (ret > 0) {
+            break;
+        }
+    }
+
+    if (res.status < 200 || res.status > 299) {
+        src->non_2xx++;
+    }
+    return res.close ? 1 : 0;
+}
+
+/* Send 'n' records through the source, returns the bytes written */
+static ssize_t mix_source_send(struct mix_source *src, int n)
+{
+    int c;
+    int ret;
+    size_t len;
+    size_t hlen;
+    char header[1024];
+    struct timespec t1;
+    struct timespec t2;
+
+    c = mix_records_iov(src, n, &len);
+    if (c == -1) {
+        return -1;
+    }
+
+    if (src->type != MIX_SOURCE_HTTP) {
+        if (writev_all(src->fd, src->iov + 1, c - 1) == -1) {
+            return -1;
+        }
+        return len;
+    }
+
+    /* records already end with a new line: the body is plain NDJSON */
+    hlen = snprintf(header, sizeof(header),
+                    "POST %s HTTP/1.1\r\n"
+                    "Host: %s:%s\r\n"
+                    "User-Agent: fluent-bit-perf\r\n"
+                    "Connection: keep-alive\r\n"
+                    "Content-Type: application/x-ndjson\r\n"
+                    "Content-Length: %zu\r\n"
+                    "\r\n",
+                    src->uri, src->host, src->port, len);
+    src->iov[0].iov_base = header;
+    src->iov[0].iov_len = hlen;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    ret = writev_all(src->fd, src->iov, c);
+    if (ret == 0) {
+        ret = mix_http_response(src);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    if (ret != 0) {
+        /* error or 'Connection: close', start a new connection */
+        close(src->fd);
+        src->fd = flb_net_tcp_connect(src->host, src->port);
+        if (ret == -1 || src->fd == -1) {
+            return -1;
+        }
+    }
+
+    flb_histogram_record(src->hist, flb_time_diff_us(&t1, &t2));
+    return hlen + len;
+}
+
+static void *mix_source_worker(void *data)
+{
+    int i;
+    int n;
+    int left;
+    ssize_t bytes;
+    struct mix_source *src = data;
+    struct mix_ctx *ctx = src->ctx;
+
+    for (i = 0; i < ctx->seconds; i++) {
+        n = src->records + (src->increase_by * i);
+
+        /* HTTP sources split the round in requests of 'batch' records */
+        left = n;
+        while (left > 0) {
+            /* a failed reconnect is retried once per round */
+            if (src->fd == -1) {
+                src->fd = flb_net_tcp_connect(src->host, src->port);
+                if (src->fd == -1) {
+                    fprintf(stderr, "error: source %s cannot reconnect to "
+                            "%s:%s, round %i skipped\n",
+                            src->name, src->host, src->port, i + 1);
+                    src->errors++;
+                    break;
+                }
+            }
+
+            n = left;
+            if (src->type == MIX_SOURCE_HTTP && n > src->batch) {
+                n = src->batch;
+            }
+            left -= n;
+
+            bytes = mix_source_send(src, n);
+            if (bytes == -1) {
+                src->errors++;
+                continue;
+            }
+
+            __atomic_add_fetch(&src->round_records, n, __ATOMIC_RELAXED);
+            __atomic_add_fetch(&src->round_bytes, bytes, __ATOMIC_RELAXED);
+            src->total_records += n;
+            src->total_bytes += bytes;
+        }
+
+        /* every source starts its rounds on the same second boundary */
+        flb_time_sleep_until(&ctx->start, (i + 1) * 1000);
+    }
+
+    return NULL;
+}
+
+static void mix_summary(struct mk_list *sources, int fd)
+{
+    char *tmp;
+    char title[128];
+    struct mk_list *head;
+    struct mix_source *src;
+
+    dprintf(fd, "\n- Sources\n");
+    mk_list_foreach(head, sources) {
+        src = mk_list_entry(head, struct mix_source, _head);
+        tmp = flb_report_human_readable_size(src->total_bytes);
+        dprintf(fd, "  - %-10s: %s %s, %lu records, %s, %lu errors",
+                src->name, mix_source_types[src->type], src->target,
+                src->total_records, tmp, src->errors);
+        free(tmp);
+        if (src->type == MIX_SOURCE_HTTP) {
+            dprintf(fd, ", %lu non-2xx", src->non_2xx);
+        }
+        dprintf(fd, "\n");
+    }
+
+    mk_list_foreach(head, sources) {
+        src = mk_list_entry(head, struct mix_source, _head);
+        if (src->hist) {
+            snprintf(title, sizeof(title), "HTTP Responses (%s)", src->name);
+            flb_histogram_print(src->hist, fd, title);
+        }
+    }
+}
+
+static int run_mixed_writer(pid_t pid,
+                            char *report,
+                            int fmt_report,
+                            char *in_data_file,
+                            int seconds,
+                            struct mk_list *sources)
+{
+    int i;
+    int ret = 0;
+    int in_fd;
+    int wait_time = 3;
+    int net_sources = 0;
+    int round_records;
+    uint64_t n;
+    size_t round_bytes;
+    size_t total_records = 0;
+    char *data_buf;
+    size_t data_size;
+    struct mix_ctx ctx;
+    struct flb_proc_task *t1 = NULL;
+    struct flb_proc_task *t2;
+    struct flb_report *r = NULL;
+    struct mk_list *head;
+    struct mix_source *src;
+
+    /* Report file for process monitoring */
+    if (pid >= 0) {
+        r = flb_report_create(report, fmt_report, pid, wait_time);
+        if (!r) {
+            fprintf(stderr, "error: cannot initialize report");
+            return -1;
+        }
+
+        /* records of every source per round */
+        mk_list_foreach(head, sources) {
+            src = mk_list_entry(head, struct mix_source, _head);
+            src->col = flb_report_column_add(r, src->name, 8, 0);
+            if (src->type != MIX_SOURCE_TAIL) {
+                net_sources++;
+            }
+        }
+
+        /* network sources: the socket columns, if there is room for them */
+        if (net_sources > 0 && r->n_cols + 6 <= FLB_REPORT_MAX_COLS) {
+            flb_report_sockets_enable(r);
+        }
+    }
+
+    /* Load input data file, shared by all the sources */
+    in_fd = flb_data_file_load(in_data_file, &data_buf, &data_size);
+    if (in_fd == -1) {
+        fprintf(stderr, "error: cannot load input data file '%s'\n",
+                in_data_file);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.buf = data_buf;
+    ctx.size = data_size;
+    ctx.seconds = seconds;
+    ctx.n_records = flb_data_file_index(data_buf, data_size, &ctx.offsets);
+    if (ctx.n_records == -1) {
+        flb_data_file_unload(data_buf, data_size);
+        close(in_fd);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    mk_list_foreach(head, sources) {
+        src = mk_list_entry(head, struct mix_source, _head);
+        src->ctx = &ctx;
+        src->cursor = (src->id * 997) % ctx.n_records;
+        if (mix_source_open(src) == -1) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (ret == -1) {
+        free(ctx.offsets);
+        flb_data_file_unload(data_buf, data_size);
+        close(in_fd);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    if (pid >= 0) {
+        t1 = flb_proc_stat_create(pid);
+        if (!t1) {
+            fprintf(stderr, "error gathering stats for PID %i\n", (int) pid);
+        }
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &ctx.start);
+    mk_list_foreach(head, sources) {
+        src = mk_list_entry(head, struct mix_source, _head);
+        ret = pthread_create(&src->tid, NULL, mix_source_worker, src);
+        if (ret != 0) {
+            fprintf(stderr, "error: cannot start source %s\n", src->name);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* One shared row per second with the breakdown of every source */
+    for (i = 0; i < seconds; i++) {
+        flb_time_sleep_until(&ctx.start,
+                             (i + 1) * 1000 - MIX_SAMPLE_ADVANCE_MS);
+
+        round_records = 0;
+        round_bytes = 0;
+        mk_list_foreach(head, sources) {
+            src = mk_list_entry(head, struct mix_source, _head);
+            n = __atomic_exchange_n(&src->round_records, 0, __ATOMIC_RELAXED);
+            round_records += n;
+            round_bytes += __atomic_exchange_n(&src->round_bytes, 0,
+                                               __ATOMIC_RELAXED);
+            if (r) {
+                flb_report_column_set(r, src->col, n);
+            }
+        }
+        total_records += round_records;
+
+        if (pid >= 0 && t1) {
+            t2 = flb_proc_stat_create(pid);
+            if (!t2) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+                continue;
+            }
+            flb_report_stats(r, round_records, round_bytes, t1, t2);
+            flb_proc_stat_destroy(t1);
+            t1 = t2;
+        }
+    }
+
+    mk_list_foreach(head, sources) {
+        src = mk_list_entry(head, struct mix_source, _head);
+        pthread_join(src->tid, NULL);
+    }
+
+    if (t1) {
+        flb_proc_stat_destroy(t1);
+    }
+
+    /*
+     * Create continuos snapshots until resources consumption (CPU) stabilize,
+     * we assume that after three seconds without deltas in user time the
+     * process finished processing our records.
+     */
+    if (pid >= 0) {
+        int count = 0;
+
+        while (1) {
+            t1 = flb_proc_stat_create(pid);
+            sleep(1);
+            t2 = flb_proc_stat_create(pid);
+            if (!t1 || !t2) {
+                break;
+            }
+            flb_report_stats(r, 0, 0, t1, t2);
+
+            if ((t2->r_utime_ms - t1->r_utime_ms) == 0) {
+                count++;
+            }
+            else {
+                count = 0;
+            }
+
+            flb_proc_stat_destroy(t1);
+            flb_proc_stat_destroy(t2);
+
+            if (count >= wait_time) {
+                break;
+            }
+        }
+        r->sum_records = total_records;
+        flb_report_summary(r);
+    }
+
+    mix_summary(sources, r ? r->fd : STDOUT_FILENO);
+
+    if (r) {
+        flb_report_destroy(r);
+    }
+
+    free(ctx.offsets);
+    flb_data_file_unload(data_buf, data_size);
+    close(in_fd);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int opt;
+    int n_sources = 0;
+    int seconds = DEFAULT_SECONDS;
+    int pid = -1;
+    int fmt_report = FLB_REPORT_TXT;
+    char *format = NULL;
+    char *report = NULL;
+    char *data_file = NULL;
+    struct mk_list sources;
+    struct mk_list *tmp;
+    struct mk_list *head;
+    struct mix_source *src;
+
+    /* Setup long-options */
+    static const struct option long_opts[] = {
+        { "datafile"   ,   required_argument, NULL, 'd' },
+        { "pid"        ,   required_argument, NULL, 'p' },
+        { "source"     ,   required_argument, NULL, 'S' },
+        { "seconds"    ,   required_argument, NULL, 's' },
+        { "report"     ,   required_argument, NULL, 'R' },
+        { "format"     ,   required_argument, NULL, 'F' },
+        { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
+    };
+
+    mk_list_init(&sources);
+
+    while ((opt = getopt_long(argc, argv, "d:p:S:s:R:F:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd':
+            data_file = strdup(optarg);
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'S':
+            src = mix_source_create(optarg, n_sources);
+            if (!src) {
+                exit(EXIT_FAILURE);
+            }
+            mk_list_add(&src->_head, &sources);
+            n_sources++;
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'R':
+            report = strdup(optarg);
+            break;
+        case 'F':
+            format = strdup(optarg);
+            break;
+        case 'h':
+            flb_help(EXIT_SUCCESS);
+            break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
+        };
+    };
+
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    if (!data_file) {
+        fprintf(stderr, "error: no data file specified\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (n_sources == 0) {
+        fprintf(stderr, "error: no sources specified\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (seconds < 1) {
+        fprintf(stderr, "error: invalid number of seconds '%i'\n", seconds);
+        exit(EXIT_FAILURE);
+    }
+
+    if (format) {
+        if (strcasecmp(format, "markdown") == 0) {
+            fmt_report = FLB_REPORT_MARKDOWN;
+        }
+        else if (strcasecmp(format, "text") == 0) {
+            fmt_report = FLB_REPORT_TXT;
+        }
+        else if (strcasecmp(format, "csv") == 0) {
+            fmt_report = FLB_REPORT_CSV;
+        }
+        else {
+            fprintf(stderr, "error: invalid format type");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    ret = run_mixed_writer(pid, report, fmt_report, data_file,
+                           seconds, &sources);
+
+    mk_list_foreach_safe(head, tmp, &sources) {
+        src = mk_list_entry(head, struct mix_source, _head);
+        mk_list_del(&src->_head);
+        mix_source_destroy(src);
+    }
+
+    free(report);
+    free(format);
+    free(data_file);
+
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,729 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+/* local headers */
+#include "flb_data_file.h"
+#include "flb_proc.h"
+#include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_time.h"
+
+/* Default values */
+#define DEFAULT_RECORDS           1000  /* 1000 records per second */
+#define DEFAULT_INC_BY               0  /* no increase             */
+#define DEFAULT_SECONDS             10  /* test time: 10 seconds   */
+
+/* Pipe write modes */
+#define PIPE_VMSPLICE                0  /* map pages into the pipe */
+#define PIPE_WRITE                   1  /* regular write(2)        */
+
+struct pipe_ctx {
+    int fd;                 /* write end of the pipe or FIFO  */
+    int mode;
+    int pipe_size;          /* effective pipe capacity        */
+    pid_t child;            /* spawned process or -1          */
+
+    /* records ring */
+    char *buf;
+    int n_records;
+    int cursor;
+    size_t *offsets;
+    int iov_size;
+    struct iovec *iov;
+
+    /* time blocked because the pipe was full */
+    uint64_t round_stall_us;
+    uint64_t stall_us;
+    uint64_t stalls;
+};
+
+static int flb_help(int rc)
+{
+    printf("Usage: flb-pipe-writer [OPTIONS]\n\n");
+    printf("Available options\n");
+    printf("  -d, --datafile=PATH\t\tspecify source data file\n");
+    printf("  -p  --pid=FLB_PID\t\tFluent Bit PID used gather metrics (default: spawned command)\n");
+    printf("  -x, --exec='COMMAND'\t\tspawn COMMAND and write to its stdin, stopped\n"
+           "\t\t\t\twith SIGTERM 5 seconds after the EOF\n");
+    printf("  -f, --fifo=PATH\t\twrite to a named FIFO, created if missing\n");
+    printf("  -P, --pipe-size=BYTES\t\tset the pipe capacity with F_SETPIPE_SZ\n");
+    printf("  -m, --mode=MODE\t\twrite mode: vmsplice (default) or write\n");
+    printf("  -i, --increase_by=N\t\tincrease N number of records per second (default: %i)\n",
+           DEFAULT_INC_BY);
+    printf("  -r, --records=RECORDS\t\trecords per second (default: %i)\n",
+           DEFAULT_RECORDS);
+    printf("  -s, --seconds=SECONDS\t\ttotal test time meassured in seconds (default: %i)\n",
+           DEFAULT_SECONDS);
+    printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
+    printf("  -F, --format\t\t\treport format: text (default), markdown or csv\n");
+    printf("  -h, --help\t\t\tprint this help");
+    printf("\n\n");
+    flb_monitor_help();
+    exit(rc);
+}
+
+/*
+ * Spawn the command with a pipe attached to its stdin. Simple commands are
+ * executed directly, the ones using shell syntax go through the shell with
+ * 'exec' so the command replaces it and its PID can be monitored.
+ */
+static int pipe_spawn(struct pipe_ctx *ctx, char *cmd)
+{
+    int n = 0;
+    int err = 0;
+    int fds[2];
+    int sync[2];
+    pid_t pid;
+    char *p;
+    char *argv[64];
+    char line[4096];
+    char words[4096];
+
+    if (snprintf(line, sizeof(line), "exec %s", cmd) >= sizeof(line)) {
+        fprintf(stderr, "error: command is too long\n");
+        return -1;
+    }
+
+    if (!strpbrk(cmd, "|&;<>()$`\\\"'*?[]~{}=")) {
+        strcpy(words, cmd);
+        for (p = strtok(words, " \t"); p && n < 63; p = strtok(NULL, " \t")) {
+            argv[n++] = p;
+        }
+        argv[n] = NULL;
+    }
+
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        return -1;
+    }
+
+    /* closed by exec(), tells the parent when the command is running */
+    if (pipe2(sync, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        close(sync[0]);
+        close(sync[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        dup2(fds[0], STDIN_FILENO);
+        if (n > 0) {
+            execvp(argv[0], argv);
+        }
+        else {
+            execl("/bin/sh", "sh", "-c", line, (char *) NULL);
+        }
+        err = errno;
+        write(sync[1], &err, sizeof(err));
+        _exit(127);
+    }
+
+    close(fds[0]);
+    close(sync[1]);
+    if (read(sync[0], &err, sizeof(err)) > 0) {
+        fprintf(stderr, "error: cannot execute '%s': %s\n",
+                cmd, strerror(err));
+        close(sync[0]);
+        close(fds[1]);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+    close(sync[0]);
+
+    ctx->fd = fds[1];
+    ctx->child = pid;
+    return 0;
+}
+
+/* Give the spawned process some time to consume the EOF, then stop it */
+static void pipe_child_stop(struct pipe_ctx *ctx)
+{
+    int i;
+
+    for (i = 0; i < 50; i++) {
+        if (waitpid(ctx->child, NULL, WNOHANG) == ctx->child) {
+            return;
+        }
+        usleep(100000);
+    }
+
+    kill(ctx->child, SIGTERM);
+    waitpid(ctx->child, NULL, 0);
+}
+
+static int pipe_fifo_open(struct pipe_ctx *ctx, char *path)
+{
+    int ret;
+    struct stat st;
+
+    ret = stat(path, &st);
+    if (ret == -1) {
+        if (mkfifo(path, 0644) == -1) {
+            perror("mkfifo");
+            fprintf(stderr, "error: cannot create FIFO '%s'\n", path);
+            return -1;
+        }
+    }
+    else if (!S_ISFIFO(st.st_mode)) {
+        fprintf(stderr, "error: '%s' is not a FIFO\n", path);
+        return -1;
+    }
+
+    /* blocks until the reader opens its side */
+    printf("waiting for a reader on FIFO '%s'...\n", path);
+    fflush(stdout);
+    ctx->fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (ctx->fd == -1) {
+        perror("open");
+        fprintf(stderr, "error: cannot open FIFO '%s'\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int pipe_setup(struct pipe_ctx *ctx, int pipe_size)
+{
+    int ret;
+    int flags;
+
+    if (pipe_size > 0) {
+        ret = fcntl(ctx->fd, F_SETPIPE_SZ, pipe_size);
+        if (ret == -1) {
+            perror("fcntl F_SETPIPE_SZ");
+            fprintf(stderr, "warn: cannot set pipe size to %i bytes "
+                    "(see /proc/sys/fs/pipe-max-size)\n", pipe_size);
+        }
+    }
+    ctx->pipe_size = fcntl(ctx->fd, F_GETPIPE_SZ);
+
+    /* non-blocking, so a full pipe can be detected and timed */
+    flags = fcntl(ctx->fd, F_GETFL);
+    if (flags == -1 || fcntl(ctx->fd, F_SETFL, flags | O_NONBLOCK) == -1) {
+        perror("fcntl O_NONBLOCK");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* Wait until the reader drains the pipe, accounting the stall time */
+static int pipe_wait(struct pipe_ctx *ctx)
+{
+    int ret;
+    struct pollfd pfd;
+    struct timespec t1;
+    struct timespec t2;
+
+    pfd.fd = ctx->fd;
+    pfd.events = POLLOUT;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    do {
+        ret = poll(&pfd, 1, -1);
+    } while (ret == -1 && errno == EINTR);
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+
+    ctx->round_stall_us += flb_time_diff_us(&t1, &t2);
+    ctx->stalls++;
+
+    if (ret == -1) {
+        perror("poll");
+        return -1;
+    }
+    if (pfd.revents & (POLLERR | POLLHUP)) {
+        fprintf(stderr, "error: the pipe reader is gone\n");
+        return -1;
+    }
+    return 0;
+}
+
+/* Write 'n' records from the ring, returns the number of bytes written */
+static ssize_t pipe_write_records(struct pipe_ctx *ctx, int n)
+{
+    int c = 0;
+    int take;
+    ssize_t ret;
+    ssize_t total = 0;
+    struct iovec *iov;
+    struct iovec *tmp;
+
+    while (n > 0) {
+        if (c == ctx->iov_size) {
+            tmp = realloc(ctx->iov, sizeof(struct iovec) * ctx->iov_size * 2);
+            if (!tmp) {
+                perror("realloc");
+                return -1;
+            }
+            ctx->iov = tmp;
+            ctx->iov_size *= 2;
+        }
+
+        take = ctx->n_records - ctx->cursor;
+        if (take > n) {
+            take = n;
+        }
+
+        ctx->iov[c].iov_base = ctx->buf + ctx->offsets[ctx->cursor];
+        ctx->iov[c].iov_len = ctx->offsets[ctx->cursor + take] -
+            ctx->offsets[ctx->cursor];
+        c++;
+
+        n -= take;
+        ctx->cursor = (ctx->cursor + take) % ctx->n_records;
+    }
+
+    iov = ctx->iov;
+    while (c > 0) {
+        if (ctx->mode == PIPE_VMSPLICE) {
+            ret = vmsplice(ctx->fd, iov, c > IOV_MAX ? IOV_MAX : c,
+                           SPLICE_F_NONBLOCK);
+        }
+        else {
+            ret = writev(ctx->fd, iov, c > IOV_MAX ? IOV_MAX : c);
+        }
+
+        if (ret == -1) {
+            if (errno == EAGAIN) {
+                if (pipe_wait(ctx) == -1) {
+                    return -1;
+                }
+                continue;
+            }
+            else if (errno == EINTR) {
+                continue;
+            }
+            perror(ctx->mode == PIPE_VMSPLICE ? "vmsplice" : "writev");
+            return -1;
+        }
+
+        total += ret;
+        while (c > 0 && ret >= iov->iov_len) {
+            ret -= iov->iov_len;
+            iov++;
+            c--;
+        }
+        if (c > 0) {
+            iov->iov_base = (char *) iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return total;
+}
+
+static int child_exited(struct pipe_ctx *ctx)
+{
+    int status;
+
+    if (ctx->child <= 0) {
+        return 0;
+    }
+
+    if (waitpid(ctx->child, &status, WNOHANG) == ctx->child) {
+        fprintf(stderr, "error: spawned process exited with status %i\n",
+                WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+        ctx->child = -1;
+        return 1;
+    }
+    return 0;
+}
+
+static int run_pipe_writer(pid_t pid,
+                           char *report,
+                           int fmt_report,
+                           char *in_data_file,
+                           int records, int increase_by,
+                           int seconds,
+                           struct pipe_ctx *ctx)
+{
+    int i;
+    int n;
+    int in_fd;
+    int ret = 0;
+    int round_records;
+    int wait_time = 3;
+    int col_stall = -1;
+    int fd_out;
+    char *data_buf;
+    size_t data_size;
+    ssize_t bytes;
+    size_t total_records = 0;
+    struct flb_proc_task *t1 = NULL;
+    struct flb_proc_task *t2;
+    struct flb_report *r = NULL;
+    struct timespec round_start;
+
+    /* Monitor the spawned process unless a PID was given */
+    if (pid < 0 && ctx->child > 0) {
+        pid = ctx->child;
+    }
+
+    /* Report file for process monitoring */
+    if (pid >= 0) {
+        r = flb_report_create(report, fmt_report, pid, wait_time);
+        if (!r) {
+            fprintf(stderr, "error: cannot initialize report");
+            return -1;
+        }
+        col_stall = flb_report_column_add(r, "stall_ms", 9, 2);
+    }
+
+    /* Load input data file in-memory */
+    in_fd = flb_data_file_load(in_data_file, &data_buf, &data_size);
+    if (in_fd == -1) {
+        fprintf(stderr, "error: cannot load input data file '%s'\n",
+                in_data_file);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    ctx->buf = data_buf;
+    ctx->n_records = flb_data_file_index(data_buf, data_size, &ctx->offsets);
+    ctx->iov_size = 16;
+    ctx->iov = malloc(sizeof(struct iovec) * ctx->iov_size);
+    if (ctx->n_records == -1 || !ctx->iov) {
+        fprintf(stderr, "error: cannot index data file records\n");
+        flb_data_file_unload(data_buf, data_size);
+        close(in_fd);
+        if (r) {
+            flb_report_destroy(r);
+        }
+        return -1;
+    }
+
+    for (i = 0; i < seconds; i++) {
+        round_records = 0;
+        ctx->round_stall_us = 0;
+
+        if (pid >= 0 && !t1) {
+            t1 = flb_proc_stat_create(pid);
+            if (!t1) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+            }
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &round_start);
+
+        n = records + (increase_by * i);
+        bytes = pipe_write_records(ctx, n);
+        if (bytes == -1) {
+            fprintf(stderr, "error: exception on writing records chunk\n");
+            ret = -1;
+            break;
+        }
+        round_records = n;
+        total_records += n;
+        ctx->stall_us += ctx->round_stall_us;
+
+        if (child_exited(ctx)) {
+            ret = -1;
+            break;
+        }
+
+        /* Wait for the rest of the second */
+        flb_time_sleep_until(&round_start, 1000);
+
+        /* Get stats */
+        if (pid >= 0 && t1) {
+            t2 = flb_proc_stat_create(pid);
+            if (!t2) {
+                fprintf(stderr, "error gathering stats for PID %i\n",
+                        (int) pid);
+                continue;
+            }
+            flb_report_column_set(r, col_stall, ctx->round_stall_us / 1000.0);
+            flb_report_stats(r, round_records, bytes, t1, t2);
+            flb_proc_stat_destroy(t1);
+            t1 = t2;
+        }
+    }
+
+    if (t1) {
+        flb_proc_stat_destroy(t1);
+    }
+
+    /*
+     * Create continuos snapshots until resources consumption (CPU) stabilize,
+     * we assume that after three seconds without deltas in user time the
+     * process finished processing our records.
+     */
+    if (pid >= 0) {
+        int count = 0;
+
+        while (1) {
+            t1 = flb_proc_stat_create(pid);
+            sleep(1);
+            t2 = flb_proc_stat_create(pid);
+            if (!t1 || !t2) {
+                break;
+            }
+            flb_report_stats(r, 0, 0, t1, t2);
+
+            if ((t2->r_utime_ms - t1->r_utime_ms) == 0) {
+                count++;
+            }
+            else {
+                count = 0;
+            }
+
+            flb_proc_stat_destroy(t1);
+            flb_proc_stat_destroy(t2);
+
+            if (count >= wait_time) {
+                break;
+            }
+        }
+        r->sum_records = total_records;
+        flb_report_summary(r);
+    }
+
+    fd_out = r ? r->fd : STDOUT_FILENO;
+    dprintf(fd_out,
+            "- Pipe (%s)\n"
+            "  - Pipe Size   : %i bytes\n"
+            "  - Stalls      : %lu\n"
+            "  - Stall Time  : %.2f ms\n",
+            ctx->mode == PIPE_VMSPLICE ? "vmsplice" : "write",
+            ctx->pipe_size, ctx->stalls, ctx->stall_us / 1000.0);
+
+    if (r) {
+        flb_report_destroy(r);
+    }
+
+    free(ctx->iov);
+    free(ctx->offsets);
+    flb_data_file_unload(data_buf, data_size);
+    close(in_fd);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int opt;
+    int records = DEFAULT_RECORDS;
+    int seconds = DEFAULT_SECONDS;
+    int increase_by = DEFAULT_INC_BY;
+    int pipe_size = 0;
+    int pid = -1;
+    int fmt_report = FLB_REPORT_TXT;
+    char *format = NULL;
+    char *report = NULL;
+    char *data_file = NULL;
+    char *cmd = NULL;
+    char *fifo = NULL;
+    char *mode = NULL;
+    struct pipe_ctx ctx;
+
+    /* Setup long-options */
+    static const struct option long_opts[] = {
+        { "datafile"   ,   required_argument, NULL, 'd' },
+        { "pid"        ,   required_argument, NULL, 'p' },
+        { "exec"       ,   required_argument, NULL, 'x' },
+        { "fifo"       ,   required_argument, NULL, 'f' },
+        { "pipe-size"  ,   required_argument, NULL, 'P' },
+        { "mode"       ,   required_argument, NULL, 'm' },
+        { "records"    ,   required_argument, NULL, 'r' },
+        { "increase_by",   required_argument, NULL, 'i' },
+        { "seconds"    ,   required_argument, NULL, 's' },
+        { "report"     ,   required_argument, NULL, 'R' },
+        { "format"     ,   required_argument, NULL, 'F' },
+        { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
+    };
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.fd = -1;
+    ctx.child = -1;
+    ctx.mode = PIPE_VMSPLICE;
+
+    while ((opt = getopt_long(argc, argv,
+                              "d:p:x:f:P:m:r:i:s:R:F:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'd':
+            data_file = strdup(optarg);
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'x':
+            cmd = strdup(optarg);
+            break;
+        case 'f':
+            fifo = strdup(optarg);
+            break;
+        case 'P':
+            pipe_size = atoi(optarg);
+            break;
+        case 'm':
+            mode = strdup(optarg);
+            break;
+        case 'r':
+            records = atoi(optarg);
+            break;
+        case 'i':
+            increase_by = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'R':
+            report = strdup(optarg);
+            break;
+        case 'F':
+            format = strdup(optarg);
+            break;
+        case 'h':
+            flb_help(EXIT_SUCCESS);
+            break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
+        };
+    };
+
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    if (!data_file) {
+        fprintf(stderr, "error: no data file specified\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (records < 1) {
+        fprintf(stderr, "error: invalid number of records '%i'\n", records);
+        exit(EXIT_FAILURE);
+    }
+
+    if (seconds < 1) {
+        fprintf(stderr, "error: invalid number of seconds '%i'\n", seconds);
+        exit(EXIT_FAILURE);
+    }
+
+    if ((cmd && fifo) || (!cmd && !fifo)) {
+        fprintf(stderr, "error: specify one of --exec or --fifo\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (mode) {
+        if (strcasecmp(mode, "vmsplice") == 0) {
+            ctx.mode = PIPE_VMSPLICE;
+        }
+        else if (strcasecmp(mode, "write") == 0) {
+            ctx.mode = PIPE_WRITE;
+        }
+        else {
+            fprintf(stderr, "error: invalid mode '%s'\n", mode);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (format) {
+        if (strcasecmp(format, "markdown") == 0) {
+            fmt_report = FLB_REPORT_MARKDOWN;
+        }
+        else if (strcasecmp(format, "text") == 0) {
+            fmt_report = FLB_REPORT_TXT;
+        }
+        else if (strcasecmp(format, "csv") == 0) {
+            fmt_report = FLB_REPORT_CSV;
+        }
+        else {
+            fprintf(stderr, "error: invalid format type");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    /* a reader going away must not kill us */
+    signal(SIGPIPE, SIG_IGN);
+
+    if (cmd) {
+        ret = pipe_spawn(&ctx, cmd);
+    }
+    else {
+        ret = pipe_fifo_open(&ctx, fifo);
+    }
+
+    if (ret == 0) {
+        ret = pipe_setup(&ctx, pipe_size);
+    }
+
+    if (ret == 0) {
+        ret = run_pipe_writer(pid, report, fmt_report, data_file,
+                              records, increase_by, seconds, &ctx);
+    }
+
+    /* EOF for the reader, then stop the spawned process */
+    if (ctx.fd >= 0) {
+        close(ctx.fd);
+    }
+    if (ctx.child > 0) {
+        pipe_child_stop(&ctx);
+    }
+
+    free(report);
+    free(format);
+    free(data_file);
+    free(cmd);
+    free(fifo);
+    free(mode);
+
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -0,0 +1,968 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <poll.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+/* local headers */
+#include "mk_list.h"
+#include "flb_proc.h"
+#include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_network.h"
+#include "flb_time.h"
+
+/* Default values */
+#define DEFAULT_LISTEN_HOST  "0.0.0.0"
+#define DEFAULT_LISTEN_PORT     "5171"
+#define DEFAULT_HOST       "127.0.0.1"  /* upstream: Fluent Bit in_tcp */
+#define DEFAULT_PORT            "5170"
+#define DEFAULT_PIPE_SIZE      1048576  /* bytes in flight per direction */
+
+#define PROXY_MAX_EVENTS            64
+#define PROXY_CONNECT_TIMEOUT     5000  /* ms to connect to the upstream */
+
+/* bytes spliced into the pipe at once, they leave it at the same time */
+struct proxy_chunk {
+    size_t size;
+    uint64_t due_us;
+};
+
+/*
+ * One direction of a connection: data is spliced from 'src' into a pipe
+ * and from the pipe into 'dst' once it's due, so it never goes through
+ * user space. The pipe capacity bounds the bytes in flight, when it's full
+ * the source is not read and TCP flow control pushes back on the sender.
+ */
+struct proxy_pump {
+    int src;
+    int dst;
+    int pipe[2];
+    size_t capacity;             /* pipe size granted by the kernel */
+    size_t queued;               /* bytes in the pipe           */
+    int eof;                     /* 'src' was closed            */
+    int shut;                    /* 'dst' write side shutdown   */
+    int blocked;                 /* 'dst' send buffer is full   */
+    uint64_t bytes;              /* forwarded bytes             */
+
+    /* bandwidth token bucket */
+    double tokens;
+    uint64_t refill_us;
+
+    /* chunks ring, due times never go backwards */
+    int head;
+    int count;
+    int size;
+    uint64_t last_due;
+    struct proxy_chunk *chunks;
+};
+
+struct proxy_conn {
+    int client_fd;
+    int upstream_fd;
+    uint32_t client_events;
+    uint32_t upstream_events;
+    int connecting;              /* upstream connect in progress */
+    uint64_t connect_due;
+    struct proxy_pump up;        /* client -> upstream */
+    struct proxy_pump down;      /* upstream -> client */
+    struct mk_list _head;
+};
+
+struct proxy_ctx {
+    char *host;
+    char *port;
+    struct sockaddr_storage addr;    /* upstream, resolved once */
+    socklen_t addr_len;
+    int server_fd;
+    int efd;
+    int pipe_size;
+    int pipe_warned;
+
+    /* impairments */
+    int delay_ms;
+    int jitter_ms;
+    int bandwidth;               /* bytes/sec per connection and direction */
+    int stall_ms;
+    int stall_every;             /* seconds */
+    unsigned int seed;
+    uint64_t start_us;
+
+    struct mk_list conns;
+    int n_conns;
+    uint64_t connections;
+    uint64_t errors;
+    uint64_t stalls;
+    size_t max_queued;
+};
+
+static volatile int proxy_exit = 0;
+
+static void proxy_signal(int sig)
+{
+    (void) sig;
+    proxy_exit = 1;
+}
+
+static int flb_help(int rc)
+{
+    printf("Usage: flb-proxy [OPTIONS]\n\n");
+    printf("Available options\n");
+    printf("  -l, --listen=HOST:PORT\tlisten address (default: %s:%s)\n",
+           DEFAULT_LISTEN_HOST, DEFAULT_LISTEN_PORT);
+    printf("  -o, --output=HOST:PORT\tupstream address (default: %s:%s)\n",
+           DEFAULT_HOST, DEFAULT_PORT);
+    printf("  -d, --delay=MS\t\tone way latency added in both directions\n");
+    printf("  -j, --jitter=MS\t\trandom latency variation, +/- MS\n");
+    printf("  -b, --bandwidth=KB\t\tKB/s per connection and direction (default: unlimited)\n");
+    printf("  -S, --stall=MS:SECONDS\tstop forwarding for MS every SECONDS\n");
+    printf("  -P, --pipe-size=BYTES\t\tbytes in flight per direction (default: %i)\n",
+           DEFAULT_PIPE_SIZE);
+    printf("  -s, --seconds=SECONDS\t\tstop after N seconds (default: until interrupted)\n");
+    printf("  -p  --pid=FLB_PID\t\tFluent Bit PID used gather metrics\n");
+    printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
+    printf("  -F, --format\t\t\treport format: text (default), markdown or csv\n");
+    printf("  -h, --help\t\t\tprint this help");
+    printf("\n\n");
+    flb_monitor_help();
+    exit(rc);
+}
+
+/* Stalls happen at the end of every period, returns when the state flips */
+static int proxy_stalled(struct proxy_ctx *ctx, uint64_t now, uint64_t *next)
+{
+    uint64_t period;
+    uint64_t pos;
+    uint64_t stall;
+
+    if (ctx->stall_ms <= 0) {
+        return 0;
+    }
+
+    period = (uint64_t) ctx->stall_every * 1000000;
+    stall = (uint64_t) ctx->stall_ms * 1000;
+    pos = (now - ctx->start_us) % period;
+
+    if (pos >= period - stall) {
+        *next = now + (period - pos);
+        return 1;
+    }
+    *next = now + (period - stall - pos);
+    return 0;
+}
+
+static uint64_t proxy_due(struct proxy_ctx *ctx, struct proxy_pump *p,
+                          uint64_t now)
+{
+    int64_t delay = ctx->delay_ms * 1000;
+    uint64_t due;
+
+    if (ctx->jitter_ms > 0) {
+        delay += ((int64_t) (rand_r(&ctx->seed) % (2 * ctx->jitter_ms + 1)) -
+                  ctx->jitter_ms) * 1000;
+    }
+    if (delay < 0) {
+        delay = 0;
+    }
+
+    /* a TCP stream is not reordered */
+    due = now + delay;
+    if (due < p->last_due) {
+        due = p->last_due;
+    }
+    p->last_due = due;
+    return due;
+}
+
+static int proxy_chunk_push(struct proxy_pump *p, size_t size, uint64_t due)
+{
+    int i;
+    struct proxy_chunk *tmp;
+
+    if (p->count == p->size) {
+        tmp = malloc(sizeof(struct proxy_chunk) * p->size * 2);
+        if (!tmp) {
+            perror("malloc");
+            return -1;
+        }
+        for (i = 0; i < p->count; i++) {
+            tmp[i] = p->chunks[(p->head + i) % p->size];
+        }
+        free(p->chunks);
+        p->chunks = tmp;
+        p->head = 0;
+        p->size *= 2;
+    }
+
+    p->chunks[(p->head + p->count) % p->size].size = size;
+    p->chunks[(p->head + p->count) % p->size].due_us = due;
+    p->count++;
+    return 0;
+}
+
+static int proxy_pump_init(struct proxy_ctx *ctx, struct proxy_pump *p,
+                           int src, int dst)
+{
+    int ret;
+
+    memset(p, 0, sizeof(struct proxy_pump));
+    p->src = src;
+    p->dst = dst;
+
+    if (pipe2(p->pipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+        perror("pipe2");
+        p->pipe[0] = p->pipe[1] = -1;
+        return -1;
+    }
+
+    /* an unprivileged process is capped by fs.pipe-max-size */
+    ret = fcntl(p->pipe[1], F_SETPIPE_SZ, ctx->pipe_size);
+    if (ret == -1) {
+        ret = fcntl(p->pipe[1], F_GETPIPE_SZ);
+        if (ret == -1) {
+            perror("fcntl");
+            return -1;
+        }
+        if (!ctx->pipe_warned) {
+            fprintf(stderr, "warn: pipe size %i not granted, using %i "
+                    "bytes in flight\n", ctx->pipe_size, ret);
+            ctx->pipe_warned = 1;
+        }
+    }
+    p->capacity = ret;
+
+    p->size = 64;
+    p->chunks = malloc(sizeof(struct proxy_chunk) * p->size);
+    if (!p->chunks) {
+        perror("malloc");
+        return -1;
+    }
+
+    p->tokens = ctx->bandwidth;
+    p->refill_us = flb_time_now_us();
+    return 0;
+}
+
+static void proxy_pump_destroy(struct proxy_pump *p)
+{
+    if (p->pipe[0] >= 0) {
+        close(p->pipe[0]);
+        close(p->pipe[1]);
+    }
+    free(p->chunks);
+}
+
+/*
+ * Move what can be moved in one direction, returns -1 on a connection
+ * error. 'next' gets the time when the pump needs to run again.
+ */
+static int proxy_pump_run(struct proxy_ctx *ctx, struct proxy_pump *p,
+                          uint64_t now, int stalled, uint64_t *next)
+{
+    ssize_t n;
+    size_t amount;
+    uint64_t wait;
+    struct proxy_chunk *c;
+
+    /* ingress */
+    while (!stalled && !p->eof && p->queued < p->capacity) {
+        n = splice(p->src, NULL, p->pipe[1], NULL, p->capacity - p->queued,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            if (proxy_chunk_push(p, n, proxy_due(ctx, p, now)) == -1) {
+                return -1;
+            }
+            p->queued += n;
+        }
+        else if (n == 0) {
+            p->eof = 1;
+        }
+        else if (errno == EAGAIN) {
+            break;
+        }
+        else {
+            return -1;
+        }
+    }
+    if (p->queued > ctx->max_queued) {
+        ctx->max_queued = p->queued;
+    }
+
+    /* egress, bandwidth refills continuously up to one second of data */
+    if (ctx->bandwidth > 0) {
+        p->tokens += (double) (now - p->refill_us) * ctx->bandwidth / 1000000;
+        if (p->tokens > ctx->bandwidth) {
+            p->tokens = ctx->bandwidth;
+        }
+        p->refill_us = now;
+    }
+
+    p->blocked = 0;
+    while (!stalled && p->count > 0) {
+        c = &p->chunks[p->head];
+        if (c->due_us > now) {
+            if (*next == 0 || c->due_us < *next) {
+                *next = c->due_us;
+            }
+            break;
+        }
+
+        amount = c->size;
+        if (ctx->bandwidth > 0) {
+            if (p->tokens < 1) {
+                /* wait for one 4KB segment worth of tokens */
+                wait = ((4096 - p->tokens) * 1000000) / ctx->bandwidth;
+                if (*next == 0 || now + wait < *next) {
+                    *next = now + wait;
+                }
+                break;
+            }
+            if (amount > p->tokens) {
+                amount = p->tokens;
+            }
+        }
+
+        n = splice(p->pipe[0], NULL, p->dst, NULL, amount,
+                   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            c->size -= n;
+            p->queued -= n;
+            p->bytes += n;
+            p->tokens -= n;
+            if (c->size == 0) {
+                p->head = (p->head + 1) % p->size;
+                p->count--;
+            }
+        }
+        else if (n == -1 && errno == EAGAIN) {
+            p->blocked = 1;
+            break;
+        }
+        else {
+            return -1;
+        }
+    }
+
+    /* propagate the half close once everything was delivered */
+    if (p->eof && p->queued == 0 && !p->shut) {
+        shutdown(p->dst, SHUT_WR);
+        p->shut = 1;
+    }
+    return 0;
+}
+
+static void proxy_conn_destroy(struct proxy_ctx *ctx, struct proxy_conn *conn)
+{
+    mk_list_del(&conn->_head);
+    ctx->n_conns--;
+
+    if (conn->client_fd >= 0) {
+        close(conn->client_fd);
+    }
+    if (conn->upstream_fd >= 0) {
+        close(conn->upstream_fd);
+    }
+    proxy_pump_destroy(&conn->up);
+    proxy_pump_destroy(&conn->down);
+    free(conn);
+}
+
+static void proxy_conn_events(struct proxy_ctx *ctx, int fd, uint32_t *cur,
+                              uint32_t events, void *ptr)
+{
+    struct epoll_event ev;
+
+    if (*cur == events) {
+        return;
+    }
+    ev.events = events;
+    ev.data.ptr = ptr;
+    epoll_ctl(ctx->efd, EPOLL_CTL_MOD, fd, &ev);
+    *cur = events;
+}
+
+/*
+ * Check the non-blocking connect to the upstream, returns 1 once it's
+ * established, 0 while in progress or -1 if it failed.
+ */
+static int proxy_conn_connect(struct proxy_ctx *ctx, struct proxy_conn *conn,
+                              uint64_t now, uint64_t *next)
+{
+    int err = 0;
+    socklen_t len = sizeof(err);
+    struct pollfd pfd = { conn->upstream_fd, POLLOUT, 0 };
+
+    if (poll(&pfd, 1, 0) == 0) {
+        if (now >= conn->connect_due) {
+            fprintf(stderr, "error: cannot connect to upstream %s:%s: "
+                    "timeout\n", ctx->host, ctx->port);
+            ctx->errors++;
+            return -1;
+        }
+        if (*next == 0 || conn->connect_due < *next) {
+            *next = conn->connect_due;
+        }
+        return 0;
+    }
+
+    if (getsockopt(conn->upstream_fd, SOL_SOCKET, SO_ERROR, &err, &len) == -1 ||
+        err != 0) {
+        fprintf(stderr, "error: cannot connect to upstream %s:%s: %s\n",
+                ctx->host, ctx->port, strerror(err ? err : errno));
+        ctx->errors++;
+        return -1;
+    }
+    conn->connecting = 0;
+    return 1;
+}
+
+/* Run both directions and update the epoll interest of both sockets */
+static int proxy_conn_run(struct proxy_ctx *ctx, struct proxy_conn *conn,
+                          uint64_t now, uint64_t *next)
+{
+    int ret;
+    int stalled;
+    uint64_t stall_next = 0;
+    uint32_t ev_client;
+    uint32_t ev_upstream;
+
+    /* the client is not read until the upstream accepted the connection */
+    if (conn->connecting) {
+        ret = proxy_conn_connect(ctx, conn, now, next);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+
+    stalled = proxy_stalled(ctx, now, &stall_next);
+
+    if (proxy_pump_run(ctx, &conn->up, now, stalled, next) == -1 ||
+        proxy_pump_run(ctx, &conn->down, now, stalled, next) == -1) {
+        return -1;
+    }
+
+    /* both sides closed and nothing left in flight */
+    if (conn->up.shut && conn->down.shut) {
+        return -1;
+    }
+
+    if (stall_next > 0 && (*next == 0 || stall_next < *next) &&
+        (stalled || conn->up.count > 0 || conn->down.count > 0)) {
+        *next = stall_next;
+    }
+
+    ev_client = 0;
+    ev_upstream = 0;
+    if (!stalled && !conn->up.eof && conn->up.queued < conn->up.capacity) {
+        ev_client |= EPOLLIN;
+    }
+    if (!stalled && !conn->down.eof &&
+        conn->down.queued < conn->down.capacity) {
+        ev_upstream |= EPOLLIN;
+    }
+    if (conn->up.blocked) {
+        ev_upstream |= EPOLLOUT;
+    }
+    if (conn->down.blocked) {
+        ev_client |= EPOLLOUT;
+    }
+
+    proxy_conn_events(ctx, conn->client_fd, &conn->client_events,
+                      ev_client, conn);
+    proxy_conn_events(ctx, conn->upstream_fd, &conn->upstream_events,
+                      ev_upstream, conn);
+    return 0;
+}
+
+static void proxy_accept(struct proxy_ctx *ctx)
+{
+    int fd;
+    int ufd;
+    struct epoll_event ev;
+    struct proxy_conn *conn;
+
+    while ((fd = accept4(ctx->server_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        /* connected in the background, the loop never waits on it */
+        ufd = socket(ctx->addr.ss_family,
+                     SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (ufd == -1) {
+            perror("socket");
+            ctx->errors++;
+            close(fd);
+            continue;
+        }
+        if (connect(ufd, (struct sockaddr *) &ctx->addr, ctx->addr_len) == -1 &&
+            errno != EINPROGRESS) {
+            fprintf(stderr, "error: cannot connect to upstream %s:%s: %s\n",
+                    ctx->host, ctx->port, strerror(errno));
+            ctx->errors++;
+            close(fd);
+            close(ufd);
+            continue;
+        }
+
+        conn = calloc(1, sizeof(struct proxy_conn));
+        if (!conn) {
+            perror("calloc");
+            close(fd);
+            close(ufd);
+            continue;
+        }
+        conn->client_fd = fd;
+        conn->upstream_fd = ufd;
+        /* no pipes yet, a failed init must not close fd 0 */
+        conn->up.pipe[0] = conn->up.pipe[1] = -1;
+        conn->down.pipe[0] = conn->down.pipe[1] = -1;
+        conn->connecting = 1;
+        conn->connect_due = flb_time_now_us() + PROXY_CONNECT_TIMEOUT * 1000;
+        mk_list_add(&conn->_head, &ctx->conns);
+        ctx->n_conns++;
+
+        if (proxy_pump_init(ctx, &conn->up, fd, ufd) == -1 ||
+            proxy_pump_init(ctx, &conn->down, ufd, fd) == -1) {
+            proxy_conn_destroy(ctx, conn);
+            continue;
+        }
+
+        conn->client_events = 0;
+        conn->upstream_events = EPOLLOUT;
+        ev.data.ptr = conn;
+        ev.events = conn->client_events;
+        if (epoll_ctl(ctx->efd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("epoll_ctl");
+            proxy_conn_destroy(ctx, conn);
+            continue;
+        }
+        ev.events = conn->upstream_events;
+        if (epoll_ctl(ctx->efd, EPOLL_CTL_ADD, ufd, &ev) == -1) {
+            perror("epoll_ctl");
+            proxy_conn_destroy(ctx, conn);
+            continue;
+        }
+        ctx->connections++;
+    }
+}
+
+static void proxy_totals(struct proxy_ctx *ctx, uint64_t *up, uint64_t *down,
+                         size_t *queued)
+{
+    struct mk_list *head;
+    struct proxy_conn *conn;
+
+    *queued = 0;
+    mk_list_foreach(head, &ctx->conns) {
+        conn = mk_list_entry(head, struct proxy_conn, _head);
+        *up += conn->up.bytes;
+        *down += conn->down.bytes;
+        *queued += conn->up.queued + conn->down.queued;
+    }
+}
+
+static int run_proxy(struct proxy_ctx *ctx, pid_t pid, char *report,
+                     int fmt_report, int seconds)
+{
+    int i;
+    int n;
+    int timeout;
+    int rounds = 0;
+    int col_conns = -1;
+    int col_queued = -1;
+    int col_down = -1;
+    int was_stalled = 0;
+    int fd_out;
+    size_t queued;
+    uint64_t now;
+    uint64_t next;
+    uint64_t round_start;
+    uint64_t stall_next;
+    uint64_t up;
+    uint64_t down;
+    uint64_t closed_up = 0;
+    uint64_t closed_down = 0;
+    uint64_t last_up = 0;
+    uint64_t last_down = 0;
+    struct epoll_event ev;
+    struct epoll_event events[PROXY_MAX_EVENTS];
+    struct mk_list *head;
+    struct mk_list *tmp;
+    struct proxy_conn *conn;
+    struct flb_proc_task *t1 = NULL;
+    struct flb_proc_task *t2;
+    struct flb_report *r = NULL;
+
+    /* Report file for process monitoring */
+    if (pid >= 0) {
+        r = flb_report_create(report, fmt_report, pid, 0);
+        if (!r) {
+            fprintf(stderr, "error: cannot initialize report");
+            return -1;
+        }
+        col_conns = flb_report_column_add(r, "conns", 6, 0);
+        col_queued = flb_report_column_add(r, "queued_kb", 10, 0);
+        col_down = flb_report_column_add(r, "down_b", 10, 0);
+        t1 = flb_proc_stat_create(pid);
+    }
+
+    ctx->efd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctx->efd == -1) {
+        perror("epoll_create1");
+        return -1;
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(ctx->efd, EPOLL_CTL_ADD, ctx->server_fd, &ev);
+
+    ctx->start_us = flb_time_now_us();
+    round_start = ctx->start_us;
+    timeout = 100;
+
+    while (!proxy_exit) {
+        n = epoll_wait(ctx->efd, events, PROXY_MAX_EVENTS, timeout);
+        for (i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) {
+                proxy_accept(ctx);
+            }
+        }
+
+        /* every connection is checked: few connections, timers matter */
+        now = flb_time_now_us();
+        next = 0;
+        mk_list_foreach_safe(head, tmp, &ctx->conns) {
+            conn = mk_list_entry(head, struct proxy_conn, _head);
+            if (proxy_conn_run(ctx, conn, now, &next) == -1) {
+                closed_up += conn->up.bytes;
+                closed_down += conn->down.bytes;
+                proxy_conn_destroy(ctx, conn);
+            }
+        }
+
+        stall_next = 0;
+        if (proxy_stalled(ctx, now, &stall_next) && !was_stalled) {
+            ctx->stalls++;
+        }
+        was_stalled = proxy_stalled(ctx, now, &stall_next);
+
+        timeout = 100;
+        if (next > 0) {
+            timeout = (next > now) ? ((next - now + 999) / 1000) : 0;
+            if (timeout > 100) {
+                timeout = 100;
+            }
+        }
+
+        /* one row per second */
+        if (now - round_start < 1000000) {
+            continue;
+        }
+        round_start += 1000000;
+        rounds++;
+
+        up = closed_up;
+        down = closed_down;
+        proxy_totals(ctx, &up, &down, &queued);
+
+        if (r && t1) {
+            t2 = flb_proc_stat_create(pid);
+            if (t2) {
+                flb_report_column_set(r, col_conns, ctx->n_conns);
+                flb_report_column_set(r, col_queued, queued / 1024.0);
+                flb_report_column_set(r, col_down, down - last_down);
+                flb_report_stats(r, 0, up - last_up, t1, t2);
+                flb_proc_stat_destroy(t1);
+                t1 = t2;
+            }
+        }
+        else {
+            printf("%4i conns  up %12lu bytes  down %10lu bytes  queued %8zu KB%s\n",
+                   ctx->n_conns, up - last_up, down - last_down,
+                   queued / 1024, was_stalled ? "  (stalled)" : "");
+            fflush(stdout);
+        }
+        last_up = up;
+        last_down = down;
+
+        if (seconds > 0 && rounds >= seconds) {
+            break;
+        }
+    }
+
+    if (t1) {
+        flb_proc_stat_destroy(t1);
+    }
+
+    fd_out = r ? r->fd : STDOUT_FILENO;
+    if (r) {
+        flb_report_summary(r);
+    }
+
+    up = closed_up;
+    down = closed_down;
+    proxy_totals(ctx, &up, &down, &queued);
+    dprintf(fd_out,
+            "\n- Proxy (%s:%s)\n"
+            "  - Delay       : %i ms +/- %i ms\n"
+            "  - Bandwidth   : %i KB/s\n"
+            "  - Stalls      : %lu (%i ms every %i s)\n"
+            "  - Connections : %lu\n"
+            "  - Bytes up    : %lu\n"
+            "  - Bytes down  : %lu\n"
+            "  - Max queued  : %zu bytes per direction\n",
+            ctx->host, ctx->port, ctx->delay_ms, ctx->jitter_ms,
+            ctx->bandwidth / 1024, ctx->stalls, ctx->stall_ms,
+            ctx->stall_every, ctx->connections, up, down, ctx->max_queued);
+    if (ctx->errors > 0) {
+        dprintf(fd_out, "  - Errors      : %lu\n", ctx->errors);
+    }
+
+    if (r) {
+        flb_report_destroy(r);
+    }
+
+    mk_list_foreach_safe(head, tmp, &ctx->conns) {
+        conn = mk_list_entry(head, struct proxy_conn, _head);
+        proxy_conn_destroy(ctx, conn);
+    }
+    close(ctx->efd);
+    return 0;
+}
+
+/* Resolve the upstream once, connections must not wait on DNS */
+static int proxy_resolve(struct proxy_ctx *ctx)
+{
+    int ret;
+    struct addrinfo hints;
+    struct addrinfo *res;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    ret = getaddrinfo(ctx->host, ctx->port, &hints, &res);
+    if (ret != 0) {
+        fprintf(stderr, "error: cannot resolve upstream %s:%s: %s\n",
+                ctx->host, ctx->port, gai_strerror(ret));
+        return -1;
+    }
+    memcpy(&ctx->addr, res->ai_addr, res->ai_addrlen);
+    ctx->addr_len = res->ai_addrlen;
+    freeaddrinfo(res);
+    return 0;
+}
+
+static int parse_address(char *addr, char *def_host, char *def_port,
+                         char **host, char **port)
+{
+    char *p;
+
+    if (!addr) {
+        *host = strdup(def_host);
+        *port = strdup(def_port);
+    }
+    else {
+        p = strrchr(addr, ':');
+        if (!p) {
+            *host = strdup(addr);
+            *port = strdup(def_port);
+        }
+        else {
+            *host = strndup(addr, p - addr);
+            *port = strdup(*(p + 1) ? p + 1 : def_port);
+        }
+    }
+
+    if (!*host || !*port) {
+        perror("strdup");
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int opt;
+    int pid = -1;
+    int seconds = 0;
+    int fmt_report = FLB_REPORT_TXT;
+    char *listen_addr = NULL;
+    char *out_addr = NULL;
+    char *format = NULL;
+    char *report = NULL;
+    char *host = NULL;
+    char *port = NULL;
+    char *p;
+    struct proxy_ctx ctx;
+
+    /* Setup long-options */
+    static const struct option long_opts[] = {
+        { "listen"     ,   required_argument, NULL, 'l' },
+        { "output"     ,   required_argument, NULL, 'o' },
+        { "delay"      ,   required_argument, NULL, 'd' },
+        { "jitter"     ,   required_argument, NULL, 'j' },
+        { "bandwidth"  ,   required_argument, NULL, 'b' },
+        { "stall"      ,   required_argument, NULL, 'S' },
+        { "pipe-size"  ,   required_argument, NULL, 'P' },
+        { "seconds"    ,   required_argument, NULL, 's' },
+        { "pid"        ,   required_argument, NULL, 'p' },
+        { "report"     ,   required_argument, NULL, 'R' },
+        { "format"     ,   required_argument, NULL, 'F' },
+        { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
+    };
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.pipe_size = DEFAULT_PIPE_SIZE;
+    mk_list_init(&ctx.conns);
+
+    while ((opt = getopt_long(argc, argv, "l:o:d:j:b:S:P:s:p:R:F:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'l':
+            listen_addr = strdup(optarg);
+            break;
+        case 'o':
+            out_addr = strdup(optarg);
+            break;
+        case 'd':
+            ctx.delay_ms = atoi(optarg);
+            break;
+        case 'j':
+            ctx.jitter_ms = atoi(optarg);
+            break;
+        case 'b':
+            ctx.bandwidth = atoi(optarg) * 1024;
+            break;
+        case 'S':
+            ctx.stall_ms = atoi(optarg);
+            p = strchr(optarg, ':');
+            ctx.stall_every = p ? atoi(p + 1) : 0;
+            if (ctx.stall_ms <= 0 || ctx.stall_every <= 0 ||
+                ctx.stall_ms >= ctx.stall_every * 1000) {
+                fprintf(stderr, "error: invalid stall '%s'\n", optarg);
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'P':
+            ctx.pipe_size = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'R':
+            report = strdup(optarg);
+            break;
+        case 'F':
+            format = strdup(optarg);
+            break;
+        case 'h':
+            flb_help(EXIT_SUCCESS);
+            break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
+        };
+    };
+
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    if (ctx.delay_ms < 0 || ctx.jitter_ms < 0 || ctx.bandwidth < 0) {
+        fprintf(stderr, "error: invalid impairment values\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (ctx.pipe_size < 4096) {
+        fprintf(stderr, "error: invalid pipe size '%i'\n", ctx.pipe_size);
+        exit(EXIT_FAILURE);
+    }
+
+    if (format) {
+        if (strcasecmp(format, "markdown") == 0) {
+            fmt_report = FLB_REPORT_MARKDOWN;
+        }
+        else if (strcasecmp(format, "text") == 0) {
+            fmt_report = FLB_REPORT_TXT;
+        }
+        else if (strcasecmp(format, "csv") == 0) {
+            fmt_report = FLB_REPORT_CSV;
+        }
+        else {
+            fprintf(stderr, "error: invalid format type");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (parse_address(listen_addr, DEFAULT_LISTEN_HOST, DEFAULT_LISTEN_PORT,
+                      &host, &port) == -1 ||
+        parse_address(out_addr, DEFAULT_HOST, DEFAULT_PORT,
+                      &ctx.host, &ctx.port) == -1 ||
+        proxy_resolve(&ctx) == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    ctx.server_fd = flb_net_server(host, port, 0);
+    if (ctx.server_fd == -1) {
+        exit(EXIT_FAILURE);
+    }
+    fcntl(ctx.server_fd, F_SETFL, O_NONBLOCK);
+    ctx.seed = time(NULL);
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, proxy_signal);
+    signal(SIGTERM, proxy_signal);
+
+    ret = run_proxy(&ctx, pid, report, fmt_report, seconds);
+
+    close(ctx.server_fd);
+    free(listen_addr);
+    free(out_addr);
+    free(format);
+    free(report);
+    free(host);
+    free(port);
+    free(ctx.host);
+    free(ctx.port);
+
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
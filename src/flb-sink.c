@@ -0,0 +1,2125 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <signal.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/* local headers */
+#include "mk_list.h"
+#include "flb_proc.h"
+#include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_network.h"
+#include "flb_http.h"
+#include "flb_compress.h"
+#include "flb_msgpack.h"
+#include "flb_histogram.h"
+#include "flb_stamp.h"
+#include "flb_time.h"
+
+/* Default values */
+#define DEFAULT_HOST         "0.0.0.0"
+#define DEFAULT_PORT            "5180"
+#define DEFAULT_IDLE                 5  /* seconds without data to stop */
+
+#define SINK_PROTO_TCP               0  /* newline delimited records    */
+#define SINK_PROTO_HTTP              1  /* HTTP/1.1, JSON or NDJSON     */
+#define SINK_PROTO_FORWARD           2  /* Fluent Forward protocol      */
+#define SINK_PROTO_ES                3  /* Elasticsearch _bulk API      */
+#define SINK_PROTO_LOKI              4  /* Loki push API (JSON)         */
+#define SINK_PROTO_SPLUNK            5  /* Splunk HTTP Event Collector  */
+
+#define SINK_READ_SIZE           65536
+#define SINK_MAX_EVENTS             64
+#define SINK_STREAM_BUCKETS       1024
+#define SINK_STREAM_TOP             20  /* streams listed in the summary */
+
+static char *sink_protocols[] = {
+    "tcp", "http", "forward", "es", "loki", "splunk"
+};
+
+/* Faults, enabled with -f [START-END:]NAME=VALUE */
+#define SINK_FAULT_LATENCY           0  /* ms added to every response      */
+#define SINK_FAULT_ERROR             1  /* % of requests answered with 503 */
+#define SINK_FAULT_THROTTLE          2  /* % of requests answered with 429 */
+#define SINK_FAULT_RESET             3  /* % of requests reset (RST)       */
+#define SINK_FAULT_SLOW              4  /* KB/s read per connection        */
+#define SINK_FAULT_RCVBUF            5  /* SO_RCVBUF of new connections    */
+#define SINK_FAULT_MAX               6
+
+static char *sink_fault_names[] = {
+    "latency", "error", "throttle", "reset", "slow", "rcvbuf"
+};
+
+struct sink_fault {
+    int type;
+    int value;
+    int start;                   /* seconds since the sink started */
+    int end;                     /* -1: until the end              */
+};
+
+/* Growable byte buffer for composed replies */
+struct sink_buf {
+    char *data;
+    size_t len;
+    size_t size;
+};
+
+/* Records per stream: Elasticsearch index, Loki label set or HEC index */
+struct sink_stream {
+    char *name;
+    size_t len;
+    uint64_t records;
+    struct sink_stream *next;
+};
+
+struct sink_streams {
+    uint64_t count;
+    struct sink_stream *buckets[SINK_STREAM_BUCKETS];
+};
+
+struct sink_conn {
+    int fd;
+    size_t len;
+    size_t size;
+    char *buf;
+
+    /* delayed replies and throttled reads */
+    int closing;
+    int paused;
+    int writing;                 /* EPOLLOUT armed, 'out' is pending */
+    int in_timers;
+    uint64_t due_us;
+    uint64_t resume_us;
+    struct sink_buf out;
+    struct mk_list _timer;
+};
+
+struct sink_ctx;
+
+/*
+ * Every worker owns an epoll loop and a listener bound with SO_REUSEPORT,
+ * the kernel balances the agent connections between them. Counters only
+ * grow, the main thread computes the per second deltas.
+ */
+struct sink_worker {
+    int id;
+    int efd;
+    int server_fd;
+    pthread_t tid;
+
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t requests;
+    uint64_t connections;
+    uint64_t errors;
+
+    /* injected faults per type */
+    uint64_t faults[SINK_FAULT_MAX];
+
+    /* connections waiting for a delayed reply or a read resume */
+    unsigned int seed;
+    struct mk_list timers;
+
+    /* fake backends state, only used by the worker thread */
+    uint64_t next_id;
+    struct sink_buf body;
+    struct sink_buf reply;
+    struct sink_streams streams;
+
+    struct sink_ctx *ctx;
+};
+
+struct sink_ctx {
+    int proto;
+    int n_workers;
+    struct sink_worker *workers;
+
+    /* fault schedule */
+    int n_faults;
+    struct sink_fault *faults;
+    uint64_t start_us;
+
+    /* stamps are rare compared to bytes, a lock per read buffer is fine */
+    pthread_mutex_t lock;
+    struct flb_stamp_stats stamps;
+    struct flb_histogram *round_hist;
+};
+
+static volatile int sink_exit = 0;
+
+static void sink_signal(int sig)
+{
+    (void) sig;
+    sink_exit = 1;
+}
+
+static int flb_help(int rc)
+{
+    printf("Usage: flb-sink [OPTIONS]\n\n");
+    printf("Available options\n");
+    printf("  -l, --listen=HOST:PORT\tlisten address (default: %s:%s)\n",
+           DEFAULT_HOST, DEFAULT_PORT);
+    printf("  -P, --protocol=PROTO\t\ttcp (newline delimited, default), http or forward\n");
+    printf("\t\t\t\tfake backends: es (_bulk), loki (push) or splunk (HEC)\n");
+    printf("  -w, --workers=N\t\tepoll worker threads (default: one per CPU)\n");
+    printf("  -f, --fault=SPEC\t\tinject a fault, [START-END:]NAME=VALUE in seconds, can be\n"
+           "\t\t\t\tused many times. NAME: latency (ms), error (%% of 503),\n"
+           "\t\t\t\tthrottle (%% of 429), reset (%% of RST), slow (KB/s read\n"
+           "\t\t\t\tper connection) or rcvbuf (bytes, new connections)\n");
+    printf("  -p  --pid=FLB_PID\t\tFluent Bit PID used gather metrics\n");
+    printf("  -n, --expect=N\t\tnumber of stamped records sent, used to compute the loss\n");
+    printf("  -t, --idle=SECONDS\t\tstop after N seconds without data (default: %i)\n",
+           DEFAULT_IDLE);
+    printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
+    printf("  -F, --format\t\t\treport format: text (default), markdown or csv\n");
+    printf("  -h, --help\t\t\tprint this help");
+    printf("\n\n");
+    flb_monitor_help();
+    exit(rc);
+}
+
+/* Newlines counter, 16 bytes per iteration when SSE2 is available */
+static uint64_t count_lines(const char *buf, size_t len)
+{
+    size_t i = 0;
+    uint64_t n = 0;
+    const char *p;
+    const char *end = buf + len;
+
+#ifdef __SSE2__
+    __m128i nl = _mm_set1_epi8('\n');
+    __m128i v;
+
+    for (; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i *) (buf + i));
+        n += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(v, nl)));
+    }
+#endif
+
+    p = buf + i;
+    while (p < end && (p = memchr(p, '\n', end - p))) {
+        n++;
+        p++;
+    }
+    return n;
+}
+
+/* Records of a JSON body: objects of the top level array or NDJSON lines */
+static uint64_t count_json(const char *buf, size_t len)
+{
+    int depth = 0;
+    int in_str = 0;
+    uint64_t n = 0;
+    const char *p = buf;
+    const char *end = buf + len;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        p++;
+    }
+    if (p == end) {
+        return 0;
+    }
+    else if (*p != '[') {
+        n = count_lines(p, end - p);
+        return (end[-1] != '\n') ? n + 1 : n;
+    }
+
+    for (; p < end; p++) {
+        if (in_str) {
+            if (*p == '\\') {
+                p++;
+            }
+            else if (*p == '"') {
+                in_str = 0;
+            }
+            continue;
+        }
+
+        switch (*p) {
+        case '"':
+            in_str = 1;
+            break;
+        case '[':
+        case '{':
+            if (depth == 1 && *p == '{') {
+                n++;
+            }
+            depth++;
+            break;
+        case ']':
+        case '}':
+            depth--;
+            break;
+        }
+    }
+    return n;
+}
+
+/* Track the stamps found in 'buf' */
+static void sink_stamps(struct sink_ctx *ctx, const char *buf, size_t len,
+                        int mp)
+{
+    size_t off = 0;
+    uint64_t seq;
+    uint64_t ts;
+    uint64_t now;
+    int (*find)(const char *, size_t, size_t *, uint64_t *, uint64_t *);
+
+    if (!memmem(buf, len, "_flb_seq", 8)) {
+        return;
+    }
+
+    find = mp ? flb_stamp_find_mp : flb_stamp_find;
+    now = flb_stamp_now();
+
+    pthread_mutex_lock(&ctx->lock);
+    while (find(buf, len, &off, &seq, &ts)) {
+        flb_stamp_track(&ctx->stamps, seq, ts, now);
+        flb_histogram_record(ctx->round_hist, now > ts ? now - ts : 0);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+static int sink_buf_append(struct sink_buf *b, const char *data, size_t len)
+{
+    size_t size;
+    char *tmp;
+
+    if (b->len + len + 1 > b->size) {
+        size = b->size ? b->size : 4096;
+        while (b->len + len + 1 > size) {
+            size *= 2;
+        }
+        tmp = realloc(b->data, size);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        b->data = tmp;
+        b->size = size;
+    }
+
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+static int sink_buf_printf(struct sink_buf *b, const char *fmt, ...)
+{
+    int len;
+    char tmp[512];
+    va_list ap;
+
+    va_start(ap, fmt);
+    len = vsnprintf(tmp, sizeof(tmp), fmt, ap);
+    va_end(ap);
+
+    if (len < 0 || len >= sizeof(tmp)) {
+        return -1;
+    }
+    return sink_buf_append(b, tmp, len);
+}
+
+/* Value of the active fault of a type, zero if none is scheduled now */
+static int sink_fault_get(struct sink_ctx *ctx, int type)
+{
+    int i;
+    int value = 0;
+    uint64_t secs;
+    struct sink_fault *f;
+
+    if (ctx->n_faults == 0) {
+        return 0;
+    }
+
+    secs = (flb_time_now_us() - ctx->start_us) / 1000000;
+    for (i = 0; i < ctx->n_faults; i++) {
+        f = &ctx->faults[i];
+        if (f->type == type && secs >= f->start &&
+            (f->end == -1 || secs < f->end)) {
+            value = f->value;
+        }
+    }
+    return value;
+}
+
+/* Roll the dice for a percentage fault, counts it when injected */
+static int sink_fault_roll(struct sink_worker *w, int type)
+{
+    int pct = sink_fault_get(w->ctx, type);
+
+    if (pct <= 0 || (rand_r(&w->seed) % 100) >= pct) {
+        return 0;
+    }
+    __atomic_add_fetch(&w->faults[type], 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+/* Abort the connection with a RST instead of a FIN */
+static int sink_conn_reset(struct sink_conn *conn)
+{
+    struct linger lg = { 1, 0 };
+
+    setsockopt(conn->fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    return -1;
+}
+
+static void sink_timer_add(struct sink_worker *w, struct sink_conn *conn)
+{
+    if (!conn->in_timers) {
+        mk_list_add(&conn->_timer, &w->timers);
+        conn->in_timers = 1;
+    }
+}
+
+/* Events of a connection: reads unless paused, writes while pending */
+static void sink_conn_events(struct sink_worker *w, struct sink_conn *conn)
+{
+    struct epoll_event ev;
+
+    ev.events = (conn->paused ? 0 : EPOLLIN) | (conn->writing ? EPOLLOUT : 0);
+    ev.data.ptr = conn;
+    epoll_ctl(w->efd, EPOLL_CTL_MOD, conn->fd, &ev);
+}
+
+/*
+ * Send the pending replies, what the socket does not take waits for
+ * EPOLLOUT. Returns -1 on error or when a closing connection is done.
+ */
+static int sink_conn_flush(struct sink_worker *w, struct sink_conn *conn)
+{
+    ssize_t ret;
+
+    if (conn->out.len > 0) {
+        ret = send(conn->fd, conn->out.data, conn->out.len, MSG_NOSIGNAL);
+        if (ret == -1 && errno != EAGAIN && errno != EINTR) {
+            return -1;
+        }
+        else if (ret > 0) {
+            memmove(conn->out.data, conn->out.data + ret,
+                    conn->out.len - ret);
+            conn->out.len -= ret;
+        }
+    }
+
+    if ((conn->out.len > 0) != conn->writing) {
+        conn->writing = (conn->out.len > 0);
+        sink_conn_events(w, conn);
+    }
+    if (conn->out.len == 0 && conn->closing) {
+        return -1;
+    }
+    return 0;
+}
+
+/* Send a reply now or queue it when the latency fault is active */
+static int sink_conn_send(struct sink_worker *w, struct sink_conn *conn,
+                          const char *data, size_t len)
+{
+    ssize_t ret;
+    int ms = sink_fault_get(w->ctx, SINK_FAULT_LATENCY);
+
+    if (ms <= 0 && conn->out.len == 0) {
+        ret = send(conn->fd, data, len, MSG_NOSIGNAL);
+        if (ret == -1) {
+            if (errno != EAGAIN && errno != EINTR) {
+                return -1;
+            }
+            ret = 0;
+        }
+        if (ret == len) {
+            return 0;
+        }
+
+        /* short write, the rest goes out on EPOLLOUT */
+        if (sink_buf_append(&conn->out, data + ret, len - ret) == -1) {
+            return -1;
+        }
+        conn->writing = 1;
+        sink_conn_events(w, conn);
+        return 0;
+    }
+
+    if (conn->out.len == 0) {
+        conn->due_us = flb_time_now_us() + (ms * 1000);
+    }
+    if (ms > 0) {
+        __atomic_add_fetch(&w->faults[SINK_FAULT_LATENCY], 1,
+                           __ATOMIC_RELAXED);
+    }
+    sink_timer_add(w, conn);
+    return sink_buf_append(&conn->out, data, len);
+}
+
+/* FNV-1a */
+static uint32_t stream_hash(const char *name, size_t len)
+{
+    size_t i;
+    uint32_t h = 2166136261u;
+
+    for (i = 0; i < len; i++) {
+        h = (h ^ (uint8_t) name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static int sink_stream_add(struct sink_streams *t, const char *name,
+                           size_t len, uint64_t records)
+{
+    uint32_t h;
+    struct sink_stream *st;
+
+    h = stream_hash(name, len) % SINK_STREAM_BUCKETS;
+    for (st = t->buckets[h]; st; st = st->next) {
+        if (st->len == len && memcmp(st->name, name, len) == 0) {
+            st->records += records;
+            return 0;
+        }
+    }
+
+    st = malloc(sizeof(struct sink_stream));
+    if (!st) {
+        perror("malloc");
+        return -1;
+    }
+    st->name = strndup(name, len);
+    st->len = len;
+    st->records = records;
+    st->next = t->buckets[h];
+    t->buckets[h] = st;
+    t->count++;
+    return 0;
+}
+
+static void sink_streams_destroy(struct sink_streams *t)
+{
+    int i;
+    struct sink_stream *st;
+    struct sink_stream *next;
+
+    for (i = 0; i < SINK_STREAM_BUCKETS; i++) {
+        for (st = t->buckets[i]; st; st = next) {
+            next = st->next;
+            free(st->name);
+            free(st);
+        }
+        t->buckets[i] = NULL;
+    }
+    t->count = 0;
+}
+
+/*
+ * Minimal JSON walking for the fake backends: values are skipped without
+ * being decoded, only the few keys each API needs are looked at.
+ */
+static const char *json_ws(const char *p, const char *end)
+{
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        p++;
+    }
+    return p;
+}
+
+static const char *json_string_end(const char *p, const char *end)
+{
+    for (p++; p < end; p++) {
+        if (*p == '\\') {
+            p++;
+        }
+        else if (*p == '"') {
+            return p + 1;
+        }
+    }
+    return NULL;
+}
+
+/* Returns the position right after the value starting at 'p' or NULL */
+static const char *json_skip(const char *p, const char *end)
+{
+    int depth = 0;
+
+    if (p >= end) {
+        return NULL;
+    }
+    else if (*p == '"') {
+        return json_string_end(p, end);
+    }
+    else if (*p != '{' && *p != '[') {
+        while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+               *p != ' ' && *p != '\r' && *p != '\n' && *p != '\t') {
+            p++;
+        }
+        return p;
+    }
+
+    for (; p < end; p++) {
+        if (*p == '"') {
+            p = json_string_end(p, end);
+            if (!p) {
+                return NULL;
+            }
+            p--;
+        }
+        else if (*p == '{' || *p == '[') {
+            depth++;
+        }
+        else if (*p == '}' || *p == ']') {
+            if (--depth == 0) {
+                return p + 1;
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Iterate the members of an object or the items of an array: '*p' points
+ * to the opening bracket the first time. Returns 1 with the next member,
+ * 0 at the end and -1 on invalid data. 'key' is NULL for arrays.
+ */
+static int json_next(const char **p, const char *end,
+                     const char **key, size_t *key_len,
+                     const char **val, const char **val_end)
+{
+    const char *c = json_ws(*p, end);
+    const char *k = NULL;
+
+    if (c >= end) {
+        return -1;
+    }
+    if (*c == '{' || *c == '[' || *c == ',') {
+        c = json_ws(c + 1, end);
+    }
+    if (c < end && (*c == '}' || *c == ']')) {
+        *p = c + 1;
+        return 0;
+    }
+
+    if (key) {
+        if (c >= end || *c != '"') {
+            return -1;
+        }
+        k = c + 1;
+        c = json_string_end(c, end);
+        if (!c) {
+            return -1;
+        }
+        *key = k;
+        *key_len = (c - 1) - k;
+
+        c = json_ws(c, end);
+        if (c >= end || *c != ':') {
+            return -1;
+        }
+        c = json_ws(c + 1, end);
+    }
+
+    *val = c;
+    *val_end = json_skip(c, end);
+    if (!*val_end) {
+        return -1;
+    }
+    *p = *val_end;
+    return 1;
+}
+
+static int json_key_is(const char *key, size_t len, char *name)
+{
+    return (len == strlen(name) && memcmp(key, name, len) == 0);
+}
+
+/* Value of a top level string member of an object, quotes removed */
+static int json_get_str(const char *obj, const char *end, char *name,
+                        const char **val, size_t *val_len)
+{
+    int ret;
+    const char *p = obj;
+    const char *key;
+    const char *v;
+    const char *v_end;
+    size_t key_len;
+
+    while ((ret = json_next(&p, end, &key, &key_len, &v, &v_end)) == 1) {
+        if (json_key_is(key, key_len, name) && *v == '"') {
+            *val = v + 1;
+            *val_len = (v_end - 1) - (v + 1);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/* Consume the complete lines of the buffer */
+static ssize_t sink_tcp_process(struct sink_worker *w, struct sink_conn *conn)
+{
+    size_t len;
+    char *last;
+
+    last = memrchr(conn->buf, '\n', conn->len);
+    if (!last) {
+        return 0;
+    }
+    len = (last - conn->buf) + 1;
+
+    if (sink_fault_roll(w, SINK_FAULT_RESET)) {
+        return sink_conn_reset(conn);
+    }
+
+    sink_stamps(w->ctx, conn->buf, len, 0);
+    __atomic_add_fetch(&w->records, count_lines(conn->buf, len),
+                       __ATOMIC_RELAXED);
+    return len;
+}
+
+/* Map a Content-Encoding value, it's not NULL terminated */
+static int content_encoding(const char *val, size_t len)
+{
+    int type;
+    char *name;
+
+    for (type = FLB_COMPRESS_GZIP; type <= FLB_COMPRESS_ZSTD; type++) {
+        name = flb_compress_name(type);
+        if (len >= strlen(name) && strncasecmp(val, name, strlen(name)) == 0) {
+            return type;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Elasticsearch _bulk: NDJSON action and document lines. Every action gets
+ * an item in the response, like a real cluster does, so the agent pays the
+ * cost of parsing it.
+ */
+static int es_bulk(struct sink_worker *w, struct flb_http_request *req,
+                   const char *body, size_t body_len, int *status)
+{
+    int items = 0;
+    const char *p = body;
+    const char *end = body + body_len;
+    const char *eol;
+    const char *op;
+    const char *it;
+    const char *meta;
+    const char *meta_end;
+    const char *idx;
+    const char *q;
+    size_t op_len;
+    size_t idx_len;
+    size_t def_len = 0;
+    const char *def = NULL;
+    struct sink_buf *b = &w->body;
+
+    /* default index from the URI: /INDEX/_bulk */
+    if (req->uri_len > 7 && req->uri[0] == '/' && req->uri[1] != '_') {
+        def = req->uri + 1;
+        q = memchr(def, '/', req->uri_len - 1);
+        def_len = q ? q - def : 0;
+    }
+
+    sink_buf_printf(b, "{\"took\":0,\"errors\":false,\"items\":[");
+    while (p < end) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+        p = json_ws(p, eol);
+        if (p == eol) {
+            p = eol + 1;
+            continue;
+        }
+
+        /* action line: {"OP":{"_index":"NAME",...}} */
+        it = p;
+        if (json_next(&it, eol, &op, &op_len, &meta, &meta_end) != 1) {
+            *status = 400;
+            return -1;
+        }
+        if (json_get_str(meta, meta_end, "_index", &idx, &idx_len) == -1) {
+            idx = def ? def : "_default";
+            idx_len = def ? def_len : 8;
+        }
+        sink_stream_add(&w->streams, idx, idx_len, 1);
+
+        sink_buf_printf(b, "%s{\"%.*s\":{\"_index\":\"%.*s\",\"_id\":\"%i-%lu\","
+                        "\"_version\":1,\"result\":\"created\",\"status\":201}}",
+                        items > 0 ? "," : "", (int) op_len, op,
+                        (int) idx_len, idx, w->id, w->next_id++);
+        items++;
+
+        /* every action but delete is followed by the document */
+        p = eol + 1;
+        if (!json_key_is(op, op_len, "delete") && p < end) {
+            eol = memchr(p, '\n', end - p);
+            p = eol ? eol + 1 : end;
+        }
+    }
+    sink_buf_printf(b, "]}");
+
+    sink_stamps(w->ctx, body, body_len, 0);
+    __atomic_add_fetch(&w->records, items, __ATOMIC_RELAXED);
+    *status = 200;
+    return 0;
+}
+
+static int es_request(struct sink_worker *w, struct flb_http_request *req,
+                      const char *body, size_t body_len, int *status)
+{
+    if (memmem(req->uri, req->uri_len, "_bulk", 5)) {
+        return es_bulk(w, req, body, body_len, status);
+    }
+
+    /* cluster info for version probes, anything else is acknowledged */
+    *status = 200;
+    if (req->uri_len == 1 && req->method_len == 3) {
+        return sink_buf_printf(&w->body,
+                               "{\"name\":\"flb-sink\",\"cluster_name\":\"flb-perf\","
+                               "\"version\":{\"number\":\"8.11.0\"},"
+                               "\"tagline\":\"You Know, for Search\"}");
+    }
+    return sink_buf_printf(&w->body, "{\"acknowledged\":true}");
+}
+
+/* Loki push: {"streams":[{"stream":{LABELS},"values":[[TS,LINE],...]}]} */
+static int loki_push(struct sink_worker *w, struct flb_http_request *req,
+                     const char *body, size_t body_len, int *status)
+{
+    int ret;
+    int has_values;
+    uint64_t records = 0;
+    uint64_t n;
+    const char *end = body + body_len;
+    const char *p;
+    const char *key;
+    const char *val;
+    const char *val_end;
+    const char *st;
+    const char *st_end;
+    const char *m;
+    const char *m_end;
+    const char *item;
+    const char *item_end;
+    const char *labels;
+    const char *labels_end;
+    size_t key_len;
+    size_t val_len;
+
+    val = flb_http_header_get(req->method, req->header_len, "Content-Type",
+                              &val_len);
+    if (val && memmem(val, val_len, "protobuf", 8)) {
+        /* snappy protobuf pushes are not decoded */
+        *status = 415;
+        return -1;
+    }
+
+    p = json_ws(body, end);
+    while ((ret = json_next(&p, end, &key, &key_len, &val, &val_end)) == 1) {
+        if (!json_key_is(key, key_len, "streams") || *val != '[') {
+            continue;
+        }
+
+        /* every stream object */
+        while ((ret = json_next(&val, val_end, NULL, NULL,
+                                &st, &st_end)) == 1) {
+            n = 0;
+            has_values = 0;
+            labels = "{}";
+            labels_end = labels + 2;
+
+            while (json_next(&st, st_end, &key, &key_len, &m, &m_end) == 1) {
+                if (json_key_is(key, key_len, "stream")) {
+                    labels = m;
+                    labels_end = m_end;
+                }
+                else if (json_key_is(key, key_len, "values")) {
+                    has_values = 1;
+                    while (json_next(&m, m_end, NULL, NULL,
+                                     &item, &item_end) == 1) {
+                        n++;
+                    }
+                }
+            }
+            if (has_values) {
+                sink_stream_add(&w->streams, labels, labels_end - labels, n);
+                records += n;
+            }
+        }
+        if (ret == -1) {
+            break;
+        }
+    }
+    if (ret == -1) {
+        *status = 400;
+        return -1;
+    }
+
+    sink_stamps(w->ctx, body, body_len, 0);
+    __atomic_add_fetch(&w->records, records, __ATOMIC_RELAXED);
+    *status = 204;
+    return 0;
+}
+
+/* Splunk HEC: concatenated event objects or raw lines, optional acks */
+static int splunk_request(struct sink_worker *w, struct flb_http_request *req,
+                          const char *body, size_t body_len, int *status)
+{
+    int ret;
+    int first = 1;
+    uint64_t records = 0;
+    const char *p;
+    const char *end = body + body_len;
+    const char *obj;
+    const char *obj_end;
+    const char *idx;
+    const char *key;
+    const char *val;
+    size_t idx_len;
+    size_t key_len;
+    size_t val_len;
+    struct sink_buf *b = &w->body;
+
+    *status = 200;
+    if (memmem(req->uri, req->uri_len, "/health", 7)) {
+        return sink_buf_printf(b, "{\"text\":\"HEC is healthy\",\"code\":17}");
+    }
+    else if (memmem(req->uri, req->uri_len, "/ack", 4)) {
+        /* {"acks":[1,2,3]}: every event is always indexed */
+        sink_buf_printf(b, "{\"acks\":{");
+        p = json_ws(body, end);
+        while (json_next(&p, end, &key, &key_len, &val, &obj_end) == 1) {
+            if (!json_key_is(key, key_len, "acks") || *val != '[') {
+                continue;
+            }
+            while (json_next(&val, obj_end, NULL, NULL, &obj, &idx) == 1) {
+                sink_buf_printf(b, "%s\"%.*s\":true", first ? "" : ",",
+                                (int) (idx - obj), obj);
+                first = 0;
+            }
+        }
+        return sink_buf_printf(b, "}}");
+    }
+    else if (memmem(req->uri, req->uri_len, "/raw", 4)) {
+        records = count_lines(body, body_len);
+        if (body_len > 0 && body[body_len - 1] != '\n') {
+            records++;
+        }
+        sink_stream_add(&w->streams, "main", 4, records);
+    }
+    else {
+        p = json_ws(body, end);
+        while (p < end) {
+            obj = p;
+            obj_end = json_skip(p, end);
+            if (*obj != '{' || !obj_end) {
+                /* like HEC, the events before the invalid one are kept */
+                __atomic_add_fetch(&w->records, records, __ATOMIC_RELAXED);
+                *status = 400;
+                sink_buf_printf(b, "{\"text\":\"Invalid data format\","
+                                "\"code\":6,\"invalid-event-number\":%lu}",
+                                records);
+                return -1;
+            }
+
+            ret = json_get_str(obj, obj_end, "index", &idx, &idx_len);
+            if (ret == -1) {
+                idx = "main";
+                idx_len = 4;
+            }
+            sink_stream_add(&w->streams, idx, idx_len, 1);
+            records++;
+            p = json_ws(obj_end, end);
+        }
+    }
+
+    sink_stamps(w->ctx, body, body_len, 0);
+    __atomic_add_fetch(&w->records, records, __ATOMIC_RELAXED);
+
+    /* indexer acknowledgement is enabled per channel */
+    val = flb_http_header_get(req->method, req->header_len,
+                              "X-Splunk-Request-Channel", &val_len);
+    if (val) {
+        return sink_buf_printf(b, "{\"text\":\"Success\",\"code\":0,"
+                               "\"ackId\":%lu}",
+                               w->next_id++ * w->ctx->n_workers + w->id);
+    }
+    return sink_buf_printf(b, "{\"text\":\"Success\",\"code\":0}");
+}
+
+static char *http_reason(int status)
+{
+    switch (status) {
+    case 200:
+        return "OK";
+    case 204:
+        return "No Content";
+    case 400:
+        return "Bad Request";
+    case 415:
+        return "Unsupported Media Type";
+    case 429:
+        return "Too Many Requests";
+    case 503:
+        return "Service Unavailable";
+    default:
+        return "Internal Server Error";
+    }
+}
+
+/* Compose the response with the body left by the handler in w->body */
+static int sink_http_reply(struct sink_worker *w, struct sink_conn *conn,
+                           int status)
+{
+    struct sink_buf *b = &w->reply;
+
+    b->len = 0;
+    if (status == 204) {
+        sink_buf_printf(b, "HTTP/1.1 204 No Content\r\n\r\n");
+    }
+    else {
+        sink_buf_printf(b, "HTTP/1.1 %i %s\r\n"
+                        "Content-Type: application/json\r\n"
+                        "Content-Length: %zu\r\n"
+                        "%s"
+                        "\r\n", status, http_reason(status), w->body.len,
+                        status == 429 ? "Retry-After: 1\r\n" : "");
+        sink_buf_append(b, w->body.data ? w->body.data : "", w->body.len);
+    }
+
+    return sink_conn_send(w, conn, b->data, b->len);
+}
+
+/* Consume the complete requests of the buffer and reply them */
+static ssize_t sink_http_process(struct sink_worker *w, struct sink_conn *conn)
+{
+    int ret = 0;
+    int type;
+    int status;
+    int close_conn = 0;
+    ssize_t req_len;
+    size_t off = 0;
+    size_t val_len;
+    size_t body_len;
+    void *body;
+    char *plain;
+    const char *val;
+    struct flb_http_request req;
+
+    while (off < conn->len) {
+        req_len = flb_http_request_parse(conn->buf + off, conn->len - off,
+                                         &req);
+        if (req_len == -1) {
+            fprintf(stderr, "error: invalid HTTP request\n");
+            return -1;
+        }
+        else if (req_len == 0) {
+            break;
+        }
+
+        if (sink_fault_roll(w, SINK_FAULT_RESET)) {
+            return sink_conn_reset(conn);
+        }
+
+        body = conn->buf + off + req.header_len;
+        body_len = req.body_len;
+        plain = NULL;
+        ret = 0;
+        status = 200;
+        w->body.len = 0;
+
+        /* injected failures are not processed, the agent must retry */
+        if (sink_fault_roll(w, SINK_FAULT_ERROR)) {
+            status = 503;
+            body_len = 0;
+        }
+        else if (sink_fault_roll(w, SINK_FAULT_THROTTLE)) {
+            status = 429;
+            body_len = 0;
+        }
+
+        /* chunk sizes out before the content coding and the counting */
+        if (req.chunked && body_len > 0 && status == 200) {
+            if (flb_http_chunked_decode(body, body_len, &plain,
+                                        &body_len) == -1) {
+                body_len = 0;
+                status = 400;
+            }
+            else {
+                body = plain;
+            }
+        }
+
+        val = flb_http_header_get(conn->buf + off, req.header_len,
+                                  "Content-Encoding", &val_len);
+        if (val && body_len > 0 && status == 200) {
+            type = content_encoding(val, val_len);
+            if (type == -1 ||
+                flb_decompress(type, body, body_len, &body, &body_len) == -1) {
+                body = NULL;
+                body_len = 0;
+                status = 415;
+            }
+        }
+
+        /* handlers set the status, the response body goes to w->body */
+        if (status != 200) {
+            ret = -1;
+        }
+        else if (w->ctx->proto == SINK_PROTO_ES) {
+            ret = es_request(w, &req, body, body_len, &status);
+        }
+        else if (w->ctx->proto == SINK_PROTO_LOKI) {
+            ret = loki_push(w, &req, body, body_len, &status);
+        }
+        else if (w->ctx->proto == SINK_PROTO_SPLUNK) {
+            ret = splunk_request(w, &req, body, body_len, &status);
+        }
+        else if (body_len > 0) {
+            sink_stamps(w->ctx, body, body_len, 0);
+            __atomic_add_fetch(&w->records, count_json(body, body_len),
+                               __ATOMIC_RELAXED);
+        }
+
+        if (ret == -1 && status < 400) {
+            status = 500;
+        }
+        if (status >= 400 && status != 429 && status != 503) {
+            __atomic_add_fetch(&w->errors, 1, __ATOMIC_RELAXED);
+        }
+        if (body && body != conn->buf + off + req.header_len &&
+            body != plain) {
+            free(body);
+        }
+        free(plain);
+        __atomic_add_fetch(&w->requests, 1, __ATOMIC_RELAXED);
+
+        if (sink_http_reply(w, conn, status) == -1) {
+            return -1;
+        }
+        off += req_len;
+
+        if (req.close) {
+            /* a delayed reply closes the connection once it's sent */
+            if (conn->out.len > 0) {
+                conn->closing = 1;
+            }
+            else {
+                close_conn = 1;
+            }
+            break;
+        }
+    }
+
+    return close_conn ? -1 : off;
+}
+
+/* Count the entries of a PackedForward stream */
+static uint64_t forward_entries(const char *buf, size_t len)
+{
+    size_t off = 0;
+    uint64_t n = 0;
+
+    while (off < len && flb_mp_skip(buf, len, &off) == FLB_MP_OK) {
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Handle one Forward message: [tag, time, record, option],
+ * [tag, [[time, record], ...], option] or [tag, entries, option] where the
+ * entries may be gzip compressed. Acks are sent when a chunk id is given.
+ */
+static int forward_message(struct sink_worker *w, struct sink_conn *conn,
+                           const char *buf, size_t len)
+{
+    int ret;
+    int compressed = 0;
+    uint32_t n;
+    uint32_t i;
+    size_t off = 0;
+    size_t o;
+    size_t entries_len = 0;
+    size_t chunk_len = 0;
+    size_t out_len;
+    uint64_t records = 0;
+    const char *entries = NULL;
+    const char *chunk = NULL;
+    const char *key;
+    size_t key_len;
+    void *out;
+    struct flb_mp_obj obj;
+    struct flb_mp_buf ack;
+
+    if (flb_mp_unpack_array(buf, len, &off, &n) != FLB_MP_OK || n < 2 ||
+        flb_mp_skip(buf, len, &off) != FLB_MP_OK) {
+        return -1;
+    }
+
+    o = off;
+    if (flb_mp_unpack_next(buf, len, &o, &obj) != FLB_MP_OK) {
+        return -1;
+    }
+
+    if (obj.type == FLB_MP_ARRAY) {
+        /* Forward mode */
+        records = obj.via.n;
+        entries = buf + off;
+        flb_mp_skip(buf, len, &off);
+        entries_len = (buf + off) - entries;
+        n -= 2;
+    }
+    else if (obj.type == FLB_MP_STR || obj.type == FLB_MP_BIN) {
+        /* PackedForward and CompressedPackedForward modes */
+        entries = obj.via.raw.ptr;
+        entries_len = obj.via.raw.size;
+        off = o;
+        n -= 2;
+    }
+    else {
+        /* Message mode */
+        records = 1;
+        entries = buf + off;
+        flb_mp_skip(buf, len, &off);
+        flb_mp_skip(buf, len, &off);
+        entries_len = (buf + off) - entries;
+        n = (n > 3) ? n - 3 : 0;
+    }
+
+    /* options */
+    if (n > 0 && flb_mp_unpack_map(buf, len, &off, &n) == FLB_MP_OK) {
+        for (i = 0; i < n; i++) {
+            if (flb_mp_unpack_str(buf, len, &off, &key, &key_len) != FLB_MP_OK) {
+                break;
+            }
+            o = off;
+            if (flb_mp_unpack_next(buf, len, &o, &obj) != FLB_MP_OK) {
+                break;
+            }
+            if (key_len == 5 && memcmp(key, "chunk", 5) == 0 &&
+                obj.type == FLB_MP_STR) {
+                chunk = obj.via.raw.ptr;
+                chunk_len = obj.via.raw.size;
+            }
+            else if (key_len == 10 && memcmp(key, "compressed", 10) == 0 &&
+                     obj.type == FLB_MP_STR && obj.via.raw.size == 4 &&
+                     memcmp(obj.via.raw.ptr, "gzip", 4) == 0) {
+                compressed = 1;
+            }
+            flb_mp_skip(buf, len, &off);
+        }
+    }
+
+    if (compressed) {
+        ret = flb_decompress(FLB_COMPRESS_GZIP, entries, entries_len,
+                             &out, &out_len);
+        if (ret == -1) {
+            __atomic_add_fetch(&w->errors, 1, __ATOMIC_RELAXED);
+        }
+        else {
+            records = forward_entries(out, out_len);
+            sink_stamps(w->ctx, out, out_len, 1);
+            free(out);
+        }
+    }
+    else {
+        if (records == 0) {
+            records = forward_entries(entries, entries_len);
+        }
+        sink_stamps(w->ctx, entries, entries_len, 1);
+    }
+    __atomic_add_fetch(&w->records, records, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&w->requests, 1, __ATOMIC_RELAXED);
+
+    if (chunk) {
+        if (flb_mp_buf_init(&ack, chunk_len + 16) == -1) {
+            return -1;
+        }
+        flb_mp_pack_map(&ack, 1);
+        flb_mp_pack_str(&ack, "ack", 3);
+        flb_mp_pack_str(&ack, chunk, chunk_len);
+        ret = sink_conn_send(w, conn, ack.data, ack.len);
+        flb_mp_buf_destroy(&ack);
+        if (ret == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Consume the complete Forward messages of the buffer */
+static ssize_t sink_forward_process(struct sink_worker *w,
+                                    struct sink_conn *conn)
+{
+    int ret;
+    size_t off = 0;
+    size_t end;
+
+    while (off < conn->len) {
+        end = off;
+        ret = flb_mp_skip(conn->buf, conn->len, &end);
+        if (ret == FLB_MP_INCOMPLETE) {
+            break;
+        }
+
+        /* failed messages are dropped without an ack */
+        if (ret == FLB_MP_OK) {
+            if (sink_fault_roll(w, SINK_FAULT_RESET)) {
+                return sink_conn_reset(conn);
+            }
+            if (sink_fault_roll(w, SINK_FAULT_ERROR) ||
+                sink_fault_roll(w, SINK_FAULT_THROTTLE)) {
+                off = end;
+                continue;
+            }
+        }
+
+        if (ret != FLB_MP_OK ||
+                 forward_message(w, conn, conn->buf + off, end - off) == -1) {
+            fprintf(stderr, "error: invalid Forward message\n");
+            return -1;
+        }
+        off = end;
+    }
+
+    return off;
+}
+
+static void sink_conn_close(struct sink_worker *w, struct sink_conn *conn)
+{
+    if (conn->in_timers) {
+        mk_list_del(&conn->_timer);
+    }
+    epoll_ctl(w->efd, EPOLL_CTL_DEL, conn->fd, NULL);
+    close(conn->fd);
+    free(conn->out.data);
+    free(conn->buf);
+    free(conn);
+}
+
+/*
+ * Flush the delayed replies and resume the throttled reads that are due,
+ * returns the epoll timeout until the next one.
+ */
+static int sink_timers_run(struct sink_worker *w)
+{
+    int ms = 100;
+    uint64_t now;
+    uint64_t next = 0;
+    struct mk_list *head;
+    struct mk_list *tmp;
+    struct sink_conn *conn;
+
+    if (mk_list_is_empty(&w->timers) == 0) {
+        return ms;
+    }
+
+    now = flb_time_now_us();
+    mk_list_foreach_safe(head, tmp, &w->timers) {
+        conn = mk_list_entry(head, struct sink_conn, _timer);
+
+        /* due replies, a short write continues on EPOLLOUT */
+        if (conn->out.len > 0 && !conn->writing && conn->due_us <= now &&
+            sink_conn_flush(w, conn) == -1) {
+            sink_conn_close(w, conn);
+            continue;
+        }
+
+        if (conn->paused && conn->resume_us <= now) {
+            conn->paused = 0;
+            sink_conn_events(w, conn);
+        }
+
+        if ((conn->out.len == 0 || conn->writing) && !conn->paused) {
+            mk_list_del(&conn->_timer);
+            conn->in_timers = 0;
+            continue;
+        }
+
+        if (conn->out.len > 0 && !conn->writing &&
+            (next == 0 || conn->due_us < next)) {
+            next = conn->due_us;
+        }
+        if (conn->paused && (next == 0 || conn->resume_us < next)) {
+            next = conn->resume_us;
+        }
+    }
+
+    if (next > 0) {
+        ms = (next > now) ? ((next - now) / 1000) + 1 : 0;
+        if (ms > 100) {
+            ms = 100;
+        }
+    }
+    return ms;
+}
+
+static int sink_conn_read(struct sink_worker *w, struct sink_conn *conn)
+{
+    int kbps;
+    ssize_t ret;
+    size_t size;
+    size_t max;
+    char *tmp;
+
+    /* grow by doubling, Forward chunks can be several megabytes */
+    if (conn->size - conn->len < SINK_READ_SIZE) {
+        size = conn->size ? conn->size * 2 : SINK_READ_SIZE * 2;
+        tmp = realloc(conn->buf, size);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        conn->buf = tmp;
+        conn->size = size;
+    }
+
+    /* slow reader: 100ms worth of data, then pause for its duration */
+    max = conn->size - conn->len;
+    kbps = sink_fault_get(w->ctx, SINK_FAULT_SLOW);
+    if (kbps > 0 && max > (kbps * 1024) / 10) {
+        max = (kbps * 1024) / 10;
+        if (max == 0) {
+            max = 1;
+        }
+    }
+
+    ret = read(conn->fd, conn->buf + conn->len, max);
+    if (ret == -1) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return 0;
+        }
+        return -1;
+    }
+    else if (ret == 0) {
+        return -1;
+    }
+    conn->len += ret;
+    __atomic_add_fetch(&w->bytes, ret, __ATOMIC_RELAXED);
+
+    if (kbps > 0) {
+        conn->paused = 1;
+        sink_conn_events(w, conn);
+        conn->resume_us = flb_time_now_us() + (ret * 1000000) / (kbps * 1024);
+        sink_timer_add(w, conn);
+        __atomic_add_fetch(&w->faults[SINK_FAULT_SLOW], 1, __ATOMIC_RELAXED);
+    }
+
+    if (w->ctx->proto == SINK_PROTO_TCP) {
+        ret = sink_tcp_process(w, conn);
+    }
+    else if (w->ctx->proto == SINK_PROTO_FORWARD) {
+        ret = sink_forward_process(w, conn);
+    }
+    else {
+        ret = sink_http_process(w, conn);
+    }
+    if (ret == -1) {
+        return -1;
+    }
+
+    /* keep the incomplete data for the next read */
+    if (ret > 0) {
+        memmove(conn->buf, conn->buf + ret, conn->len - ret);
+        conn->len -= ret;
+    }
+    return 0;
+}
+
+static void sink_accept(struct sink_worker *w)
+{
+    int fd;
+    int rcvbuf;
+    struct sink_conn *conn;
+    struct epoll_event ev;
+
+    while ((fd = accept4(w->server_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        conn = calloc(1, sizeof(struct sink_conn));
+        if (!conn) {
+            perror("calloc");
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+
+        /* a tiny receive window for the connections accepted now */
+        rcvbuf = sink_fault_get(w->ctx, SINK_FAULT_RCVBUF);
+        if (rcvbuf > 0) {
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+            __atomic_add_fetch(&w->faults[SINK_FAULT_RCVBUF], 1,
+                               __ATOMIC_RELAXED);
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = conn;
+        if (epoll_ctl(w->efd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+            perror("epoll_ctl");
+            close(fd);
+            free(conn);
+            continue;
+        }
+        __atomic_add_fetch(&w->connections, 1, __ATOMIC_RELAXED);
+    }
+}
+
+static void *sink_worker(void *data)
+{
+    int i;
+    int n;
+    int timeout = 100;
+    struct sink_conn *conn;
+    struct sink_worker *w = data;
+    struct epoll_event events[SINK_MAX_EVENTS];
+
+    while (!sink_exit) {
+        n = epoll_wait(w->efd, events, SINK_MAX_EVENTS, timeout);
+        for (i = 0; i < n; i++) {
+            conn = events[i].data.ptr;
+            if (conn == NULL) {
+                sink_accept(w);
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) &&
+                sink_conn_flush(w, conn) == -1) {
+                sink_conn_close(w, conn);
+                continue;
+            }
+            if ((events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) &&
+                sink_conn_read(w, conn) == -1) {
+                sink_conn_close(w, conn);
+            }
+        }
+        timeout = sink_timers_run(w);
+    }
+
+    return NULL;
+}
+
+static int sink_workers_start(struct sink_ctx *ctx, char *host, char *port)
+{
+    int i;
+    struct sink_worker *w;
+    struct epoll_event ev;
+
+    ctx->workers = calloc(ctx->n_workers, sizeof(struct sink_worker));
+    if (!ctx->workers) {
+        perror("calloc");
+        return -1;
+    }
+
+    for (i = 0; i < ctx->n_workers; i++) {
+        ctx->workers[i].efd = -1;
+        ctx->workers[i].server_fd = -1;
+    }
+
+    for (i = 0; i < ctx->n_workers; i++) {
+        w = &ctx->workers[i];
+        w->id = i;
+        w->ctx = ctx;
+        w->seed = time(NULL) + i;
+        mk_list_init(&w->timers);
+
+        w->server_fd = flb_net_server(host, port, ctx->n_workers > 1);
+        if (w->server_fd == -1) {
+            return -1;
+        }
+        fcntl(w->server_fd, F_SETFL, O_NONBLOCK);
+
+        w->efd = epoll_create1(EPOLL_CLOEXEC);
+        if (w->efd == -1) {
+            perror("epoll_create1");
+            return -1;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        epoll_ctl(w->efd, EPOLL_CTL_ADD, w->server_fd, &ev);
+
+        if (pthread_create(&w->tid, NULL, sink_worker, w) != 0) {
+            fprintf(stderr, "error: cannot create worker #%i\n", i);
+            w->tid = 0;
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Join the workers, their counters stay available for the summary */
+static void sink_workers_stop(struct sink_ctx *ctx)
+{
+    int i;
+    struct sink_worker *w;
+
+    if (!ctx->workers) {
+        return;
+    }
+
+    sink_exit = 1;
+    for (i = 0; i < ctx->n_workers; i++) {
+        w = &ctx->workers[i];
+        if (w->tid) {
+            pthread_join(w->tid, NULL);
+            w->tid = 0;
+        }
+        if (w->efd >= 0) {
+            close(w->efd);
+            w->efd = -1;
+        }
+        if (w->server_fd >= 0) {
+            close(w->server_fd);
+            w->server_fd = -1;
+        }
+        free(w->body.data);
+        free(w->reply.data);
+        memset(&w->body, 0, sizeof(struct sink_buf));
+        memset(&w->reply, 0, sizeof(struct sink_buf));
+    }
+}
+
+static int stream_cmp(const void *a, const void *b)
+{
+    const struct sink_stream *sa = *(struct sink_stream **) a;
+    const struct sink_stream *sb = *(struct sink_stream **) b;
+
+    if (sa->records == sb->records) {
+        return 0;
+    }
+    return (sa->records < sb->records) ? 1 : -1;
+}
+
+/* Merge the per worker streams and print the busiest ones */
+static void sink_streams_print(struct sink_ctx *ctx, int fd)
+{
+    int i;
+    uint64_t n = 0;
+    struct sink_streams all;
+    struct sink_stream *st;
+    struct sink_stream **list;
+
+    memset(&all, 0, sizeof(all));
+    for (i = 0; i < ctx->n_workers; i++) {
+        for (n = 0; n < SINK_STREAM_BUCKETS; n++) {
+            for (st = ctx->workers[i].streams.buckets[n]; st; st = st->next) {
+                sink_stream_add(&all, st->name, st->len, st->records);
+            }
+        }
+        sink_streams_destroy(&ctx->workers[i].streams);
+    }
+    if (all.count == 0) {
+        return;
+    }
+
+    list = malloc(sizeof(struct sink_stream *) * all.count);
+    if (!list) {
+        perror("malloc");
+        sink_streams_destroy(&all);
+        return;
+    }
+    n = 0;
+    for (i = 0; i < SINK_STREAM_BUCKETS; i++) {
+        for (st = all.buckets[i]; st; st = st->next) {
+            list[n++] = st;
+        }
+    }
+    qsort(list, n, sizeof(struct sink_stream *), stream_cmp);
+
+    dprintf(fd, "\n- %s (%lu)\n",
+            ctx->proto == SINK_PROTO_LOKI ? "Streams" : "Indices", all.count);
+    for (i = 0; i < n && i < SINK_STREAM_TOP; i++) {
+        dprintf(fd, "  - %-40.*s : %lu\n",
+                (int) list[i]->len, list[i]->name, list[i]->records);
+    }
+    if (n > SINK_STREAM_TOP) {
+        dprintf(fd, "  - ... %lu more\n", n - SINK_STREAM_TOP);
+    }
+
+    free(list);
+    sink_streams_destroy(&all);
+}
+
+/* Sum a counter of every worker */
+#define SINK_SUM(ctx, field, out)                                       \
+    do {                                                                \
+        int _i;                                                         \
+        out = 0;                                                        \
+        for (_i = 0; _i < (ctx)->n_workers; _i++) {                     \
+            out += __atomic_load_n(&(ctx)->workers[_i].field,           \
+                                   __ATOMIC_RELAXED);                   \
+        }                                                               \
+    } while (0)
+
+/* Parse a fault: [START-END:]NAME=VALUE, START and END are optional */
+static int sink_fault_add(struct sink_ctx *ctx, char *spec)
+{
+    int type;
+    char *p = spec;
+    char *sep;
+    char *end;
+    struct sink_fault f;
+    struct sink_fault *tmp;
+
+    f.start = 0;
+    f.end = -1;
+
+    sep = strchr(p, ':');
+    if (sep) {
+        f.start = strtol(p, &end, 10);
+        if (*end == '-') {
+            end++;
+            if (end < sep) {
+                f.end = strtol(end, &end, 10);
+            }
+        }
+        if (end != sep || f.start < 0 || (f.end != -1 && f.end <= f.start)) {
+            fprintf(stderr, "error: invalid fault schedule '%s'\n", spec);
+            return -1;
+        }
+        p = sep + 1;
+    }
+
+    sep = strchr(p, '=');
+    if (!sep) {
+        fprintf(stderr, "error: invalid fault '%s'\n", spec);
+        return -1;
+    }
+
+    for (type = 0; type < SINK_FAULT_MAX; type++) {
+        if (strncasecmp(p, sink_fault_names[type], sep - p) == 0 &&
+            strlen(sink_fault_names[type]) == sep - p) {
+            break;
+        }
+    }
+    if (type == SINK_FAULT_MAX) {
+        fprintf(stderr, "error: unknown fault '%.*s'\n", (int) (sep - p), p);
+        return -1;
+    }
+    f.type = type;
+    f.value = atoi(sep + 1);
+
+    if (f.value < 0 || (type >= SINK_FAULT_ERROR && type <= SINK_FAULT_RESET &&
+                        f.value > 100)) {
+        fprintf(stderr, "error: invalid fault value '%s'\n", spec);
+        return -1;
+    }
+
+    tmp = realloc(ctx->faults, sizeof(struct sink_fault) * (ctx->n_faults + 1));
+    if (!tmp) {
+        perror("realloc");
+        return -1;
+    }
+    ctx->faults = tmp;
+    ctx->faults[ctx->n_faults++] = f;
+    return 0;
+}
+
+static int run_sink(struct sink_ctx *ctx, pid_t pid, char *report,
+                    int fmt_report, int idle, uint64_t expected)
+{
+    int i;
+    int t;
+    int idle_secs = 0;
+    int last_start = 0;
+    int col_p50 = -1;
+    int col_p99 = -1;
+    int col_faults = -1;
+    int fd_out;
+    double p50;
+    double p99;
+    uint64_t records;
+    uint64_t bytes;
+    uint64_t requests;
+    uint64_t connections;
+    uint64_t errors;
+    uint64_t last_records = 0;
+    uint64_t last_bytes = 0;
+    uint64_t faults;
+    uint64_t last_faults = 0;
+    uint64_t count;
+    struct timespec round_start;
+    struct flb_proc_task *t1 = NULL;
+    struct flb_proc_task *t2;
+    struct flb_report *r = NULL;
+    struct sink_worker *w;
+    struct sink_fault *f;
+
+    /* Report file for process monitoring */
+    if (pid >= 0) {
+        r = flb_report_create(report, fmt_report, pid, 0);
+        if (!r) {
+            fprintf(stderr, "error: cannot initialize report");
+            return -1;
+        }
+        col_p50 = flb_report_column_add(r, "p50_ms", 8, 2);
+        col_p99 = flb_report_column_add(r, "p99_ms", 8, 2);
+        if (ctx->n_faults > 0) {
+            /* faults injected in the round, next to the agent memory */
+            col_faults = flb_report_column_add(r, "faults", 8, 0);
+        }
+        t1 = flb_proc_stat_create(pid);
+    }
+
+    /* don't stop on idle before the last scheduled fault started */
+    for (i = 0; i < ctx->n_faults; i++) {
+        if (ctx->faults[i].start > last_start) {
+            last_start = ctx->faults[i].start;
+        }
+    }
+
+    /* one row per second */
+    clock_gettime(CLOCK_MONOTONIC, &round_start);
+    while (!sink_exit) {
+        while (flb_time_sleep_until(&round_start, 1000) == -1 &&
+               !sink_exit);
+        clock_gettime(CLOCK_MONOTONIC, &round_start);
+
+        SINK_SUM(ctx, records, records);
+        SINK_SUM(ctx, bytes, bytes);
+
+        faults = 0;
+        for (t = 0; t < SINK_FAULT_MAX; t++) {
+            SINK_SUM(ctx, faults[t], count);
+            faults += count;
+        }
+
+        pthread_mutex_lock(&ctx->lock);
+        p50 = flb_histogram_percentile(ctx->round_hist, 50.0) / 1000.0;
+        p99 = flb_histogram_percentile(ctx->round_hist, 99.0) / 1000.0;
+        flb_histogram_reset(ctx->round_hist);
+        pthread_mutex_unlock(&ctx->lock);
+
+        if (r && t1) {
+            t2 = flb_proc_stat_create(pid);
+            if (t2) {
+                flb_report_column_set(r, col_p50, p50);
+                flb_report_column_set(r, col_p99, p99);
+                if (col_faults >= 0) {
+                    flb_report_column_set(r, col_faults, faults - last_faults);
+                }
+                flb_report_stats(r, records - last_records,
+                                 bytes - last_bytes, t1, t2);
+                flb_proc_stat_destroy(t1);
+                t1 = t2;
+            }
+        }
+        else if (records > last_records || faults > last_faults) {
+            printf("%10lu records  %12lu bytes",
+                   records - last_records, bytes - last_bytes);
+            if (ctx->stamps.received > 0) {
+                printf("  p50 %8.2f ms  p99 %8.2f ms", p50, p99);
+            }
+            if (ctx->n_faults > 0) {
+                printf("  faults %6lu", faults - last_faults);
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+
+        /* stop once the data stopped flowing */
+        if (bytes == last_bytes && bytes > 0) {
+            idle_secs++;
+        }
+        else {
+            idle_secs = 0;
+        }
+        last_records = records;
+        last_bytes = bytes;
+        last_faults = faults;
+
+        if (idle > 0 && idle_secs >= idle &&
+            (flb_time_now_us() - ctx->start_us) / 1000000 >= last_start) {
+            break;
+        }
+    }
+
+    sink_workers_stop(ctx);
+    if (t1) {
+        flb_proc_stat_destroy(t1);
+    }
+
+    fd_out = r ? r->fd : STDOUT_FILENO;
+    if (r) {
+        r->sum_records = last_records;
+        flb_report_summary(r);
+    }
+
+    /* workers are gone, the counters are final */
+    records = bytes = requests = connections = errors = 0;
+    dprintf(fd_out, "\n- Sink (%s)\n", sink_protocols[ctx->proto]);
+    for (i = 0; i < ctx->n_workers; i++) {
+        w = &ctx->workers[i];
+        dprintf(fd_out, "  - Worker #%-3i : %lu records, %lu connections\n",
+                i, w->records, w->connections);
+        records += w->records;
+        bytes += w->bytes;
+        requests += w->requests;
+        connections += w->connections;
+        errors += w->errors;
+    }
+    dprintf(fd_out,
+            "  - Connections : %lu\n"
+            "  - Records     : %lu\n"
+            "  - Bytes       : %lu\n",
+            connections, records, bytes);
+    if (ctx->proto != SINK_PROTO_TCP) {
+        dprintf(fd_out, "  - %-11s : %lu\n",
+                ctx->proto == SINK_PROTO_FORWARD ? "Messages" : "Requests",
+                requests);
+    }
+    if (errors > 0) {
+        dprintf(fd_out, "  - Errors      : %lu\n", errors);
+    }
+    sink_streams_print(ctx, fd_out);
+
+    if (ctx->n_faults > 0) {
+        dprintf(fd_out, "\n- Faults\n");
+        for (i = 0; i < ctx->n_faults; i++) {
+            f = &ctx->faults[i];
+            if (f->end == -1) {
+                dprintf(fd_out, "  - %-8s = %-6i : from %is\n",
+                        sink_fault_names[f->type], f->value, f->start);
+            }
+            else {
+                dprintf(fd_out, "  - %-8s = %-6i : from %is to %is\n",
+                        sink_fault_names[f->type], f->value, f->start, f->end);
+            }
+        }
+
+        /* responses delayed, requests failed, reads throttled... */
+        for (t = 0; t < SINK_FAULT_MAX; t++) {
+            count = 0;
+            for (i = 0; i < ctx->n_workers; i++) {
+                count += ctx->workers[i].faults[t];
+            }
+            dprintf(fd_out, "  - Injected %-8s : %lu\n",
+                    sink_fault_names[t], count);
+        }
+    }
+
+    if (ctx->stamps.received > 0 || expected > 0) {
+        flb_stamp_print(&ctx->stamps, fd_out, expected);
+    }
+
+    if (r) {
+        flb_report_destroy(r);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int ret;
+    int opt;
+    int pid = -1;
+    int idle = DEFAULT_IDLE;
+    int fmt_report = FLB_REPORT_TXT;
+    uint64_t expected = 0;
+    char *listen_addr = NULL;
+    char *proto = NULL;
+    char *format = NULL;
+    char *report = NULL;
+    char *host;
+    char *port;
+    char *p;
+    struct sink_ctx ctx;
+
+    /* Setup long-options */
+    static const struct option long_opts[] = {
+        { "listen"     ,   required_argument, NULL, 'l' },
+        { "protocol"   ,   required_argument, NULL, 'P' },
+        { "workers"    ,   required_argument, NULL, 'w' },
+        { "fault"      ,   required_argument, NULL, 'f' },
+        { "pid"        ,   required_argument, NULL, 'p' },
+        { "expect"     ,   required_argument, NULL, 'n' },
+        { "idle"       ,   required_argument, NULL, 't' },
+        { "report"     ,   required_argument, NULL, 'R' },
+        { "format"     ,   required_argument, NULL, 'F' },
+        { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
+    };
+
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.proto = SINK_PROTO_TCP;
+    ctx.n_workers = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((opt = getopt_long(argc, argv, "l:P:w:f:p:n:t:R:F:h",
+                              long_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'l':
+            listen_addr = strdup(optarg);
+            break;
+        case 'P':
+            proto = strdup(optarg);
+            break;
+        case 'w':
+            ctx.n_workers = atoi(optarg);
+            break;
+        case 'f':
+            if (sink_fault_add(&ctx, optarg) == -1) {
+                exit(EXIT_FAILURE);
+            }
+            break;
+        case 'p':
+            pid = atoi(optarg);
+            break;
+        case 'n':
+            expected = strtoull(optarg, NULL, 10);
+            break;
+        case 't':
+            idle = atoi(optarg);
+            break;
+        case 'R':
+            report = strdup(optarg);
+            break;
+        case 'F':
+            format = strdup(optarg);
+            break;
+        case 'h':
+            flb_help(EXIT_SUCCESS);
+            break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
+        };
+    };
+
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    if (proto) {
+        if (strcasecmp(proto, "tcp") == 0) {
+            ctx.proto = SINK_PROTO_TCP;
+        }
+        else if (strcasecmp(proto, "http") == 0) {
+            ctx.proto = SINK_PROTO_HTTP;
+        }
+        else if (strcasecmp(proto, "forward") == 0) {
+            ctx.proto = SINK_PROTO_FORWARD;
+        }
+        else if (strcasecmp(proto, "es") == 0) {
+            ctx.proto = SINK_PROTO_ES;
+        }
+        else if (strcasecmp(proto, "loki") == 0) {
+            ctx.proto = SINK_PROTO_LOKI;
+        }
+        else if (strcasecmp(proto, "splunk") == 0) {
+            ctx.proto = SINK_PROTO_SPLUNK;
+        }
+        else {
+            fprintf(stderr, "error: invalid protocol '%s'\n", proto);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (ctx.n_workers < 1) {
+        fprintf(stderr, "error: invalid number of workers '%i'\n",
+                ctx.n_workers);
+        exit(EXIT_FAILURE);
+    }
+
+    if (format) {
+        if (strcasecmp(format, "markdown") == 0) {
+            fmt_report = FLB_REPORT_MARKDOWN;
+        }
+        else if (strcasecmp(format, "text") == 0) {
+            fmt_report = FLB_REPORT_TXT;
+        }
+        else if (strcasecmp(format, "csv") == 0) {
+            fmt_report = FLB_REPORT_CSV;
+        }
+        else {
+            fprintf(stderr, "error: invalid format type");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (!listen_addr) {
+        host = strdup(DEFAULT_HOST);
+        port = strdup(DEFAULT_PORT);
+    }
+    else {
+        p = strrchr(listen_addr, ':');
+        if (!p) {
+            host = strdup(listen_addr);
+            port = strdup(DEFAULT_PORT);
+        }
+        else {
+            host = strndup(listen_addr, p - listen_addr);
+            port = strdup(*(p + 1) ? p + 1 : DEFAULT_PORT);
+        }
+    }
+
+    pthread_mutex_init(&ctx.lock, NULL);
+    ctx.round_hist = flb_histogram_create();
+    if (!ctx.round_hist || flb_stamp_stats_init(&ctx.stamps) == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, sink_signal);
+    signal(SIGTERM, sink_signal);
+
+    ctx.start_us = flb_time_now_us();
+    ret = sink_workers_start(&ctx, host, port);
+    if (ret == 0) {
+        ret = run_sink(&ctx, pid, report, fmt_report, idle, expected);
+    }
+    sink_workers_stop(&ctx);
+    free(ctx.workers);
+    free(ctx.faults);
+
+    flb_histogram_destroy(ctx.round_hist);
+    flb_stamp_stats_destroy(&ctx.stamps);
+    pthread_mutex_destroy(&ctx.lock);
+    free(listen_addr);
+    free(proto);
+    free(format);
+    free(report);
+    free(host);
+    free(port);
+
+    if (ret == -1) {
+        exit(EXIT_FAILURE);
+    }
+
+    return 0;
+}
@@ -29,18 +29,60 @@
 #include <fcntl.h>
 #include <sys/sendfile.h>
 #include <time.h>
+#include <stdint.h>
 
 /* local headers */
 #include "mk_list.h"
 #include "flb_data_file.h"
 #include "flb_proc.h"
 #include "flb_report.h"
+#include "flb_monitor.h"
+#include "flb_time.h"
 
 /* Default values */
 #define DEFAULT_RECORDS    1000  /* 1000 records per second */
 #define DEFAULT_INC_BY        0  /* no increase             */
 #define DEFAULT_SECONDS      10  /* test time: 10 seconds   */
 
+/* Saturation search */
+#define DEFAULT_WINDOW       10  /* seconds each rate is held        */
+#define DEFAULT_MAX_LAG       1  /* seconds of input behind          */
+#define DEFAULT_MAX_RSS      10  /* % of RSS growth once stable      */
+#define SEARCH_PRECISION      5  /* stop when bounds are within 5%   */
+#define SEARCH_LAG_SLOPE      2  /* max lag growth, % of the input   */
+#define SEARCH_TICKS         10  /* writes per second                */
+#define SEARCH_MAX_RATE 10000000
+#define SEARCH_RSS_NOISE (1024 * 1024)
+#define SEARCH_DRAIN_TIMEOUT 30  /* seconds for the agent to catch up */
+
+struct search_probe {
+    int rate;                    /* records per second          */
+    int ok;                      /* sustainable ?               */
+    int writer;                  /* the writer could not keep it */
+    char *reason;                /* why it's not sustainable    */
+    double cpu;                  /* avg %CPU once stable        */
+    double bytes_sec;            /* bytes per second written    */
+    long rss;                    /* max RSS once stable         */
+    off_t lag;                   /* max bytes behind once stable */
+};
+
+struct search_ctx {
+    pid_t pid;
+    int in_fd;
+    int out_fd;
+    char *out_file;
+    int n_records;               /* records in the data file    */
+    size_t *index;               /* records offsets             */
+    off_t written;               /* bytes written to out_file   */
+    int rate;                    /* current records per second  */
+    int window;
+    int max_lag;
+    int max_rss;
+    int col_rate;
+    int col_lag;
+    struct flb_report *r;
+};
+
 static int flb_help(int rc)
 {
     printf("Usage: flb-tail-writer [OPTIONS]\n\n");
@@ -57,8 +99,16 @@ static int flb_help(int rc)
     printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
     printf("  -F, --format\t\t\treport format, text (default) or markdown)\n");
     printf("  -D, --delta-stop\t\tstop the test when the delta between two snapshots is near this value\n");
+    printf("  -S, --search\t\t\tsearch the max sustainable rate (requires -p), starts at -r\n");
+    printf("  -W, --window=SECONDS\t\tseconds each rate is held by the search (default: %i)\n",
+           DEFAULT_WINDOW);
+    printf("  -L, --max-lag=SECONDS\t\tmax input not read by the agent, in seconds (default: %i)\n",
+           DEFAULT_MAX_LAG);
+    printf("  -M, --max-rss=PERCENT\t\tmax RSS growth once the rate is stable (default: %i)\n",
+           DEFAULT_MAX_RSS);
     printf("  -h, --help\t\t\tprint this help");
     printf("\n\n");
+    flb_monitor_help();
     exit(rc);
 }
 
@@ -302,6 +352,369 @@ static int run_fs_writer(pid_t pid,
     return 0;
 }
 
+/* Append 'records' lines, the data file is repeated as needed */
+static ssize_t search_write(struct search_ctx *ctx, int records)
+{
+    int n;
+    off_t off;
+    size_t len;
+    ssize_t bytes;
+    ssize_t total = 0;
+
+    while (records > 0) {
+        n = (records > ctx->n_records) ? ctx->n_records : records;
+        len = ctx->index[n];
+        off = 0;
+        while (off < len) {
+            bytes = sendfile(ctx->out_fd, ctx->in_fd, &off, len - off);
+            if (bytes <= 0) {
+                perror("sendfile");
+                return -1;
+            }
+        }
+        total += len;
+        records -= n;
+    }
+
+    ctx->written += total;
+    return total;
+}
+
+/* Bytes written and not read by the agent yet */
+static off_t search_lag(struct search_ctx *ctx)
+{
+    off_t pos;
+
+    pos = flb_proc_file_offset(ctx->pid, ctx->out_file);
+    if (pos < 0) {
+        /* the file is not opened (yet or anymore) */
+        return ctx->written;
+    }
+    return (pos >= ctx->written) ? 0 : ctx->written - pos;
+}
+
+/*
+ * Hold 'rate' records per second for the search window. The first third of
+ * the window lets the agent settle, the rest decides: the agent must not
+ * fall more than 'max_lag' seconds of input behind and its memory must not
+ * keep growing. A rate the writer itself cannot keep is not sustainable
+ * either, 'writer' tells it apart. Returns -1 on error.
+ */
+static int search_probe(struct search_ctx *ctx, struct search_probe *probe)
+{
+    int i;
+    int tick;
+    int records;
+    int judged = 0;
+    int warmup;
+    long rss_base = 0;
+    off_t lag;
+    off_t lag_limit;
+    double slope;
+    double sx = 0;
+    double sy = 0;
+    double sxy = 0;
+    double sxx = 0;
+    ssize_t bytes;
+    size_t round_bytes;
+    size_t total_bytes = 0;
+    double cpu_sum = 0;
+    struct timespec start;
+    struct timespec now;
+    struct flb_proc_task *t1;
+    struct flb_proc_task *t2;
+
+    memset(probe, 0, sizeof(struct search_probe));
+    probe->rate = ctx->rate;
+    warmup = ctx->window / 3;
+
+    t1 = flb_proc_stat_create(ctx->pid);
+    if (!t1) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < ctx->window; i++) {
+        round_bytes = 0;
+
+        /* spread the second over a few writes */
+        for (tick = 0; tick < SEARCH_TICKS; tick++) {
+            records = ((long) ctx->rate * (tick + 1) / SEARCH_TICKS) -
+                ((long) ctx->rate * tick / SEARCH_TICKS);
+            bytes = search_write(ctx, records);
+            if (bytes == -1) {
+                flb_proc_stat_destroy(t1);
+                return -1;
+            }
+            round_bytes += bytes;
+            flb_time_sleep_until(&start, (i * 1000) +
+                                 ((tick + 1) * 1000 / SEARCH_TICKS));
+        }
+        total_bytes += round_bytes;
+
+        t2 = flb_proc_stat_create(ctx->pid);
+        if (!t2) {
+            flb_proc_stat_destroy(t1);
+            return -1;
+        }
+        lag = search_lag(ctx);
+
+        flb_report_column_set(ctx->r, ctx->col_rate, ctx->rate);
+        flb_report_column_set(ctx->r, ctx->col_lag, lag / 1024.0);
+        flb_report_stats(ctx->r, ctx->rate, round_bytes, t1, t2);
+        ctx->r->sum_records += ctx->rate;
+
+        if (i >= warmup) {
+            if (judged == 0) {
+                rss_base = t2->r_rss;
+            }
+            judged++;
+            cpu_sum += flb_report_cpu_usage(ctx->r, t1, t2);
+            if (t2->r_rss > probe->rss) {
+                probe->rss = t2->r_rss;
+            }
+            if (lag > probe->lag) {
+                probe->lag = lag;
+            }
+            sx += i;
+            sy += lag;
+            sxy += (double) i * lag;
+            sxx += (double) i * i;
+        }
+
+        flb_proc_stat_destroy(t1);
+        t1 = t2;
+    }
+    flb_proc_stat_destroy(t1);
+
+    /* the writer was late: the rate was not really offered */
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (flb_time_diff_us(&start, &now) > ctx->window * 1100000) {
+        probe->writer = 1;
+        probe->reason = "writer";
+        return 0;
+    }
+
+    probe->cpu = cpu_sum / judged;
+    probe->bytes_sec = (double) total_bytes / ctx->window;
+    probe->ok = 1;
+
+    /*
+     * The lag must stay under the limit and not trend up: a least squares
+     * slope above a small share of the input means the agent reads less
+     * than what is written, it would hit the limit with a longer window.
+     */
+    lag_limit = probe->bytes_sec * ctx->max_lag;
+    slope = 0;
+    if (judged > 1) {
+        slope = (judged * sxy - sx * sy) / (judged * sxx - sx * sx);
+    }
+    if (probe->lag > lag_limit ||
+        slope > probe->bytes_sec * SEARCH_LAG_SLOPE / 100) {
+        probe->ok = 0;
+        probe->reason = "lag";
+    }
+    /* small RSS changes are allocator noise */
+    else if (probe->rss - rss_base > SEARCH_RSS_NOISE &&
+             probe->rss - rss_base > rss_base * ctx->max_rss / 100) {
+        probe->ok = 0;
+        probe->reason = "rss";
+    }
+
+    return 0;
+}
+
+/* Wait for the agent to read everything before the next probe */
+static int search_drain(struct search_ctx *ctx)
+{
+    int i;
+    struct timespec ts = {0, 100000000};
+
+    for (i = 0; i < SEARCH_DRAIN_TIMEOUT * 10; i++) {
+        if (search_lag(ctx) == 0) {
+            return 0;
+        }
+        nanosleep(&ts, NULL);
+    }
+    return -1;
+}
+
+/*
+ * Start every probe with an empty file, the agent sees the truncation on
+ * the first write. Otherwise the file grows by a whole window per probe.
+ */
+static int search_truncate(struct search_ctx *ctx)
+{
+    if (ftruncate(ctx->out_fd, 0) == -1 ||
+        lseek(ctx->out_fd, 0, SEEK_SET) == -1) {
+        perror("ftruncate");
+        return -1;
+    }
+    ctx->written = 0;
+    return 0;
+}
+
+/*
+ * Look for the maximum sustainable rate: double the rate until a probe
+ * fails, then bisect between the last good and the first bad rate. A rate
+ * the writer cannot keep bounds the search the same way.
+ */
+static int run_search(pid_t pid, char *report, int fmt_report,
+                      char *in_data_file, char *out_data_file,
+                      int records, int window, int max_lag, int max_rss)
+{
+    int ret;
+    int lo = 0;
+    int hi = 0;
+    int probes = 0;
+    int writer_limit = 0;
+    char *stop = NULL;
+    char *rss_hr;
+    char *bytes_hr;
+    char *data_buf;
+    size_t data_size;
+    struct search_probe probe;
+    struct search_probe best;
+    struct search_probe fail;
+    struct search_ctx ctx;
+
+    memset(&ctx, 0, sizeof(ctx));
+    memset(&best, 0, sizeof(best));
+    memset(&fail, 0, sizeof(fail));
+    ctx.pid = pid;
+    ctx.out_file = out_data_file;
+    ctx.window = window;
+    ctx.max_lag = max_lag;
+    ctx.max_rss = max_rss;
+
+    ctx.r = flb_report_create(report, fmt_report, pid, 0);
+    if (!ctx.r) {
+        fprintf(stderr, "error: cannot initialize report");
+        return -1;
+    }
+    ctx.col_rate = flb_report_column_add(ctx.r, "rate", 10, 0);
+    ctx.col_lag = flb_report_column_add(ctx.r, "lag_kb", 10, 0);
+
+    ctx.out_fd = open(out_data_file, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (ctx.out_fd == -1) {
+        perror("open");
+        fprintf(stderr, "error: cannot open/create output data file '%s'\n",
+                out_data_file);
+        flb_report_destroy(ctx.r);
+        return -1;
+    }
+
+    ctx.in_fd = flb_data_file_load(in_data_file, &data_buf, &data_size);
+    if (ctx.in_fd == -1) {
+        fprintf(stderr, "error: cannot load input data file '%s'\n",
+                in_data_file);
+        close(ctx.out_fd);
+        flb_report_destroy(ctx.r);
+        return -1;
+    }
+
+    ctx.n_records = flb_data_file_index(data_buf, data_size, &ctx.index);
+    if (ctx.n_records == -1) {
+        flb_data_file_unload(data_buf, data_size);
+        close(ctx.in_fd);
+        close(ctx.out_fd);
+        flb_report_destroy(ctx.r);
+        return -1;
+    }
+
+    ctx.rate = records;
+    while (1) {
+        ret = search_probe(&ctx, &probe);
+        if (ret == -1) {
+            stop = "probe failed";
+            break;
+        }
+        probes++;
+
+        dprintf(ctx.r->fd, "probe #%i: %i records/s, %s%s%s\n",
+                probes, ctx.rate, probe.ok ? "sustainable" : "saturated",
+                probe.ok ? "" : " by ", probe.ok ? "" : probe.reason);
+
+        if (probe.ok) {
+            lo = ctx.rate;
+            best = probe;
+        }
+        else if (probe.writer) {
+            hi = ctx.rate;
+            if (writer_limit == 0 || ctx.rate < writer_limit) {
+                writer_limit = ctx.rate;
+            }
+        }
+        else {
+            hi = ctx.rate;
+            fail = probe;
+        }
+
+        /* next rate */
+        if (hi == 0) {
+            if (ctx.rate > SEARCH_MAX_RATE / 2) {
+                stop = "max rate reached";
+                break;
+            }
+            ctx.rate *= 2;
+        }
+        else {
+            if (hi - lo <= (long) hi * SEARCH_PRECISION / 100 || hi - lo < 2) {
+                break;
+            }
+            ctx.rate = lo + (hi - lo) / 2;
+        }
+
+        if (search_drain(&ctx) == -1) {
+            stop = "the agent did not catch up";
+            break;
+        }
+        if (search_truncate(&ctx) == -1) {
+            stop = "cannot truncate the output file";
+            break;
+        }
+    }
+
+    flb_report_summary(ctx.r);
+
+    dprintf(ctx.r->fd, "\n- Saturation Search\n");
+    dprintf(ctx.r->fd, "  - Probes        : %i (%i seconds each)\n",
+            probes, window);
+    if (best.rate > 0) {
+        rss_hr = flb_report_human_readable_size(best.rss);
+        bytes_hr = flb_report_human_readable_size(best.bytes_sec);
+        dprintf(ctx.r->fd,
+                "  - Max records/s : %i\n"
+                "  - Max bytes/s   : %.0f (%s)\n"
+                "  - CPU           : %.2f%%\n"
+                "  - Memory (RSS)  : %s\n",
+                best.rate, best.bytes_sec, bytes_hr, best.cpu, rss_hr);
+        free(rss_hr);
+        free(bytes_hr);
+    }
+    else {
+        dprintf(ctx.r->fd, "  - Max records/s : none sustainable\n");
+    }
+    if (fail.rate > 0) {
+        dprintf(ctx.r->fd, "  - Saturated at  : %i records/s (%s, lag %ld bytes)\n",
+                fail.rate, fail.reason, (long) fail.lag);
+    }
+    if (writer_limit > 0) {
+        dprintf(ctx.r->fd, "  - Writer limit  : %i records/s, higher rates "
+                "were not offered\n", writer_limit);
+    }
+    if (stop) {
+        dprintf(ctx.r->fd, "  - Stopped       : %s\n", stop);
+    }
+
+    free(ctx.index);
+    flb_data_file_unload(data_buf, data_size);
+    close(ctx.in_fd);
+    close(ctx.out_fd);
+    flb_report_destroy(ctx.r);
+    return 0;
+}
+
 int main(int argc, char **argv)
 {
     int ret;
@@ -310,6 +723,10 @@ int main(int argc, char **argv)
     int seconds = DEFAULT_SECONDS;
     int increase_by = DEFAULT_INC_BY;
     int delta_stop = 0;
+    int search = 0;
+    int window = DEFAULT_WINDOW;
+    int max_lag = DEFAULT_MAX_LAG;
+    int max_rss = DEFAULT_MAX_RSS;
     int out_fd;
     int pid = -1;
     int fd_report;
@@ -330,11 +747,17 @@ int main(int argc, char **argv)
         { "report"     ,   required_argument, NULL, 'R' },
         { "format"     ,   required_argument, NULL, 'F' },
         { "delta_stop" ,   required_argument, NULL, 'D' },
+        { "search"     ,   no_argument      , NULL, 'S' },
+        { "window"     ,   required_argument, NULL, 'W' },
+        { "max-lag"    ,   required_argument, NULL, 'L' },
+        { "max-rss"    ,   required_argument, NULL, 'M' },
         { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
     };
 
     while ((opt = getopt_long(argc, argv,
-                              "d:p:o:r:i:s:R:F:D:h", long_opts, NULL)) != -1) {
+                              "d:p:o:r:i:s:R:F:D:SW:L:M:h", long_opts, NULL)) != -1) {
         switch (opt) {
         case 'd':
             data_file = strdup(optarg);
@@ -363,12 +786,31 @@ int main(int argc, char **argv)
         case 'D':
             delta_stop = atoi(optarg);
             break;
+        case 'S':
+            search = 1;
+            break;
+        case 'W':
+            window = atoi(optarg);
+            break;
+        case 'L':
+            max_lag = atoi(optarg);
+            break;
+        case 'M':
+            max_rss = atoi(optarg);
+            break;
         case 'h':
             flb_help(EXIT_SUCCESS);
             break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
         };
     };
 
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
     if (!data_file) {
         fprintf(stderr, "error: no data file specified\n");
         exit(EXIT_FAILURE);
@@ -406,8 +848,26 @@ int main(int argc, char **argv)
         }
     }
 
-    ret = run_fs_writer(pid, report, fmt_report, data_file, out_file,
-                        records, increase_by, seconds, delta_stop);
+    if (search) {
+        if (pid < 0) {
+            fprintf(stderr, "error: the search mode requires the agent PID\n");
+            exit(EXIT_FAILURE);
+        }
+        if (window < 3 || max_lag < 1 || max_rss < 1) {
+            fprintf(stderr, "error: invalid search window or limits\n");
+            exit(EXIT_FAILURE);
+        }
+        if (strcmp(out_file, "/dev/stdout") == 0) {
+            fprintf(stderr, "error: the search mode requires an output file\n");
+            exit(EXIT_FAILURE);
+        }
+        ret = run_search(pid, report, fmt_report, data_file, out_file,
+                         records, window, max_lag, max_rss);
+    }
+    else {
+        ret = run_fs_writer(pid, report, fmt_report, data_file, out_file,
+                            records, increase_by, seconds, delta_stop);
+    }
     if (ret == -1) {
         exit(EXIT_FAILURE);
     }
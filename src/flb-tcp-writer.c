@@ -28,6 +28,9 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/uio.h>
 #include <time.h>
 
 /* local headers */
@@ -35,7 +38,9 @@
 #include "flb_data_file.h"
 #include "flb_proc.h"
 #include "flb_report.h"
+#include "flb_monitor.h"
 #include "flb_network.h"
+#include "flb_stamp.h"
 
 /* Default values */
 #define DEFAULT_RECORDS           1000  /* 1000 records per second */
@@ -43,15 +48,40 @@
 #define DEFAULT_SECONDS             10  /* test time: 10 seconds   */
 #define DEFAULT_CONCURRENCY          1  /* one active connection   */
 
+/* Send modes, besides sendfile(2) the rest are handled by flb_net_sender */
+#define SEND_SENDFILE               -1
+
 /* Default network host and port */
 #define DEFAULT_PORT            "5170"
 #define DEFAULT_HOST       "127.0.0.1"
 
 struct tcp_conn {
     int fd;
+    int cursor;                     /* next in-memory record to send */
+    struct flb_net_sender sender;
     struct mk_list _head;
 };
 
+/*
+ * In-memory records used by the writev, zerocopy and splice modes: the data
+ * file is copied into anonymous memory and every connection walks the
+ * records in a ring, so consecutive rounds don't send the same bytes.
+ */
+struct tcp_mem {
+    char *buf;
+    size_t size;
+    int n_records;
+    size_t *offsets;
+    int iov_size;
+    struct iovec *iov;
+
+    /* stamped copies of the records, rebuilt on every send */
+    int stamp;
+    uint64_t seq;
+    size_t stamp_size;
+    char *stamp_buf;
+};
+
 static void tcp_connect_destroy(struct mk_list *list)
 {
     struct mk_list *tmp;
@@ -61,6 +91,7 @@ static void tcp_connect_destroy(struct mk_list *list)
     mk_list_foreach_safe(head, tmp, list) {
         conn = mk_list_entry(head, struct tcp_conn, _head);
         mk_list_del(&conn->_head);
+        flb_net_sender_destroy(&conn->sender);
         if (conn->fd > 0) {
             close(conn->fd);
         }
@@ -70,7 +101,8 @@ static void tcp_connect_destroy(struct mk_list *list)
     free(list);
 }
 
-static struct mk_list *tcp_connect_create(int connections, char *host, char *port)
+static struct mk_list *tcp_connect_create(int connections, char *host, char *port,
+                                          int mode)
 {
     int i;
     int fd;
@@ -105,11 +137,172 @@ static struct mk_list *tcp_connect_create(int connections, char *host, char *por
 
         conn->fd = fd;
         mk_list_add(&conn->_head, list);
+
+        if (mode != SEND_SENDFILE) {
+            flb_net_sender_init(&conn->sender, fd, mode);
+        }
+        else {
+            conn->sender.pipe[0] = -1;
+            conn->sender.pipe[1] = -1;
+        }
     }
 
     return list;
 }
 
+static void tcp_mem_destroy(struct tcp_mem *m)
+{
+    if (m->buf) {
+        munmap(m->buf, m->size);
+    }
+    free(m->offsets);
+    free(m->iov);
+    free(m->stamp_buf);
+    free(m);
+}
+
+static struct tcp_mem *tcp_mem_create(char *data_buf, size_t data_size)
+{
+    struct tcp_mem *m;
+
+    m = calloc(1, sizeof(struct tcp_mem));
+    if (!m) {
+        perror("calloc");
+        return NULL;
+    }
+
+    /* page aligned private memory, like a buffer produced by the writer */
+    m->buf = mmap(NULL, data_size, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (m->buf == MAP_FAILED) {
+        perror("mmap");
+        m->buf = NULL;
+        tcp_mem_destroy(m);
+        return NULL;
+    }
+    m->size = data_size;
+    memcpy(m->buf, data_buf, data_size);
+
+    m->n_records = flb_data_file_index(m->buf, m->size, &m->offsets);
+    if (m->n_records == -1) {
+        tcp_mem_destroy(m);
+        return NULL;
+    }
+
+    m->iov_size = 16;
+    m->iov = malloc(sizeof(struct iovec) * m->iov_size);
+    if (!m->iov) {
+        perror("malloc");
+        tcp_mem_destroy(m);
+        return NULL;
+    }
+
+    return m;
+}
+
+/* Copy 'n' records into the stamp buffer with a sequence and send time */
+static ssize_t tcp_mem_send_stamped(struct tcp_mem *m, struct tcp_conn *conn,
+                                    int n)
+{
+    int i;
+    int rec;
+    size_t size;
+    size_t rec_len;
+    size_t stamped;
+    size_t len = 0;
+    uint64_t ts;
+    char *tmp;
+    struct iovec iov;
+
+    size = n * FLB_STAMP_SIZE;
+    for (i = 0, rec = conn->cursor; i < n; i++) {
+        size += m->offsets[rec + 1] - m->offsets[rec];
+        rec = (rec + 1) % m->n_records;
+    }
+
+    if (size > m->stamp_size) {
+        tmp = realloc(m->stamp_buf, size);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        m->stamp_buf = tmp;
+        m->stamp_size = size;
+    }
+
+    ts = flb_stamp_now();
+    for (i = 0; i < n; i++) {
+        rec = conn->cursor;
+        rec_len = m->offsets[rec + 1] - m->offsets[rec];
+        stamped = flb_stamp_record(m->stamp_buf + len,
+                                   m->buf + m->offsets[rec], rec_len,
+                                   m->seq, ts);
+        if (stamped > 0) {
+            m->seq++;
+            len += stamped;
+        }
+        else {
+            /* not a JSON map, sent as is like the HTTP writer does */
+            memcpy(m->stamp_buf + len, m->buf + m->offsets[rec], rec_len);
+            len += rec_len;
+        }
+        conn->cursor = (rec + 1) % m->n_records;
+    }
+
+    iov.iov_base = m->stamp_buf;
+    iov.iov_len = len;
+    return flb_net_sender_send(&conn->sender, &iov, 1);
+}
+
+/* Send 'n' records starting at the connection cursor */
+static ssize_t tcp_mem_send(struct tcp_mem *m, struct tcp_conn *conn, int n)
+{
+    int c = 0;
+    int take;
+    struct iovec *tmp;
+
+    if (m->stamp) {
+        return tcp_mem_send_stamped(m, conn, n);
+    }
+
+    while (n > 0) {
+        if (c == m->iov_size) {
+            tmp = realloc(m->iov, sizeof(struct iovec) * m->iov_size * 2);
+            if (!tmp) {
+                perror("realloc");
+                return -1;
+            }
+            m->iov = tmp;
+            m->iov_size *= 2;
+        }
+
+        /* contiguous records until the end of the ring */
+        take = m->n_records - conn->cursor;
+        if (take > n) {
+            take = n;
+        }
+
+        m->iov[c].iov_base = m->buf + m->offsets[conn->cursor];
+        m->iov[c].iov_len = m->offsets[conn->cursor + take] -
+            m->offsets[conn->cursor];
+        c++;
+
+        n -= take;
+        conn->cursor = (conn->cursor + take) % m->n_records;
+    }
+
+    return flb_net_sender_send(&conn->sender, m->iov, c);
+}
+
+static double rusage_ms(void)
+{
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 +
+        (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
 static int flb_help(int rc)
 {
     printf("Usage: flb-tcp-writer [OPTIONS]\n\n");
@@ -125,10 +318,13 @@ static int flb_help(int rc)
            DEFAULT_RECORDS);
     printf("  -s, --seconds=SECONDS\t\ttotal test time meassured in seconds (default: %i)\n",
            DEFAULT_SECONDS);
+    printf("  -m, --send-mode=MODE\t\tsendfile (default), writev, zerocopy or splice\n");
+    printf("  -T, --stamp\t\t\tembed sequence and send time stamps (see flb-sink)\n");
     printf("  -R, --report\t\t\tset report output file (default: stdout)\n");
     printf("  -F, --format\t\t\treport format: text (default) or markdown\n");
     printf("  -h, --help\t\t\tprint this help");
     printf("\n\n");
+    flb_monitor_help();
     exit(rc);
 }
 
@@ -150,7 +346,7 @@ static int run_tcp_writer(pid_t pid,
                           char *host, char *port,
                           int n_cons,
                           int records, int increase_by,
-                          int seconds)
+                          int seconds, int mode, int stamp)
 {
     int i;
     int x;
@@ -161,6 +357,11 @@ static int run_tcp_writer(pid_t pid,
     int round_records;
     int report_fd = -1;
     int wait_time = 3;
+    int n;
+    int col_wcpu = -1;
+    double cpu_start;
+    double w_cpu;
+    double total_w_cpu = 0;
     size_t round_bytes;
     off_t off = 0;
     off_t off_rec;
@@ -173,12 +374,19 @@ static int run_tcp_writer(pid_t pid,
     size_t total_records = 0;
     ssize_t total_bytes = 0;
     char *proc_name = NULL;
-    struct flb_proc_task *t1;
+    struct flb_proc_task *t1 = NULL;
     struct flb_proc_task *t2;
     struct flb_report *r = NULL;
     struct mk_list *head;
     struct mk_list *connections;
     struct tcp_conn *conn;
+    struct tcp_mem *mem = NULL;
+    uint64_t zc_sent = 0;
+    uint64_t zc_done = 0;
+    uint64_t zc_copied = 0;
+    int used_mode = mode;
+    int fallbacks = 0;
+    char mode_name[128];
     time_t start_time;
     time_t end_time;
 
@@ -189,10 +397,14 @@ static int run_tcp_writer(pid_t pid,
             fprintf(stderr, "error: cannot initialize report");
             return -1;
         }
+
+        /* Writer CPU time spent on each round */
+        col_wcpu = flb_report_column_add(r, "w_cpu_ms", 9, 2);
+        flb_report_sockets_enable(r);
     }
 
     /* Create TCP connections */
-    connections = tcp_connect_create(n_cons, host, port);
+    connections = tcp_connect_create(n_cons, host, port, mode);
     if (!connections) {
         return -1;
     }
@@ -239,6 +451,29 @@ static int run_tcp_writer(pid_t pid,
         return -1;
     }
 
+    /* In-memory records for the non sendfile(2) modes */
+    if (mode != SEND_SENDFILE) {
+        mem = tcp_mem_create(data_buf, data_size);
+        if (!mem) {
+            fprintf(stderr, "error: cannot create in-memory records\n");
+            flb_data_file_unload(data_buf, data_size);
+            close(in_fd);
+            tcp_connect_destroy(connections);
+            if (r) {
+                flb_report_destroy(r);
+            }
+            return -1;
+        }
+        mem->stamp = stamp;
+
+        /* every connection starts on a different region of the ring */
+        n = 0;
+        mk_list_foreach(head, connections) {
+            conn = mk_list_entry(head, struct tcp_conn, _head);
+            conn->cursor = (n++ * (mem->n_records / n_cons)) % mem->n_records;
+        }
+    }
+
     /* Get Process name */
     if (pid >= 0) {
         t1 = flb_proc_stat_create(pid);
@@ -266,10 +501,28 @@ static int run_tcp_writer(pid_t pid,
             }
         }
 
+        cpu_start = rusage_ms();
+
         mk_list_foreach(head, connections) {
             conn = mk_list_entry(head, struct tcp_conn, _head);
             out_fd = conn->fd;
 
+            if (mem) {
+                /* one send operation for the records and the increment */
+                n = conn_records + (increase_by * i);
+                bytes = tcp_mem_send(mem, conn, n);
+                if (bytes == -1) {
+                    fprintf(stderr, "error: exception on writing records chunk\n");
+                }
+                else {
+                    total_bytes += bytes;
+                    total_records += n;
+                    round_records += n;
+                    round_bytes += bytes;
+                }
+                continue;
+            }
+
             /*
              * Use zero-copy strategy with sendfile(2). In benchmarking we want
              * to avoid extra Kernel work, this is a Linux specific feature.
@@ -310,6 +563,9 @@ static int run_tcp_writer(pid_t pid,
             }
         }
 
+        w_cpu = rusage_ms() - cpu_start;
+        total_w_cpu += w_cpu;
+
         /* Dummy sleep */
         sleep(1);
 
@@ -322,6 +578,7 @@ static int run_tcp_writer(pid_t pid,
             }
 
             if (r) {
+                flb_report_column_set(r, col_wcpu, w_cpu);
                 flb_report_stats(r, round_records, round_bytes, t1, t2);
             }
 
@@ -382,6 +639,53 @@ static int run_tcp_writer(pid_t pid,
         flb_report_summary(r);
     }
 
+    /* Let the kernel release the zerocopy buffers */
+    if (mem) {
+        mk_list_foreach(head, connections) {
+            conn = mk_list_entry(head, struct tcp_conn, _head);
+            flb_net_sender_flush(&conn->sender);
+            zc_sent += conn->sender.zc_sent;
+            zc_done += conn->sender.zc_done;
+            zc_copied += conn->sender.zc_copied;
+
+            /* the sender falls back to writev when a mode is not usable */
+            if (conn->sender.mode != mode) {
+                used_mode = conn->sender.mode;
+                fallbacks++;
+            }
+        }
+    }
+
+    if (!mem) {
+        snprintf(mode_name, sizeof(mode_name), "sendfile");
+    }
+    else if (fallbacks > 0) {
+        snprintf(mode_name, sizeof(mode_name),
+                 "%s, fallback from %s on %i of %i connections",
+                 flb_net_send_mode_name(used_mode),
+                 flb_net_send_mode_name(mode), fallbacks, n_cons);
+    }
+    else {
+        snprintf(mode_name, sizeof(mode_name), "%s",
+                 flb_net_send_mode_name(mode));
+    }
+
+    dprintf(r ? r->fd : STDOUT_FILENO,
+            "- Writer (%s)\n"
+            "  - CPU time    : %.2f ms\n"
+            "  - CPU per GB  : %.2f ms\n",
+            mode_name,
+            total_w_cpu,
+            total_bytes > 0 ?
+            total_w_cpu / ((double) total_bytes / (1024 * 1024 * 1024)) : 0);
+
+    if (mem && mode == FLB_NET_SEND_ZEROCOPY && fallbacks < n_cons) {
+        /* on loopback the kernel always copies, see 'copied' */
+        dprintf(r ? r->fd : STDOUT_FILENO,
+                "  - Zerocopy    : %lu sends, %lu completed, %lu copied\n",
+                zc_sent, zc_done, zc_copied);
+    }
+
     if (r) {
         flb_report_destroy(r);
     }
@@ -390,7 +694,14 @@ static int run_tcp_writer(pid_t pid,
         free(proc_name);
     }
 
-    close(out_fd);
+    if (mem) {
+        tcp_mem_destroy(mem);
+    }
+    tcp_connect_destroy(connections);
+    flb_data_file_unload(data_buf, data_size);
+    close(in_fd);
+
+    return 0;
 }
 
 int main(int argc, char **argv)
@@ -405,6 +716,8 @@ int main(int argc, char **argv)
     int pid = -1;
     int fd_report;
     int fmt_report = FLB_REPORT_TXT;
+    int mode = SEND_SENDFILE;
+    int stamp = 0;
     char *format = NULL;
     char *report = NULL;
     char *out_host = NULL;
@@ -423,11 +736,15 @@ int main(int argc, char **argv)
         { "seconds"    ,   required_argument, NULL, 's' },
         { "report"     ,   required_argument, NULL, 'R' },
         { "format"     ,   required_argument, NULL, 'F' },
+        { "send-mode"  ,   required_argument, NULL, 'm' },
+        { "stamp"      ,   no_argument      , NULL, 'T' },
         { "help"       ,   no_argument      , NULL, 'h' },
+        FLB_MONITOR_LONG_OPTS,
+        { NULL         ,   0                , NULL,  0  },
     };
 
     while ((opt = getopt_long(argc, argv,
-                              "c:d:p:o:r:i:s:R:F:h", long_opts, NULL)) != -1) {
+                              "c:d:p:o:r:i:s:R:F:m:Th", long_opts, NULL)) != -1) {
         switch (opt) {
         case 'c':
             concurrency = atoi(optarg);
@@ -456,12 +773,48 @@ int main(int argc, char **argv)
         case 'F':
             format = strdup(optarg);
             break;
+        case 'm':
+            if (strcasecmp(optarg, "sendfile") == 0) {
+                mode = SEND_SENDFILE;
+            }
+            else {
+                mode = flb_net_send_mode(optarg);
+                if (mode == -1) {
+                    fprintf(stderr, "error: invalid send mode '%s'\n", optarg);
+                    exit(EXIT_FAILURE);
+                }
+            }
+            break;
+        case 'T':
+            stamp = 1;
+            break;
         case 'h':
             flb_help(EXIT_SUCCESS);
             break;
+        default:
+            if (flb_monitor_option(opt, optarg) == -1) {
+                flb_help(EXIT_FAILURE);
+            }
         };
     };
 
+    /* -p or the first process of --cgroup */
+    pid = flb_monitor_target(pid);
+
+    /*
+     * Stamped records are composed in memory right before the send, the
+     * buffer is reused so it cannot be handed to the kernel by reference.
+     */
+    if (stamp) {
+        if (mode == SEND_SENDFILE) {
+            mode = FLB_NET_SEND_WRITEV;
+        }
+        else if (mode != FLB_NET_SEND_WRITEV) {
+            fprintf(stderr, "error: stamps are only supported with writev\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
     if (!data_file) {
         fprintf(stderr, "error: no data file specified\n");
         exit(EXIT_FAILURE);
@@ -518,7 +871,8 @@ int main(int argc, char **argv)
 
     ret = run_tcp_writer(pid, report, fmt_report, data_file,
                          host, port,
-                         concurrency, records, increase_by, seconds);
+                         concurrency, records, increase_by, seconds, mode,
+                         stamp);
 
     free(report);
     free(format);
@@ -0,0 +1,281 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/types.h>
+
+#include "flb_proc.h"
+#include "flb_cgroup.h"
+
+/* the cgroup serving flb_cgroup_task(), one per process */
+static struct flb_cgroup *cgroup_active = NULL;
+
+static int cgroup_open(char *dir, char *name)
+{
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static void cgroup_dir(char *path, char *buf, size_t size)
+{
+    if (path[0] == '/') {
+        snprintf(buf, size, "%s", path);
+    }
+    else {
+        snprintf(buf, size, FLB_CGROUP_ROOT "/%s", path);
+    }
+}
+
+/* Whole file in a NULL terminated buffer, returns -1 if it's not there */
+static int cgroup_pread(int fd, char *buf, size_t size)
+{
+    ssize_t bytes;
+
+    if (fd == -1) {
+        return -1;
+    }
+    bytes = pread(fd, buf, size - 1, 0);
+    if (bytes < 0) {
+        return -1;
+    }
+    buf[bytes] = '\0';
+    return 0;
+}
+
+/* Value of a "key N" line of a flat keyed file */
+static uint64_t cgroup_key(const char *buf, const char *key)
+{
+    size_t len = strlen(key);
+    const char *p = buf;
+
+    while (p) {
+        if (strncmp(p, key, len) == 0 && p[len] == ' ') {
+            return strtoull(p + len + 1, NULL, 10);
+        }
+        p = strchr(p, '\n');
+        if (p) {
+            p++;
+        }
+    }
+    return 0;
+}
+
+/* Sum of a "key=N" field over every line (device) of io.stat */
+static uint64_t cgroup_io_key(const char *buf, const char *key)
+{
+    uint64_t sum = 0;
+    size_t len = strlen(key);
+    const char *p = buf;
+
+    while ((p = strstr(p, key)) != NULL) {
+        if ((p == buf || p[-1] == ' ') && p[len] == '=') {
+            sum += strtoull(p + len + 1, NULL, 10);
+        }
+        p += len;
+    }
+    return sum;
+}
+
+pid_t flb_cgroup_pid(char *path)
+{
+    int fd;
+    char dir[PATH_MAX];
+    char buf[64];
+
+    cgroup_dir(path, dir, sizeof(dir));
+    fd = cgroup_open(dir, "cgroup.procs");
+    if (fd == -1) {
+        perror("open");
+        fprintf(stderr, "error: cannot open '%s/cgroup.procs'\n", dir);
+        return -1;
+    }
+    if (cgroup_pread(fd, buf, sizeof(buf)) == -1 || buf[0] == '\0') {
+        fprintf(stderr, "error: cgroup '%s' has no processes\n", dir);
+        close(fd);
+        return -1;
+    }
+    close(fd);
+
+    return atoi(buf);
+}
+
+struct flb_cgroup *flb_cgroup_create(char *path, pid_t pid)
+{
+    char dir[PATH_MAX];
+    struct flb_cgroup *cg;
+
+    cg = calloc(1, sizeof(struct flb_cgroup));
+    if (!cg) {
+        perror("calloc");
+        return NULL;
+    }
+
+    cgroup_dir(path, dir, sizeof(dir));
+    while (strlen(dir) > 1 && dir[strlen(dir) - 1] == '/') {
+        dir[strlen(dir) - 1] = '\0';
+    }
+    cg->path = strdup(dir);
+    cg->pid = (pid >= 0) ? pid : flb_cgroup_pid(path);
+
+    cg->fd_cpu = cgroup_open(dir, "cpu.stat");
+    if (cg->fd_cpu == -1) {
+        perror("open");
+        fprintf(stderr, "error: cannot open '%s/cpu.stat', cgroup v2 is "
+                "required\n", dir);
+        free(cg->path);
+        free(cg);
+        return NULL;
+    }
+
+    /* missing with the memory or io controllers disabled */
+    cg->fd_current = cgroup_open(dir, "memory.current");
+    cg->fd_peak = cgroup_open(dir, "memory.peak");
+    cg->fd_max = cgroup_open(dir, "memory.max");
+    cg->fd_stat = cgroup_open(dir, "memory.stat");
+    cg->fd_events = cgroup_open(dir, "memory.events");
+    cg->fd_io = cgroup_open(dir, "io.stat");
+    if (cg->fd_current == -1) {
+        fprintf(stderr, "warn: memory controller not enabled in '%s'\n", dir);
+    }
+    if (cg->fd_io == -1) {
+        fprintf(stderr, "warn: io controller not enabled in '%s'\n", dir);
+    }
+
+    if (!cgroup_active) {
+        cgroup_active = cg;
+    }
+    return cg;
+}
+
+void flb_cgroup_destroy(struct flb_cgroup *cg)
+{
+    if (cgroup_active == cg) {
+        cgroup_active = NULL;
+    }
+    close(cg->fd_cpu);
+    if (cg->fd_current != -1) {
+        close(cg->fd_current);
+    }
+    if (cg->fd_peak != -1) {
+        close(cg->fd_peak);
+    }
+    if (cg->fd_max != -1) {
+        close(cg->fd_max);
+    }
+    if (cg->fd_stat != -1) {
+        close(cg->fd_stat);
+    }
+    if (cg->fd_events != -1) {
+        close(cg->fd_events);
+    }
+    if (cg->fd_io != -1) {
+        close(cg->fd_io);
+    }
+    free(cg->path);
+    free(cg);
+}
+
+int flb_cgroup_read(struct flb_cgroup *cg, struct flb_cgroup_stat *st)
+{
+    char buf[8192];
+
+    memset(st, 0, sizeof(struct flb_cgroup_stat));
+
+    if (cgroup_pread(cg->fd_cpu, buf, sizeof(buf)) == -1) {
+        return -1;
+    }
+    st->usage_usec = cgroup_key(buf, "usage_usec");
+    st->user_usec = cgroup_key(buf, "user_usec");
+    st->system_usec = cgroup_key(buf, "system_usec");
+    st->nr_periods = cgroup_key(buf, "nr_periods");
+    st->nr_throttled = cgroup_key(buf, "nr_throttled");
+    st->throttled_usec = cgroup_key(buf, "throttled_usec");
+
+    if (cgroup_pread(cg->fd_current, buf, sizeof(buf)) == 0) {
+        st->mem_current = strtoull(buf, NULL, 10);
+    }
+    if (cgroup_pread(cg->fd_peak, buf, sizeof(buf)) == 0) {
+        st->mem_peak = strtoull(buf, NULL, 10);
+    }
+    if (cgroup_pread(cg->fd_max, buf, sizeof(buf)) == 0) {
+        /* "max" reads as zero: no limit */
+        st->mem_max = strtoull(buf, NULL, 10);
+    }
+    if (cgroup_pread(cg->fd_stat, buf, sizeof(buf)) == 0) {
+        st->anon = cgroup_key(buf, "anon");
+        st->file = cgroup_key(buf, "file");
+        st->kernel = cgroup_key(buf, "kernel");
+        st->sock = cgroup_key(buf, "sock");
+        st->pgmajfault = cgroup_key(buf, "pgmajfault");
+    }
+    if (cgroup_pread(cg->fd_events, buf, sizeof(buf)) == 0) {
+        st->oom = cgroup_key(buf, "oom");
+        st->oom_kill = cgroup_key(buf, "oom_kill");
+    }
+    if (cgroup_pread(cg->fd_io, buf, sizeof(buf)) == 0) {
+        st->rbytes = cgroup_io_key(buf, "rbytes");
+        st->wbytes = cgroup_io_key(buf, "wbytes");
+        st->rios = cgroup_io_key(buf, "rios");
+        st->wios = cgroup_io_key(buf, "wios");
+    }
+
+    return 0;
+}
+
+void flb_cgroup_to_task(struct flb_cgroup *cg, struct flb_cgroup_stat *st,
+                        struct flb_proc_task *t)
+{
+    int cpu_hz = sysconf(_SC_CLK_TCK);
+
+    memset(t, 0, sizeof(struct flb_proc_task));
+    snprintf(t->name, sizeof(t->name), "%s", strrchr(cg->path, '/') + 1);
+    t->utime = (st->user_usec * cpu_hz) / 1000000;
+    t->stime = (st->system_usec * cpu_hz) / 1000000;
+    t->majflt = st->pgmajfault;
+    t->r_rss = st->mem_current;
+    t->rss = t->r_rss / getpagesize();
+    t->r_utime_s  = st->user_usec / 1000000;
+    t->r_utime_ms = st->user_usec / 1000;
+    t->r_stime_s  = st->system_usec / 1000000;
+    t->r_stime_ms = st->system_usec / 1000;
+    clock_gettime(CLOCK_REALTIME, &t->ts);
+}
+
+int flb_cgroup_task(pid_t pid, struct flb_proc_task *t)
+{
+    struct flb_cgroup_stat st;
+    struct flb_cgroup *cg = cgroup_active;
+
+    if (!cg || cg->pid != pid || flb_cgroup_read(cg, &st) == -1) {
+        return -1;
+    }
+
+    flb_cgroup_to_task(cg, &st, t);
+    return 0;
+}
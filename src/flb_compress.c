@@ -0,0 +1,550 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <zlib.h>
+
+#ifdef FLB_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "flb_compress.h"
+
+int flb_compress_type(char *name)
+{
+    if (strcasecmp(name, "none") == 0) {
+        return FLB_COMPRESS_NONE;
+    }
+    else if (strcasecmp(name, "gzip") == 0) {
+        return FLB_COMPRESS_GZIP;
+    }
+    else if (strcasecmp(name, "snappy") == 0) {
+        return FLB_COMPRESS_SNAPPY;
+    }
+    else if (strcasecmp(name, "zstd") == 0) {
+#ifdef FLB_HAVE_ZSTD
+        return FLB_COMPRESS_ZSTD;
+#else
+        fprintf(stderr, "error: built without zstd support\n");
+        return -1;
+#endif
+    }
+    return -1;
+}
+
+char *flb_compress_name(int type)
+{
+    switch (type) {
+    case FLB_COMPRESS_GZIP:
+        return "gzip";
+    case FLB_COMPRESS_SNAPPY:
+        return "snappy";
+    case FLB_COMPRESS_ZSTD:
+        return "zstd";
+    default:
+        return "none";
+    }
+}
+
+static int gzip_compress(const void *in, size_t in_len,
+                         void **out, size_t *out_len)
+{
+    int ret;
+    size_t size;
+    void *buf;
+    z_stream strm;
+
+    memset(&strm, 0, sizeof(strm));
+
+    /* windowBits + 16 makes zlib write a gzip header and trailer */
+    ret = deflateInit2(&strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+                       15 + 16, 8, Z_DEFAULT_STRATEGY);
+    if (ret != Z_OK) {
+        fprintf(stderr, "error: cannot initialize gzip compressor\n");
+        return -1;
+    }
+
+    size = deflateBound(&strm, in_len);
+    buf = malloc(size);
+    if (!buf) {
+        perror("malloc");
+        deflateEnd(&strm);
+        return -1;
+    }
+
+    strm.next_in = (Bytef *) in;
+    strm.avail_in = in_len;
+    strm.next_out = buf;
+    strm.avail_out = size;
+
+    ret = deflate(&strm, Z_FINISH);
+    if (ret != Z_STREAM_END) {
+        fprintf(stderr, "error: gzip compression failed\n");
+        deflateEnd(&strm);
+        free(buf);
+        return -1;
+    }
+
+    *out = buf;
+    *out_len = strm.total_out;
+    deflateEnd(&strm);
+    return 0;
+}
+
+/*
+ * Snappy block format encoder: the uncompressed length as a varint followed
+ * by literal and copy elements. Input is processed in 64KB fragments like
+ * the reference implementation, with a greedy hash based match finder. It
+ * does not compress as well as libsnappy but the output is fully valid.
+ */
+#define SNAPPY_FRAGMENT    65536
+#define SNAPPY_HASH_BITS   14
+
+static inline uint32_t snappy_load32(const char *p)
+{
+    uint32_t v;
+
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline uint32_t snappy_hash(uint32_t v)
+{
+    return (v * 0x1e35a7bd) >> (32 - SNAPPY_HASH_BITS);
+}
+
+static char *snappy_literal(char *op, const char *lit, size_t len)
+{
+    size_t n = len - 1;
+
+    if (n < 60) {
+        *op++ = n << 2;
+    }
+    else if (n < (1 << 8)) {
+        *op++ = 60 << 2;
+        *op++ = n;
+    }
+    else if (n < (1 << 16)) {
+        *op++ = 61 << 2;
+        *op++ = n;
+        *op++ = n >> 8;
+    }
+    else {
+        *op++ = 62 << 2;
+        *op++ = n;
+        *op++ = n >> 8;
+        *op++ = n >> 16;
+    }
+
+    memcpy(op, lit, len);
+    return op + len;
+}
+
+static char *snappy_copy2(char *op, size_t offset, size_t len)
+{
+    *op++ = ((len - 1) << 2) | 2;
+    *op++ = offset;
+    *op++ = offset >> 8;
+    return op;
+}
+
+static char *snappy_copy(char *op, size_t offset, size_t len)
+{
+    while (len >= 68) {
+        op = snappy_copy2(op, offset, 64);
+        len -= 64;
+    }
+    if (len > 64) {
+        op = snappy_copy2(op, offset, 60);
+        len -= 60;
+    }
+
+    /* short copies with a close offset fit in two bytes */
+    if (len < 12 && offset < 2048) {
+        *op++ = ((offset >> 8) << 5) | ((len - 4) << 2) | 1;
+        *op++ = offset;
+        return op;
+    }
+    return snappy_copy2(op, offset, len);
+}
+
+static char *snappy_fragment(char *op, const char *frag, size_t len,
+                             uint16_t *table)
+{
+    size_t m;
+    uint32_t h;
+    const char *ip = frag + 1;
+    const char *end = frag + len;
+    const char *next_emit = frag;
+    const char *cand;
+
+    if (len >= 16) {
+        memset(table, 0, sizeof(uint16_t) * (1 << SNAPPY_HASH_BITS));
+
+        while (ip + 4 <= end) {
+            h = snappy_hash(snappy_load32(ip));
+            cand = frag + table[h];
+            table[h] = ip - frag;
+
+            if (cand >= ip || snappy_load32(cand) != snappy_load32(ip)) {
+                ip++;
+                continue;
+            }
+
+            if (ip > next_emit) {
+                op = snappy_literal(op, next_emit, ip - next_emit);
+            }
+
+            m = 4;
+            while (ip + m < end && cand[m] == ip[m]) {
+                m++;
+            }
+            op = snappy_copy(op, ip - cand, m);
+
+            ip += m;
+            next_emit = ip;
+        }
+    }
+
+    if (next_emit < end) {
+        op = snappy_literal(op, next_emit, end - next_emit);
+    }
+    return op;
+}
+
+static int snappy_compress(const void *in, size_t in_len,
+                           void **out, size_t *out_len)
+{
+    size_t off;
+    size_t n;
+    size_t v;
+    char *buf;
+    char *op;
+    uint16_t *table;
+
+    /* worst case from the reference implementation */
+    buf = malloc(32 + in_len + in_len / 6);
+    table = malloc(sizeof(uint16_t) * (1 << SNAPPY_HASH_BITS));
+    if (!buf || !table) {
+        perror("malloc");
+        free(buf);
+        free(table);
+        return -1;
+    }
+
+    op = buf;
+    v = in_len;
+    while (v >= 0x80) {
+        *op++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *op++ = v;
+
+    for (off = 0; off < in_len; off += n) {
+        n = in_len - off;
+        if (n > SNAPPY_FRAGMENT) {
+            n = SNAPPY_FRAGMENT;
+        }
+        op = snappy_fragment(op, (const char *) in + off, n, table);
+    }
+
+    free(table);
+    *out = buf;
+    *out_len = op - buf;
+    return 0;
+}
+
+#ifdef FLB_HAVE_ZSTD
+static int zstd_compress(const void *in, size_t in_len,
+                         void **out, size_t *out_len)
+{
+    size_t ret;
+    size_t size;
+    void *buf;
+
+    size = ZSTD_compressBound(in_len);
+    buf = malloc(size);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+
+    ret = ZSTD_compress(buf, size, in, in_len, ZSTD_CLEVEL_DEFAULT);
+    if (ZSTD_isError(ret)) {
+        fprintf(stderr, "error: zstd compression failed: %s\n",
+                ZSTD_getErrorName(ret));
+        free(buf);
+        return -1;
+    }
+
+    *out = buf;
+    *out_len = ret;
+    return 0;
+}
+#endif
+
+int flb_compress(int type, const void *in, size_t in_len,
+                 void **out, size_t *out_len)
+{
+    switch (type) {
+    case FLB_COMPRESS_GZIP:
+        return gzip_compress(in, in_len, out, out_len);
+    case FLB_COMPRESS_SNAPPY:
+        return snappy_compress(in, in_len, out, out_len);
+#ifdef FLB_HAVE_ZSTD
+    case FLB_COMPRESS_ZSTD:
+        return zstd_compress(in, in_len, out, out_len);
+#endif
+    default:
+        fprintf(stderr, "error: unsupported compression type %i\n", type);
+        return -1;
+    }
+}
+
+/* Inflate one or more concatenated gzip members */
+static int gzip_decompress(const void *in, size_t in_len,
+                           void **out, size_t *out_len)
+{
+    int ret;
+    size_t size;
+    char *buf;
+    char *tmp;
+    z_stream strm;
+
+    memset(&strm, 0, sizeof(strm));
+    ret = inflateInit2(&strm, 15 + 16);
+    if (ret != Z_OK) {
+        fprintf(stderr, "error: cannot initialize gzip decompressor\n");
+        return -1;
+    }
+
+    size = in_len * 4 + 1024;
+    buf = malloc(size);
+    if (!buf) {
+        perror("malloc");
+        inflateEnd(&strm);
+        return -1;
+    }
+
+    strm.next_in = (Bytef *) in;
+    strm.avail_in = in_len;
+    strm.next_out = (Bytef *) buf;
+    strm.avail_out = size;
+
+    while (1) {
+        ret = inflate(&strm, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END) {
+            if (strm.avail_in == 0) {
+                break;
+            }
+            inflateReset(&strm);
+            continue;
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+            fprintf(stderr, "error: gzip decompression failed\n");
+            inflateEnd(&strm);
+            free(buf);
+            return -1;
+        }
+
+        if (strm.avail_out > 0) {
+            /* truncated input */
+            fprintf(stderr, "error: incomplete gzip data\n");
+            inflateEnd(&strm);
+            free(buf);
+            return -1;
+        }
+
+        tmp = realloc(buf, size * 2);
+        if (!tmp) {
+            perror("realloc");
+            inflateEnd(&strm);
+            free(buf);
+            return -1;
+        }
+        buf = tmp;
+        strm.next_out = (Bytef *) buf + size;
+        strm.avail_out = size;
+        size *= 2;
+    }
+
+    *out = buf;
+    *out_len = (char *) strm.next_out - buf;
+    inflateEnd(&strm);
+    return 0;
+}
+
+/* Snappy block format decoder, see snappy_compress() */
+static int snappy_decompress(const void *in, size_t in_len,
+                             void **out, size_t *out_len)
+{
+    int shift = 0;
+    size_t len = 0;
+    size_t n;
+    size_t offset;
+    char *buf;
+    char *op;
+    const uint8_t *ip = in;
+    const uint8_t *end = ip + in_len;
+
+    /* uncompressed length */
+    while (ip < end) {
+        len |= (size_t) (*ip & 0x7f) << shift;
+        shift += 7;
+        if (!(*ip++ & 0x80)) {
+            break;
+        }
+    }
+
+    buf = malloc(len + 1);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+    op = buf;
+
+    while (ip < end) {
+        switch (*ip & 0x03) {
+        case 0:
+            /* literal, long lengths use 1 to 4 extra bytes */
+            n = *ip++ >> 2;
+            if (n >= 60) {
+                shift = n - 59;
+                n = 0;
+                if (end - ip < shift) {
+                    goto error;
+                }
+                memcpy(&n, ip, shift);
+                ip += shift;
+            }
+            n++;
+            if (end - ip < n || (op - buf) + n > len) {
+                goto error;
+            }
+            memcpy(op, ip, n);
+            op += n;
+            ip += n;
+            continue;
+        case 1:
+            if (end - ip < 2) {
+                goto error;
+            }
+            n = ((*ip >> 2) & 0x07) + 4;
+            offset = ((size_t) (*ip & 0xe0) << 3) | ip[1];
+            ip += 2;
+            break;
+        case 2:
+            if (end - ip < 3) {
+                goto error;
+            }
+            n = (*ip >> 2) + 1;
+            offset = ip[1] | ((size_t) ip[2] << 8);
+            ip += 3;
+            break;
+        default:
+            if (end - ip < 5) {
+                goto error;
+            }
+            n = (*ip >> 2) + 1;
+            offset = ip[1] | ((size_t) ip[2] << 8) |
+                ((size_t) ip[3] << 16) | ((size_t) ip[4] << 24);
+            ip += 5;
+            break;
+        }
+
+        /* copies may overlap their own output */
+        if (offset == 0 || offset > (op - buf) || (op - buf) + n > len) {
+            goto error;
+        }
+        while (n-- > 0) {
+            *op = *(op - offset);
+            op++;
+        }
+    }
+
+    if (op - buf != len) {
+        goto error;
+    }
+
+    *out = buf;
+    *out_len = len;
+    return 0;
+
+error:
+    fprintf(stderr, "error: invalid snappy data\n");
+    free(buf);
+    return -1;
+}
+
+#ifdef FLB_HAVE_ZSTD
+static int zstd_decompress(const void *in, size_t in_len,
+                           void **out, size_t *out_len)
+{
+    size_t ret;
+    unsigned long long size;
+    void *buf;
+
+    size = ZSTD_getFrameContentSize(in, in_len);
+    if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN) {
+        fprintf(stderr, "error: invalid zstd frame\n");
+        return -1;
+    }
+
+    buf = malloc(size + 1);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+
+    ret = ZSTD_decompress(buf, size, in, in_len);
+    if (ZSTD_isError(ret)) {
+        fprintf(stderr, "error: zstd decompression failed: %s\n",
+                ZSTD_getErrorName(ret));
+        free(buf);
+        return -1;
+    }
+
+    *out = buf;
+    *out_len = ret;
+    return 0;
+}
+#endif
+
+int flb_decompress(int type, const void *in, size_t in_len,
+                   void **out, size_t *out_len)
+{
+    switch (type) {
+    case FLB_COMPRESS_GZIP:
+        return gzip_decompress(in, in_len, out, out_len);
+    case FLB_COMPRESS_SNAPPY:
+        return snappy_decompress(in, in_len, out, out_len);
+#ifdef FLB_HAVE_ZSTD
+    case FLB_COMPRESS_ZSTD:
+        return zstd_decompress(in, in_len, out, out_len);
+#endif
+    default:
+        fprintf(stderr, "error: unsupported compression type %i\n", type);
+        return -1;
+    }
+}
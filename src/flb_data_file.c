@@ -131,3 +131,46 @@ int flb_data_file_offset_records(int n_records, char *buf,
     *offset = (p - buf) + 1;
     return 0;
 }
+
+/*
+ * Build an index with the starting offset of every record (line). The
+ * returned array has one extra entry with the end offset of the last
+ * record, so record 'i' spans [offsets[i], offsets[i + 1]). Returns the
+ * number of records or -1 on error.
+ */
+int flb_data_file_index(char *buf, size_t size, size_t **offsets)
+{
+    int n = 0;
+    int total = 0;
+    char *p;
+    char *start;
+    char *end;
+    size_t *index;
+
+    end = buf + size;
+    for (p = buf; p < end && (p = memchr(p, '\n', end - p)); p++) {
+        total++;
+    }
+
+    if (total == 0) {
+        fprintf(stderr, "error: data file have no records\n");
+        return -1;
+    }
+
+    index = malloc(sizeof(size_t) * (total + 1));
+    if (!index) {
+        perror("malloc");
+        return -1;
+    }
+
+    start = buf;
+    index[0] = 0;
+    while (n < total) {
+        p = memchr(start, '\n', end - start);
+        start = p + 1;
+        index[++n] = start - buf;
+    }
+
+    *offsets = index;
+    return total;
+}
@@ -0,0 +1,159 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "flb_histogram.h"
+
+static int hist_index(uint64_t val)
+{
+    int msb;
+    int shift;
+
+    if (val < FLB_HIST_SUB) {
+        return val;
+    }
+
+    msb = 63 - __builtin_clzll(val);
+    shift = msb - FLB_HIST_SUB_BITS + 1;
+
+    return FLB_HIST_SUB + ((shift - 1) * FLB_HIST_SUB_HALF) +
+           ((val >> shift) - FLB_HIST_SUB_HALF);
+}
+
+/* Highest value that maps to the given bucket */
+static uint64_t hist_value(int idx)
+{
+    int shift;
+    uint64_t low;
+
+    if (idx < FLB_HIST_SUB) {
+        return idx;
+    }
+
+    shift = ((idx - FLB_HIST_SUB) / FLB_HIST_SUB_HALF) + 1;
+    low = (uint64_t) (((idx - FLB_HIST_SUB) % FLB_HIST_SUB_HALF) +
+                      FLB_HIST_SUB_HALF) << shift;
+
+    return low + ((uint64_t) 1 << shift) - 1;
+}
+
+struct flb_histogram *flb_histogram_create()
+{
+    struct flb_histogram *h;
+
+    h = calloc(1, sizeof(struct flb_histogram));
+    if (!h) {
+        perror("calloc");
+        return NULL;
+    }
+    h->min = UINT64_MAX;
+    return h;
+}
+
+void flb_histogram_destroy(struct flb_histogram *h)
+{
+    free(h);
+}
+
+void flb_histogram_reset(struct flb_histogram *h)
+{
+    memset(h, 0, sizeof(struct flb_histogram));
+    h->min = UINT64_MAX;
+}
+
+void flb_histogram_record(struct flb_histogram *h, uint64_t val)
+{
+    h->buckets[hist_index(val)]++;
+    h->count++;
+    h->sum += val;
+    if (val < h->min) {
+        h->min = val;
+    }
+    if (val > h->max) {
+        h->max = val;
+    }
+}
+
+void flb_histogram_merge(struct flb_histogram *dst, struct flb_histogram *src)
+{
+    int i;
+
+    for (i = 0; i < FLB_HIST_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+}
+
+uint64_t flb_histogram_percentile(struct flb_histogram *h, double pct)
+{
+    int i;
+    uint64_t acc = 0;
+    uint64_t target;
+    uint64_t val;
+
+    if (h->count == 0) {
+        return 0;
+    }
+
+    target = (uint64_t) ((pct / 100.0) * h->count + 0.5);
+    if (target < 1) {
+        target = 1;
+    }
+
+    for (i = 0; i < FLB_HIST_BUCKETS; i++) {
+        acc += h->buckets[i];
+        if (acc >= target) {
+            val = hist_value(i);
+            return val > h->max ? h->max : val;
+        }
+    }
+    return h->max;
+}
+
+void flb_histogram_print(struct flb_histogram *h, int fd, char *title)
+{
+    int i;
+    static const double pcts[] = { 50.0, 90.0, 99.0, 99.9 };
+
+    dprintf(fd, "\n- %s\n", title);
+    dprintf(fd, "  - Samples     : %lu\n", h->count);
+    if (h->count == 0) {
+        return;
+    }
+
+    dprintf(fd, "  - Min         : %.3lf ms\n", h->min / 1000.0);
+    dprintf(fd, "  - Avg         : %.3lf ms\n", (h->sum / h->count) / 1000.0);
+    for (i = 0; i < sizeof(pcts) / sizeof(double); i++) {
+        dprintf(fd, "  - p%-11g: %.3lf ms\n", pcts[i],
+                flb_histogram_percentile(h, pcts[i]) / 1000.0);
+    }
+    dprintf(fd, "  - Max         : %.3lf ms\n", h->max / 1000.0);
+}
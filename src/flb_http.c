@@ -0,0 +1,337 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/types.h>
+
+#include "flb_http.h"
+
+char *flb_http_request_create(char *method, char *host, char *port,
+                              char *uri, char *content_type, char *headers,
+                              const char *body, size_t body_len,
+                              size_t *out_len)
+{
+    int len;
+    size_t size;
+    char *buf;
+
+    size = 512 + strlen(host) + strlen(port) + strlen(uri) +
+        (content_type ? strlen(content_type) : 0) +
+        (headers ? strlen(headers) : 0) + body_len;
+
+    buf = malloc(size);
+    if (!buf) {
+        perror("malloc");
+        return NULL;
+    }
+
+    len = snprintf(buf, size,
+                   "%s %s HTTP/1.1\r\n"
+                   "Host: %s:%s\r\n"
+                   "User-Agent: fluent-bit-perf\r\n"
+                   "Connection: keep-alive\r\n"
+                   "Content-Type: %s\r\n"
+                   "Content-Length: %zu\r\n"
+                   "%s"
+                   "\r\n",
+                   method, uri, host, port,
+                   content_type ? content_type : "application/octet-stream",
+                   body_len,
+                   headers ? headers : "");
+    if (len < 0 || len >= size - body_len) {
+        fprintf(stderr, "error: cannot compose HTTP request\n");
+        free(buf);
+        return NULL;
+    }
+
+    if (body_len > 0) {
+        memcpy(buf + len, body, body_len);
+    }
+
+    *out_len = len + body_len;
+    return buf;
+}
+
+/* Compare a header name, 'line' is not NULL terminated */
+static int header_is(const char *line, size_t len, char *name)
+{
+    size_t n = strlen(name);
+
+    return (len > n && line[n] == ':' && strncasecmp(line, name, n) == 0);
+}
+
+static const char *header_value(const char *line, const char *eol)
+{
+    const char *p = memchr(line, ':', eol - line) + 1;
+
+    while (p < eol && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    return p;
+}
+
+const char *flb_http_header_get(const char *buf, size_t header_len,
+                                char *name, size_t *val_len)
+{
+    const char *p;
+    const char *eol;
+    const char *val;
+    const char *end = buf + header_len;
+
+    p = memmem(buf, header_len, "\r\n", 2);
+    if (!p) {
+        return NULL;
+    }
+    p += 2;
+
+    while (p < end - 2) {
+        eol = memmem(p, end - p, "\r\n", 2);
+        if (!eol) {
+            return NULL;
+        }
+        if (header_is(p, eol - p, name)) {
+            val = header_value(p, eol);
+            *val_len = eol - val;
+            return val;
+        }
+        p = eol + 2;
+    }
+
+    return NULL;
+}
+
+/* Walk a chunked body, returns its encoded length or zero if incomplete */
+static ssize_t chunked_length(const char *buf, size_t len)
+{
+    char *endp;
+    size_t chunk;
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *eol;
+
+    while (p < end) {
+        eol = memmem(p, end - p, "\r\n", 2);
+        if (!eol) {
+            return 0;
+        }
+
+        chunk = strtoul(p, &endp, 16);
+        if (endp == p) {
+            return -1;
+        }
+        p = eol + 2;
+
+        if (chunk == 0) {
+            /* optional trailers end with an empty line */
+            if (end - p >= 2 && p[0] == '\r' && p[1] == '\n') {
+                return (p + 2) - buf;
+            }
+            eol = memmem(p, end - p, "\r\n\r\n", 4);
+            if (!eol) {
+                return 0;
+            }
+            return (eol + 4) - buf;
+        }
+
+        if (end - p < chunk + 2) {
+            return 0;
+        }
+        p += chunk + 2;
+    }
+
+    return 0;
+}
+
+int flb_http_chunked_decode(const char *buf, size_t len,
+                            char **out, size_t *out_len)
+{
+    char *endp;
+    char *dst;
+    size_t chunk;
+    size_t off = 0;
+    const char *p = buf;
+    const char *end = buf + len;
+    const char *eol;
+
+    /* the decoded body is never larger than the encoded one */
+    dst = malloc(len + 1);
+    if (!dst) {
+        perror("malloc");
+        return -1;
+    }
+
+    while (p < end) {
+        eol = memmem(p, end - p, "\r\n", 2);
+        if (!eol) {
+            break;
+        }
+        chunk = strtoul(p, &endp, 16);
+        if (endp == p || end - (eol + 2) < chunk) {
+            break;
+        }
+        p = eol + 2;
+
+        if (chunk == 0) {
+            *out = dst;
+            *out_len = off;
+            return 0;
+        }
+        memcpy(dst + off, p, chunk);
+        off += chunk;
+        p += chunk + 2;
+    }
+
+    free(dst);
+    return -1;
+}
+
+/* Scan the header lines between the first line and the empty line */
+static void headers_parse(const char *buf, size_t len, const char *end,
+                          ssize_t *content_length, int *chunked, int *close)
+{
+    const char *p;
+    const char *eol;
+    const char *val;
+
+    p = memmem(buf, len, "\r\n", 2) + 2;
+    while (p < end - 2) {
+        eol = memmem(p, end - p, "\r\n", 2);
+        if (header_is(p, eol - p, "Content-Length")) {
+            *content_length = strtol(header_value(p, eol), NULL, 10);
+        }
+        else if (header_is(p, eol - p, "Transfer-Encoding")) {
+            val = header_value(p, eol);
+            if (strncasecmp(val, "chunked", 7) == 0) {
+                *chunked = 1;
+            }
+        }
+        else if (header_is(p, eol - p, "Connection")) {
+            val = header_value(p, eol);
+            if (strncasecmp(val, "close", 5) == 0) {
+                *close = 1;
+            }
+        }
+        p = eol + 2;
+    }
+}
+
+ssize_t flb_http_response_parse(const char *buf, size_t len,
+                                struct flb_http_response *res)
+{
+    int chunked = 0;
+    ssize_t body;
+    ssize_t content_length = -1;
+    const char *end;
+
+    end = memmem(buf, len, "\r\n\r\n", 4);
+    if (!end) {
+        return 0;
+    }
+    end += 4;
+
+    /* Status line: HTTP/1.x NNN Reason */
+    if (len < 12 || strncmp(buf, "HTTP/1.", 7) != 0) {
+        return -1;
+    }
+    res->status = atoi(buf + 9);
+    res->close = 0;
+    res->header_len = end - buf;
+
+    headers_parse(buf, len, end, &content_length, &chunked, &res->close);
+
+    if (chunked) {
+        body = chunked_length(end, len - res->header_len);
+        if (body <= 0) {
+            return body;
+        }
+    }
+    else if (content_length >= 0) {
+        body = content_length;
+        if (len - res->header_len < body) {
+            return 0;
+        }
+    }
+    else if (res->status == 204 || res->status == 304 ||
+             (res->status >= 100 && res->status < 200)) {
+        body = 0;
+    }
+    else {
+        /* body delimited by the connection close, not supported */
+        body = 0;
+        res->close = 1;
+    }
+
+    res->body_len = body;
+    return res->header_len + body;
+}
+
+ssize_t flb_http_request_parse(const char *buf, size_t len,
+                               struct flb_http_request *req)
+{
+    int chunked = 0;
+    ssize_t body = 0;
+    ssize_t content_length = -1;
+    const char *p;
+    const char *end;
+    const char *eol;
+
+    end = memmem(buf, len, "\r\n\r\n", 4);
+    if (!end) {
+        return 0;
+    }
+    end += 4;
+
+    /* Request line: METHOD URI HTTP/1.x */
+    eol = memmem(buf, len, "\r\n", 2);
+    p = memchr(buf, ' ', eol - buf);
+    if (!p || eol - buf < 14 || strncmp(eol - 8, "HTTP/1.", 7) != 0) {
+        return -1;
+    }
+    req->method = buf;
+    req->method_len = p - buf;
+    req->uri = p + 1;
+    req->uri_len = (eol - 9) - req->uri;
+    req->close = (eol[-1] == '0');
+    req->chunked = 0;
+    req->header_len = end - buf;
+
+    headers_parse(buf, len, end, &content_length, &chunked, &req->close);
+
+    if (chunked) {
+        body = chunked_length(end, len - req->header_len);
+        if (body <= 0) {
+            return body;
+        }
+        req->chunked = 1;
+    }
+    else if (content_length > 0) {
+        body = content_length;
+        if (len - req->header_len < body) {
+            return 0;
+        }
+    }
+
+    req->body_len = body;
+    return req->header_len + body;
+}
@@ -0,0 +1,377 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+
+#include "flb_proc.h"
+#include "flb_sockdiag.h"
+#include "flb_launch.h"
+
+/* the target stopped by the signal handlers, one per process */
+static struct flb_launch *launch_active = NULL;
+
+static double launch_elapsed_ms(struct flb_launch *l)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - l->start.tv_sec) * 1000.0 +
+        (now.tv_nsec - l->start.tv_nsec) / 1e6;
+}
+
+int flb_launch_ready_parse(char *spec, int *ready, int *port, char **path)
+{
+    *port = 0;
+    *path = NULL;
+
+    if (strcmp(spec, "none") == 0) {
+        *ready = FLB_LAUNCH_READY_NONE;
+    }
+    else if (strcmp(spec, "listen") == 0) {
+        *ready = FLB_LAUNCH_READY_LISTEN;
+    }
+    else if (strncmp(spec, "listen:", 7) == 0) {
+        *ready = FLB_LAUNCH_READY_LISTEN;
+        *port = atoi(spec + 7);
+        if (*port < 1 || *port > 65535) {
+            fprintf(stderr, "error: invalid port '%s'\n", spec + 7);
+            return -1;
+        }
+    }
+    else if (strncmp(spec, "read:", 5) == 0 && spec[5] != '\0') {
+        *ready = FLB_LAUNCH_READY_READ;
+        *path = spec + 5;
+    }
+    else {
+        fprintf(stderr, "error: invalid ready condition '%s'\n", spec);
+        return -1;
+    }
+    return 0;
+}
+
+static int launch_is_ready(struct flb_launch *l)
+{
+    int i;
+    struct flb_sockdiag sd;
+
+    switch (l->ready) {
+    case FLB_LAUNCH_READY_LISTEN:
+        if (flb_sockdiag_sample(l->pid, &sd) == -1) {
+            return 0;
+        }
+        if (l->port == 0 && sd.n_ports > 0) {
+            l->port = sd.ports[0];
+            return 1;
+        }
+        for (i = 0; i < sd.n_ports; i++) {
+            if (sd.ports[i] == l->port) {
+                return 1;
+            }
+        }
+        return 0;
+    case FLB_LAUNCH_READY_READ:
+        /* the file may not exist before the tool writes it */
+        if (access(l->path, F_OK) == -1) {
+            return 0;
+        }
+        return flb_proc_file_offset(l->pid, l->path) > 0;
+    }
+    return 1;
+}
+
+/* Poll the target every millisecond until it's ready or gone */
+static void *launch_worker(void *data)
+{
+    int fd;
+    int status;
+    ssize_t bytes;
+    char path[PROC_PID_SIZE];
+    char buf[PROC_STAT_BUF_SIZE];
+    struct timespec next;
+    struct flb_proc_task t;
+    struct flb_launch *l = data;
+
+    memset(&t, 0, sizeof(t));
+    snprintf(path, sizeof(path), "/proc/%i/stat", l->pid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (__atomic_load_n(&l->running, __ATOMIC_RELAXED)) {
+        if (waitpid(l->pid, &status, WNOHANG) == l->pid) {
+            l->exited = 1;
+            l->status = status;
+            break;
+        }
+
+        if (fd >= 0) {
+            bytes = pread(fd, buf, sizeof(buf), 0);
+            if (bytes > 0 && flb_proc_stat_parse(buf, bytes, &t) == 0) {
+                l->samples++;
+                if (t.r_rss > l->peak_rss) {
+                    l->peak_rss = t.r_rss;
+                }
+            }
+        }
+
+        if (launch_is_ready(l)) {
+            l->ready_ms = launch_elapsed_ms(l);
+            l->ready_rss = t.r_rss;
+            l->ready_cpu_ms = t.r_utime_ms + t.r_stime_ms;
+            l->ready_minflt = t.minflt;
+            l->ready_majflt = t.majflt;
+            break;
+        }
+
+        next.tv_nsec += 1000000;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    __atomic_store_n(&l->done, 1, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+/*
+ * Ctrl-C or a kill of the tool would leave the target running, its process
+ * group is not ours. Only installed where the tool keeps the default action.
+ */
+static void launch_signal(int sig)
+{
+    if (launch_active) {
+        kill(-launch_active->pid, SIGTERM);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void launch_signal_set(int sig)
+{
+    struct sigaction sa;
+
+    if (sigaction(sig, NULL, &sa) == 0 && sa.sa_handler == SIG_DFL) {
+        signal(sig, launch_signal);
+    }
+}
+
+/*
+ * Same approach as the pipe writer: simple commands are executed directly,
+ * the ones using shell syntax go through the shell with 'exec' so the
+ * command replaces it and its PID is the target.
+ */
+struct flb_launch *flb_launch_create(char *cmd, int ready, int port,
+                                     char *path)
+{
+    int n = 0;
+    int err = 0;
+    int sync[2];
+    pid_t pid;
+    pid_t parent;
+    char *p;
+    char *argv[64];
+    char line[4096];
+    char words[4096];
+    struct flb_launch *l;
+
+    if (snprintf(line, sizeof(line), "exec %s", cmd) >= sizeof(line)) {
+        fprintf(stderr, "error: command is too long\n");
+        return NULL;
+    }
+
+    if (!strpbrk(cmd, "|&;<>()$`\\\"'*?[]~{}=")) {
+        strcpy(words, cmd);
+        for (p = strtok(words, " \t"); p && n < 63; p = strtok(NULL, " \t")) {
+            argv[n++] = p;
+        }
+        argv[n] = NULL;
+    }
+
+    l = calloc(1, sizeof(struct flb_launch));
+    if (!l) {
+        perror("calloc");
+        return NULL;
+    }
+    l->cmd = cmd;
+    l->ready = ready;
+    l->port = port;
+    l->path = path;
+    l->ready_ms = -1;
+
+    /* closed by exec(), tells the parent when the command is running */
+    if (pipe2(sync, O_CLOEXEC) == -1) {
+        perror("pipe2");
+        free(l);
+        return NULL;
+    }
+
+    parent = getpid();
+    clock_gettime(CLOCK_MONOTONIC, &l->start);
+    pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        close(sync[0]);
+        close(sync[1]);
+        free(l);
+        return NULL;
+    }
+
+    if (pid == 0) {
+        /* own process group, stopped as a whole; die with the tool */
+        setpgid(0, 0);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        if (getppid() != parent) {
+            _exit(127);
+        }
+        if (n > 0) {
+            execvp(argv[0], argv);
+        }
+        else {
+            execl("/bin/sh", "sh", "-c", line, (char *) NULL);
+        }
+        err = errno;
+        write(sync[1], &err, sizeof(err));
+        _exit(127);
+    }
+
+    /* both sides set the group, whichever runs first */
+    setpgid(pid, pid);
+    l->pid = pid;
+
+    close(sync[1]);
+    if (read(sync[0], &err, sizeof(err)) > 0) {
+        fprintf(stderr, "error: cannot execute '%s': %s\n",
+                cmd, strerror(err));
+        close(sync[0]);
+        waitpid(pid, NULL, 0);
+        free(l);
+        return NULL;
+    }
+    close(sync[0]);
+    l->exec_ms = launch_elapsed_ms(l);
+
+    l->running = 1;
+    if (pthread_create(&l->thread, NULL, launch_worker, l) != 0) {
+        fprintf(stderr, "error: cannot create launch thread\n");
+        l->running = 0;
+        l->done = 1;
+        flb_launch_destroy(l);
+        return NULL;
+    }
+
+    if (!launch_active) {
+        launch_active = l;
+        launch_signal_set(SIGINT);
+        launch_signal_set(SIGTERM);
+        launch_signal_set(SIGHUP);
+    }
+    return l;
+}
+
+int flb_launch_wait(struct flb_launch *l, int timeout)
+{
+    struct timespec ts = {0, 1000000};
+
+    while (!__atomic_load_n(&l->done, __ATOMIC_ACQUIRE)) {
+        if (launch_elapsed_ms(l) > timeout) {
+            fprintf(stderr, "error: '%s' not ready after %i ms\n",
+                    l->cmd, timeout);
+            return -1;
+        }
+        nanosleep(&ts, NULL);
+    }
+
+    if (l->exited) {
+        if (WIFEXITED(l->status)) {
+            fprintf(stderr, "error: '%s' exited with status %i before it "
+                    "was ready\n", l->cmd, WEXITSTATUS(l->status));
+        }
+        else {
+            fprintf(stderr, "error: '%s' killed by signal %i before it "
+                    "was ready\n", l->cmd, WTERMSIG(l->status));
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/* Wait up to 'timeout' ms for the target, returns 1 if it was reaped */
+static int launch_reap(struct flb_launch *l, int timeout)
+{
+    int i;
+    pid_t ret;
+
+    for (i = 0; i <= timeout / 10; i++) {
+        ret = waitpid(l->pid, &l->status, WNOHANG);
+        if (ret == l->pid || (ret == -1 && errno == ECHILD)) {
+            return 1;
+        }
+        usleep(10000);
+    }
+    return 0;
+}
+
+void flb_launch_destroy(struct flb_launch *l)
+{
+    if (__atomic_load_n(&l->running, __ATOMIC_RELAXED)) {
+        __atomic_store_n(&l->running, 0, __ATOMIC_RELAXED);
+        pthread_join(l->thread, NULL);
+    }
+
+    if (!l->exited) {
+        /* the agent flushes and exits on SIGTERM, then it's forced */
+        kill(-l->pid, SIGTERM);
+        if (!launch_reap(l, FLB_LAUNCH_TERM_TIMEOUT)) {
+            fprintf(stderr, "error: '%s' did not exit after SIGTERM in "
+                    "%i ms, killing it\n", l->cmd, FLB_LAUNCH_TERM_TIMEOUT);
+            kill(-l->pid, SIGKILL);
+            waitpid(l->pid, &l->status, 0);
+        }
+    }
+    /* leftovers of the group, e.g. workers that ignored the SIGTERM */
+    kill(-l->pid, SIGKILL);
+
+    if (launch_active == l) {
+        launch_active = NULL;
+    }
+    free(l);
+}
+
+struct flb_launch *flb_launch_get()
+{
+    return launch_active;
+}
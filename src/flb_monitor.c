@@ -0,0 +1,213 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flb_monitor.h"
+#include "flb_cgroup.h"
+#include "flb_profile.h"
+#include "flb_launch.h"
+
+static struct flb_monitor monitor = {
+    .profile_first = 1,
+    .ready = FLB_LAUNCH_READY_LISTEN,
+};
+
+struct flb_monitor *flb_monitor_get()
+{
+    return &monitor;
+}
+
+/* Returns 0 if the option was consumed, -1 if it's unknown or invalid */
+int flb_monitor_option(int opt, char *arg)
+{
+    char *dash;
+
+    switch (opt) {
+    case FLB_MONITOR_OPT_SAMPLE_HZ:
+        monitor.sample_hz = arg ? atoi(arg) : FLB_MONITOR_DEFAULT_HZ;
+        if (monitor.sample_hz != 0 &&
+            (monitor.sample_hz < 10 || monitor.sample_hz > 1000)) {
+            fprintf(stderr, "error: sample rate must be 0 or 10-1000 Hz\n");
+            return -1;
+        }
+        return 0;
+    case FLB_MONITOR_OPT_THREADS:
+        monitor.threads = 1;
+        return 0;
+    case FLB_MONITOR_OPT_MEMORY:
+        monitor.memory = 1;
+        return 0;
+    case FLB_MONITOR_OPT_IO:
+        monitor.io = 1;
+        return 0;
+    case FLB_MONITOR_OPT_TREE:
+        monitor.tree = 1;
+        if (arg) {
+            monitor.tree_top = atoi(arg);
+            if (monitor.tree_top < 1) {
+                fprintf(stderr, "error: invalid number of processes '%s'\n",
+                        arg);
+                return -1;
+            }
+        }
+        return 0;
+    case FLB_MONITOR_OPT_CGROUP:
+        monitor.cgroup = arg;
+        return 0;
+    case FLB_MONITOR_OPT_PERF:
+        monitor.perf = 1;
+        return 0;
+    case FLB_MONITOR_OPT_SCHEDSTAT:
+        monitor.schedstat = 1;
+        return 0;
+    case FLB_MONITOR_OPT_SOCKETS:
+        monitor.sockets = 1;
+        return 0;
+    case FLB_MONITOR_OPT_PROFILE:
+        monitor.profile = arg;
+        return 0;
+    case FLB_MONITOR_OPT_LAUNCH:
+        monitor.launch = arg;
+        return 0;
+    case FLB_MONITOR_OPT_READY:
+        return flb_launch_ready_parse(arg, &monitor.ready,
+                                      &monitor.ready_port,
+                                      &monitor.ready_path);
+    case FLB_MONITOR_OPT_ROUNDS:
+        /* N, N- or N-M */
+        monitor.profile_first = atoi(arg);
+        dash = strchr(arg, '-');
+        if (!dash) {
+            monitor.profile_last = monitor.profile_first;
+        }
+        else {
+            monitor.profile_last = atoi(dash + 1);
+        }
+        if (monitor.profile_first < 1 || monitor.profile_last < 0 ||
+            (monitor.profile_last > 0 &&
+             monitor.profile_last < monitor.profile_first)) {
+            fprintf(stderr, "error: invalid rounds '%s'\n", arg);
+            return -1;
+        }
+        return 0;
+    case FLB_MONITOR_OPT_SMAPS:
+        monitor.memory = 1;
+        monitor.smaps = arg ? atoi(arg) : 10;
+        if (monitor.smaps < 1) {
+            fprintf(stderr, "error: invalid number of mappings '%s'\n", arg);
+            return -1;
+        }
+        return 0;
+    }
+
+    return -1;
+}
+
+static void monitor_launch_stop()
+{
+    struct flb_launch *l = flb_launch_get();
+
+    if (l) {
+        flb_launch_destroy(l);
+    }
+}
+
+static int monitor_launch()
+{
+    struct flb_launch *l;
+
+    l = flb_launch_create(monitor.launch, monitor.ready,
+                          monitor.ready_port, monitor.ready_path);
+    if (!l) {
+        exit(EXIT_FAILURE);
+    }
+    atexit(monitor_launch_stop);
+
+    /* the tool writes the file a reader waits for, it can't block here */
+    if (monitor.ready != FLB_LAUNCH_READY_READ &&
+        flb_launch_wait(l, FLB_LAUNCH_READY_TIMEOUT) == -1) {
+        exit(EXIT_FAILURE);
+    }
+    return l->pid;
+}
+
+int flb_monitor_target(int pid)
+{
+    if (monitor.launch) {
+        if (pid >= 0 || monitor.cgroup) {
+            fprintf(stderr, "error: --launch can't be used with a PID or "
+                    "--cgroup\n");
+            exit(EXIT_FAILURE);
+        }
+        return monitor_launch();
+    }
+
+    if (pid >= 0 || !monitor.cgroup) {
+        return pid;
+    }
+
+    pid = flb_cgroup_pid(monitor.cgroup);
+    if (pid == -1) {
+        exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+void flb_monitor_help()
+{
+    printf("Monitor options (with a target PID, cgroup or launch)\n");
+    printf("  --sample-hz[=HZ]\t\tbackground /proc sampler for the sub-second CPU\n"
+           "\t\t\t\tand RSS peaks, 10-1000 Hz (default: off, %i Hz\n"
+           "\t\t\t\twithout a rate)\n", FLB_MONITOR_DEFAULT_HZ);
+    printf("  --threads\t\t\tCPU usage per thread name, busiest one per round\n");
+    printf("  --memory\t\t\tPSS, peak RSS and anon/file/shmem RSS per round\n");
+    printf("  --smaps[=N]\t\t\tsame as --memory plus the top N mappings by PSS\n"
+           "\t\t\t\t(default: 10)\n");
+    printf("  --io\t\t\t\tsyscalls, I/O bytes, context switches and page\n"
+           "\t\t\t\tfaults per round and per record\n");
+    printf("  --schedstat\t\t\tnanosecond CPU time and run queue delay of the\n"
+           "\t\t\t\ttarget threads, from /proc/PID/task/*/schedstat\n");
+    printf("  --sockets\t\t\tTCP writers: accept queue, recv/send queues,\n"
+           "\t\t\t\tdrops and retransmits of the target sockets\n");
+    printf("  --tree[=N]\t\t\tsum the target and all its descendants, with N\n"
+           "\t\t\t\tlist the top N processes by CPU in the summary\n");
+    printf("  --cgroup=PATH\t\t\tmonitor a cgroup v2 (absolute or relative to\n"
+           "\t\t\t\t%s) instead of a PID: CPU, throttling,\n"
+           "\t\t\t\tmemory with page cache and block I/O\n",
+           FLB_CGROUP_ROOT);
+    printf("  --launch=CMD\t\t\tstart CMD as the target, measure its startup\n"
+           "\t\t\t\tand stop it (SIGTERM, SIGKILL after %i ms) on exit\n",
+           FLB_LAUNCH_TERM_TIMEOUT);
+    printf("  --ready=COND\t\t\twhen the launched target is ready: listen,\n"
+           "\t\t\t\tlisten:PORT, read:PATH (first byte read) or\n"
+           "\t\t\t\tnone (default: listen, timeout %i ms)\n",
+           FLB_LAUNCH_READY_TIMEOUT);
+    printf("  --perf\t\t\t\thardware counters of the target threads: IPC,\n"
+           "\t\t\t\tcache misses, instructions per record\n");
+    printf("  --profile=DIR\t\t\tsample the target stacks at %i Hz, one folded\n"
+           "\t\t\t\tstacks file per round: DIR/round-NNN.folded\n",
+           FLB_PROFILE_HZ);
+    printf("  --profile-rounds=N[-M]\t\tprofile only rounds N to M (default: all,\n"
+           "\t\t\t\tM can be empty: until the end)\n");
+    printf("\n");
+}
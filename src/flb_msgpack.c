@@ -0,0 +1,920 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "flb_msgpack.h"
+
+/* Max nesting level accepted by the JSON converter */
+#define JSON_MAX_DEPTH  64
+
+int flb_mp_buf_init(struct flb_mp_buf *b, size_t size)
+{
+    b->data = malloc(size);
+    if (!b->data) {
+        perror("malloc");
+        return -1;
+    }
+    b->len = 0;
+    b->size = size;
+    return 0;
+}
+
+void flb_mp_buf_destroy(struct flb_mp_buf *b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->len = 0;
+    b->size = 0;
+}
+
+static int mp_buf_reserve(struct flb_mp_buf *b, size_t bytes)
+{
+    size_t size;
+    char *tmp;
+
+    if (b->len + bytes <= b->size) {
+        return 0;
+    }
+
+    size = b->size ? b->size : 64;
+    while (size < b->len + bytes) {
+        size *= 2;
+    }
+
+    tmp = realloc(b->data, size);
+    if (!tmp) {
+        perror("realloc");
+        return -1;
+    }
+    b->data = tmp;
+    b->size = size;
+    return 0;
+}
+
+static int mp_put_be(struct flb_mp_buf *b, uint8_t type, uint64_t val, int bytes)
+{
+    int i;
+    unsigned char *p;
+
+    if (mp_buf_reserve(b, bytes + 1) == -1) {
+        return -1;
+    }
+
+    p = (unsigned char *) b->data + b->len;
+    *p++ = type;
+    for (i = bytes - 1; i >= 0; i--) {
+        *p++ = (val >> (i * 8)) & 0xff;
+    }
+    b->len += bytes + 1;
+    return 0;
+}
+
+int flb_mp_pack_raw(struct flb_mp_buf *b, const void *data, size_t len)
+{
+    if (mp_buf_reserve(b, len) == -1) {
+        return -1;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+int flb_mp_pack_nil(struct flb_mp_buf *b)
+{
+    return flb_mp_pack_raw(b, "\xc0", 1);
+}
+
+int flb_mp_pack_bool(struct flb_mp_buf *b, int val)
+{
+    return flb_mp_pack_raw(b, val ? "\xc3" : "\xc2", 1);
+}
+
+int flb_mp_pack_uint(struct flb_mp_buf *b, uint64_t val)
+{
+    uint8_t c;
+
+    if (val < 128) {
+        c = val;
+        return flb_mp_pack_raw(b, &c, 1);
+    }
+    else if (val <= UINT8_MAX) {
+        return mp_put_be(b, 0xcc, val, 1);
+    }
+    else if (val <= UINT16_MAX) {
+        return mp_put_be(b, 0xcd, val, 2);
+    }
+    else if (val <= UINT32_MAX) {
+        return mp_put_be(b, 0xce, val, 4);
+    }
+    return mp_put_be(b, 0xcf, val, 8);
+}
+
+int flb_mp_pack_int(struct flb_mp_buf *b, int64_t val)
+{
+    uint8_t c;
+
+    if (val >= 0) {
+        return flb_mp_pack_uint(b, val);
+    }
+    else if (val >= -32) {
+        c = (uint8_t) val;
+        return flb_mp_pack_raw(b, &c, 1);
+    }
+    else if (val >= INT8_MIN) {
+        return mp_put_be(b, 0xd0, (uint8_t) val, 1);
+    }
+    else if (val >= INT16_MIN) {
+        return mp_put_be(b, 0xd1, (uint16_t) val, 2);
+    }
+    else if (val >= INT32_MIN) {
+        return mp_put_be(b, 0xd2, (uint32_t) val, 4);
+    }
+    return mp_put_be(b, 0xd3, (uint64_t) val, 8);
+}
+
+int flb_mp_pack_double(struct flb_mp_buf *b, double val)
+{
+    uint64_t u;
+
+    memcpy(&u, &val, sizeof(u));
+    return mp_put_be(b, 0xcb, u, 8);
+}
+
+static int mp_pack_str_header(struct flb_mp_buf *b, size_t len)
+{
+    uint8_t c;
+
+    if (len < 32) {
+        c = 0xa0 | len;
+        return flb_mp_pack_raw(b, &c, 1);
+    }
+    else if (len <= UINT8_MAX) {
+        return mp_put_be(b, 0xd9, len, 1);
+    }
+    else if (len <= UINT16_MAX) {
+        return mp_put_be(b, 0xda, len, 2);
+    }
+    return mp_put_be(b, 0xdb, len, 4);
+}
+
+int flb_mp_pack_str(struct flb_mp_buf *b, const char *str, size_t len)
+{
+    if (mp_pack_str_header(b, len) == -1) {
+        return -1;
+    }
+    return flb_mp_pack_raw(b, str, len);
+}
+
+int flb_mp_pack_bin(struct flb_mp_buf *b, const void *data, size_t len)
+{
+    int ret;
+
+    if (len <= UINT8_MAX) {
+        ret = mp_put_be(b, 0xc4, len, 1);
+    }
+    else if (len <= UINT16_MAX) {
+        ret = mp_put_be(b, 0xc5, len, 2);
+    }
+    else {
+        ret = mp_put_be(b, 0xc6, len, 4);
+    }
+
+    if (ret == -1) {
+        return -1;
+    }
+    return flb_mp_pack_raw(b, data, len);
+}
+
+int flb_mp_pack_array(struct flb_mp_buf *b, uint32_t n)
+{
+    uint8_t c;
+
+    if (n < 16) {
+        c = 0x90 | n;
+        return flb_mp_pack_raw(b, &c, 1);
+    }
+    else if (n <= UINT16_MAX) {
+        return mp_put_be(b, 0xdc, n, 2);
+    }
+    return mp_put_be(b, 0xdd, n, 4);
+}
+
+int flb_mp_pack_map(struct flb_mp_buf *b, uint32_t n)
+{
+    uint8_t c;
+
+    if (n < 16) {
+        c = 0x80 | n;
+        return flb_mp_pack_raw(b, &c, 1);
+    }
+    else if (n <= UINT16_MAX) {
+        return mp_put_be(b, 0xde, n, 2);
+    }
+    return mp_put_be(b, 0xdf, n, 4);
+}
+
+/* Fluentd EventTime: fixext8, type 0, seconds and nanoseconds big-endian */
+int flb_mp_pack_event_time(struct flb_mp_buf *b, uint32_t sec, uint32_t nsec)
+{
+    unsigned char tmp[10];
+
+    tmp[0] = 0xd7;
+    tmp[1] = 0x00;
+    tmp[2] = sec >> 24;
+    tmp[3] = sec >> 16;
+    tmp[4] = sec >> 8;
+    tmp[5] = sec;
+    tmp[6] = nsec >> 24;
+    tmp[7] = nsec >> 16;
+    tmp[8] = nsec >> 8;
+    tmp[9] = nsec;
+    return flb_mp_pack_raw(b, tmp, sizeof(tmp));
+}
+
+/*
+ * JSON to msgpack conversion: a small recursive descent parser which
+ * writes msgpack directly while scanning. Containers are counted ahead
+ * with a lightweight scan so headers can be emitted in order.
+ */
+struct json_ctx {
+    const char *p;
+    const char *end;
+    int depth;
+};
+
+static void json_skip_ws(struct json_ctx *ctx)
+{
+    while (ctx->p < ctx->end &&
+           (*ctx->p == ' ' || *ctx->p == '\t' ||
+            *ctx->p == '\n' || *ctx->p == '\r')) {
+        ctx->p++;
+    }
+}
+
+/* Skip a JSON string starting at the opening quote, returns end or NULL */
+static const char *json_skip_str(const char *p, const char *end)
+{
+    p++;
+    while (p < end) {
+        if (*p == '\\') {
+            p += 2;
+            continue;
+        }
+        if (*p == '"') {
+            return p + 1;
+        }
+        p++;
+    }
+    return NULL;
+}
+
+/* Count the direct children of the container starting at 'p' */
+static int json_count_items(const char *p, const char *end, uint32_t *count)
+{
+    int level = 0;
+    int items = 0;
+    int empty = 1;
+
+    for (; p < end; p++) {
+        if (*p == '"') {
+            p = json_skip_str(p, end);
+            if (!p) {
+                return -1;
+            }
+            p--;
+            empty = 0;
+            continue;
+        }
+
+        if (*p == '{' || *p == '[') {
+            level++;
+            if (level > 1) {
+                empty = 0;
+            }
+        }
+        else if (*p == '}' || *p == ']') {
+            level--;
+            if (level == 0) {
+                *count = empty ? 0 : items + 1;
+                return 0;
+            }
+        }
+        else if (*p == ',' && level == 1) {
+            items++;
+        }
+        else if (*p != ' ' && *p != '\t' && *p != '\n' && *p != '\r') {
+            empty = 0;
+        }
+    }
+    return -1;
+}
+
+static int json_hex4(const char *p, uint32_t *out)
+{
+    int i;
+    uint32_t v = 0;
+
+    for (i = 0; i < 4; i++) {
+        v <<= 4;
+        if (p[i] >= '0' && p[i] <= '9') {
+            v |= p[i] - '0';
+        }
+        else if (p[i] >= 'a' && p[i] <= 'f') {
+            v |= p[i] - 'a' + 10;
+        }
+        else if (p[i] >= 'A' && p[i] <= 'F') {
+            v |= p[i] - 'A' + 10;
+        }
+        else {
+            return -1;
+        }
+    }
+    *out = v;
+    return 0;
+}
+
+static int json_utf8(char *out, uint32_t cp)
+{
+    if (cp < 0x80) {
+        out[0] = cp;
+        return 1;
+    }
+    else if (cp < 0x800) {
+        out[0] = 0xc0 | (cp >> 6);
+        out[1] = 0x80 | (cp & 0x3f);
+        return 2;
+    }
+    else if (cp < 0x10000) {
+        out[0] = 0xe0 | (cp >> 12);
+        out[1] = 0x80 | ((cp >> 6) & 0x3f);
+        out[2] = 0x80 | (cp & 0x3f);
+        return 3;
+    }
+    out[0] = 0xf0 | (cp >> 18);
+    out[1] = 0x80 | ((cp >> 12) & 0x3f);
+    out[2] = 0x80 | ((cp >> 6) & 0x3f);
+    out[3] = 0x80 | (cp & 0x3f);
+    return 4;
+}
+
+static int json_pack_string(struct json_ctx *ctx, struct flb_mp_buf *b)
+{
+    int n;
+    size_t hdr;
+    size_t start;
+    size_t len;
+    uint32_t cp;
+    uint32_t lo;
+    const char *p;
+    const char *q;
+    char *out;
+    char tmp[5];
+
+    q = json_skip_str(ctx->p, ctx->end);
+    if (!q) {
+        return -1;
+    }
+    p = ctx->p + 1;
+
+    /* Fast path: no escapes, copy as is */
+    if (!memchr(p, '\\', (q - 1) - p)) {
+        ctx->p = q;
+        return flb_mp_pack_str(b, p, (q - 1) - p);
+    }
+
+    /*
+     * Decode right after a worst case str32 header, then move the
+     * payload if a shorter header fits.
+     */
+    hdr = b->len;
+    if (mp_buf_reserve(b, 5 + ((q - 1) - p)) == -1) {
+        return -1;
+    }
+    start = hdr + 5;
+    out = b->data + start;
+
+    while (p < q - 1) {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case '"': *out++ = '"'; break;
+        case '\\': *out++ = '\\'; break;
+        case '/': *out++ = '/'; break;
+        case 'b': *out++ = '\b'; break;
+        case 'f': *out++ = '\f'; break;
+        case 'n': *out++ = '\n'; break;
+        case 'r': *out++ = '\r'; break;
+        case 't': *out++ = '\t'; break;
+        case 'u':
+            if (q - p < 5 || json_hex4(p + 1, &cp) == -1) {
+                return -1;
+            }
+            p += 4;
+            if (cp >= 0xd800 && cp <= 0xdbff && q - p > 6 &&
+                p[1] == '\\' && p[2] == 'u' &&
+                json_hex4(p + 3, &lo) == 0 && lo >= 0xdc00 && lo <= 0xdfff) {
+                cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                p += 6;
+            }
+            n = json_utf8(tmp, cp);
+            memcpy(out, tmp, n);
+            out += n;
+            break;
+        default:
+            return -1;
+        }
+        p++;
+    }
+
+    len = out - (b->data + start);
+    b->len = hdr;
+    if (mp_pack_str_header(b, len) == -1) {
+        return -1;
+    }
+    memmove(b->data + b->len, b->data + start, len);
+    b->len += len;
+    ctx->p = q;
+    return 0;
+}
+
+static int json_pack_number(struct json_ctx *ctx, struct flb_mp_buf *b)
+{
+    int is_float = 0;
+    char *endp;
+    char tmp[64];
+    const char *p = ctx->p;
+    size_t len;
+
+    while (p < ctx->end &&
+           ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' ||
+            *p == '.' || *p == 'e' || *p == 'E')) {
+        if (*p == '.' || *p == 'e' || *p == 'E') {
+            is_float = 1;
+        }
+        p++;
+    }
+
+    len = p - ctx->p;
+    if (len == 0 || len >= sizeof(tmp)) {
+        return -1;
+    }
+    memcpy(tmp, ctx->p, len);
+    tmp[len] = '\0';
+    ctx->p = p;
+
+    if (is_float) {
+        return flb_mp_pack_double(b, strtod(tmp, &endp));
+    }
+    else if (tmp[0] == '-') {
+        return flb_mp_pack_int(b, strtoll(tmp, &endp, 10));
+    }
+    return flb_mp_pack_uint(b, strtoull(tmp, &endp, 10));
+}
+
+static int json_pack_value(struct json_ctx *ctx, struct flb_mp_buf *b);
+
+static int json_pack_container(struct json_ctx *ctx, struct flb_mp_buf *b)
+{
+    int ret;
+    int is_map;
+    char close;
+    uint32_t i;
+    uint32_t n;
+
+    if (++ctx->depth > JSON_MAX_DEPTH) {
+        return -1;
+    }
+
+    if (json_count_items(ctx->p, ctx->end, &n) == -1) {
+        return -1;
+    }
+
+    is_map = (*ctx->p == '{');
+    close = is_map ? '}' : ']';
+    ret = is_map ? flb_mp_pack_map(b, n) : flb_mp_pack_array(b, n);
+    if (ret == -1) {
+        return -1;
+    }
+    ctx->p++;
+
+    for (i = 0; i < n; i++) {
+        json_skip_ws(ctx);
+        if (is_map) {
+            if (ctx->p >= ctx->end || *ctx->p != '"' ||
+                json_pack_string(ctx, b) == -1) {
+                return -1;
+            }
+            json_skip_ws(ctx);
+            if (ctx->p >= ctx->end || *ctx->p != ':') {
+                return -1;
+            }
+            ctx->p++;
+        }
+        if (json_pack_value(ctx, b) == -1) {
+            return -1;
+        }
+        json_skip_ws(ctx);
+        if (i + 1 < n) {
+            if (ctx->p >= ctx->end || *ctx->p != ',') {
+                return -1;
+            }
+            ctx->p++;
+        }
+    }
+
+    json_skip_ws(ctx);
+    if (ctx->p >= ctx->end || *ctx->p != close) {
+        return -1;
+    }
+    ctx->p++;
+    ctx->depth--;
+    return 0;
+}
+
+static int json_pack_value(struct json_ctx *ctx, struct flb_mp_buf *b)
+{
+    size_t left;
+
+    json_skip_ws(ctx);
+    if (ctx->p >= ctx->end) {
+        return -1;
+    }
+
+    left = ctx->end - ctx->p;
+    switch (*ctx->p) {
+    case '{':
+    case '[':
+        return json_pack_container(ctx, b);
+    case '"':
+        return json_pack_string(ctx, b);
+    case 't':
+        if (left < 4 || strncmp(ctx->p, "true", 4) != 0) {
+            return -1;
+        }
+        ctx->p += 4;
+        return flb_mp_pack_bool(b, 1);
+    case 'f':
+        if (left < 5 || strncmp(ctx->p, "false", 5) != 0) {
+            return -1;
+        }
+        ctx->p += 5;
+        return flb_mp_pack_bool(b, 0);
+    case 'n':
+        if (left < 4 || strncmp(ctx->p, "null", 4) != 0) {
+            return -1;
+        }
+        ctx->p += 4;
+        return flb_mp_pack_nil(b);
+    default:
+        return json_pack_number(ctx, b);
+    }
+}
+
+int flb_mp_pack_json(struct flb_mp_buf *b, const char *json, size_t len)
+{
+    size_t off = b->len;
+    struct json_ctx ctx;
+
+    ctx.p = json;
+    ctx.end = json + len;
+    ctx.depth = 0;
+
+    if (json_pack_value(&ctx, b) == -1) {
+        /* discard partial content */
+        b->len = off;
+        return -1;
+    }
+    return 0;
+}
+
+static uint64_t mp_get_be(const char *buf, int bytes)
+{
+    int i;
+    uint64_t val = 0;
+
+    for (i = 0; i < bytes; i++) {
+        val = (val << 8) | (unsigned char) buf[i];
+    }
+    return val;
+}
+
+/* Read a container header: fix, 16 and 32 bits variants */
+static int mp_unpack_container(const char *buf, size_t len, size_t *off,
+                               uint32_t *n, uint8_t fix, uint8_t t16)
+{
+    uint8_t c;
+    size_t o = *off;
+
+    if (o >= len) {
+        return FLB_MP_INCOMPLETE;
+    }
+
+    c = buf[o];
+    if ((c & 0xf0) == fix) {
+        *n = c & 0x0f;
+        *off = o + 1;
+        return FLB_MP_OK;
+    }
+    else if (c == t16) {
+        if (len - o < 3) {
+            return FLB_MP_INCOMPLETE;
+        }
+        *n = mp_get_be(buf + o + 1, 2);
+        *off = o + 3;
+        return FLB_MP_OK;
+    }
+    else if (c == t16 + 1) {
+        if (len - o < 5) {
+            return FLB_MP_INCOMPLETE;
+        }
+        *n = mp_get_be(buf + o + 1, 4);
+        *off = o + 5;
+        return FLB_MP_OK;
+    }
+    return FLB_MP_ERROR;
+}
+
+int flb_mp_unpack_map(const char *buf, size_t len, size_t *off, uint32_t *n)
+{
+    return mp_unpack_container(buf, len, off, n, 0x80, 0xde);
+}
+
+int flb_mp_unpack_array(const char *buf, size_t len, size_t *off, uint32_t *n)
+{
+    return mp_unpack_container(buf, len, off, n, 0x90, 0xdc);
+}
+
+/* Read a string, binary types are accepted too */
+int flb_mp_unpack_str(const char *buf, size_t len, size_t *off,
+                      const char **str, size_t *str_len)
+{
+    int hdr;
+    uint8_t c;
+    size_t o = *off;
+    size_t n;
+
+    if (o >= len) {
+        return FLB_MP_INCOMPLETE;
+    }
+
+    c = buf[o];
+    if ((c & 0xe0) == 0xa0) {
+        hdr = 1;
+        n = c & 0x1f;
+    }
+    else if (c == 0xd9 || c == 0xc4) {
+        hdr = 2;
+    }
+    else if (c == 0xda || c == 0xc5) {
+        hdr = 3;
+    }
+    else if (c == 0xdb || c == 0xc6) {
+        hdr = 5;
+    }
+    else {
+        return FLB_MP_ERROR;
+    }
+
+    if (len - o < hdr) {
+        return FLB_MP_INCOMPLETE;
+    }
+    if (hdr > 1) {
+        n = mp_get_be(buf + o + 1, hdr - 1);
+    }
+    if (len - o - hdr < n) {
+        return FLB_MP_INCOMPLETE;
+    }
+
+    *str = buf + o + hdr;
+    *str_len = n;
+    *off = o + hdr + n;
+    return FLB_MP_OK;
+}
+
+static int mp_unpack_raw(const char *buf, size_t len, size_t o, int hdr,
+                         struct flb_mp_obj *obj, size_t *off)
+{
+    uint32_t n;
+
+    if (len - o < hdr + 1) {
+        return FLB_MP_INCOMPLETE;
+    }
+    n = mp_get_be(buf + o + 1, hdr);
+    if (len - o - 1 - hdr < n) {
+        return FLB_MP_INCOMPLETE;
+    }
+    obj->via.raw.ptr = buf + o + 1 + hdr;
+    obj->via.raw.size = n;
+    *off = o + 1 + hdr + n;
+    return FLB_MP_OK;
+}
+
+static int mp_unpack_ext(const char *buf, size_t len, size_t o, int hdr,
+                         uint32_t fixed, struct flb_mp_obj *obj, size_t *off)
+{
+    uint32_t n = fixed;
+
+    if (len - o < hdr + 2) {
+        return FLB_MP_INCOMPLETE;
+    }
+    if (hdr > 0) {
+        n = mp_get_be(buf + o + 1, hdr);
+    }
+    if (len - o - 2 - hdr < n) {
+        return FLB_MP_INCOMPLETE;
+    }
+    obj->type = FLB_MP_EXT;
+    obj->ext_type = (int8_t) buf[o + 1 + hdr];
+    obj->via.raw.ptr = buf + o + 2 + hdr;
+    obj->via.raw.size = n;
+    *off = o + 2 + hdr + n;
+    return FLB_MP_OK;
+}
+
+/* Unpack the next object header, scalars are fully decoded */
+int flb_mp_unpack_next(const char *buf, size_t len, size_t *off,
+                       struct flb_mp_obj *obj)
+{
+    int bytes;
+    uint8_t c;
+    uint64_t u;
+    size_t o = *off;
+    float f;
+
+    if (o >= len) {
+        return FLB_MP_INCOMPLETE;
+    }
+
+    c = buf[o];
+    if (c <= 0x7f) {
+        obj->type = FLB_MP_UINT;
+        obj->via.u64 = c;
+        *off = o + 1;
+        return FLB_MP_OK;
+    }
+    else if (c >= 0xe0) {
+        obj->type = FLB_MP_INT;
+        obj->via.i64 = (int8_t) c;
+        *off = o + 1;
+        return FLB_MP_OK;
+    }
+    else if ((c & 0xf0) == 0x80) {
+        obj->type = FLB_MP_MAP;
+        return flb_mp_unpack_map(buf, len, off, &obj->via.n);
+    }
+    else if ((c & 0xf0) == 0x90) {
+        obj->type = FLB_MP_ARRAY;
+        return flb_mp_unpack_array(buf, len, off, &obj->via.n);
+    }
+    else if ((c & 0xe0) == 0xa0) {
+        obj->type = FLB_MP_STR;
+        if (len - o - 1 < (c & 0x1f)) {
+            return FLB_MP_INCOMPLETE;
+        }
+        obj->via.raw.ptr = buf + o + 1;
+        obj->via.raw.size = c & 0x1f;
+        *off = o + 1 + (c & 0x1f);
+        return FLB_MP_OK;
+    }
+
+    switch (c) {
+    case 0xc0:
+        obj->type = FLB_MP_NIL;
+        *off = o + 1;
+        return FLB_MP_OK;
+    case 0xc2:
+    case 0xc3:
+        obj->type = FLB_MP_BOOL;
+        obj->via.boolean = (c == 0xc3);
+        *off = o + 1;
+        return FLB_MP_OK;
+    case 0xc4:
+    case 0xc5:
+    case 0xc6:
+        obj->type = FLB_MP_BIN;
+        return mp_unpack_raw(buf, len, o, 1 << (c - 0xc4), obj, off);
+    case 0xd9:
+    case 0xda:
+    case 0xdb:
+        obj->type = FLB_MP_STR;
+        return mp_unpack_raw(buf, len, o, 1 << (c - 0xd9), obj, off);
+    case 0xc7:
+    case 0xc8:
+    case 0xc9:
+        return mp_unpack_ext(buf, len, o, 1 << (c - 0xc7), 0, obj, off);
+    case 0xd4:
+    case 0xd5:
+    case 0xd6:
+    case 0xd7:
+    case 0xd8:
+        return mp_unpack_ext(buf, len, o, 0, 1 << (c - 0xd4), obj, off);
+    case 0xca:
+    case 0xcb:
+        bytes = (c == 0xca) ? 4 : 8;
+        if (len - o < bytes + 1) {
+            return FLB_MP_INCOMPLETE;
+        }
+        u = mp_get_be(buf + o + 1, bytes);
+        obj->type = FLB_MP_FLOAT;
+        if (bytes == 4) {
+            uint32_t u32 = u;
+            memcpy(&f, &u32, 4);
+            obj->via.f64 = f;
+        }
+        else {
+            memcpy(&obj->via.f64, &u, 8);
+        }
+        *off = o + 1 + bytes;
+        return FLB_MP_OK;
+    case 0xcc:
+    case 0xcd:
+    case 0xce:
+    case 0xcf:
+        bytes = 1 << (c - 0xcc);
+        if (len - o < bytes + 1) {
+            return FLB_MP_INCOMPLETE;
+        }
+        obj->type = FLB_MP_UINT;
+        obj->via.u64 = mp_get_be(buf + o + 1, bytes);
+        *off = o + 1 + bytes;
+        return FLB_MP_OK;
+    case 0xd0:
+    case 0xd1:
+    case 0xd2:
+    case 0xd3:
+        bytes = 1 << (c - 0xd0);
+        if (len - o < bytes + 1) {
+            return FLB_MP_INCOMPLETE;
+        }
+        u = mp_get_be(buf + o + 1, bytes);
+        obj->type = FLB_MP_INT;
+        /* sign extension */
+        if (bytes < 8 && (u & ((uint64_t) 1 << (bytes * 8 - 1)))) {
+            u |= ~(((uint64_t) 1 << (bytes * 8)) - 1);
+        }
+        obj->via.i64 = (int64_t) u;
+        *off = o + 1 + bytes;
+        return FLB_MP_OK;
+    case 0xdc:
+    case 0xdd:
+        obj->type = FLB_MP_ARRAY;
+        return flb_mp_unpack_array(buf, len, off, &obj->via.n);
+    case 0xde:
+    case 0xdf:
+        obj->type = FLB_MP_MAP;
+        return flb_mp_unpack_map(buf, len, off, &obj->via.n);
+    }
+
+    return FLB_MP_ERROR;
+}
+
+/* Skip a complete object, including all the children of containers */
+int flb_mp_skip(const char *buf, size_t len, size_t *off)
+{
+    int ret;
+    size_t o = *off;
+    uint64_t pending = 1;
+    struct flb_mp_obj obj;
+
+    while (pending > 0) {
+        ret = flb_mp_unpack_next(buf, len, &o, &obj);
+        if (ret != FLB_MP_OK) {
+            return ret;
+        }
+        pending--;
+
+        if (obj.type == FLB_MP_ARRAY) {
+            pending += obj.via.n;
+        }
+        else if (obj.type == FLB_MP_MAP) {
+            pending += (uint64_t) obj.via.n * 2;
+        }
+    }
+
+    *off = o;
+    return FLB_MP_OK;
+}
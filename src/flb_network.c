@@ -18,14 +18,42 @@
  *  limitations under the License.
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <linux/errqueue.h>
 #include <netdb.h>
 
+#include "flb_network.h"
+
+/* Requested capacity of the splice pipe */
+#define FLB_NET_PIPE_SIZE   (1024 * 1024)
+
+/* Older C libraries don't expose the zerocopy constants */
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
+
 int flb_net_socket_create(int family)
 {
     int fd;
@@ -82,3 +110,394 @@ int flb_net_tcp_connect(char *host, char *port)
 
     return fd;
 }
+
+/* Connected UDP socket, so plain send(2) calls can be used */
+int flb_net_udp_connect(char *host, char *port)
+{
+    int fd = -1;
+    int ret;
+    struct addrinfo hints;
+    struct addrinfo *res, *rp;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_DGRAM;
+
+    ret = getaddrinfo(host, port, &hints, &res);
+    if (ret != 0) {
+        fprintf(stderr, "net_udp_connect: getaddrinfo(host='%s'): %s\n",
+                host, gai_strerror(ret));
+        return -1;
+    }
+
+    for (rp = res; rp != NULL; rp = rp->ai_next) {
+        fd = socket(rp->ai_family, SOCK_DGRAM, 0);
+        if (fd == -1) {
+            perror("socket");
+            continue;
+        }
+
+        if (connect(fd, rp->ai_addr, rp->ai_addrlen) == -1) {
+            perror("connect");
+            close(fd);
+            continue;
+        }
+        break;
+    }
+
+    freeaddrinfo(res);
+
+    if (rp == NULL) {
+        fprintf(stderr, "net_udp_connect: cannot connect to %s:%s\n",
+                host, port);
+        return -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Create a listening TCP socket. With 'reuse_port' many sockets can be
+ * bound to the same address and the kernel balances the connections.
+ */
+int flb_net_server(char *host, char *port, int reuse_port)
+{
+    int fd = -1;
+    int on = 1;
+    int ret;
+    struct addrinfo hints;
+    struct addrinfo *res, *rp;
+
+    memset(&hints, 0, sizeof hints);
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+
+    ret = getaddrinfo(host, port, &hints, &res);
+    if (ret != 0) {
+        fprintf(stderr, "net_server: getaddrinfo(host='%s'): %s\n",
+                host, gai_strerror(ret));
+        return -1;
+    }
+
+    for (rp = res; rp != NULL; rp = rp->ai_next) {
+        fd = flb_net_socket_create(rp->ai_family);
+        if (fd == -1) {
+            continue;
+        }
+
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if (reuse_port &&
+            setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+            perror("setsockopt SO_REUSEPORT");
+        }
+
+        if (bind(fd, rp->ai_addr, rp->ai_addrlen) == 0 &&
+            listen(fd, 1024) == 0) {
+            break;
+        }
+        perror("bind");
+        close(fd);
+        fd = -1;
+    }
+
+    freeaddrinfo(res);
+
+    if (fd == -1) {
+        fprintf(stderr, "net_server: cannot listen on %s:%s\n", host, port);
+        return -1;
+    }
+
+    return fd;
+}
+
+int flb_net_send_mode(char *name)
+{
+    if (strcasecmp(name, "writev") == 0) {
+        return FLB_NET_SEND_WRITEV;
+    }
+    else if (strcasecmp(name, "zerocopy") == 0) {
+        return FLB_NET_SEND_ZEROCOPY;
+    }
+    else if (strcasecmp(name, "splice") == 0) {
+        return FLB_NET_SEND_SPLICE;
+    }
+    return -1;
+}
+
+char *flb_net_send_mode_name(int mode)
+{
+    switch (mode) {
+    case FLB_NET_SEND_ZEROCOPY:
+        return "zerocopy";
+    case FLB_NET_SEND_SPLICE:
+        return "splice";
+    default:
+        return "writev";
+    }
+}
+
+/*
+ * Setup a sender for the connection, if the requested zero-copy mode is
+ * not available it falls back to writev(2).
+ */
+int flb_net_sender_init(struct flb_net_sender *s, int fd, int mode)
+{
+    int ret;
+    int on = 1;
+
+    memset(s, 0, sizeof(struct flb_net_sender));
+    s->fd = fd;
+    s->mode = mode;
+    s->pipe[0] = -1;
+    s->pipe[1] = -1;
+
+    if (mode == FLB_NET_SEND_ZEROCOPY) {
+        ret = setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &on, sizeof(on));
+        if (ret == -1) {
+            perror("setsockopt SO_ZEROCOPY");
+            fprintf(stderr, "warn: MSG_ZEROCOPY not available, using writev\n");
+            s->mode = FLB_NET_SEND_WRITEV;
+        }
+    }
+    else if (mode == FLB_NET_SEND_SPLICE) {
+        ret = pipe2(s->pipe, O_CLOEXEC);
+        if (ret == -1) {
+            perror("pipe2");
+            fprintf(stderr, "warn: cannot create splice pipe, using writev\n");
+            s->mode = FLB_NET_SEND_WRITEV;
+            return 0;
+        }
+
+        /* a larger pipe means less splice round trips */
+        fcntl(s->pipe[1], F_SETPIPE_SZ, FLB_NET_PIPE_SIZE);
+        ret = fcntl(s->pipe[1], F_GETPIPE_SZ);
+        s->pipe_size = (ret > 0) ? ret : 65536;
+    }
+
+    return 0;
+}
+
+/* Consume zerocopy completion notifications from the socket error queue */
+static int sender_zc_reap(struct flb_net_sender *s)
+{
+    int ret;
+    uint32_t n;
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct sock_extended_err *serr;
+
+    while (1) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ret = recvmsg(s->fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+        if (ret == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            perror("recvmsg MSG_ERRQUEUE");
+            return -1;
+        }
+
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR) ||
+                  (cm->cmsg_level == SOL_IPV6 &&
+                   cm->cmsg_type == IPV6_RECVERR))) {
+                continue;
+            }
+
+            serr = (struct sock_extended_err *) CMSG_DATA(cm);
+            if (serr->ee_errno != 0 ||
+                serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+
+            /* notifications cover the range of ids [ee_info, ee_data] */
+            n = serr->ee_data - serr->ee_info + 1;
+            s->zc_done += n;
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                s->zc_copied += n;
+            }
+        }
+    }
+}
+
+static int sender_zc_wait(struct flb_net_sender *s)
+{
+    int ret;
+    struct pollfd pfd;
+
+    pfd.fd = s->fd;
+    pfd.events = 0;
+
+    ret = poll(&pfd, 1, 1000);
+    if (ret == -1 && errno != EINTR) {
+        perror("poll");
+        return -1;
+    }
+    return sender_zc_reap(s);
+}
+
+static void iov_advance(struct iovec **iov, int *iovcnt, size_t bytes)
+{
+    while (*iovcnt > 0 && bytes >= (*iov)->iov_len) {
+        bytes -= (*iov)->iov_len;
+        (*iov)++;
+        (*iovcnt)--;
+    }
+    if (*iovcnt > 0) {
+        (*iov)->iov_base = (char *) (*iov)->iov_base + bytes;
+        (*iov)->iov_len -= bytes;
+    }
+}
+
+static ssize_t sender_zerocopy(struct flb_net_sender *s,
+                               struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+    ssize_t total = 0;
+    struct msghdr msg;
+
+    while (iovcnt > 0) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt > IOV_MAX ? IOV_MAX : iovcnt;
+
+        ret = sendmsg(s->fd, &msg, MSG_ZEROCOPY);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            else if (errno == ENOBUFS) {
+                /* too many pending notifications (optmem limit) */
+                if (sender_zc_wait(s) == -1) {
+                    return -1;
+                }
+                continue;
+            }
+            perror("sendmsg MSG_ZEROCOPY");
+            return -1;
+        }
+
+        s->zc_sent++;
+        total += ret;
+        iov_advance(&iov, &iovcnt, ret);
+    }
+
+    /* don't let the error queue grow */
+    if (sender_zc_reap(s) == -1) {
+        return -1;
+    }
+    return total;
+}
+
+static ssize_t sender_splice(struct flb_net_sender *s,
+                             struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+    ssize_t in_pipe;
+    ssize_t total = 0;
+
+    while (iovcnt > 0) {
+        /* map user pages into the pipe, no copy involved */
+        in_pipe = vmsplice(s->pipe[1], iov,
+                           iovcnt > IOV_MAX ? IOV_MAX : iovcnt, 0);
+        if (in_pipe == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("vmsplice");
+            return -1;
+        }
+        iov_advance(&iov, &iovcnt, in_pipe);
+
+        /* move the pipe content to the socket */
+        while (in_pipe > 0) {
+            ret = splice(s->pipe[0], NULL, s->fd, NULL, in_pipe,
+                         SPLICE_F_MOVE | (iovcnt > 0 ? SPLICE_F_MORE : 0));
+            if (ret == -1) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                perror("splice");
+                return -1;
+            }
+            in_pipe -= ret;
+            total += ret;
+        }
+    }
+
+    return total;
+}
+
+static ssize_t sender_writev(struct flb_net_sender *s,
+                             struct iovec *iov, int iovcnt)
+{
+    ssize_t ret;
+    ssize_t total = 0;
+
+    while (iovcnt > 0) {
+        ret = writev(s->fd, iov, iovcnt > IOV_MAX ? IOV_MAX : iovcnt);
+        if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("writev");
+            return -1;
+        }
+        total += ret;
+        iov_advance(&iov, &iovcnt, ret);
+    }
+
+    return total;
+}
+
+/*
+ * Send the complete content of the iovec array. The array is modified
+ * while sending. In zerocopy and splice modes the pages are referenced
+ * by the kernel after returning, buffers must not be modified.
+ */
+ssize_t flb_net_sender_send(struct flb_net_sender *s,
+                            struct iovec *iov, int iovcnt)
+{
+    switch (s->mode) {
+    case FLB_NET_SEND_ZEROCOPY:
+        return sender_zerocopy(s, iov, iovcnt);
+    case FLB_NET_SEND_SPLICE:
+        return sender_splice(s, iov, iovcnt);
+    default:
+        return sender_writev(s, iov, iovcnt);
+    }
+}
+
+/* Wait until the kernel released every zerocopy buffer */
+int flb_net_sender_flush(struct flb_net_sender *s)
+{
+    int tries = 0;
+
+    if (s->mode != FLB_NET_SEND_ZEROCOPY) {
+        return 0;
+    }
+
+    while (s->zc_done < s->zc_sent && tries++ < 10) {
+        if (sender_zc_wait(s) == -1) {
+            return -1;
+        }
+    }
+    return (s->zc_done < s->zc_sent) ? -1 : 0;
+}
+
+void flb_net_sender_destroy(struct flb_net_sender *s)
+{
+    if (s->pipe[0] >= 0) {
+        close(s->pipe[0]);
+    }
+    if (s->pipe[1] >= 0) {
+        close(s->pipe[1]);
+    }
+    s->pipe[0] = -1;
+    s->pipe[1] = -1;
+}
@@ -0,0 +1,277 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flb_msgpack.h"
+#include "flb_protobuf.h"
+#include "flb_otlp.h"
+
+/*
+ * Field numbers from opentelemetry/proto/{collector/logs/v1,logs/v1,
+ * common/v1,resource/v1}
+ */
+#define OTLP_REQUEST_RESOURCE_LOGS     1
+
+#define OTLP_RESOURCE_LOGS_RESOURCE    1
+#define OTLP_RESOURCE_LOGS_SCOPE_LOGS  2
+
+#define OTLP_RESOURCE_ATTRIBUTES       1
+
+#define OTLP_SCOPE_LOGS_SCOPE          1
+#define OTLP_SCOPE_LOGS_LOG_RECORDS    2
+
+#define OTLP_SCOPE_NAME                1
+#define OTLP_SCOPE_VERSION             2
+
+#define OTLP_LOG_TIME                  1
+#define OTLP_LOG_SEVERITY_NUMBER       2
+#define OTLP_LOG_SEVERITY_TEXT         3
+#define OTLP_LOG_BODY                  5
+#define OTLP_LOG_OBSERVED_TIME        11
+
+#define OTLP_KV_KEY                    1
+#define OTLP_KV_VALUE                  2
+
+#define OTLP_ANY_STRING                1
+#define OTLP_ANY_BOOL                  2
+#define OTLP_ANY_INT                   3
+#define OTLP_ANY_DOUBLE                4
+#define OTLP_ANY_ARRAY                 5
+#define OTLP_ANY_KVLIST                6
+#define OTLP_ANY_BYTES                 7
+
+#define OTLP_LIST_VALUES               1
+
+#define OTLP_SEVERITY_INFO             9
+
+static int otlp_any_value(struct flb_pb_buf *b, const char *buf, size_t len,
+                          size_t *off);
+
+static int otlp_kv_string(struct flb_pb_buf *b, uint32_t field,
+                          char *key, char *val)
+{
+    size_t kv;
+    size_t any;
+
+    if (flb_pb_begin(b, field, &kv) == -1 ||
+        flb_pb_string(b, OTLP_KV_KEY, key) == -1 ||
+        flb_pb_begin(b, OTLP_KV_VALUE, &any) == -1 ||
+        flb_pb_string(b, OTLP_ANY_STRING, val) == -1 ||
+        flb_pb_end(b, any) == -1) {
+        return -1;
+    }
+    return flb_pb_end(b, kv);
+}
+
+/* Encode the children of a msgpack map as a KeyValueList */
+static int otlp_kvlist(struct flb_pb_buf *b, const char *buf, size_t len,
+                       size_t *off, uint32_t n)
+{
+    uint32_t i;
+    size_t kv;
+    size_t any;
+    struct flb_mp_obj key;
+
+    for (i = 0; i < n; i++) {
+        if (flb_mp_unpack_next(buf, len, off, &key) != FLB_MP_OK) {
+            return -1;
+        }
+
+        if (key.type != FLB_MP_STR) {
+            /* non string keys are not representable, skip the value */
+            if (flb_mp_skip(buf, len, off) != FLB_MP_OK) {
+                return -1;
+            }
+            continue;
+        }
+
+        if (flb_pb_begin(b, OTLP_LIST_VALUES, &kv) == -1 ||
+            flb_pb_bytes(b, OTLP_KV_KEY,
+                         key.via.raw.ptr, key.via.raw.size) == -1 ||
+            flb_pb_begin(b, OTLP_KV_VALUE, &any) == -1 ||
+            otlp_any_value(b, buf, len, off) == -1 ||
+            flb_pb_end(b, any) == -1 ||
+            flb_pb_end(b, kv) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Write the content of an AnyValue message from the next msgpack object */
+static int otlp_any_value(struct flb_pb_buf *b, const char *buf, size_t len,
+                          size_t *off)
+{
+    uint32_t i;
+    size_t mark;
+    size_t any;
+    struct flb_mp_obj obj;
+
+    if (flb_mp_unpack_next(buf, len, off, &obj) != FLB_MP_OK) {
+        return -1;
+    }
+
+    switch (obj.type) {
+    case FLB_MP_STR:
+        return flb_pb_bytes(b, OTLP_ANY_STRING,
+                            obj.via.raw.ptr, obj.via.raw.size);
+    case FLB_MP_BIN:
+        return flb_pb_bytes(b, OTLP_ANY_BYTES,
+                            obj.via.raw.ptr, obj.via.raw.size);
+    case FLB_MP_BOOL:
+        return flb_pb_bool(b, OTLP_ANY_BOOL, obj.via.boolean);
+    case FLB_MP_INT:
+        return flb_pb_int64(b, OTLP_ANY_INT, obj.via.i64);
+    case FLB_MP_UINT:
+        return flb_pb_int64(b, OTLP_ANY_INT, (int64_t) obj.via.u64);
+    case FLB_MP_FLOAT:
+        return flb_pb_double(b, OTLP_ANY_DOUBLE, obj.via.f64);
+    case FLB_MP_ARRAY:
+        if (flb_pb_begin(b, OTLP_ANY_ARRAY, &mark) == -1) {
+            return -1;
+        }
+        for (i = 0; i < obj.via.n; i++) {
+            if (flb_pb_begin(b, OTLP_LIST_VALUES, &any) == -1 ||
+                otlp_any_value(b, buf, len, off) == -1 ||
+                flb_pb_end(b, any) == -1) {
+                return -1;
+            }
+        }
+        return flb_pb_end(b, mark);
+    case FLB_MP_MAP:
+        if (flb_pb_begin(b, OTLP_ANY_KVLIST, &mark) == -1 ||
+            otlp_kvlist(b, buf, len, off, obj.via.n) == -1) {
+            return -1;
+        }
+        return flb_pb_end(b, mark);
+    default:
+        /* nil and extensions: empty AnyValue */
+        return 0;
+    }
+}
+
+static int otlp_log_record(struct flb_pb_buf *b, struct flb_mp_buf *mp,
+                           struct flb_otlp_record *record, uint64_t now)
+{
+    size_t off = 0;
+    size_t log;
+    size_t body;
+
+    /* JSON to msgpack, non JSON lines are sent as a string body */
+    mp->len = 0;
+    if (flb_mp_pack_json(mp, record->json, record->len) == -1) {
+        flb_mp_pack_str(mp, record->json, record->len);
+    }
+
+    if (flb_pb_begin(b, OTLP_SCOPE_LOGS_LOG_RECORDS, &log) == -1 ||
+        flb_pb_fixed64(b, OTLP_LOG_TIME, now) == -1 ||
+        flb_pb_uint64(b, OTLP_LOG_SEVERITY_NUMBER, OTLP_SEVERITY_INFO) == -1 ||
+        flb_pb_string(b, OTLP_LOG_SEVERITY_TEXT, "INFO") == -1 ||
+        flb_pb_begin(b, OTLP_LOG_BODY, &body) == -1 ||
+        otlp_any_value(b, mp->data, mp->len, &off) == -1 ||
+        flb_pb_end(b, body) == -1 ||
+        flb_pb_fixed64(b, OTLP_LOG_OBSERVED_TIME, now) == -1) {
+        return -1;
+    }
+    return flb_pb_end(b, log);
+}
+
+int flb_otlp_logs_encode(struct flb_pb_buf *b,
+                         struct flb_otlp_record *records, int n,
+                         int resources, int scopes)
+{
+    int i;
+    int s;
+    int idx;
+    int groups;
+    uint64_t now;
+    size_t rl;
+    size_t res;
+    size_t sl;
+    size_t scope;
+    char tmp[64];
+    struct timespec ts;
+    struct flb_mp_buf mp;
+
+    if (flb_mp_buf_init(&mp, 4096) == -1) {
+        return -1;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    now = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+    groups = resources * scopes;
+
+    for (i = 0; i < resources; i++) {
+        if (flb_pb_begin(b, OTLP_REQUEST_RESOURCE_LOGS, &rl) == -1 ||
+            flb_pb_begin(b, OTLP_RESOURCE_LOGS_RESOURCE, &res) == -1) {
+            goto error;
+        }
+
+        snprintf(tmp, sizeof(tmp), "flb-perf-%i", i);
+        if (otlp_kv_string(b, OTLP_RESOURCE_ATTRIBUTES,
+                           "service.name", tmp) == -1 ||
+            otlp_kv_string(b, OTLP_RESOURCE_ATTRIBUTES,
+                           "host.name", "fluent-bit-perf") == -1 ||
+            flb_pb_end(b, res) == -1) {
+            goto error;
+        }
+
+        for (s = 0; s < scopes; s++) {
+            if (flb_pb_begin(b, OTLP_RESOURCE_LOGS_SCOPE_LOGS, &sl) == -1 ||
+                flb_pb_begin(b, OTLP_SCOPE_LOGS_SCOPE, &scope) == -1) {
+                goto error;
+            }
+
+            snprintf(tmp, sizeof(tmp), "flb-perf-scope-%i", s);
+            if (flb_pb_string(b, OTLP_SCOPE_NAME, tmp) == -1 ||
+                flb_pb_string(b, OTLP_SCOPE_VERSION, "1.0.0") == -1 ||
+                flb_pb_end(b, scope) == -1) {
+                goto error;
+            }
+
+            /* records of this resource/scope group */
+            for (idx = (i * scopes) + s; idx < n; idx += groups) {
+                if (otlp_log_record(b, &mp, &records[idx], now) == -1) {
+                    goto error;
+                }
+            }
+
+            if (flb_pb_end(b, sl) == -1) {
+                goto error;
+            }
+        }
+
+        if (flb_pb_end(b, rl) == -1) {
+            goto error;
+        }
+    }
+
+    flb_mp_buf_destroy(&mp);
+    return 0;
+
+ error:
+    fprintf(stderr, "error: cannot encode OTLP logs request\n");
+    flb_mp_buf_destroy(&mp);
+    return -1;
+}
@@ -0,0 +1,237 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/types.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "flb_proc.h"
+#include "flb_perf.h"
+
+struct perf_event {
+    uint32_t type;
+    uint64_t config;
+    const char *name;
+};
+
+static struct perf_event perf_hw[FLB_PERF_EVENTS] = {
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,       "cycles"        },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,     "instructions"  },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES, "cache-refs"    },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,     "cache-misses"  },
+    { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,    "branch-misses" },
+};
+
+static struct perf_event perf_sw[FLB_PERF_EVENTS] = {
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,       "task-clock"    },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES, "ctx-switches"  },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS,   "migrations"    },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,      "page-faults"   },
+    { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_ALIGNMENT_FAULTS, "align-faults"  },
+};
+
+/* value, time enabled, time running */
+struct perf_read {
+    uint64_t value;
+    uint64_t enabled;
+    uint64_t running;
+};
+
+static int perf_open(struct perf_event *ev, pid_t tid, int group,
+                     int user_only)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = ev->type;
+    attr.config = ev->config;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = user_only;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+        PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return syscall(SYS_perf_event_open, &attr, tid, -1, group,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+/* One group per thread, the first event leads */
+static int perf_group(struct perf_event *set, pid_t tid, int *fds,
+                      int *user_only)
+{
+    int i;
+
+    fds[0] = perf_open(&set[0], tid, -1, *user_only);
+    if (fds[0] == -1 && (errno == EACCES || errno == EPERM) && !*user_only) {
+        /* perf_event_paranoid >= 2, user space only */
+        *user_only = 1;
+        fds[0] = perf_open(&set[0], tid, -1, *user_only);
+    }
+    if (fds[0] == -1) {
+        return -1;
+    }
+
+    for (i = 1; i < FLB_PERF_EVENTS; i++) {
+        /* not every PMU has every event, the others still count */
+        fds[i] = perf_open(&set[i], tid, fds[0], *user_only);
+    }
+    return 0;
+}
+
+struct flb_perf *flb_perf_create(pid_t pid)
+{
+    int i;
+    int size = 16;
+    int user_only = 0;
+    int *tmp;
+    DIR *dir;
+    pid_t tid;
+    char path[PROC_PID_SIZE];
+    struct dirent *ent;
+    struct flb_perf *p;
+
+    p = calloc(1, sizeof(struct flb_perf));
+    if (!p) {
+        perror("calloc");
+        return NULL;
+    }
+    p->pid = pid;
+    p->scaled = 1.0;
+
+    p->fds = malloc(sizeof(int) * FLB_PERF_EVENTS * size);
+    if (!p->fds) {
+        perror("malloc");
+        free(p);
+        return NULL;
+    }
+
+    /* hardware counters if the leader (cycles) can be opened */
+    p->hw = 1;
+    if (perf_group(perf_hw, pid, p->fds, &user_only) == -1) {
+        p->hw = 0;
+        fprintf(stderr, "warn: hardware counters not available (%s), "
+                "using software events\n", strerror(errno));
+    }
+    else {
+        for (i = 0; i < FLB_PERF_EVENTS; i++) {
+            if (p->fds[i] != -1) {
+                close(p->fds[i]);
+            }
+        }
+    }
+
+    snprintf(path, sizeof(path), "/proc/%i/task", pid);
+    dir = opendir(path);
+    if (!dir) {
+        perror("opendir");
+        free(p->fds);
+        free(p);
+        return NULL;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        if (p->n_threads == size) {
+            tmp = realloc(p->fds, sizeof(int) * FLB_PERF_EVENTS * size * 2);
+            if (!tmp) {
+                perror("realloc");
+                break;
+            }
+            p->fds = tmp;
+            size *= 2;
+        }
+
+        tid = atoi(ent->d_name);
+        if (perf_group(p->hw ? perf_hw : perf_sw, tid,
+                       &p->fds[p->n_threads * FLB_PERF_EVENTS],
+                       &user_only) == 0) {
+            p->n_threads++;
+        }
+    }
+    closedir(dir);
+
+    if (p->n_threads == 0) {
+        perror("perf_event_open");
+        fprintf(stderr, "error: cannot attach counters to PID %i\n", pid);
+        free(p->fds);
+        free(p);
+        return NULL;
+    }
+    return p;
+}
+
+void flb_perf_destroy(struct flb_perf *p)
+{
+    int i;
+
+    for (i = 0; i < p->n_threads * FLB_PERF_EVENTS; i++) {
+        if (p->fds[i] != -1) {
+            close(p->fds[i]);
+        }
+    }
+    free(p->fds);
+    free(p);
+}
+
+int flb_perf_read(struct flb_perf *p, uint64_t *values)
+{
+    int i;
+    int fd;
+    double ratio;
+    struct perf_read rd;
+
+    /* p->scaled is not reset, it keeps the lowest ratio of the run */
+    memset(values, 0, sizeof(uint64_t) * FLB_PERF_EVENTS);
+
+    /* counters of exited threads keep their final value */
+    for (i = 0; i < p->n_threads * FLB_PERF_EVENTS; i++) {
+        fd = p->fds[i];
+        if (fd == -1 || read(fd, &rd, sizeof(rd)) != sizeof(rd) ||
+            rd.running == 0) {
+            continue;
+        }
+
+        if (rd.running < rd.enabled) {
+            ratio = (double) rd.running / rd.enabled;
+            if (ratio < p->scaled) {
+                p->scaled = ratio;
+            }
+            rd.value = (uint64_t) (rd.value / ratio);
+        }
+        values[i % FLB_PERF_EVENTS] += rd.value;
+    }
+
+    return 0;
+}
+
+const char *flb_perf_name(struct flb_perf *p, int event)
+{
+    return p->hw ? perf_hw[event].name : perf_sw[event].name;
+}
@@ -25,67 +25,122 @@
  * https://github.com/edsiper/wr
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <limits.h>
+#include <dirent.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #include "flb_proc.h"
+#include "flb_sampler.h"
+#include "flb_ptree.h"
+#include "flb_cgroup.h"
+
+/* Parse a decimal number, returns the position after it */
+static const char *parse_num(const char *p, const char *end, long *val)
+{
+    int neg = 0;
+    long v = 0;
+
+    if (p < end && *p == '-') {
+        neg = 1;
+        p++;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = (v * 10) + (*p - '0');
+        p++;
+    }
+
+    *val = neg ? -v : v;
+    return p;
+}
 
 /*
- * Read file content to a memory buffer,
- * Use this function just for really SMALL files
+ * Hand rolled parser for /proc/PID/stat: the command name is between the
+ * first '(' and the last ')' (it can contain spaces and parenthesis), the
+ * remaining fields are separated by a single space.
  */
-static char *file_to_buffer(const char *path)
+int flb_proc_stat_parse(const char *buf, size_t len, struct flb_proc_task *t)
 {
-    FILE *fp;
-    char *buffer;
-    long bytes;
+    int field;
+    int cpu_hz = sysconf(_SC_CLK_TCK);
+    long val;
+    size_t n;
+    const char *p;
+    const char *open;
+    const char *close;
+    const char *end = buf + len;
 
-    if (access(path, R_OK) != 0) {
-        perror("access");
-        fprintf(stderr, "error: cannot open '%s'\n", path);
-        return NULL;
+    open = memchr(buf, '(', len);
+    close = memrchr(buf, ')', len);
+    if (!open || !close || close < open || end - close < 4) {
+        return -1;
     }
 
-    if (!(fp = fopen(path, "r"))) {
-        perror("fopen");
-        fprintf(stderr, "error: cannot fopen '%s'\n", path);
-        return NULL;
+    n = close - open - 1;
+    if (n >= sizeof(t->name)) {
+        n = sizeof(t->name) - 1;
     }
+    memcpy(t->name, open + 1, n);
+    t->name[n] = '\0';
 
-    buffer = malloc(PROC_STAT_BUF_SIZE);
-    if (!buffer) {
-        perror("malloc");
-        fprintf(stderr, "error: could not allocate memory to open '%s'\n",
-                path);
-        fclose(fp);
-        exit(EXIT_FAILURE);
-    }
+    /* field 3 is the state character */
+    p = close + 4;
+    for (field = 4; field <= 24 && p < end; field++) {
+        if (*p == ' ') {
+            p++;
+        }
+        p = parse_num(p, end, &val);
 
-    bytes = fread(buffer, PROC_STAT_BUF_SIZE, 1, fp);
-    if (bytes < 0) {
-        free(buffer);
-        fclose(fp);
-        printf("Error: could not read '%s'\n", path);
-        exit(EXIT_FAILURE);
+        switch (field) {
+        case 4:
+            t->ppid = val;
+            break;
+        case 10:
+            t->minflt = val;
+            break;
+        case 12:
+            t->majflt = val;
+            break;
+        case 14:
+            t->utime = val;
+            break;
+        case 15:
+            t->stime = val;
+            break;
+        case 22:
+            t->starttime = val;
+            break;
+        case 24:
+            t->rss = val;
+            break;
+        }
     }
+    if (field <= 24) {
+        return -1;
+    }
+
+    /* Internal conversion */
+    t->r_rss      = (t->rss * getpagesize());
+    t->r_utime_s  = (t->utime / cpu_hz);
+    t->r_utime_ms = ((t->utime * 1000) / cpu_hz);
+    t->r_stime_s  = (t->stime / cpu_hz);
+    t->r_stime_ms = ((t->stime * 1000) / cpu_hz);
 
-    fclose(fp);
-    return buffer;
+    return 0;
 }
 
 struct flb_proc_task *flb_proc_stat_create(pid_t pid)
 {
-    int ret;
-    int fields;
-    int cpu_hz = sysconf(_SC_CLK_TCK);
-    char *p, *q;
-    char *buf;
+    int fd;
+    ssize_t bytes;
     char pid_path[PROC_PID_SIZE];
-    char tmp[256];
+    char buf[PROC_STAT_BUF_SIZE];
     struct flb_proc_task *t;
 
     t = calloc(1, sizeof(struct flb_proc_task));
@@ -94,49 +149,680 @@ struct flb_proc_task *flb_proc_stat_create(pid_t pid)
       return NULL;
     }
 
+    /* a running sampler already has a fresh snapshot */
+    if (flb_sampler_task(pid, t) == 0) {
+        return t;
+    }
+
+    /* or the totals of a cgroup, or the sum of a process tree */
+    if (flb_cgroup_task(pid, t) == 0) {
+        return t;
+    }
+    if (flb_ptree_task(pid, t) == 0) {
+        return t;
+    }
+
     /* Compose path for /proc/PID/stat */
-    ret = snprintf(pid_path, PROC_PID_SIZE, "/proc/%i/stat", pid);
-    if (ret < 0) {
-        fprintf(stderr, "error: could not compose PID path: %s\n", pid_path);
+    snprintf(pid_path, PROC_PID_SIZE, "/proc/%i/stat", pid);
+
+    fd = open(pid_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror("open");
+        fprintf(stderr, "error: could not read stat file data: %s\n", pid_path);
         free(t);
         return NULL;
     }
 
-    buf = file_to_buffer(pid_path);
-    if (!buf) {
-        fprintf(stderr, "error: could not read stat file data: %s\n", pid_path);
+    bytes = pread(fd, buf, sizeof(buf), 0);
+    close(fd);
+
+    if (bytes <= 0 || flb_proc_stat_parse(buf, bytes, t) == -1) {
+        fprintf(stderr, "error: invalid stat file data: %s\n", pid_path);
         free(t);
         return NULL;
     }
 
+    /* Set timestamp */
+    clock_gettime(CLOCK_REALTIME, &t->ts);
+
+    /* nanosecond CPU time if it's followed */
+    flb_proc_sched_task(pid, t);
+
+    return t;
+}
+
+int flb_proc_threads(pid_t pid, struct flb_proc_thread **out)
+{
+    int fd;
+    int count = 0;
+    int size = 32;
+    ssize_t bytes;
+    DIR *dir;
+    char path[PROC_PID_SIZE];
+    char buf[PROC_STAT_BUF_SIZE];
+    struct dirent *ent;
+    struct flb_proc_task t;
+    struct flb_proc_thread *tmp;
+    struct flb_proc_thread *threads;
+
+    snprintf(path, sizeof(path), "/proc/%i/task", pid);
+    dir = opendir(path);
+    if (!dir) {
+        perror("opendir");
+        return -1;
+    }
+
+    threads = malloc(sizeof(struct flb_proc_thread) * size);
+    if (!threads) {
+        perror("malloc");
+        closedir(dir);
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "/proc/%i/task/%s/stat", pid, ent->d_name);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            /* the thread just exited */
+            continue;
+        }
+        bytes = pread(fd, buf, sizeof(buf), 0);
+        close(fd);
+        if (bytes <= 0 || flb_proc_stat_parse(buf, bytes, &t) == -1) {
+            continue;
+        }
+
+        if (count == size) {
+            tmp = realloc(threads, sizeof(struct flb_proc_thread) * size * 2);
+            if (!tmp) {
+                perror("realloc");
+                free(threads);
+                closedir(dir);
+                return -1;
+            }
+            threads = tmp;
+            size *= 2;
+        }
+        threads[count].tid = atoi(ent->d_name);
+        snprintf(threads[count].name, sizeof(threads[count].name), "%s", t.name);
+        threads[count].utime = t.utime;
+        threads[count].stime = t.stime;
+        count++;
+    }
+    closedir(dir);
+
+    *out = threads;
+    return count;
+}
+
+/* the tracker serving flb_proc_sched_task(), one per process */
+static struct flb_proc_sched *sched_active = NULL;
+
+struct flb_proc_sched *flb_proc_sched_create(pid_t pid)
+{
+    struct flb_proc_sched *s;
+
+    s = calloc(1, sizeof(struct flb_proc_sched));
+    if (!s) {
+        perror("calloc");
+        return NULL;
+    }
+    s->pid = pid;
+    s->size = 16;
+    s->threads = malloc(sizeof(struct flb_proc_sched_thread) * s->size);
+    if (!s->threads) {
+        perror("malloc");
+        free(s);
+        return NULL;
+    }
+
+    if (flb_proc_sched_scan(s) <= 0) {
+        fprintf(stderr, "error: cannot read /proc/%i/task/*/schedstat\n", pid);
+        flb_proc_sched_destroy(s);
+        return NULL;
+    }
+
+    if (!sched_active) {
+        sched_active = s;
+    }
+    return s;
+}
+
+void flb_proc_sched_destroy(struct flb_proc_sched *s)
+{
+    int i;
+
+    if (sched_active == s) {
+        sched_active = NULL;
+    }
+    for (i = 0; i < s->n; i++) {
+        close(s->threads[i].fd);
+    }
+    free(s->threads);
+    free(s);
+}
+
+/*
+ * Walk /proc/PID/task and call 'add' for every thread, the trackers skip
+ * the ones they already follow. Stops when 'add' returns -1.
+ */
+static int task_walk(pid_t pid, int (*add)(void *, pid_t), void *data)
+{
+    DIR *dir;
+    char path[PROC_PID_SIZE];
+    struct dirent *ent;
+
+    snprintf(path, sizeof(path), "/proc/%i/task", pid);
+    dir = opendir(path);
+    if (!dir) {
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        if (add(data, atoi(ent->d_name)) == -1) {
+            break;
+        }
+    }
+    closedir(dir);
+
+    return 0;
+}
+
+/* Open /proc/PID/task/TID/'file', -1 if the thread is gone */
+static int task_open(pid_t pid, pid_t tid, char *file)
+{
+    char path[PROC_PID_SIZE];
+
+    snprintf(path, sizeof(path), "/proc/%i/task/%i/%s", pid, tid, file);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int sched_add(void *data, pid_t tid)
+{
+    int i;
+    int fd;
+    struct flb_proc_sched *s = data;
+    struct flb_proc_sched_thread *tmp;
+    struct flb_proc_sched_thread *th;
+
+    for (i = 0; i < s->n; i++) {
+        if (s->threads[i].tid == tid) {
+            return 0;
+        }
+    }
+
+    if (s->n == s->size) {
+        tmp = realloc(s->threads, sizeof(struct flb_proc_sched_thread) *
+                      s->size * 2);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        s->threads = tmp;
+        s->size *= 2;
+    }
+
+    fd = task_open(s->pid, tid, "schedstat");
+    if (fd == -1) {
+        return 0;
+    }
+    th = &s->threads[s->n++];
+    memset(th, 0, sizeof(struct flb_proc_sched_thread));
+    th->tid = tid;
+    th->fd = fd;
+    return 0;
+}
+
+int flb_proc_sched_scan(struct flb_proc_sched *s)
+{
+    if (task_walk(s->pid, sched_add, s) == -1) {
+        return -1;
+    }
+    return s->n;
+}
+
+int flb_proc_sched_read(struct flb_proc_sched *s, struct flb_proc_task *t)
+{
+    int i = 0;
+    ssize_t bytes;
+    char *p;
+    char buf[128];
+    struct flb_proc_sched_thread *th;
+
+    t->run_ns = 0;
+    t->wait_ns = 0;
+    t->timeslices = 0;
+
+    while (i < s->n) {
+        th = &s->threads[i];
+        bytes = pread(th->fd, buf, sizeof(buf) - 1, 0);
+        if (bytes <= 0) {
+            /* exited: keep its time, the last entry takes the slot */
+            s->gone_run_ns += th->run_ns;
+            s->gone_wait_ns += th->wait_ns;
+            s->gone_timeslices += th->timeslices;
+            close(th->fd);
+            s->threads[i] = s->threads[--s->n];
+            continue;
+        }
+        buf[bytes] = '\0';
+
+        /* run_ns wait_ns timeslices */
+        th->run_ns = strtoull(buf, &p, 10);
+        th->wait_ns = strtoull(p, &p, 10);
+        th->timeslices = strtoull(p, NULL, 10);
+
+        t->run_ns += th->run_ns;
+        t->wait_ns += th->wait_ns;
+        t->timeslices += th->timeslices;
+        i++;
+    }
+
+    if (s->n == 0) {
+        return -1;
+    }
+
+    t->run_ns += s->gone_run_ns;
+    t->wait_ns += s->gone_wait_ns;
+    t->timeslices += s->gone_timeslices;
+    return 0;
+}
+
+int flb_proc_sched_task(pid_t pid, struct flb_proc_task *t)
+{
+    struct flb_proc_sched *s = sched_active;
+
+    if (!s || s->pid != pid) {
+        return -1;
+    }
+
+    flb_proc_sched_scan(s);
+    return flb_proc_sched_read(s, t);
+}
+
+/* Value in bytes of a "Key:   N kB" line, 'key' includes the colon */
+static int kb_line(const char *line, const char *key, long *val)
+{
+    size_t len = strlen(key);
+
+    if (strncmp(line, key, len) != 0) {
+        return 0;
+    }
+    *val = strtol(line + len, NULL, 10) * 1024;
+    return 1;
+}
+
+/* Read a small proc file, returns the bytes stored in 'buf' (NULL ended) */
+static ssize_t pread_all(int fd, char *buf, size_t size)
+{
+    ssize_t bytes;
+
+    bytes = pread(fd, buf, size - 1, 0);
+    if (bytes <= 0) {
+        return -1;
+    }
+    buf[bytes] = '\0';
+    return bytes;
+}
+
+/* Unsigned value of a "key: N" line, 'key' includes the colon */
+static int ul_line(const char *line, const char *key, unsigned long *val)
+{
+    size_t len = strlen(key);
+
+    if (strncmp(line, key, len) != 0) {
+        return 0;
+    }
+    *val = strtoul(line + len, NULL, 10);
+    return 1;
+}
+
+static int ctxsw_add(void *data, pid_t tid)
+{
+    int i;
+    int fd;
+    struct flb_proc_ctxsw *c = data;
+    struct flb_proc_ctxsw_thread *tmp;
+    struct flb_proc_ctxsw_thread *th;
+
+    for (i = 0; i < c->n; i++) {
+        if (c->threads[i].tid == tid) {
+            return 0;
+        }
+    }
+
+    if (c->n == c->size) {
+        tmp = realloc(c->threads, sizeof(struct flb_proc_ctxsw_thread) *
+                      c->size * 2);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        c->threads = tmp;
+        c->size *= 2;
+    }
+
+    fd = task_open(c->pid, tid, "status");
+    if (fd == -1) {
+        return 0;
+    }
+    th = &c->threads[c->n++];
+    memset(th, 0, sizeof(struct flb_proc_ctxsw_thread));
+    th->tid = tid;
+    th->fd = fd;
+    return 0;
+}
+
+struct flb_proc_ctxsw *flb_proc_ctxsw_create(pid_t pid)
+{
+    struct flb_proc_ctxsw *c;
+
+    c = calloc(1, sizeof(struct flb_proc_ctxsw));
+    if (!c) {
+        perror("calloc");
+        return NULL;
+    }
+    c->pid = pid;
+    c->size = 16;
+    c->threads = malloc(sizeof(struct flb_proc_ctxsw_thread) * c->size);
+    if (!c->threads) {
+        perror("malloc");
+        free(c);
+        return NULL;
+    }
+
+    if (task_walk(pid, ctxsw_add, c) == -1 || c->n == 0) {
+        flb_proc_ctxsw_destroy(c);
+        return NULL;
+    }
+    return c;
+}
+
+void flb_proc_ctxsw_destroy(struct flb_proc_ctxsw *c)
+{
+    int i;
+
+    for (i = 0; i < c->n; i++) {
+        close(c->threads[i].fd);
+    }
+    free(c->threads);
+    free(c);
+}
+
+/* Sum the switches of every thread into 'io' */
+static int ctxsw_read(struct flb_proc_ctxsw *c, struct flb_proc_io *io)
+{
+    int i = 0;
+    char *p;
+    char buf[4096];
+    struct flb_proc_ctxsw_thread *th;
+
+    task_walk(c->pid, ctxsw_add, c);
+
+    while (i < c->n) {
+        th = &c->threads[i];
+        if (pread_all(th->fd, buf, sizeof(buf)) == -1) {
+            /* exited: keep its switches, the last entry takes the slot */
+            c->gone_vol_cs += th->vol_cs;
+            c->gone_invol_cs += th->invol_cs;
+            close(th->fd);
+            c->threads[i] = c->threads[--c->n];
+            continue;
+        }
+
+        p = buf;
+        while (p) {
+            if (!ul_line(p, "voluntary_ctxt_switches:", &th->vol_cs)) {
+                ul_line(p, "nonvoluntary_ctxt_switches:", &th->invol_cs);
+            }
+            p = strchr(p, '\n');
+            if (p) {
+                p++;
+            }
+        }
+
+        io->vol_cs += th->vol_cs;
+        io->invol_cs += th->invol_cs;
+        i++;
+    }
+
+    if (c->n == 0) {
+        return -1;
+    }
+
+    io->vol_cs += c->gone_vol_cs;
+    io->invol_cs += c->gone_invol_cs;
+    return 0;
+}
+
+int flb_proc_io_read(int io_fd, struct flb_proc_ctxsw *cs,
+                     struct flb_proc_io *io)
+{
+    char *p;
+    char buf[4096];
+
+    memset(io, 0, sizeof(struct flb_proc_io));
+
+    if (pread_all(io_fd, buf, sizeof(buf)) == -1) {
+        return -1;
+    }
     p = buf;
-    while (*p != ')') *p++;
-    *p++;
+    while (p) {
+        if (!ul_line(p, "rchar:", &io->rchar) &&
+            !ul_line(p, "wchar:", &io->wchar) &&
+            !ul_line(p, "syscr:", &io->syscr) &&
+            !ul_line(p, "syscw:", &io->syscw) &&
+            !ul_line(p, "read_bytes:", &io->read_bytes)) {
+            ul_line(p, "write_bytes:", &io->write_bytes);
+        }
+        p = strchr(p, '\n');
+        if (p) {
+            p++;
+        }
+    }
 
-    /* Read pending values */
-    char *x = "%*d %s %*c %*d %*d %*d %*d %*d %*lu %*lu %*lu %*lu %*lu %lu %lu %*ld %*ld %*ld %*ld %*ld %*ld %*lu %*lu %ld ";
+    return ctxsw_read(cs, io);
+}
 
-    fields = sscanf(buf, x,
-                    &tmp,
-                    &t->utime,
-                    &t->stime,
-                    &t->rss);
+int flb_proc_mem_read(int status_fd, int rollup_fd, struct flb_proc_mem *m)
+{
+    char *p;
+    char buf[4096];
 
-    p = strndup(tmp + 1, strlen(tmp + 1) - 1);
-    memcpy(t->name, p, strlen(p));
+    memset(m, 0, sizeof(struct flb_proc_mem));
 
-    /* Internal conversion */
-    t->r_rss      = (t->rss * getpagesize());
-    t->r_utime_s  = (t->utime / cpu_hz);
-    t->r_utime_ms = ((t->utime * 1000) / cpu_hz);
-    t->r_stime_s  = (t->stime / cpu_hz);
-    t->r_stime_ms = ((t->stime * 1000) / cpu_hz);
+    if (pread_all(status_fd, buf, sizeof(buf)) == -1) {
+        return -1;
+    }
+    p = buf;
+    while (p) {
+        if (!kb_line(p, "VmHWM:", &m->hwm) &&
+            !kb_line(p, "RssAnon:", &m->rss_anon) &&
+            !kb_line(p, "RssFile:", &m->rss_file)) {
+            kb_line(p, "RssShmem:", &m->rss_shmem);
+        }
+        p = strchr(p, '\n');
+        if (p) {
+            p++;
+        }
+    }
 
-    /* Set timestamp */
-    clock_gettime(CLOCK_REALTIME, &t->ts);
+    /* smaps_rollup needs Linux >= 4.14 */
+    if (rollup_fd == -1 || pread_all(rollup_fd, buf, sizeof(buf)) == -1) {
+        return 0;
+    }
+    p = buf;
+    while (p) {
+        if (!kb_line(p, "Pss:", &m->pss) &&
+            !kb_line(p, "Pss_Anon:", &m->pss_anon) &&
+            !kb_line(p, "Pss_File:", &m->pss_file) &&
+            !kb_line(p, "Pss_Shmem:", &m->pss_shmem)) {
+            kb_line(p, "Swap:", &m->swap);
+        }
+        p = strchr(p, '\n');
+        if (p) {
+            p++;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * A mapping header looks like:
+ *
+ *   7f2d1c000000-7f2d1c021000 rw-p 00000000 00:00 0      [heap]
+ *
+ * the name is the sixth field, anonymous mappings have none.
+ */
+static int smaps_header(const char *line, const char *eol, char *name,
+                        size_t size)
+{
+    int field = 1;
+    size_t len;
+    const char *p = line;
+
+    while (p < eol && *p != ' ') {
+        if (!((*p >= '0' && *p <= '9') || (*p >= 'a' && *p <= 'f') ||
+              *p == '-')) {
+            return 0;
+        }
+        p++;
+    }
+
+    while (p < eol && field < 6) {
+        while (p < eol && *p == ' ') {
+            p++;
+        }
+        field++;
+        if (field == 6) {
+            break;
+        }
+        while (p < eol && *p != ' ') {
+            p++;
+        }
+    }
+
+    len = eol - p;
+    if (len == 0) {
+        snprintf(name, size, "[anon]");
+    }
+    else {
+        if (len >= size) {
+            len = size - 1;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+    }
+    return 1;
+}
+
+int flb_proc_smaps_read(int smaps_fd, struct flb_proc_mapping **out)
+{
+    int i;
+    int count = 0;
+    int size = 64;
+    long val;
+    char *buf;
+    char *tmp;
+    char *line;
+    char *eol;
+    char name[128];
+    ssize_t bytes;
+    size_t len = 0;
+    size_t buf_size = 256 * 1024;
+    struct flb_proc_mapping *cur = NULL;
+    struct flb_proc_mapping *maps;
+    struct flb_proc_mapping *mtmp;
+
+    /* the whole file is needed, it's generated while it's read */
+    buf = malloc(buf_size);
+    if (!buf) {
+        perror("malloc");
+        return -1;
+    }
+    lseek(smaps_fd, 0, SEEK_SET);
+    while ((bytes = read(smaps_fd, buf + len, buf_size - len - 1)) > 0) {
+        len += bytes;
+        if (buf_size - len - 1 == 0) {
+            tmp = realloc(buf, buf_size * 2);
+            if (!tmp) {
+                perror("realloc");
+                free(buf);
+                return -1;
+            }
+            buf = tmp;
+            buf_size *= 2;
+        }
+    }
+    buf[len] = '\0';
+
+    maps = malloc(sizeof(struct flb_proc_mapping) * size);
+    if (!maps) {
+        perror("malloc");
+        free(buf);
+        return -1;
+    }
+
+    for (line = buf; line < buf + len; line = eol + 1) {
+        eol = strchr(line, '\n');
+        if (!eol) {
+            eol = buf + len;
+        }
+
+        if (line[0] >= 'A' && line[0] <= 'Z') {
+            if (!cur) {
+                continue;
+            }
+            if (kb_line(line, "Rss:", &val)) {
+                cur->rss += val;
+            }
+            else if (kb_line(line, "Pss:", &val)) {
+                cur->pss += val;
+            }
+            else if (kb_line(line, "Anonymous:", &val)) {
+                cur->anon += val;
+            }
+            continue;
+        }
+
+        if (!smaps_header(line, eol, name, sizeof(name))) {
+            continue;
+        }
+        for (i = 0; i < count; i++) {
+            if (strcmp(maps[i].name, name) == 0) {
+                break;
+            }
+        }
+        if (i == count) {
+            if (count == size) {
+                mtmp = realloc(maps, sizeof(struct flb_proc_mapping) * size * 2);
+                if (!mtmp) {
+                    perror("realloc");
+                    free(maps);
+                    free(buf);
+                    return -1;
+                }
+                maps = mtmp;
+                size *= 2;
+            }
+            memset(&maps[count], 0, sizeof(struct flb_proc_mapping));
+            memcpy(maps[count].name, name, sizeof(name));
+            count++;
+        }
+        cur = &maps[i];
+    }
 
     free(buf);
-    return t;
+    *out = maps;
+    return count;
 }
 
 void flb_proc_stat_destroy(struct flb_proc_task *t)
@@ -151,3 +837,64 @@ void flb_proc_stat_print(struct flb_proc_task *t)
     printf("rss         = %ld\n", t->rss);
     fflush(stdout);
 }
+
+off_t flb_proc_file_offset(pid_t pid, const char *path)
+{
+    int n;
+    FILE *fp;
+    DIR *dir;
+    off_t pos;
+    off_t max = -1;
+    char real[PATH_MAX];
+    char link[PATH_MAX];
+    char fd_path[PROC_PID_SIZE];
+    char line[256];
+    struct dirent *ent;
+
+    if (!realpath(path, real)) {
+        return -1;
+    }
+
+    snprintf(fd_path, sizeof(fd_path), "/proc/%i/fd", pid);
+    dir = opendir(fd_path);
+    if (!dir) {
+        perror("opendir");
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+
+        snprintf(fd_path, sizeof(fd_path), "/proc/%i/fd/%s", pid, ent->d_name);
+        n = readlink(fd_path, link, sizeof(link) - 1);
+        if (n <= 0) {
+            continue;
+        }
+        link[n] = '\0';
+        if (strcmp(link, real) != 0) {
+            continue;
+        }
+
+        /* first line of fdinfo is 'pos: N' */
+        snprintf(fd_path, sizeof(fd_path), "/proc/%i/fdinfo/%s",
+                 pid, ent->d_name);
+        fp = fopen(fd_path, "r");
+        if (!fp) {
+            continue;
+        }
+        while (fgets(line, sizeof(line), fp)) {
+            if (sscanf(line, "pos: %ld", &pos) == 1) {
+                if (pos > max) {
+                    max = pos;
+                }
+                break;
+            }
+        }
+        fclose(fp);
+    }
+
+    closedir(dir);
+    return max;
+}
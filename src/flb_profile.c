@@ -0,0 +1,749 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <elf.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "flb_proc.h"
+#include "flb_profile.h"
+
+/* One frame of a stack, symbol names longer than this are cut */
+#define PROFILE_FRAME  128
+
+/* Thread names of the round, the root frame of every stack */
+#define PROFILE_COMMS  256
+
+struct profile_comm {
+    pid_t tid;
+    char name[16];
+};
+
+static int sym_cmp(const void *a, const void *b)
+{
+    const struct flb_profile_sym *sa = a;
+    const struct flb_profile_sym *sb = b;
+
+    return (sa->addr > sb->addr) - (sa->addr < sb->addr);
+}
+
+static int str_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+/* Function symbols and load segments of an ELF64 file */
+static int elf_load(struct flb_profile_elf *elf, const char *path)
+{
+    int i;
+    int fd;
+    int n = 0;
+    char *base;
+    size_t size;
+    struct stat st;
+    Elf64_Ehdr *eh;
+    Elf64_Phdr *ph;
+    Elf64_Shdr *sh;
+    Elf64_Shdr *symtab = NULL;
+    Elf64_Shdr *strtab;
+    Elf64_Sym *sym;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return -1;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < sizeof(Elf64_Ehdr)) {
+        close(fd);
+        return -1;
+    }
+    size = st.st_size;
+    base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        return -1;
+    }
+
+    eh = (Elf64_Ehdr *) base;
+    if (memcmp(eh->e_ident, ELFMAG, SELFMAG) != 0 ||
+        eh->e_ident[EI_CLASS] != ELFCLASS64 ||
+        eh->e_phoff + eh->e_phnum * sizeof(Elf64_Phdr) > size ||
+        eh->e_shoff + eh->e_shnum * sizeof(Elf64_Shdr) > size) {
+        munmap(base, size);
+        return -1;
+    }
+
+    ph = (Elf64_Phdr *) (base + eh->e_phoff);
+    for (i = 0; i < eh->e_phnum && elf->n_loads < 8; i++) {
+        if (ph[i].p_type != PT_LOAD || !(ph[i].p_flags & PF_X)) {
+            continue;
+        }
+        elf->load_off[elf->n_loads] = ph[i].p_offset;
+        elf->load_vaddr[elf->n_loads] = ph[i].p_vaddr;
+        elf->load_size[elf->n_loads] = ph[i].p_filesz;
+        elf->n_loads++;
+    }
+
+    /* .symtab if not stripped, .dynsym otherwise */
+    sh = (Elf64_Shdr *) (base + eh->e_shoff);
+    for (i = 0; i < eh->e_shnum; i++) {
+        if (sh[i].sh_type == SHT_SYMTAB ||
+            (sh[i].sh_type == SHT_DYNSYM && !symtab)) {
+            symtab = &sh[i];
+        }
+    }
+    if (!symtab || symtab->sh_link >= eh->e_shnum ||
+        symtab->sh_offset + symtab->sh_size > size) {
+        munmap(base, size);
+        return -1;
+    }
+    strtab = &sh[symtab->sh_link];
+    if (strtab->sh_offset + strtab->sh_size > size || strtab->sh_size == 0) {
+        munmap(base, size);
+        return -1;
+    }
+
+    elf->strtab = malloc(strtab->sh_size);
+    elf->syms = malloc(symtab->sh_size / sizeof(Elf64_Sym) *
+                       sizeof(struct flb_profile_sym));
+    if (!elf->strtab || !elf->syms) {
+        perror("malloc");
+        munmap(base, size);
+        return -1;
+    }
+    memcpy(elf->strtab, base + strtab->sh_offset, strtab->sh_size);
+    elf->strtab[strtab->sh_size - 1] = '\0';
+
+    sym = (Elf64_Sym *) (base + symtab->sh_offset);
+    for (i = 0; i < symtab->sh_size / sizeof(Elf64_Sym); i++) {
+        if ((ELF64_ST_TYPE(sym[i].st_info) != STT_FUNC &&
+             ELF64_ST_TYPE(sym[i].st_info) != STT_GNU_IFUNC) ||
+            sym[i].st_value == 0 || sym[i].st_shndx == SHN_UNDEF ||
+            sym[i].st_name >= strtab->sh_size) {
+            continue;
+        }
+        elf->syms[n].addr = sym[i].st_value;
+        elf->syms[n].size = sym[i].st_size;
+        elf->syms[n].name = elf->strtab + sym[i].st_name;
+        n++;
+    }
+    munmap(base, size);
+
+    qsort(elf->syms, n, sizeof(struct flb_profile_sym), sym_cmp);
+    elf->n_syms = n;
+    return 0;
+}
+
+/* Symbols of 'path' as seen by the target, loaded once */
+static struct flb_profile_elf *profile_elf(struct flb_profile *p,
+                                           const char *path)
+{
+    char full[PATH_MAX];
+    struct flb_profile_elf *elf;
+
+    for (elf = p->elfs; elf; elf = elf->next) {
+        if (strcmp(elf->path, path) == 0) {
+            return elf;
+        }
+    }
+
+    elf = calloc(1, sizeof(struct flb_profile_elf));
+    if (!elf) {
+        perror("calloc");
+        return NULL;
+    }
+    elf->path = strdup(path);
+
+    /* the target can live in another mount namespace (containers) */
+    snprintf(full, sizeof(full), "/proc/%i/root%s", p->pid, path);
+    if (elf_load(elf, full) == -1) {
+        /* kept without symbols so it's not read again */
+        free(elf->syms);
+        free(elf->strtab);
+        elf->syms = NULL;
+        elf->strtab = NULL;
+        elf->n_syms = 0;
+    }
+
+    elf->next = p->elfs;
+    p->elfs = elf;
+    return elf;
+}
+
+/* Executable mappings, they change as libraries are loaded */
+static int profile_maps(struct flb_profile *p)
+{
+    int n = 0;
+    int size = 64;
+    char *path;
+    char *deleted;
+    char line[PATH_MAX + 128];
+    char perms[8];
+    unsigned long long start;
+    unsigned long long end;
+    unsigned long long offset;
+    FILE *f;
+    struct flb_profile_map *tmp;
+    struct flb_profile_map *maps;
+
+    snprintf(line, sizeof(line), "/proc/%i/maps", p->pid);
+    f = fopen(line, "re");
+    if (!f) {
+        return -1;
+    }
+
+    maps = malloc(sizeof(struct flb_profile_map) * size);
+    if (!maps) {
+        perror("malloc");
+        fclose(f);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%llx-%llx %7s %llx", &start, &end, perms,
+                   &offset) != 4 || perms[2] != 'x') {
+            continue;
+        }
+        if (n == size) {
+            tmp = realloc(maps, sizeof(struct flb_profile_map) * size * 2);
+            if (!tmp) {
+                perror("realloc");
+                break;
+            }
+            maps = tmp;
+            size *= 2;
+        }
+
+        line[strcspn(line, "\n")] = '\0';
+        path = strchr(line, '/');
+        if (!path) {
+            path = strchr(line, '[');
+        }
+        if (path) {
+            deleted = strstr(path, " (deleted)");
+            if (deleted) {
+                *deleted = '\0';
+            }
+        }
+
+        maps[n].start = start;
+        maps[n].end = end;
+        maps[n].offset = offset;
+        maps[n].elf = (path && path[0] == '/') ? profile_elf(p, path) : NULL;
+        snprintf(maps[n].name, sizeof(maps[n].name), "%s",
+                 path ? (strrchr(path, '/') ? strrchr(path, '/') + 1 : path)
+                 : "[anon]");
+        n++;
+    }
+    fclose(f);
+
+    free(p->maps);
+    p->maps = maps;
+    p->n_maps = n;
+    return n;
+}
+
+/* Function name of an instruction address, or the module name */
+static void profile_symbol(struct flb_profile *p, uint64_t ip,
+                           char *buf, size_t size)
+{
+    int i;
+    int lo = 0;
+    int hi;
+    int mid;
+    uint64_t off;
+    uint64_t vaddr = 0;
+    struct flb_profile_map *map = NULL;
+    struct flb_profile_elf *elf;
+    struct flb_profile_sym *sym;
+
+    hi = p->n_maps - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (ip < p->maps[mid].start) {
+            hi = mid - 1;
+        }
+        else if (ip >= p->maps[mid].end) {
+            lo = mid + 1;
+        }
+        else {
+            map = &p->maps[mid];
+            break;
+        }
+    }
+    if (!map) {
+        snprintf(buf, size, "[unknown]");
+        return;
+    }
+
+    elf = map->elf;
+    if (!elf || elf->n_syms == 0) {
+        snprintf(buf, size, "[%s]", map->name);
+        return;
+    }
+
+    /* file offset to the address used by the symbol table */
+    off = ip - map->start + map->offset;
+    for (i = 0; i < elf->n_loads; i++) {
+        if (off >= elf->load_off[i] &&
+            off < elf->load_off[i] + elf->load_size[i]) {
+            vaddr = off - elf->load_off[i] + elf->load_vaddr[i];
+            break;
+        }
+    }
+
+    /* last symbol at or before the address */
+    lo = 0;
+    hi = elf->n_syms - 1;
+    sym = NULL;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (elf->syms[mid].addr <= vaddr) {
+            sym = &elf->syms[mid];
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+    if (!sym || i == elf->n_loads ||
+        (sym->size > 0 && vaddr >= sym->addr + sym->size)) {
+        snprintf(buf, size, "[%s]", map->name);
+        return;
+    }
+    snprintf(buf, size, "%s", sym->name);
+}
+
+static const char *profile_comm(struct flb_profile *p, pid_t tid,
+                                struct profile_comm *comms, int *n)
+{
+    int i;
+    int fd;
+    ssize_t bytes;
+    char path[PROC_PID_SIZE];
+    struct profile_comm *c;
+
+    for (i = 0; i < *n; i++) {
+        if (comms[i].tid == tid) {
+            return comms[i].name;
+        }
+    }
+    if (*n == PROFILE_COMMS) {
+        return "[thread]";
+    }
+
+    c = &comms[(*n)++];
+    c->tid = tid;
+    snprintf(c->name, sizeof(c->name), "[thread]");
+
+    snprintf(path, sizeof(path), "/proc/%i/task/%i/comm", p->pid, tid);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd != -1) {
+        bytes = read(fd, c->name, sizeof(c->name) - 1);
+        if (bytes > 0) {
+            c->name[bytes] = '\0';
+            c->name[strcspn(c->name, "\n")] = '\0';
+            /* ';' separates frames, ' ' the count */
+            for (i = 0; c->name[i]; i++) {
+                if (c->name[i] == ';' || c->name[i] == ' ') {
+                    c->name[i] = '_';
+                }
+            }
+        }
+        close(fd);
+    }
+    return c->name;
+}
+
+/* Collapsed stack of a sample: thread;root;...;leaf */
+static void profile_sample(struct flb_profile *p, const char *rec,
+                           struct profile_comm *comms, int *n_comms)
+{
+    int i;
+    int n = 0;
+    int user = 1;
+    int kernel_frame = 0;
+    size_t len;
+    uint32_t tid;
+    uint64_t nr;
+    uint64_t ip;
+    const uint64_t *ips;
+    char **tmp;
+    char stack[8192];
+    char frames[FLB_PROFILE_DEPTH + 1][PROFILE_FRAME];
+
+    /* header, u32 pid, u32 tid, u64 nr, u64 ips[nr] */
+    if (*(const uint32_t *) (rec + 8) != p->pid) {
+        /* an inherited child process, other address space */
+        return;
+    }
+    tid = *(const uint32_t *) (rec + 12);
+    nr = *(const uint64_t *) (rec + 16);
+    ips = (const uint64_t *) (rec + 24);
+
+    for (i = 0; i < nr && n <= FLB_PROFILE_DEPTH; i++) {
+        ip = ips[i];
+        if (ip >= (uint64_t) PERF_CONTEXT_MAX) {
+            user = (ip == (uint64_t) PERF_CONTEXT_USER);
+            continue;
+        }
+        if (!user) {
+            /* kernel frames fold in one, kallsyms is not needed */
+            if (!kernel_frame) {
+                snprintf(frames[n++], PROFILE_FRAME, "[kernel]");
+                kernel_frame = 1;
+            }
+            continue;
+        }
+        /* return addresses point after the call */
+        profile_symbol(p, n > 0 ? ip - 1 : ip, frames[n], PROFILE_FRAME);
+        n++;
+    }
+
+    len = snprintf(stack, sizeof(stack), "%s",
+                   profile_comm(p, tid, comms, n_comms));
+    for (i = n - 1; i >= 0 && len < sizeof(stack); i--) {
+        len += snprintf(stack + len, sizeof(stack) - len, ";%s", frames[i]);
+    }
+
+    if (p->n_stacks == p->size_stacks) {
+        tmp = realloc(p->stacks, sizeof(char *) * p->size_stacks * 2);
+        if (!tmp) {
+            perror("realloc");
+            return;
+        }
+        p->stacks = tmp;
+        p->size_stacks *= 2;
+    }
+    p->stacks[p->n_stacks] = strdup(stack);
+    if (p->stacks[p->n_stacks]) {
+        p->n_stacks++;
+    }
+}
+
+/* Read the records of a thread ring, stacks are kept if 'keep' is set */
+static void profile_drain(struct flb_profile *p, struct flb_profile_thread *t,
+                          int keep, struct profile_comm *comms, int *n_comms)
+{
+    size_t off;
+    size_t chunk;
+    uint64_t head;
+    uint64_t tail;
+    size_t page = getpagesize();
+    size_t size = FLB_PROFILE_PAGES * page;
+    char *data = (char *) t->ring + page;
+    char rec[65536];
+    struct perf_event_header hdr;
+    struct perf_event_mmap_page *meta = t->ring;
+
+    head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+    tail = meta->data_tail;
+
+    while (tail < head) {
+        off = tail % size;
+        memcpy(&hdr, data + off, sizeof(hdr));
+        if (hdr.size == 0) {
+            break;
+        }
+
+        /* records can wrap at the end of the buffer */
+        chunk = size - off;
+        if (chunk >= hdr.size) {
+            memcpy(rec, data + off, hdr.size);
+        }
+        else {
+            memcpy(rec, data + off, chunk);
+            memcpy(rec + chunk, data, hdr.size - chunk);
+        }
+
+        if (hdr.type == PERF_RECORD_SAMPLE) {
+            p->samples++;
+            if (keep) {
+                profile_sample(p, rec, comms, n_comms);
+            }
+        }
+        else if (hdr.type == PERF_RECORD_LOST) {
+            /* header, u64 id, u64 lost */
+            p->lost += *(uint64_t *) (rec + 16);
+        }
+        tail += hdr.size;
+    }
+
+    __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+static int profile_write(struct flb_profile *p, int round)
+{
+    int i;
+    int fd;
+    int count;
+    char path[PATH_MAX];
+
+    snprintf(path, sizeof(path), "%s/round-%03d.folded", p->dir, round);
+    fd = open(path, O_CREAT | O_TRUNC | O_WRONLY | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        perror("open");
+        fprintf(stderr, "error: cannot create profile '%s'\n", path);
+        return -1;
+    }
+
+    qsort(p->stacks, p->n_stacks, sizeof(char *), str_cmp);
+    for (i = 0; i < p->n_stacks; i += count) {
+        count = 1;
+        while (i + count < p->n_stacks &&
+               strcmp(p->stacks[i], p->stacks[i + count]) == 0) {
+            count++;
+        }
+        dprintf(fd, "%s %i\n", p->stacks[i], count);
+    }
+    close(fd);
+
+    p->rounds++;
+    return 0;
+}
+
+static int profile_selected(struct flb_profile *p, int round)
+{
+    return round >= p->first && (p->last == 0 || round <= p->last);
+}
+
+static void profile_enable(struct flb_profile *p, int on)
+{
+    int i;
+
+    for (i = 0; i < p->n_threads; i++) {
+        ioctl(p->threads[i].fd,
+              on ? PERF_EVENT_IOC_ENABLE : PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+static int profile_open(struct flb_profile *p, pid_t tid)
+{
+    int fd;
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = p->hw ? PERF_TYPE_HARDWARE : PERF_TYPE_SOFTWARE;
+    attr.config = p->hw ? PERF_COUNT_HW_CPU_CYCLES : PERF_COUNT_SW_CPU_CLOCK;
+    attr.freq = 1;
+    attr.sample_freq = FLB_PROFILE_HZ;
+    attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_CALLCHAIN;
+    attr.disabled = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = p->user_only;
+    attr.exclude_callchain_kernel = p->user_only;
+
+    fd = syscall(SYS_perf_event_open, &attr, tid, -1, -1,
+                 PERF_FLAG_FD_CLOEXEC);
+    if (fd == -1 && (errno == EACCES || errno == EPERM) && !p->user_only) {
+        p->user_only = 1;
+        return profile_open(p, tid);
+    }
+    return fd;
+}
+
+/* Sampling event and ring of the threads not seen yet */
+static int profile_threads(struct flb_profile *p, int on)
+{
+    int i;
+    int fd;
+    void *ring;
+    DIR *d;
+    pid_t tid;
+    char path[PROC_PID_SIZE];
+    struct dirent *ent;
+    struct flb_profile_thread *tmp;
+
+    snprintf(path, sizeof(path), "/proc/%i/task", p->pid);
+    d = opendir(path);
+    if (!d) {
+        return -1;
+    }
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        tid = atoi(ent->d_name);
+        for (i = 0; i < p->n_threads; i++) {
+            if (p->threads[i].tid == tid) {
+                break;
+            }
+        }
+        if (i < p->n_threads) {
+            continue;
+        }
+
+        if (p->n_threads == p->size_threads) {
+            tmp = realloc(p->threads, sizeof(struct flb_profile_thread) *
+                          p->size_threads * 2);
+            if (!tmp) {
+                perror("realloc");
+                break;
+            }
+            p->threads = tmp;
+            p->size_threads *= 2;
+        }
+
+        fd = profile_open(p, tid);
+        if (fd == -1) {
+            continue;
+        }
+        ring = mmap(NULL, (FLB_PROFILE_PAGES + 1) * getpagesize(),
+                    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ring == MAP_FAILED) {
+            close(fd);
+            continue;
+        }
+        if (on) {
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+        p->threads[p->n_threads].tid = tid;
+        p->threads[p->n_threads].fd = fd;
+        p->threads[p->n_threads].ring = ring;
+        p->n_threads++;
+    }
+    closedir(d);
+
+    return p->n_threads;
+}
+
+struct flb_profile *flb_profile_create(pid_t pid, char *dir,
+                                       int first, int last)
+{
+    int fd;
+    struct flb_profile *p;
+
+    if (mkdir(dir, 0777) == -1 && errno != EEXIST) {
+        perror("mkdir");
+        fprintf(stderr, "error: cannot create profile directory '%s'\n", dir);
+        return NULL;
+    }
+
+    p = calloc(1, sizeof(struct flb_profile));
+    if (!p) {
+        perror("calloc");
+        return NULL;
+    }
+    p->pid = pid;
+    p->dir = strdup(dir);
+    p->first = first;
+    p->last = last;
+    p->size_stacks = 1024;
+    p->stacks = malloc(sizeof(char *) * p->size_stacks);
+    p->size_threads = 16;
+    p->threads = malloc(sizeof(struct flb_profile_thread) * p->size_threads);
+    if (!p->stacks || !p->threads) {
+        perror("malloc");
+        flb_profile_destroy(p);
+        return NULL;
+    }
+
+    /* cycles if there is a PMU, CPU clock otherwise */
+    p->hw = 1;
+    fd = profile_open(p, pid);
+    if (fd == -1) {
+        p->hw = 0;
+    }
+    else {
+        close(fd);
+    }
+
+    if (profile_threads(p, profile_selected(p, 1)) <= 0) {
+        perror("perf_event_open");
+        fprintf(stderr, "error: cannot profile PID %i\n", pid);
+        flb_profile_destroy(p);
+        return NULL;
+    }
+    return p;
+}
+
+void flb_profile_destroy(struct flb_profile *p)
+{
+    int i;
+    struct flb_profile_elf *elf;
+    struct flb_profile_elf *next;
+
+    for (i = 0; i < p->n_threads; i++) {
+        munmap(p->threads[i].ring, (FLB_PROFILE_PAGES + 1) * getpagesize());
+        close(p->threads[i].fd);
+    }
+    for (elf = p->elfs; elf; elf = next) {
+        next = elf->next;
+        free(elf->path);
+        free(elf->syms);
+        free(elf->strtab);
+        free(elf);
+    }
+    for (i = 0; i < p->n_stacks; i++) {
+        free(p->stacks[i]);
+    }
+    free(p->stacks);
+    free(p->threads);
+    free(p->maps);
+    free(p->dir);
+    free(p);
+}
+
+int flb_profile_round(struct flb_profile *p, int round)
+{
+    int i;
+    int ret = 0;
+    int keep;
+    int n_comms = 0;
+    struct profile_comm comms[PROFILE_COMMS];
+
+    keep = profile_selected(p, round);
+    if (keep) {
+        profile_enable(p, 0);
+        profile_maps(p);
+    }
+
+    for (i = 0; i < p->n_threads; i++) {
+        profile_drain(p, &p->threads[i], keep, comms, &n_comms);
+    }
+
+    if (keep) {
+        ret = profile_write(p, round);
+        for (i = 0; i < p->n_stacks; i++) {
+            free(p->stacks[i]);
+        }
+        p->n_stacks = 0;
+    }
+
+    /* sampling runs only during the selected rounds */
+    if (profile_selected(p, round + 1)) {
+        profile_enable(p, 1);
+        profile_threads(p, 1);
+    }
+    return ret;
+}
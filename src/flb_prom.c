@@ -0,0 +1,82 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flb_protobuf.h"
+#include "flb_prom.h"
+
+/* Field numbers from prometheus/prompb/{remote,types}.proto */
+#define PROM_WRITE_REQUEST_TIMESERIES  1
+
+#define PROM_TIMESERIES_LABELS         1
+#define PROM_TIMESERIES_SAMPLES        2
+
+#define PROM_LABEL_NAME                1
+#define PROM_LABEL_VALUE               2
+
+#define PROM_SAMPLE_VALUE              1
+#define PROM_SAMPLE_TIMESTAMP          2
+
+static int prom_label(struct flb_pb_buf *b, char *name, char *value)
+{
+    size_t mark;
+
+    if (flb_pb_begin(b, PROM_TIMESERIES_LABELS, &mark) == -1 ||
+        flb_pb_string(b, PROM_LABEL_NAME, name) == -1 ||
+        flb_pb_string(b, PROM_LABEL_VALUE, value) == -1) {
+        return -1;
+    }
+    return flb_pb_end(b, mark);
+}
+
+int flb_prom_write_request(struct flb_pb_buf *b, char *name,
+                           struct flb_prom_sample *samples, int n)
+{
+    int i;
+    size_t ts;
+    size_t sample;
+    char id[16];
+
+    for (i = 0; i < n; i++) {
+        snprintf(id, sizeof(id), "%u", samples[i].series);
+
+        /* labels must be sorted by name */
+        if (flb_pb_begin(b, PROM_WRITE_REQUEST_TIMESERIES, &ts) == -1 ||
+            prom_label(b, "__name__", name) == -1 ||
+            prom_label(b, "job", "flb-perf") == -1 ||
+            prom_label(b, "series", id) == -1) {
+            return -1;
+        }
+
+        if (flb_pb_begin(b, PROM_TIMESERIES_SAMPLES, &sample) == -1 ||
+            flb_pb_double(b, PROM_SAMPLE_VALUE, samples[i].value) == -1 ||
+            flb_pb_int64(b, PROM_SAMPLE_TIMESTAMP,
+                         samples[i].timestamp) == -1 ||
+            flb_pb_end(b, sample) == -1 ||
+            flb_pb_end(b, ts) == -1) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,219 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "flb_protobuf.h"
+
+int flb_pb_buf_init(struct flb_pb_buf *b, size_t size)
+{
+    b->data = malloc(size);
+    if (!b->data) {
+        perror("malloc");
+        return -1;
+    }
+    b->len = 0;
+    b->size = size;
+    return 0;
+}
+
+void flb_pb_buf_destroy(struct flb_pb_buf *b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->len = 0;
+    b->size = 0;
+}
+
+static int pb_buf_reserve(struct flb_pb_buf *b, size_t bytes)
+{
+    size_t size;
+    char *tmp;
+
+    if (b->len + bytes <= b->size) {
+        return 0;
+    }
+
+    size = b->size ? b->size : 64;
+    while (size < b->len + bytes) {
+        size *= 2;
+    }
+
+    tmp = realloc(b->data, size);
+    if (!tmp) {
+        perror("realloc");
+        return -1;
+    }
+    b->data = tmp;
+    b->size = size;
+    return 0;
+}
+
+static int varint_size(uint64_t val)
+{
+    int n = 1;
+
+    while (val >= 0x80) {
+        val >>= 7;
+        n++;
+    }
+    return n;
+}
+
+int flb_pb_varint(struct flb_pb_buf *b, uint64_t val)
+{
+    unsigned char *p;
+
+    if (pb_buf_reserve(b, 10) == -1) {
+        return -1;
+    }
+
+    p = (unsigned char *) b->data + b->len;
+    while (val >= 0x80) {
+        *p++ = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+    b->len = (char *) p - b->data;
+    return 0;
+}
+
+int flb_pb_tag(struct flb_pb_buf *b, uint32_t field, int wire_type)
+{
+    return flb_pb_varint(b, ((uint64_t) field << 3) | wire_type);
+}
+
+int flb_pb_uint64(struct flb_pb_buf *b, uint32_t field, uint64_t val)
+{
+    if (flb_pb_tag(b, field, FLB_PB_VARINT) == -1) {
+        return -1;
+    }
+    return flb_pb_varint(b, val);
+}
+
+/* int64 fields (not sint64) use the two's complement 10 bytes varint */
+int flb_pb_int64(struct flb_pb_buf *b, uint32_t field, int64_t val)
+{
+    return flb_pb_uint64(b, field, (uint64_t) val);
+}
+
+int flb_pb_bool(struct flb_pb_buf *b, uint32_t field, int val)
+{
+    return flb_pb_uint64(b, field, val ? 1 : 0);
+}
+
+static int pb_fixed(struct flb_pb_buf *b, uint64_t val, int bytes)
+{
+    int i;
+
+    if (pb_buf_reserve(b, bytes) == -1) {
+        return -1;
+    }
+
+    /* little-endian */
+    for (i = 0; i < bytes; i++) {
+        b->data[b->len++] = (val >> (i * 8)) & 0xff;
+    }
+    return 0;
+}
+
+int flb_pb_fixed64(struct flb_pb_buf *b, uint32_t field, uint64_t val)
+{
+    if (flb_pb_tag(b, field, FLB_PB_FIXED64) == -1) {
+        return -1;
+    }
+    return pb_fixed(b, val, 8);
+}
+
+int flb_pb_fixed32(struct flb_pb_buf *b, uint32_t field, uint32_t val)
+{
+    if (flb_pb_tag(b, field, FLB_PB_FIXED32) == -1) {
+        return -1;
+    }
+    return pb_fixed(b, val, 4);
+}
+
+int flb_pb_double(struct flb_pb_buf *b, uint32_t field, double val)
+{
+    uint64_t u;
+
+    memcpy(&u, &val, sizeof(u));
+    return flb_pb_fixed64(b, field, u);
+}
+
+int flb_pb_bytes(struct flb_pb_buf *b, uint32_t field,
+                 const void *data, size_t len)
+{
+    if (flb_pb_tag(b, field, FLB_PB_LEN) == -1 ||
+        flb_pb_varint(b, len) == -1 ||
+        pb_buf_reserve(b, len) == -1) {
+        return -1;
+    }
+    memcpy(b->data + b->len, data, len);
+    b->len += len;
+    return 0;
+}
+
+int flb_pb_string(struct flb_pb_buf *b, uint32_t field, const char *str)
+{
+    return flb_pb_bytes(b, field, str, strlen(str));
+}
+
+/*
+ * Open a nested message: one byte is reserved for its length, most of the
+ * messages are small and never need to be moved.
+ */
+int flb_pb_begin(struct flb_pb_buf *b, uint32_t field, size_t *mark)
+{
+    if (flb_pb_tag(b, field, FLB_PB_LEN) == -1 ||
+        pb_buf_reserve(b, 1) == -1) {
+        return -1;
+    }
+    *mark = b->len;
+    b->data[b->len++] = 0;
+    return 0;
+}
+
+int flb_pb_end(struct flb_pb_buf *b, size_t mark)
+{
+    int n;
+    size_t len;
+    size_t end;
+
+    len = b->len - (mark + 1);
+    n = varint_size(len);
+
+    if (n > 1) {
+        if (pb_buf_reserve(b, n - 1) == -1) {
+            return -1;
+        }
+        memmove(b->data + mark + n, b->data + mark + 1, len);
+    }
+
+    /* write the length in place */
+    end = b->len + (n - 1);
+    b->len = mark;
+    flb_pb_varint(b, len);
+    b->len = end;
+    return 0;
+}
@@ -0,0 +1,486 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/types.h>
+
+#include "flb_proc.h"
+#include "flb_ptree.h"
+
+/* the tree serving flb_ptree_task(), one per process */
+static struct flb_ptree *ptree_active = NULL;
+
+/* a process seen by the /proc wide scan */
+struct ptree_pair {
+    pid_t pid;
+    pid_t ppid;
+};
+
+static int proc_open(pid_t pid, char *name)
+{
+    char path[PROC_PID_SIZE];
+
+    snprintf(path, sizeof(path), "/proc/%i/%s", pid, name);
+    return open(path, O_RDONLY | O_CLOEXEC);
+}
+
+static int stat_read(int fd, struct flb_proc_task *t)
+{
+    ssize_t bytes;
+    char buf[PROC_STAT_BUF_SIZE];
+
+    bytes = pread(fd, buf, sizeof(buf), 0);
+    if (bytes <= 0) {
+        return -1;
+    }
+    return flb_proc_stat_parse(buf, bytes, t);
+}
+
+static void proc_close(struct flb_ptree *t, struct flb_ptree_proc *p)
+{
+    if (p->fd_stat != -1) {
+        close(p->fd_stat);
+    }
+    if (p->fd_status != -1) {
+        close(p->fd_status);
+    }
+    if (p->fd_rollup != -1) {
+        close(p->fd_rollup);
+    }
+    if (p->fd_io != -1) {
+        close(p->fd_io);
+    }
+    if (p->cs) {
+        flb_proc_ctxsw_destroy(p->cs);
+        p->cs = NULL;
+    }
+    p->fd_stat = p->fd_status = p->fd_rollup = p->fd_io = -1;
+    if (p->alive) {
+        p->alive = 0;
+        t->alive--;
+    }
+}
+
+/* Start tracking 'pid', or flag it as seen when it's a known one */
+static int ptree_add(struct flb_ptree *t, pid_t pid)
+{
+    int i;
+    struct flb_proc_task task;
+    struct flb_ptree_proc *p;
+    struct flb_ptree_proc *tmp;
+
+    for (i = 0; i < t->n; i++) {
+        if (t->procs[i].alive && t->procs[i].pid == pid) {
+            t->procs[i].seen = 1;
+            return 0;
+        }
+    }
+
+    if (t->n == t->size) {
+        tmp = realloc(t->procs, sizeof(struct flb_ptree_proc) * t->size * 2);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        t->procs = tmp;
+        t->size *= 2;
+    }
+
+    p = &t->procs[t->n];
+    memset(p, 0, sizeof(struct flb_ptree_proc));
+    p->pid = pid;
+    p->fd_status = p->fd_rollup = p->fd_io = -1;
+    p->fd_stat = proc_open(pid, "stat");
+    if (p->fd_stat == -1 || stat_read(p->fd_stat, &task) == -1) {
+        /* gone already */
+        if (p->fd_stat != -1) {
+            close(p->fd_stat);
+        }
+        return -1;
+    }
+
+    if (t->flags & FLB_PTREE_MEM) {
+        p->fd_status = proc_open(pid, "status");
+        p->fd_rollup = proc_open(pid, "smaps_rollup");
+    }
+    if (t->flags & FLB_PTREE_IO) {
+        p->fd_io = proc_open(pid, "io");
+        p->cs = flb_proc_ctxsw_create(pid);
+        if (p->fd_io != -1 && p->cs) {
+            flb_proc_io_read(p->fd_io, p->cs, &p->io);
+        }
+    }
+
+    snprintf(p->name, sizeof(p->name), "%s", task.name);
+    p->ppid = task.ppid;
+    p->starttime = task.starttime;
+    p->utime = task.utime;
+    p->stime = task.stime;
+    p->minflt = task.minflt;
+    p->majflt = task.majflt;
+    p->r_rss = task.r_rss;
+    p->first_ticks = task.utime + task.stime;
+    p->alive = 1;
+    p->seen = 1;
+
+    t->n++;
+    t->alive++;
+    if (t->alive > t->max_alive) {
+        t->max_alive = t->alive;
+    }
+    return 0;
+}
+
+/* Children of every thread of a member, from the task/TID/children files */
+static void ptree_children(struct flb_ptree *t, pid_t pid)
+{
+    int fd;
+    ssize_t bytes;
+    char *p;
+    char *end;
+    long child;
+    DIR *dir;
+    struct dirent *ent;
+    char path[PROC_PID_SIZE];
+    char buf[4096];
+
+    snprintf(path, sizeof(path), "/proc/%i/task", pid);
+    dir = opendir(path);
+    if (!dir) {
+        return;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%i/task/%s/children",
+                 pid, ent->d_name);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            continue;
+        }
+        bytes = read(fd, buf, sizeof(buf) - 1);
+        close(fd);
+        if (bytes <= 0) {
+            continue;
+        }
+        buf[bytes] = '\0';
+
+        p = buf;
+        while (*p) {
+            child = strtol(p, &end, 10);
+            if (end == p) {
+                break;
+            }
+            ptree_add(t, child);
+            p = end;
+        }
+    }
+    closedir(dir);
+}
+
+/* Parent of every process in /proc, returns the number of entries */
+static int ptree_scan(struct ptree_pair **out)
+{
+    int fd;
+    int n = 0;
+    int size = 256;
+    DIR *dir;
+    struct dirent *ent;
+    struct flb_proc_task task;
+    struct ptree_pair *tmp;
+    struct ptree_pair *pairs;
+    char path[PROC_PID_SIZE];
+
+    dir = opendir("/proc");
+    if (!dir) {
+        perror("opendir");
+        return -1;
+    }
+
+    pairs = malloc(sizeof(struct ptree_pair) * size);
+    if (!pairs) {
+        perror("malloc");
+        closedir(dir);
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (!isdigit(ent->d_name[0])) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%s/stat", ent->d_name);
+        fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd == -1) {
+            continue;
+        }
+        if (stat_read(fd, &task) == -1) {
+            close(fd);
+            continue;
+        }
+        close(fd);
+
+        if (n == size) {
+            tmp = realloc(pairs, sizeof(struct ptree_pair) * size * 2);
+            if (!tmp) {
+                perror("realloc");
+                break;
+            }
+            pairs = tmp;
+            size *= 2;
+        }
+        pairs[n].pid = atoi(ent->d_name);
+        pairs[n].ppid = task.ppid;
+        n++;
+    }
+    closedir(dir);
+
+    *out = pairs;
+    return n;
+}
+
+struct flb_ptree *flb_ptree_create(pid_t root, int flags)
+{
+    char path[PROC_PID_SIZE];
+    struct flb_ptree *t;
+
+    t = calloc(1, sizeof(struct flb_ptree));
+    if (!t) {
+        perror("calloc");
+        return NULL;
+    }
+    t->root = root;
+    t->flags = flags;
+    t->size = 16;
+    t->procs = malloc(sizeof(struct flb_ptree_proc) * t->size);
+    if (!t->procs) {
+        perror("malloc");
+        free(t);
+        return NULL;
+    }
+
+    if (ptree_add(t, root) == -1) {
+        fprintf(stderr, "error: cannot read process %i\n", root);
+        free(t->procs);
+        free(t);
+        return NULL;
+    }
+
+    /* CONFIG_PROC_CHILDREN is not always there, /proc is scanned then */
+    snprintf(path, sizeof(path), "/proc/%i/task/%i/children", root, root);
+    t->children = (access(path, R_OK) == 0);
+    t->interval_ms = t->children ? 100 : 1000;
+    flb_ptree_refresh(t);
+
+    if (!ptree_active) {
+        ptree_active = t;
+    }
+    return t;
+}
+
+void flb_ptree_destroy(struct flb_ptree *t)
+{
+    int i;
+
+    if (ptree_active == t) {
+        ptree_active = NULL;
+    }
+    for (i = 0; i < t->n; i++) {
+        proc_close(t, &t->procs[i]);
+    }
+    free(t->procs);
+    free(t);
+}
+
+int flb_ptree_refresh(struct flb_ptree *t)
+{
+    int i;
+    int j;
+    int n = 0;
+    long ms;
+    struct timespec now;
+    struct ptree_pair *pairs = NULL;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ms = (now.tv_sec - t->last_scan.tv_sec) * 1000 +
+        (now.tv_nsec - t->last_scan.tv_nsec) / 1000000;
+    if (t->last_scan.tv_sec != 0 && ms < t->interval_ms) {
+        return t->alive;
+    }
+    t->last_scan = now;
+
+    for (i = 0; i < t->n; i++) {
+        t->procs[i].seen = 0;
+    }
+    t->procs[0].seen = t->procs[0].alive;
+
+    if (!t->children) {
+        n = ptree_scan(&pairs);
+        if (n == -1) {
+            return t->alive;
+        }
+    }
+
+    /* breadth first, members found here are visited by the same loop */
+    for (i = 0; i < t->n; i++) {
+        if (!t->procs[i].alive || !t->procs[i].seen) {
+            continue;
+        }
+        if (t->children) {
+            ptree_children(t, t->procs[i].pid);
+            continue;
+        }
+        for (j = 0; j < n; j++) {
+            if (pairs[j].ppid == t->procs[i].pid) {
+                ptree_add(t, pairs[j].pid);
+            }
+        }
+    }
+    free(pairs);
+
+    for (i = 1; i < t->n; i++) {
+        if (t->procs[i].alive && !t->procs[i].seen) {
+            proc_close(t, &t->procs[i]);
+        }
+    }
+    return t->alive;
+}
+
+int flb_ptree_read(struct flb_ptree *t, struct flb_proc_task *task)
+{
+    int i;
+    int cpu_hz = sysconf(_SC_CLK_TCK);
+    struct flb_proc_task tmp;
+    struct flb_ptree_proc *p;
+
+    memset(task, 0, sizeof(struct flb_proc_task));
+
+    for (i = 0; i < t->n; i++) {
+        p = &t->procs[i];
+        if (p->alive) {
+            if (stat_read(p->fd_stat, &tmp) == 0) {
+                /* a fork shows the parent name until it calls exec */
+                snprintf(p->name, sizeof(p->name), "%s", tmp.name);
+                p->utime = tmp.utime;
+                p->stime = tmp.stime;
+                p->minflt = tmp.minflt;
+                p->majflt = tmp.majflt;
+                p->r_rss = tmp.r_rss;
+                task->r_rss += p->r_rss;
+            }
+            else {
+                proc_close(t, p);
+            }
+        }
+        task->utime += p->utime;
+        task->stime += p->stime;
+        task->minflt += p->minflt;
+        task->majflt += p->majflt;
+    }
+
+    if (!t->procs[0].alive) {
+        return -1;
+    }
+
+    snprintf(task->name, sizeof(task->name), "%s", t->procs[0].name);
+    task->ppid = t->procs[0].ppid;
+    task->starttime = t->procs[0].starttime;
+    task->rss = task->r_rss / getpagesize();
+    task->r_utime_s  = (task->utime / cpu_hz);
+    task->r_utime_ms = ((task->utime * 1000) / cpu_hz);
+    task->r_stime_s  = (task->stime / cpu_hz);
+    task->r_stime_ms = ((task->stime * 1000) / cpu_hz);
+    clock_gettime(CLOCK_REALTIME, &task->ts);
+    return 0;
+}
+
+int flb_ptree_mem(struct flb_ptree *t, struct flb_proc_mem *m)
+{
+    int i;
+    struct flb_ptree_proc *p;
+
+    memset(m, 0, sizeof(struct flb_proc_mem));
+    for (i = 0; i < t->n; i++) {
+        p = &t->procs[i];
+        if (!p->alive || p->fd_status == -1 || p->fd_rollup == -1 ||
+            flb_proc_mem_read(p->fd_status, p->fd_rollup, &p->mem) == -1) {
+            continue;
+        }
+        m->pss += p->mem.pss;
+        m->pss_anon += p->mem.pss_anon;
+        m->pss_file += p->mem.pss_file;
+        m->pss_shmem += p->mem.pss_shmem;
+        m->swap += p->mem.swap;
+        m->hwm += p->mem.hwm;
+        m->rss_anon += p->mem.rss_anon;
+        m->rss_file += p->mem.rss_file;
+        m->rss_shmem += p->mem.rss_shmem;
+    }
+
+    return t->procs[0].alive ? 0 : -1;
+}
+
+int flb_ptree_io(struct flb_ptree *t, struct flb_proc_io *io)
+{
+    int i;
+    struct flb_ptree_proc *p;
+    struct flb_proc_io last;
+
+    memset(io, 0, sizeof(struct flb_proc_io));
+    for (i = 0; i < t->n; i++) {
+        p = &t->procs[i];
+        /* a failed read keeps the last counters of an exiting process */
+        if (p->alive && p->fd_io != -1 && p->cs &&
+            flb_proc_io_read(p->fd_io, p->cs, &last) == 0) {
+            p->io = last;
+        }
+        io->rchar += p->io.rchar;
+        io->wchar += p->io.wchar;
+        io->syscr += p->io.syscr;
+        io->syscw += p->io.syscw;
+        io->read_bytes += p->io.read_bytes;
+        io->write_bytes += p->io.write_bytes;
+        io->vol_cs += p->io.vol_cs;
+        io->invol_cs += p->io.invol_cs;
+    }
+
+    return t->procs[0].alive ? 0 : -1;
+}
+
+int flb_ptree_task(pid_t pid, struct flb_proc_task *task)
+{
+    struct flb_ptree *t = ptree_active;
+
+    if (!t || t->root != pid) {
+        return -1;
+    }
+
+    flb_ptree_refresh(t);
+    return flb_ptree_read(t, task);
+}
@@ -28,6 +28,10 @@
 
 #include "flb_proc.h"
 #include "flb_report.h"
+#include "flb_sockdiag.h"
+#include "flb_monitor.h"
+#include "flb_sampler.h"
+#include "flb_launch.h"
 
 #define BILLION  1000000000.0
 
@@ -58,29 +62,781 @@ char *flb_report_human_readable_size(long size)
 
 static void report_txt_header(struct flb_report *r)
 {
+    int i;
+    struct flb_report_col *col;
+
     dprintf(r->fd,
             " records   write (b)     write   secs |  %% cpu  user (ms)  "
-            "sys (ms)  Mem (bytes)      Mem\n");
+            "sys (ms)  Mem (bytes)      Mem");
+    for (i = 0; i < r->n_cols; i++) {
+        col = &r->cols[i];
+        dprintf(r->fd, "  %*s", col->width, col->name);
+    }
+    dprintf(r->fd, "\n");
+
     dprintf(r->fd,
             "--------  ----------  --------  ----- + ------  ---------  "
-            "--------  -----------  -------\n");
+            "--------  -----------  -------");
+    for (i = 0; i < r->n_cols; i++) {
+        dprintf(r->fd, "  %.*s", r->cols[i].width,
+                "--------------------------------");
+    }
+    dprintf(r->fd, "\n");
 }
 
 static void report_markdown_header(struct flb_report *r)
 {
+    int i;
+
     dprintf(r->fd,
             "| records | write (b) | write | secs | %%cpu | user (ms) "
-            "| sys (ms) | Mem (bytes) | Mem |\n");
+            "| sys (ms) | Mem (bytes) | Mem |");
+    for (i = 0; i < r->n_cols; i++) {
+        dprintf(r->fd, " %s |", r->cols[i].name);
+    }
+    dprintf(r->fd, "\n");
+
     dprintf(r->fd,
             "|    ---: |      ---: |  ---: | ---: | ---: |      ---: "
-            "|     ---: |        ---: |---: |\n");
+            "|     ---: |        ---: |---: |");
+    for (i = 0; i < r->n_cols; i++) {
+        dprintf(r->fd, " ---: |");
+    }
+    dprintf(r->fd, "\n");
 }
 
 static void report_csv_header(struct flb_report *r)
 {
+    int i;
+
     dprintf(r->fd,
             "records,write_bytes,write_human,secs,cpu,user_ms,sys_ms,"
-            "mem_bytes,mem_human\n");
+            "mem_bytes,mem_human");
+    for (i = 0; i < r->n_cols; i++) {
+        dprintf(r->fd, ",%s", r->cols[i].name);
+    }
+    dprintf(r->fd, "\n");
+}
+
+static void report_header(struct flb_report *r)
+{
+    if (r->format == FLB_REPORT_TXT) {
+        report_txt_header(r);
+    }
+    else if (r->format == FLB_REPORT_MARKDOWN) {
+        report_markdown_header(r);
+    }
+    else if (r->format == FLB_REPORT_CSV) {
+        report_csv_header(r);
+    }
+    r->header = 1;
+}
+
+/* Print the extra columns of the current row and reset their values */
+static void report_columns(struct flb_report *r)
+{
+    int i;
+    struct flb_report_col *col;
+
+    for (i = 0; i < r->n_cols; i++) {
+        col = &r->cols[i];
+        if (r->format == FLB_REPORT_TXT) {
+            dprintf(r->fd, "  %*.*lf", col->width, col->precision, col->value);
+        }
+        else if (r->format == FLB_REPORT_MARKDOWN) {
+            dprintf(r->fd, " %.*lf |", col->precision, col->value);
+        }
+        else if (r->format == FLB_REPORT_CSV) {
+            dprintf(r->fd, ",%.*lf", col->precision, col->value);
+        }
+        col->value = 0.0;
+    }
+    dprintf(r->fd, "\n");
+}
+
+static int report_thread_name(struct flb_report *r, char *name)
+{
+    int i;
+    struct flb_report_thread_name *tmp;
+
+    for (i = 0; i < r->n_names; i++) {
+        if (strcmp(r->names[i].name, name) == 0) {
+            return i;
+        }
+    }
+
+    if (r->n_names == r->size_names) {
+        r->size_names = r->size_names ? r->size_names * 2 : 16;
+        tmp = realloc(r->names,
+                      sizeof(struct flb_report_thread_name) * r->size_names);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        r->names = tmp;
+    }
+
+    memset(&r->names[r->n_names], 0, sizeof(struct flb_report_thread_name));
+    snprintf(r->names[r->n_names].name, sizeof(r->names[0].name), "%s", name);
+    return r->n_names++;
+}
+
+/*
+ * Add the CPU ticks every thread used since the last scan to its name,
+ * returns the %CPU of the busiest name over 'duration' seconds.
+ */
+static double report_threads_scan(struct flb_report *r, double duration)
+{
+    int i;
+    int j;
+    int id;
+    int count;
+    double cpu;
+    double max = 0.0;
+    unsigned long ticks;
+    struct flb_proc_thread *list;
+    struct flb_report_thread *tmp;
+    struct flb_report_thread *e;
+
+    count = flb_proc_threads(r->pid, &list);
+    if (count == -1) {
+        return 0.0;
+    }
+
+    for (i = 0; i < count; i++) {
+        ticks = list[i].utime + list[i].stime;
+
+        for (j = 0; j < r->n_threads; j++) {
+            if (r->threads[j].tid == list[i].tid) {
+                break;
+            }
+        }
+
+        if (j == r->n_threads) {
+            id = report_thread_name(r, list[i].name);
+            if (id == -1) {
+                continue;
+            }
+            if (r->n_threads == r->size_threads) {
+                r->size_threads = r->size_threads ? r->size_threads * 2 : 32;
+                tmp = realloc(r->threads,
+                              sizeof(struct flb_report_thread) * r->size_threads);
+                if (!tmp) {
+                    perror("realloc");
+                    continue;
+                }
+                r->threads = tmp;
+            }
+            e = &r->threads[r->n_threads++];
+            e->tid = list[i].tid;
+            e->name_id = id;
+            e->ticks = (duration > 0) ? 0 : ticks;
+            r->names[id].threads++;
+        }
+        else {
+            e = &r->threads[j];
+        }
+
+        if (ticks >= e->ticks) {
+            r->names[e->name_id].round += ticks - e->ticks;
+        }
+        e->ticks = ticks;
+    }
+    free(list);
+
+    for (i = 0; i < r->n_names; i++) {
+        if (duration > 0) {
+            cpu = (r->names[i].round * 100.0) / r->cpu_ticks / duration;
+            if (cpu > r->names[i].peak) {
+                r->names[i].peak = cpu;
+            }
+            if (cpu > max) {
+                max = cpu;
+            }
+        }
+        r->names[i].total += r->names[i].round;
+        r->names[i].round = 0;
+    }
+
+    return max;
+}
+
+static int proc_open(pid_t pid, char *name)
+{
+    int fd;
+    char path[PROC_PID_SIZE];
+
+    snprintf(path, sizeof(path), "/proc/%i/%s", pid, name);
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        fprintf(stderr, "warn: cannot open '%s'\n", path);
+    }
+    return fd;
+}
+
+static void report_memory_open(struct flb_report *r, int smaps)
+{
+    r->fd_status = proc_open(r->pid, "status");
+    if (r->fd_status == -1) {
+        return;
+    }
+    r->fd_rollup = proc_open(r->pid, "smaps_rollup");
+    if (smaps > 0) {
+        r->fd_smaps = proc_open(r->pid, "smaps");
+    }
+
+    r->col_mem = flb_report_column_add(r, "pss_kb", 9, 0);
+    flb_report_column_add(r, "anon_kb", 9, 0);
+    flb_report_column_add(r, "file_kb", 9, 0);
+    flb_report_column_add(r, "shmem_kb", 9, 0);
+    flb_report_column_add(r, "hwm_kb", 9, 0);
+}
+
+static void report_memory(struct flb_report *r)
+{
+    int n;
+    int ret;
+    int col = r->col_mem;
+    struct flb_proc_mapping *maps;
+
+    if (r->tree) {
+        ret = flb_ptree_mem(r->tree, &r->mem);
+    }
+    else {
+        ret = flb_proc_mem_read(r->fd_status, r->fd_rollup, &r->mem);
+    }
+    if (ret == -1) {
+        return;
+    }
+    r->mem_rounds++;
+    r->sum_pss += r->mem.pss;
+    if (r->mem.pss > r->max_pss) {
+        r->max_pss = r->mem.pss;
+    }
+
+    flb_report_column_set(r, col, r->mem.pss / 1024);
+    flb_report_column_set(r, col + 1, r->mem.rss_anon / 1024);
+    flb_report_column_set(r, col + 2, r->mem.rss_file / 1024);
+    flb_report_column_set(r, col + 3, r->mem.rss_shmem / 1024);
+    flb_report_column_set(r, col + 4, r->mem.hwm / 1024);
+
+    /* first and last view of the mappings, the summary shows the growth */
+    if (r->fd_smaps == -1) {
+        return;
+    }
+    n = flb_proc_smaps_read(r->fd_smaps, &maps);
+    if (n == -1) {
+        return;
+    }
+    if (!r->maps_first) {
+        r->maps_first = maps;
+        r->n_maps_first = n;
+        return;
+    }
+    free(r->maps_last);
+    r->maps_last = maps;
+    r->n_maps_last = n;
+}
+
+/*
+ * Run queue delay of the round: the time threads were runnable but
+ * waiting for a CPU, as a share of the runnable time and per timeslice.
+ */
+static void report_sched(struct flb_report *r,
+                         struct flb_proc_task *t1, struct flb_proc_task *t2)
+{
+    int col = r->col_sched;
+    uint64_t run;
+    uint64_t wait;
+    uint64_t slices;
+
+    if (t1->run_ns == 0 || t2->wait_ns < t1->wait_ns ||
+        t2->run_ns < t1->run_ns) {
+        return;
+    }
+    run = t2->run_ns - t1->run_ns;
+    wait = t2->wait_ns - t1->wait_ns;
+    slices = t2->timeslices - t1->timeslices;
+
+    r->sum_run_ns += run;
+    r->sum_wait_ns += wait;
+    r->sum_timeslices += slices;
+    if (wait > r->max_wait_ns) {
+        r->max_wait_ns = wait;
+        r->max_wait_round = r->snapshots;
+    }
+
+    flb_report_column_set(r, col, wait / 1e6);
+    flb_report_column_set(r, col + 1, run + wait ? (wait * 100.0) / (run + wait) : 0);
+    flb_report_column_set(r, col + 2, slices ? wait / 1e3 / slices : 0);
+}
+
+static void report_io_open(struct flb_report *r)
+{
+    int ret = -1;
+
+    r->fd_io = proc_open(r->pid, "io");
+    if (r->tree) {
+        ret = flb_ptree_io(r->tree, &r->io_first);
+    }
+    else if (r->fd_io != -1) {
+        r->io_cs = flb_proc_ctxsw_create(r->pid);
+        if (r->io_cs) {
+            ret = flb_proc_io_read(r->fd_io, r->io_cs, &r->io_first);
+        }
+    }
+    if (ret == -1) {
+        fprintf(stderr, "warn: I/O counters are not available\n");
+        return;
+    }
+    r->io_last = r->io_first;
+
+    r->col_io = flb_report_column_add(r, "syscalls", 9, 0);
+    flb_report_column_add(r, "sc_rec", 7, 2);
+    flb_report_column_add(r, "rchar_kb", 9, 0);
+    flb_report_column_add(r, "wchar_kb", 9, 0);
+    flb_report_column_add(r, "disk_kb", 8, 0);
+    flb_report_column_add(r, "vol_cs", 7, 0);
+    flb_report_column_add(r, "invol_cs", 8, 0);
+    flb_report_column_add(r, "minflt", 7, 0);
+    flb_report_column_add(r, "majflt", 6, 0);
+}
+
+static void report_io(struct flb_report *r, int records, size_t bytes,
+                      struct flb_proc_task *t1, struct flb_proc_task *t2)
+{
+    int ret;
+    int col = r->col_io;
+    unsigned long syscalls;
+    unsigned long minflt = 0;
+    unsigned long majflt = 0;
+    struct flb_proc_io io;
+    struct flb_proc_io *last = &r->io_last;
+
+    if (r->tree) {
+        ret = flb_ptree_io(r->tree, &io);
+    }
+    else {
+        ret = flb_proc_io_read(r->fd_io, r->io_cs, &io);
+    }
+    if (ret == -1) {
+        return;
+    }
+
+    if (t2->minflt >= t1->minflt) {
+        minflt = t2->minflt - t1->minflt;
+    }
+    if (t2->majflt >= t1->majflt) {
+        majflt = t2->majflt - t1->majflt;
+    }
+    r->sum_minflt += minflt;
+    r->sum_majflt += majflt;
+    r->io_records += records;
+    r->io_bytes += bytes;
+
+    syscalls = (io.syscr - last->syscr) + (io.syscw - last->syscw);
+    flb_report_column_set(r, col, syscalls);
+    flb_report_column_set(r, col + 1, records > 0 ? (double) syscalls / records : 0);
+    flb_report_column_set(r, col + 2, (io.rchar - last->rchar) / 1024.0);
+    flb_report_column_set(r, col + 3, (io.wchar - last->wchar) / 1024.0);
+    flb_report_column_set(r, col + 4,
+                          ((io.read_bytes - last->read_bytes) +
+                           (io.write_bytes - last->write_bytes)) / 1024.0);
+    flb_report_column_set(r, col + 5, io.vol_cs - last->vol_cs);
+    flb_report_column_set(r, col + 6, io.invol_cs - last->invol_cs);
+    flb_report_column_set(r, col + 7, minflt);
+    flb_report_column_set(r, col + 8, majflt);
+
+    *last = io;
+}
+
+/* Totals of the run normalized per record and per MB of input */
+static void report_io_summary(struct flb_report *r)
+{
+    double mb;
+    double records;
+    unsigned long syscalls;
+    unsigned long cs;
+    struct flb_proc_io *a = &r->io_first;
+    struct flb_proc_io *b = &r->io_last;
+
+    records = r->io_records ? r->io_records : 1;
+    mb = r->io_bytes ? r->io_bytes / (1024.0 * 1024.0) : 1;
+    syscalls = (b->syscr - a->syscr) + (b->syscw - a->syscw);
+    cs = (b->vol_cs - a->vol_cs) + (b->invol_cs - a->invol_cs);
+
+    dprintf(r->fd, "\n- I/O and Scheduling (per %zu records, %.2lf MB)\n",
+            r->io_records, r->io_bytes / (1024.0 * 1024.0));
+    dprintf(r->fd, "  - Syscalls    : %lu read, %lu write, %.3lf per record\n",
+            b->syscr - a->syscr, b->syscw - a->syscw, syscalls / records);
+    dprintf(r->fd, "  - Read bytes  : %lu (%.1lf per record), storage %lu\n",
+            b->rchar - a->rchar, (b->rchar - a->rchar) / records,
+            b->read_bytes - a->read_bytes);
+    dprintf(r->fd, "  - Write bytes : %lu (%.1lf per record), storage %lu\n",
+            b->wchar - a->wchar, (b->wchar - a->wchar) / records,
+            b->write_bytes - a->write_bytes);
+    dprintf(r->fd, "  - Ctx Switches: %lu voluntary, %lu involuntary, %.1lf per MB\n",
+            b->vol_cs - a->vol_cs, b->invol_cs - a->invol_cs, cs / mb);
+    dprintf(r->fd, "  - Page Faults : %lu minor, %lu major, %.4lf per record\n",
+            r->sum_minflt, r->sum_majflt,
+            (r->sum_minflt + r->sum_majflt) / records);
+}
+
+static void report_cgroup_open(struct flb_report *r, char *path)
+{
+    r->cgroup = flb_cgroup_create(path, r->pid);
+    if (!r->cgroup) {
+        return;
+    }
+    if (flb_cgroup_read(r->cgroup, &r->cg_first) == -1) {
+        fprintf(stderr, "error: cannot read cgroup '%s'\n", r->cgroup->path);
+        flb_cgroup_destroy(r->cgroup);
+        r->cgroup = NULL;
+        return;
+    }
+    r->cg_last = r->cg_first;
+
+    r->col_cgroup = flb_report_column_add(r, "thr_ms", 7, 0);
+    flb_report_column_add(r, "thr_n", 5, 0);
+    flb_report_column_add(r, "cg_mem_kb", 10, 0);
+    flb_report_column_add(r, "cg_file_kb", 10, 0);
+    flb_report_column_add(r, "cg_anon_kb", 10, 0);
+    flb_report_column_add(r, "io_rd_kb", 8, 0);
+    flb_report_column_add(r, "io_wr_kb", 8, 0);
+}
+
+/* Throttling and block I/O of the round, memory as it is now */
+static void report_cgroup(struct flb_report *r)
+{
+    int col = r->col_cgroup;
+    struct flb_cgroup_stat st;
+    struct flb_cgroup_stat *last = &r->cg_last;
+
+    if (flb_cgroup_read(r->cgroup, &st) == -1) {
+        return;
+    }
+    if (st.mem_current > r->cg_max_mem) {
+        r->cg_max_mem = st.mem_current;
+    }
+
+    flb_report_column_set(r, col, (st.throttled_usec - last->throttled_usec) / 1000);
+    flb_report_column_set(r, col + 1, st.nr_throttled - last->nr_throttled);
+    flb_report_column_set(r, col + 2, st.mem_current / 1024);
+    flb_report_column_set(r, col + 3, st.file / 1024);
+    flb_report_column_set(r, col + 4, st.anon / 1024);
+    flb_report_column_set(r, col + 5, (st.rbytes - last->rbytes) / 1024);
+    flb_report_column_set(r, col + 6, (st.wbytes - last->wbytes) / 1024);
+
+    *last = st;
+}
+
+static void report_cgroup_summary(struct flb_report *r)
+{
+    char *tmp;
+    uint64_t peak;
+    uint64_t periods;
+    uint64_t throttled;
+    struct flb_cgroup_stat *a = &r->cg_first;
+    struct flb_cgroup_stat *b = &r->cg_last;
+
+    periods = b->nr_periods - a->nr_periods;
+    throttled = b->nr_throttled - a->nr_throttled;
+
+    dprintf(r->fd, "\n- Cgroup\n");
+    dprintf(r->fd, "  - Path        : %s\n", r->cgroup->path);
+    dprintf(r->fd, "  - CPU Time    : %lu ms (user %lu, system %lu)\n",
+            (b->usage_usec - a->usage_usec) / 1000,
+            (b->user_usec - a->user_usec) / 1000,
+            (b->system_usec - a->system_usec) / 1000);
+    dprintf(r->fd, "  - Throttled   : %lu of %lu periods (%.2lf%%), %lu ms, "
+            "%.2lf%% of the test\n",
+            throttled, periods,
+            periods ? (throttled * 100.0) / periods : 0,
+            (b->throttled_usec - a->throttled_usec) / 1000,
+            (b->throttled_usec - a->throttled_usec) / 1e4 / r->sum_duration);
+
+    /* memory.peak is the lifetime peak, older kernels don't have it */
+    peak = b->mem_peak ? b->mem_peak : r->cg_max_mem;
+    tmp = flb_report_human_readable_size(peak);
+    dprintf(r->fd, "  - Peak Memory : %s%s\n", tmp,
+            b->mem_peak ? " (memory.peak)" : " (max sampled)");
+    free(tmp);
+    if (b->mem_max) {
+        tmp = flb_report_human_readable_size(b->mem_max);
+        dprintf(r->fd, "  - Memory Limit: %s, peak at %.2lf%%\n", tmp,
+                (peak * 100.0) / b->mem_max);
+        free(tmp);
+    }
+    dprintf(r->fd, "  - Last Memory : anon %lu, file %lu, kernel %lu, "
+            "sock %lu bytes\n", b->anon, b->file, b->kernel, b->sock);
+    dprintf(r->fd, "  - OOM Events  : %lu oom, %lu killed\n",
+            b->oom - a->oom, b->oom_kill - a->oom_kill);
+    dprintf(r->fd, "  - Block I/O   : read %lu bytes (%lu ops), "
+            "write %lu bytes (%lu ops)\n",
+            b->rbytes - a->rbytes, b->rios - a->rios,
+            b->wbytes - a->wbytes, b->wios - a->wios);
+}
+
+static void report_perf_open(struct flb_report *r)
+{
+    r->perf = flb_perf_create(r->pid);
+    if (!r->perf) {
+        return;
+    }
+    flb_perf_read(r->perf, r->perf_first);
+    memcpy(r->perf_last, r->perf_first, sizeof(r->perf_last));
+
+    if (r->perf->hw) {
+        r->col_perf = flb_report_column_add(r, "mcycles", 8, 1);
+        flb_report_column_add(r, "minstr", 8, 1);
+        flb_report_column_add(r, "ipc", 5, 2);
+        flb_report_column_add(r, "miss_pct", 8, 2);
+        flb_report_column_add(r, "br_miss_k", 9, 1);
+        flb_report_column_add(r, "instr_rec", 9, 0);
+    }
+    else {
+        r->col_perf = flb_report_column_add(r, "task_ms", 8, 1);
+        flb_report_column_add(r, "ctxsw", 6, 0);
+        flb_report_column_add(r, "migr", 5, 0);
+        flb_report_column_add(r, "faults", 7, 0);
+        flb_report_column_add(r, "us_rec", 7, 2);
+    }
+}
+
+static void report_perf(struct flb_report *r, int records)
+{
+    int i;
+    int col = r->col_perf;
+    uint64_t d[FLB_PERF_EVENTS];
+    uint64_t values[FLB_PERF_EVENTS];
+
+    flb_perf_read(r->perf, values);
+    for (i = 0; i < FLB_PERF_EVENTS; i++) {
+        /* scaled values of multiplexed counters can go back a bit */
+        d[i] = values[i] > r->perf_last[i] ? values[i] - r->perf_last[i] : 0;
+    }
+    memcpy(r->perf_last, values, sizeof(r->perf_last));
+    r->perf_records += records;
+
+    if (r->perf->hw) {
+        flb_report_column_set(r, col, d[FLB_PERF_CYCLES] / 1e6);
+        flb_report_column_set(r, col + 1, d[FLB_PERF_INSTRUCTIONS] / 1e6);
+        flb_report_column_set(r, col + 2, d[FLB_PERF_CYCLES] ?
+                              (double) d[FLB_PERF_INSTRUCTIONS] /
+                              d[FLB_PERF_CYCLES] : 0);
+        flb_report_column_set(r, col + 3, d[FLB_PERF_CACHE_REFS] ?
+                              (d[FLB_PERF_CACHE_MISSES] * 100.0) /
+                              d[FLB_PERF_CACHE_REFS] : 0);
+        flb_report_column_set(r, col + 4, d[FLB_PERF_BRANCH_MISSES] / 1e3);
+        flb_report_column_set(r, col + 5, records > 0 ?
+                              (double) d[FLB_PERF_INSTRUCTIONS] / records : 0);
+    }
+    else {
+        flb_report_column_set(r, col, d[FLB_PERF_TASK_CLOCK] / 1e6);
+        flb_report_column_set(r, col + 1, d[FLB_PERF_CTX_SWITCHES]);
+        flb_report_column_set(r, col + 2, d[FLB_PERF_MIGRATIONS]);
+        flb_report_column_set(r, col + 3, d[FLB_PERF_PAGE_FAULTS]);
+        flb_report_column_set(r, col + 4, records > 0 ?
+                              d[FLB_PERF_TASK_CLOCK] / 1e3 / records : 0);
+    }
+}
+
+static void report_perf_summary(struct flb_report *r)
+{
+    int i;
+    double records;
+    uint64_t d[FLB_PERF_EVENTS];
+
+    for (i = 0; i < FLB_PERF_EVENTS; i++) {
+        /* same as the rows, scaled values can go below the first read */
+        d[i] = r->perf_last[i] > r->perf_first[i] ?
+            r->perf_last[i] - r->perf_first[i] : 0;
+    }
+    records = r->perf_records ? r->perf_records : 1;
+
+    if (!r->perf->hw) {
+        dprintf(r->fd, "\n- Software Counters (no hardware PMU)\n");
+        dprintf(r->fd, "  - Task Clock  : %.2lf ms, %.3lf us per record\n",
+                d[FLB_PERF_TASK_CLOCK] / 1e6,
+                d[FLB_PERF_TASK_CLOCK] / 1e3 / records);
+        dprintf(r->fd, "  - Ctx Switches: %lu\n", d[FLB_PERF_CTX_SWITCHES]);
+        dprintf(r->fd, "  - Migrations  : %lu\n", d[FLB_PERF_MIGRATIONS]);
+        dprintf(r->fd, "  - Page Faults : %lu\n", d[FLB_PERF_PAGE_FAULTS]);
+        return;
+    }
+
+    dprintf(r->fd, "\n- Hardware Counters (%i threads", r->perf->n_threads);
+    if (r->perf->scaled < 1.0) {
+        dprintf(r->fd, ", multiplexed, scaled from %.0lf%%",
+                r->perf->scaled * 100);
+    }
+    dprintf(r->fd, ")\n");
+    dprintf(r->fd, "  - Cycles      : %lu\n", d[FLB_PERF_CYCLES]);
+    dprintf(r->fd, "  - Instructions: %lu\n", d[FLB_PERF_INSTRUCTIONS]);
+    dprintf(r->fd, "  - IPC         : %.2lf\n", d[FLB_PERF_CYCLES] ?
+            (double) d[FLB_PERF_INSTRUCTIONS] / d[FLB_PERF_CYCLES] : 0);
+    dprintf(r->fd, "  - Cache Misses: %lu of %lu references (%.2lf%%)\n",
+            d[FLB_PERF_CACHE_MISSES], d[FLB_PERF_CACHE_REFS],
+            d[FLB_PERF_CACHE_REFS] ?
+            (d[FLB_PERF_CACHE_MISSES] * 100.0) / d[FLB_PERF_CACHE_REFS] : 0);
+    dprintf(r->fd, "  - Branch Miss : %lu (%.2lf per 1K instructions)\n",
+            d[FLB_PERF_BRANCH_MISSES], d[FLB_PERF_INSTRUCTIONS] ?
+            (d[FLB_PERF_BRANCH_MISSES] * 1000.0) / d[FLB_PERF_INSTRUCTIONS] : 0);
+    dprintf(r->fd, "  - Per Record  : %.0lf instructions, %.0lf cycles\n",
+            d[FLB_PERF_INSTRUCTIONS] / records, d[FLB_PERF_CYCLES] / records);
+}
+
+/* Startup of a --launch target, measured before the first round */
+static void report_launch_summary(struct flb_report *r, struct flb_launch *l)
+{
+    char *tmp;
+
+    dprintf(r->fd, "\n- Startup\n");
+    dprintf(r->fd, "  - Command     : %s\n", l->cmd);
+    dprintf(r->fd, "  - Exec        : %.3lf ms after fork\n", l->exec_ms);
+
+    if (!__atomic_load_n(&l->done, __ATOMIC_ACQUIRE) || l->ready_ms < 0) {
+        dprintf(r->fd, "  - Ready       : never\n");
+        return;
+    }
+
+    if (l->ready == FLB_LAUNCH_READY_LISTEN) {
+        dprintf(r->fd, "  - Ready       : %.1lf ms (listening on port %i)\n",
+                l->ready_ms, l->port);
+    }
+    else if (l->ready == FLB_LAUNCH_READY_READ) {
+        dprintf(r->fd, "  - Ready       : %.1lf ms (first byte of %s read)\n",
+                l->ready_ms, l->path);
+    }
+    else {
+        dprintf(r->fd, "  - Ready       : %.1lf ms (running)\n", l->ready_ms);
+    }
+    dprintf(r->fd, "  - CPU         : %lu ms until ready\n", l->ready_cpu_ms);
+
+    tmp = flb_report_human_readable_size(l->ready_rss);
+    dprintf(r->fd, "  - RSS         : %s when ready, ", tmp);
+    free(tmp);
+    tmp = flb_report_human_readable_size(l->peak_rss);
+    dprintf(r->fd, "%s peak\n", tmp);
+    free(tmp);
+
+    dprintf(r->fd, "  - Page Faults : %lu minor, %lu major\n",
+            l->ready_minflt, l->ready_majflt);
+    dprintf(r->fd, "  - Samples     : %lu at 1 ms\n", l->samples);
+}
+
+static int ptree_proc_cmp(const void *a, const void *b)
+{
+    const struct flb_ptree_proc *pa = a;
+    const struct flb_ptree_proc *pb = b;
+    unsigned long ta = pa->utime + pa->stime - pa->first_ticks;
+    unsigned long tb = pb->utime + pb->stime - pb->first_ticks;
+
+    return (tb > ta) - (tb < ta);
+}
+
+static void report_tree_summary(struct flb_report *r, int top)
+{
+    int i;
+    char *tmp;
+    unsigned long ticks;
+    struct flb_ptree *t = r->tree;
+    struct flb_ptree_proc *procs;
+
+    dprintf(r->fd, "\n- Process Tree\n");
+    dprintf(r->fd, "  - Processes   : %i seen, %i max alive, %i exited\n",
+            t->n, t->max_alive, t->n - t->alive);
+    if (top == 0) {
+        return;
+    }
+
+    /* busiest first, sorted on a copy: the tree is still in use */
+    procs = malloc(sizeof(struct flb_ptree_proc) * t->n);
+    if (!procs) {
+        perror("malloc");
+        return;
+    }
+    memcpy(procs, t->procs, sizeof(struct flb_ptree_proc) * t->n);
+    qsort(procs, t->n, sizeof(struct flb_ptree_proc), ptree_proc_cmp);
+
+    for (i = 0; i < t->n && i < top; i++) {
+        ticks = procs[i].utime + procs[i].stime - procs[i].first_ticks;
+        tmp = flb_report_human_readable_size(procs[i].alive ?
+                                             procs[i].r_rss : 0);
+        dprintf(r->fd,
+                "  - %-7i %-16s: %7.2lf%% avg, %8lu ms, rss %8s%s\n",
+                procs[i].pid, procs[i].name,
+                (ticks * 100.0) / r->cpu_ticks / r->sum_duration,
+                (ticks * 1000) / r->cpu_ticks,
+                tmp, procs[i].alive ? "" : " (exited)");
+        free(tmp);
+    }
+    free(procs);
+}
+
+static int mapping_cmp(const void *a, const void *b)
+{
+    const struct flb_proc_mapping *x = a;
+    const struct flb_proc_mapping *y = b;
+
+    return (y->pss > x->pss) - (y->pss < x->pss);
+}
+
+static void report_mappings_summary(struct flb_report *r, int top)
+{
+    int i;
+    int j;
+    int n;
+    long first;
+    char *name;
+    char *pss;
+    char *rss;
+    char *growth;
+    struct flb_proc_mapping *maps = r->maps_last;
+
+    n = r->n_maps_last;
+    if (!maps) {
+        maps = r->maps_first;
+        n = r->n_maps_first;
+    }
+    if (!maps || n == 0) {
+        return;
+    }
+
+    qsort(maps, n, sizeof(struct flb_proc_mapping), mapping_cmp);
+    dprintf(r->fd, "\n- Mappings (top %i by PSS, growth since the first round)\n",
+            top);
+    for (i = 0; i < n && i < top; i++) {
+        first = 0;
+        for (j = 0; j < r->n_maps_first; j++) {
+            if (strcmp(r->maps_first[j].name, maps[i].name) == 0) {
+                first = r->maps_first[j].pss;
+                break;
+            }
+        }
+        pss = flb_report_human_readable_size(maps[i].pss);
+        rss = flb_report_human_readable_size(maps[i].rss);
+        growth = flb_report_human_readable_size(labs(maps[i].pss - first));
+        /* the end of a long path says more than its beginning */
+        name = maps[i].name;
+        if (strlen(name) > 40) {
+            name += strlen(name) - 40;
+        }
+        dprintf(r->fd, "  - %-40s: pss %9s (%s%s), rss %9s, anon %s\n",
+                name, pss, maps[i].pss >= first ? "+" : "-", growth,
+                rss, maps[i].anon > 0 ? "yes" : "no");
+        free(pss);
+        free(rss);
+        free(growth);
+    }
+}
+
+static int thread_name_cmp(const void *a, const void *b)
+{
+    const struct flb_report_thread_name *x = a;
+    const struct flb_report_thread_name *y = b;
+
+    return (y->total > x->total) - (y->total < x->total);
 }
 
 struct flb_report *flb_report_create(char *out, int format, int pid, int wait)
@@ -89,6 +845,7 @@ struct flb_report *flb_report_create(char *out, int format, int pid, int wait)
     char *target;
     struct flb_report *r;
     struct flb_proc_task *t;
+    struct flb_monitor *mon = flb_monitor_get();
 
     if (out) {
         fd = open(out, O_CREAT | O_TRUNC | O_WRONLY, 0666);
@@ -120,6 +877,19 @@ struct flb_report *flb_report_create(char *out, int format, int pid, int wait)
     r->sum_mem = 0;
     r->sum_cpu = 0.0;
     r->sum_records = 0;
+    r->col_logical = -1;
+    r->col_sockets = -1;
+
+    /* before the name lookup below, it becomes the cgroup one */
+    r->col_cgroup = -1;
+    if (r->pid >= 0 && mon->cgroup) {
+        report_cgroup_open(r, mon->cgroup);
+        if (!r->cgroup) {
+            close(fd);
+            free(r);
+            return NULL;
+        }
+    }
 
     if (r->pid >= 0) {
         t = flb_proc_stat_create(r->pid);
@@ -132,19 +902,254 @@ struct flb_report *flb_report_create(char *out, int format, int pid, int wait)
         flb_proc_stat_destroy(t);
     }
 
-    if (r->format == FLB_REPORT_TXT) {
-        report_txt_header(r);
+    /*
+     * Created before the sampler: the first tree is the one answering
+     * flb_proc_stat_create(), the sampler thread reads its own.
+     */
+    r->col_tree = -1;
+    if (r->pid >= 0 && mon->tree && !r->cgroup) {
+        r->tree = flb_ptree_create(r->pid,
+                                   (mon->memory ? FLB_PTREE_MEM : 0) |
+                                   (mon->io ? FLB_PTREE_IO : 0));
+        if (r->tree) {
+            r->col_tree = flb_report_column_add(r, "procs", 5, 0);
+        }
     }
-    else if (r->format == FLB_REPORT_MARKDOWN) {
-        report_markdown_header(r);
+
+    /* also created before the sampler, for flb_proc_stat_create() */
+    r->col_sched = -1;
+    if (r->pid >= 0 && mon->schedstat) {
+        if (r->tree || r->cgroup) {
+            fprintf(stderr, "warn: --schedstat follows a single process, "
+                    "ignored with --tree and --cgroup\n");
+        }
+        else {
+            r->sched = flb_proc_sched_create(r->pid);
+        }
+        if (r->sched) {
+            r->col_sched = flb_report_column_add(r, "wait_ms", 8, 2);
+            flb_report_column_add(r, "wait_pct", 8, 2);
+            flb_report_column_add(r, "wait_us", 8, 1);
+        }
     }
-    else if (r->format == FLB_REPORT_CSV) {
-        report_csv_header(r);
+
+    /*
+     * The sampler catches what happens between two rows: the highest CPU
+     * usage over 100ms and the highest RSS seen during the round.
+     */
+    r->col_peaks = -1;
+    if (r->pid >= 0 && mon->sample_hz > 0) {
+        r->sampler = flb_sampler_create(r->pid, mon->sample_hz,
+                                        (r->tree ? FLB_SAMPLER_TREE : 0) |
+                                        (r->sched ? FLB_SAMPLER_SCHED : 0),
+                                        r->cgroup ? mon->cgroup : NULL);
+        if (r->sampler) {
+            r->win_size = mon->sample_hz / 10;
+            if (r->win_size < 1) {
+                r->win_size = 1;
+            }
+            r->col_peaks = flb_report_column_add(r, "cpu_peak", 8, 2);
+            flb_report_column_add(r, "rss_peak", 12, 0);
+        }
+    }
+
+    /* memory beyond RSS */
+    r->col_mem = -1;
+    r->fd_status = -1;
+    r->fd_rollup = -1;
+    r->fd_smaps = -1;
+    if (r->pid >= 0 && mon->memory) {
+        report_memory_open(r, mon->smaps);
+    }
+
+    /* counters are read now, rows print deltas */
+    r->col_io = -1;
+    r->fd_io = -1;
+    if (r->pid >= 0 && mon->io) {
+        report_io_open(r);
+    }
+
+    r->col_perf = -1;
+    if (r->pid >= 0 && mon->perf) {
+        report_perf_open(r);
+    }
+
+    if (r->pid >= 0 && mon->profile) {
+        r->profile = flb_profile_create(r->pid, mon->profile,
+                                        mon->profile_first,
+                                        mon->profile_last);
     }
 
+    /* threads found now are the baseline, later ones count from zero */
+    r->col_threads = -1;
+    if (r->pid >= 0 && mon->threads) {
+        r->col_threads = flb_report_column_add(r, "thr_peak", 8, 2);
+        report_threads_scan(r, 0);
+    }
+
+    /* The header is printed with the first row, once columns are known */
     return r;
 }
 
+/*
+ * Tools can append their own metrics to every row, columns must be
+ * registered before the first call to flb_report_stats().
+ */
+int flb_report_column_add(struct flb_report *r, char *name,
+                          int width, int precision)
+{
+    struct flb_report_col *col;
+
+    if (r->header || r->n_cols >= FLB_REPORT_MAX_COLS) {
+        fprintf(stderr, "error: cannot register report column '%s'\n", name);
+        return -1;
+    }
+
+    col = &r->cols[r->n_cols];
+    col->name = name;
+    col->width = width;
+    col->precision = precision;
+    col->value = 0.0;
+
+    return r->n_cols++;
+}
+
+void flb_report_column_set(struct flb_report *r, int id, double value)
+{
+    if (id < 0 || id >= r->n_cols) {
+        return;
+    }
+    r->cols[id].value = value;
+}
+
+/*
+ * Writers sending compressed payloads register a column with the logical
+ * bytes of every row, the summary then relates the target CPU time to the
+ * amount of data it had to decompress.
+ */
+int flb_report_logical_enable(struct flb_report *r)
+{
+    r->col_logical = flb_report_column_add(r, "logical_b", 11, 0);
+    return r->col_logical;
+}
+
+void flb_report_logical_set(struct flb_report *r, size_t bytes)
+{
+    flb_report_column_set(r, r->col_logical, bytes);
+}
+
+/*
+ * TCP writers add the state of the target listening and accepted sockets
+ * to every row with --sockets: a growing recv-Q shows the agent is not
+ * reading as fast as the data arrives, way before its CPU usage says so.
+ */
+int flb_report_sockets_enable(struct flb_report *r)
+{
+    if (!flb_monitor_get()->sockets) {
+        return -1;
+    }
+
+    r->col_sockets = flb_report_column_add(r, "accept_q", 8, 0);
+    flb_report_column_add(r, "recvq_kb", 9, 0);
+    flb_report_column_add(r, "sendq_kb", 9, 0);
+    flb_report_column_add(r, "drops", 6, 0);
+    flb_report_column_add(r, "retrans", 7, 0);
+    flb_report_column_add(r, "rcvspc_kb", 9, 0);
+    if (r->n_cols - r->col_sockets != 6) {
+        r->col_sockets = -1;
+        return -1;
+    }
+    return r->col_sockets;
+}
+
+/* Drain the sampler and compute the peaks of the round */
+static void report_samples(struct flb_report *r)
+{
+    double dt;
+    double cpu;
+    double peak_cpu = 0.0;
+    long peak_rss = 0;
+    struct flb_sample s;
+    struct flb_sample *old;
+
+    while (flb_sampler_pop(r->sampler, &s)) {
+        if (s.r_rss > peak_rss) {
+            peak_rss = s.r_rss;
+        }
+
+        /* CPU over the window that ends with this sample */
+        if (r->win_len == r->win_size) {
+            old = &r->win[r->win_pos];
+            dt = (s.ts.tv_sec - old->ts.tv_sec) +
+                (s.ts.tv_nsec - old->ts.tv_nsec) / BILLION;
+            if (dt > 0 && old->run_ns > 0) {
+                cpu = (s.run_ns - old->run_ns) * 100.0 / BILLION / dt;
+                if (cpu > peak_cpu) {
+                    peak_cpu = cpu;
+                }
+            }
+            else if (dt > 0) {
+                cpu = ((s.utime + s.stime) - (old->utime + old->stime)) *
+                    100.0 / r->cpu_ticks / dt;
+                if (cpu > peak_cpu) {
+                    peak_cpu = cpu;
+                }
+            }
+        }
+        else {
+            r->win_len++;
+        }
+        r->win[r->win_pos] = s;
+        r->win_pos = (r->win_pos + 1) % r->win_size;
+    }
+
+    if (peak_cpu > r->peak_cpu) {
+        r->peak_cpu = peak_cpu;
+    }
+    if (peak_rss > r->peak_rss) {
+        r->peak_rss = peak_rss;
+    }
+    flb_report_column_set(r, r->col_peaks, peak_cpu);
+    flb_report_column_set(r, r->col_peaks + 1, peak_rss);
+}
+
+static void report_sockets(struct flb_report *r)
+{
+    int col = r->col_sockets;
+    uint64_t drops = 0;
+    uint64_t retrans = 0;
+    struct flb_sockdiag sd;
+
+    if (flb_sockdiag_sample(r->pid, &sd) == -1) {
+        return;
+    }
+
+    /* totals go down when connections are closed */
+    if (sd.drops >= r->sock_drops) {
+        drops = sd.drops - r->sock_drops;
+    }
+    if (sd.retrans >= r->sock_retrans) {
+        retrans = sd.retrans - r->sock_retrans;
+    }
+    r->sock_drops = sd.drops;
+    r->sock_retrans = sd.retrans;
+    r->sum_sock_drops += drops;
+    r->sum_sock_retrans += retrans;
+    if (sd.max_recv_q > r->max_recv_q) {
+        r->max_recv_q = sd.max_recv_q;
+    }
+    if (sd.accept_q > r->max_accept_q) {
+        r->max_accept_q = sd.accept_q;
+    }
+
+    flb_report_column_set(r, col, sd.accept_q);
+    flb_report_column_set(r, col + 1, sd.recv_q / 1024.0);
+    flb_report_column_set(r, col + 2, sd.send_q / 1024.0);
+    flb_report_column_set(r, col + 3, drops);
+    flb_report_column_set(r, col + 4, retrans);
+    flb_report_column_set(r, col + 5, sd.rcv_space / 1024.0);
+}
+
 double flb_report_cpu_usage(struct flb_report *r,
                             struct flb_proc_task *t1, struct flb_proc_task *t2)
 {
@@ -153,9 +1158,14 @@ double flb_report_cpu_usage(struct flb_report *r,
     double delta_sec;
     double delta_nsec;
 
-    /* Calculate overall CPU usage */
-    diff = ((t2->utime + t2->stime) - (t1->utime + t1->stime));
-    cpu = ((diff * 100.0) / (double) r->cpu_ticks);
+    /* Calculate overall CPU usage, in ns when schedstat is followed */
+    if (t1->run_ns > 0 && t2->run_ns >= t1->run_ns) {
+        cpu = (t2->run_ns - t1->run_ns) * 100.0 / BILLION;
+    }
+    else {
+        diff = ((t2->utime + t2->stime) - (t1->utime + t1->stime));
+        cpu = ((diff * 100.0) / (double) r->cpu_ticks);
+    }
 
     /* Check and adjust based on time invested in the test */
     delta_sec  = (t2->ts.tv_sec - t1->ts.tv_sec);
@@ -173,6 +1183,11 @@ int flb_report_stats(struct flb_report *r, int records,
     char *bytes_hr;
     double cpu;
     double duration;
+    struct flb_proc_task tree_task;
+
+    if (!r->header) {
+        report_header(r);
+    }
 
     r->snapshots++;
 
@@ -195,9 +1210,53 @@ int flb_report_stats(struct flb_report *r, int records,
     }
     r->sum_duration += duration;
     r->sum_bytes += bytes;
+    r->sum_cpu_ms += (t2->r_utime_ms - t1->r_utime_ms) +
+        (t2->r_stime_ms - t1->r_stime_ms);
+    if (r->col_logical >= 0) {
+        r->sum_logical += r->cols[r->col_logical].value;
+    }
+    if (r->tree) {
+        /*
+         * New members before reading their memory and I/O. Without a
+         * sampler flb_proc_stat_create() has just read the CPU times.
+         */
+        flb_ptree_refresh(r->tree);
+        if (r->sampler) {
+            flb_ptree_read(r->tree, &tree_task);
+        }
+        flb_report_column_set(r, r->col_tree, r->tree->alive);
+    }
+    if (r->col_cgroup >= 0) {
+        report_cgroup(r);
+    }
+    if (r->col_sched >= 0) {
+        report_sched(r, t1, t2);
+    }
+    if (r->col_sockets >= 0) {
+        report_sockets(r);
+    }
+    if (r->sampler) {
+        report_samples(r);
+    }
+    if (r->col_threads >= 0) {
+        flb_report_column_set(r, r->col_threads,
+                              report_threads_scan(r, duration));
+    }
+    if (r->col_mem >= 0) {
+        report_memory(r);
+    }
+    if (r->col_io >= 0) {
+        report_io(r, records, bytes, t1, t2);
+    }
+    if (r->col_perf >= 0) {
+        report_perf(r, records);
+    }
+    if (r->profile) {
+        flb_profile_round(r->profile, r->snapshots);
+    }
 
     if (r->format == FLB_REPORT_TXT) {
-        dprintf(r->fd, "%8d  %10zu  %8s  %5.2lf | %6.2lf  %9ld  %8ld %12ld %8s\n",
+        dprintf(r->fd, "%8d  %10zu  %8s  %5.2lf | %6.2lf  %9ld  %8ld %12ld %8s",
                 records,
                 bytes,
                 bytes_hr,
@@ -211,7 +1270,7 @@ int flb_report_stats(struct flb_report *r, int records,
     else if (r->format == FLB_REPORT_MARKDOWN) {
         dprintf(r->fd,
                 "| %d | %zu | %s | %.2lf | %.2lf | %ld | %ld | "
-                "%ld | %s |\n",
+                "%ld | %s |",
                 records,
                 bytes,
                 bytes_hr,
@@ -223,7 +1282,7 @@ int flb_report_stats(struct flb_report *r, int records,
                 rss_hr);
     }
     else if (r->format == FLB_REPORT_CSV) {
-        dprintf(r->fd, "%d,%zu,%s,%.2lf,%.2lf,%ld,%ld,%ld,%s\n",
+        dprintf(r->fd, "%d,%zu,%s,%.2lf,%.2lf,%ld,%ld,%ld,%s",
                 records,
                 bytes,
                 bytes_hr,
@@ -235,12 +1294,17 @@ int flb_report_stats(struct flb_report *r, int records,
                 rss_hr);
     }
 
+    report_columns(r);
+
     free(rss_hr);
     free(bytes_hr);
+    return 0;
 }
 
 int flb_report_summary(struct flb_report *r)
 {
+    int i;
+    struct flb_report_thread_name *names;
     char *tmp;
     char unit[32];
     double duration = r->sum_duration - r->wait_time;
@@ -263,10 +1327,128 @@ int flb_report_summary(struct flb_report *r)
 
     tmp = flb_report_human_readable_size(r->sum_bytes / r->sum_duration);
     dprintf(r->fd, "  - Avg Rate    : %s/sec\n", tmp);
+    free(tmp);
     tmp = flb_report_human_readable_size(r->sum_records / r->sum_duration);
     dprintf(r->fd, "  - Avg Records : %s/sec\n", tmp);
-
     free(tmp);
+
+    if (r->col_logical >= 0 && r->sum_logical > 0) {
+        tmp = flb_report_human_readable_size(r->sum_logical / r->sum_duration);
+        dprintf(r->fd, "  - Avg Logical : %s/sec\n", tmp);
+        free(tmp);
+        dprintf(r->fd, "  - Wire Ratio  : %.2lf%%\n",
+                (r->sum_bytes * 100.0) / r->sum_logical);
+        dprintf(r->fd, "  - CPU per GB  : %.2lf ms (logical)\n",
+                r->sum_cpu_ms / ((double) r->sum_logical / (1024 * 1024 * 1024)));
+    }
+
+    if (r->sampler) {
+        tmp = flb_report_human_readable_size(r->peak_rss);
+        dprintf(r->fd, "  - Peak CPU    : %.2lf%% (100ms window)\n", r->peak_cpu);
+        dprintf(r->fd, "  - Peak Memory : %s\n", tmp);
+        free(tmp);
+        dprintf(r->fd, "  - Samples     : %lu at %i Hz (%lu dropped)\n",
+                r->sampler->samples, r->sampler->hz, r->sampler->dropped);
+    }
+
+    if (r->col_sockets >= 0) {
+        tmp = flb_report_human_readable_size(r->max_recv_q);
+        dprintf(r->fd, "  - Max Recv-Q  : %s (one connection)\n", tmp);
+        free(tmp);
+        dprintf(r->fd, "  - Max Accept-Q: %u\n", r->max_accept_q);
+        dprintf(r->fd, "  - Sock Drops  : %lu\n", r->sum_sock_drops);
+        dprintf(r->fd, "  - Retransmits : %lu\n", r->sum_sock_retrans);
+    }
+
+    if (flb_launch_get()) {
+        report_launch_summary(r, flb_launch_get());
+    }
+
+    if (r->col_cgroup >= 0) {
+        report_cgroup_summary(r);
+    }
+
+    if (r->col_sched >= 0) {
+        dprintf(r->fd, "\n- Scheduling (schedstat)\n");
+        dprintf(r->fd, "  - On CPU      : %.3lf ms\n", r->sum_run_ns / 1e6);
+        dprintf(r->fd, "  - Run-Q Wait  : %.3lf ms, %.2lf%% of runnable time\n",
+                r->sum_wait_ns / 1e6,
+                r->sum_run_ns + r->sum_wait_ns ?
+                (r->sum_wait_ns * 100.0) / (r->sum_run_ns + r->sum_wait_ns) : 0);
+        dprintf(r->fd, "  - Avg Wait    : %.1lf us per timeslice (%lu timeslices)\n",
+                r->sum_timeslices ? r->sum_wait_ns / 1e3 / r->sum_timeslices : 0,
+                r->sum_timeslices);
+        dprintf(r->fd, "  - Max Wait    : %.3lf ms in a round (round %i)\n",
+                r->max_wait_ns / 1e6, r->max_wait_round);
+    }
+
+    if (r->col_mem >= 0 && r->mem_rounds > 0) {
+        dprintf(r->fd, "\n- Memory\n");
+        tmp = flb_report_human_readable_size(r->mem.hwm);
+        dprintf(r->fd, "  - Peak RSS    : %s (VmHWM)\n", tmp);
+        free(tmp);
+        tmp = flb_report_human_readable_size(r->sum_pss / r->mem_rounds);
+        dprintf(r->fd, "  - Avg PSS     : %s\n", tmp);
+        free(tmp);
+        tmp = flb_report_human_readable_size(r->max_pss);
+        dprintf(r->fd, "  - Max PSS     : %s\n", tmp);
+        free(tmp);
+        dprintf(r->fd, "  - Last RSS    : anon %ld, file %ld, shmem %ld bytes\n",
+                r->mem.rss_anon, r->mem.rss_file, r->mem.rss_shmem);
+        dprintf(r->fd, "  - Last PSS    : anon %ld, file %ld, shmem %ld bytes\n",
+                r->mem.pss_anon, r->mem.pss_file, r->mem.pss_shmem);
+        if (r->mem.swap > 0) {
+            dprintf(r->fd, "  - Swap        : %ld bytes\n", r->mem.swap);
+        }
+        if (r->fd_smaps != -1) {
+            report_mappings_summary(r, flb_monitor_get()->smaps);
+        }
+    }
+
+    if (r->col_io >= 0) {
+        report_io_summary(r);
+    }
+
+    if (r->col_perf >= 0) {
+        report_perf_summary(r);
+    }
+
+    if (r->profile) {
+        dprintf(r->fd, "\n- Profile\n");
+        dprintf(r->fd, "  - Samples     : %lu at %i Hz (%s, %lu lost)\n",
+                r->profile->samples, FLB_PROFILE_HZ,
+                r->profile->hw ? "cycles" : "cpu-clock", r->profile->lost);
+        dprintf(r->fd, "  - Rounds      : %i written to %s/round-NNN.folded\n",
+                r->profile->rounds, r->profile->dir);
+    }
+
+    if (r->tree) {
+        report_tree_summary(r, flb_monitor_get()->tree_top);
+    }
+
+    /* busiest first, sorted on a copy: the ids are still in use */
+    names = NULL;
+    if (r->col_threads >= 0 && r->n_names > 0) {
+        names = malloc(sizeof(struct flb_report_thread_name) * r->n_names);
+    }
+    if (names) {
+        memcpy(names, r->names,
+               sizeof(struct flb_report_thread_name) * r->n_names);
+        qsort(names, r->n_names, sizeof(struct flb_report_thread_name),
+              thread_name_cmp);
+        dprintf(r->fd, "\n- Threads (CPU by thread name)\n");
+        for (i = 0; i < r->n_names; i++) {
+            dprintf(r->fd,
+                    "  - %-16s x%-3i: %7.2lf%% avg, %7.2lf%% peak, %8lu ms\n",
+                    names[i].name, names[i].threads,
+                    (names[i].total * 100.0) / r->cpu_ticks / r->sum_duration,
+                    names[i].peak,
+                    (names[i].total * 1000) / r->cpu_ticks);
+        }
+        free(names);
+    }
+
+    return 0;
 }
 
 int flb_report_destroy(struct flb_report *r)
@@ -275,6 +1457,43 @@ int flb_report_destroy(struct flb_report *r)
         close(r->fd);
     }
 
+    if (r->sampler) {
+        flb_sampler_destroy(r->sampler);
+    }
+    if (r->tree) {
+        flb_ptree_destroy(r->tree);
+    }
+    if (r->cgroup) {
+        flb_cgroup_destroy(r->cgroup);
+    }
+    if (r->perf) {
+        flb_perf_destroy(r->perf);
+    }
+    if (r->profile) {
+        flb_profile_destroy(r->profile);
+    }
+    if (r->sched) {
+        flb_proc_sched_destroy(r->sched);
+    }
+    free(r->threads);
+    free(r->names);
+    free(r->maps_first);
+    free(r->maps_last);
+    if (r->fd_status != -1) {
+        close(r->fd_status);
+    }
+    if (r->fd_rollup != -1) {
+        close(r->fd_rollup);
+    }
+    if (r->fd_smaps != -1) {
+        close(r->fd_smaps);
+    }
+    if (r->fd_io != -1) {
+        close(r->fd_io);
+    }
+    if (r->io_cs) {
+        flb_proc_ctxsw_destroy(r->io_cs);
+    }
     if (r->name) {
         free(r->name);
     }
@@ -0,0 +1,272 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/types.h>
+
+#include "flb_proc.h"
+#include "flb_sampler.h"
+
+/* the sampler serving flb_sampler_task(), one per process */
+static struct flb_sampler *sampler_active = NULL;
+
+static int sampler_read(struct flb_sampler *s, struct flb_proc_task *t)
+{
+    ssize_t bytes;
+    char buf[PROC_STAT_BUF_SIZE];
+    struct flb_cgroup_stat st;
+
+    if (s->cgroup) {
+        if (flb_cgroup_read(s->cgroup, &st) == -1) {
+            return -1;
+        }
+        flb_cgroup_to_task(s->cgroup, &st, t);
+        return 0;
+    }
+    if (s->tree) {
+        flb_ptree_refresh(s->tree);
+        return flb_ptree_read(s->tree, t);
+    }
+
+    bytes = pread(s->fd, buf, sizeof(buf), 0);
+    if (bytes <= 0 || flb_proc_stat_parse(buf, bytes, t) == -1) {
+        return -1;
+    }
+    t->run_ns = 0;
+    t->wait_ns = 0;
+    t->timeslices = 0;
+
+    if (s->sched) {
+        /* new threads every 100ms, a thread file read is cheap */
+        if (s->samples % (s->hz / 10) == 0) {
+            flb_proc_sched_scan(s->sched);
+        }
+        flb_proc_sched_read(s->sched, t);
+    }
+    return 0;
+}
+
+static void sampler_free(struct flb_sampler *s)
+{
+    if (s->tree) {
+        flb_ptree_destroy(s->tree);
+    }
+    if (s->cgroup) {
+        flb_cgroup_destroy(s->cgroup);
+    }
+    if (s->sched) {
+        flb_proc_sched_destroy(s->sched);
+    }
+    close(s->fd);
+    free(s);
+}
+
+static void *sampler_worker(void *data)
+{
+    uint64_t head;
+    uint64_t tail;
+    struct timespec next;
+    struct flb_proc_task t;
+    struct flb_sampler *s = data;
+    struct flb_sample *sample;
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+
+    while (__atomic_load_n(&s->running, __ATOMIC_RELAXED)) {
+        if (sampler_read(s, &t) == -1) {
+            /* the process is gone */
+            break;
+        }
+
+        head = s->head;
+        tail = __atomic_load_n(&s->tail, __ATOMIC_ACQUIRE);
+        if (head - tail == FLB_SAMPLER_RING) {
+            s->dropped++;
+        }
+        else {
+            sample = &s->ring[head & (FLB_SAMPLER_RING - 1)];
+            clock_gettime(CLOCK_REALTIME, &sample->ts);
+            sample->utime = t.utime;
+            sample->stime = t.stime;
+            sample->minflt = t.minflt;
+            sample->majflt = t.majflt;
+            sample->run_ns = t.run_ns;
+            sample->wait_ns = t.wait_ns;
+            sample->timeslices = t.timeslices;
+            sample->r_rss = t.r_rss;
+            __atomic_store_n(&s->head, head + 1, __ATOMIC_RELEASE);
+        }
+        s->samples++;
+
+        /* absolute deadlines, the rate does not drift with the work */
+        next.tv_nsec += 1000000000 / s->hz;
+        if (next.tv_nsec >= 1000000000) {
+            next.tv_sec++;
+            next.tv_nsec -= 1000000000;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    __atomic_store_n(&s->running, 0, __ATOMIC_RELEASE);
+    return NULL;
+}
+
+struct flb_sampler *flb_sampler_create(pid_t pid, int hz, int flags,
+                                       char *cgroup)
+{
+    char path[PROC_PID_SIZE];
+    struct flb_proc_task t;
+    struct flb_sampler *s;
+
+    s = calloc(1, sizeof(struct flb_sampler));
+    if (!s) {
+        perror("calloc");
+        return NULL;
+    }
+    s->pid = pid;
+    s->hz = hz;
+
+    snprintf(path, sizeof(path), "/proc/%i/stat", pid);
+    s->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (s->fd == -1) {
+        perror("open");
+        fprintf(stderr, "error: cannot open '%s'\n", path);
+        free(s);
+        return NULL;
+    }
+
+    if (cgroup) {
+        s->cgroup = flb_cgroup_create(cgroup, pid);
+        if (!s->cgroup) {
+            close(s->fd);
+            free(s);
+            return NULL;
+        }
+    }
+    else if (flags & FLB_SAMPLER_TREE) {
+        s->tree = flb_ptree_create(pid, 0);
+        if (!s->tree) {
+            close(s->fd);
+            free(s);
+            return NULL;
+        }
+    }
+
+    else if (flags & FLB_SAMPLER_SCHED) {
+        s->sched = flb_proc_sched_create(pid);
+        if (!s->sched) {
+            close(s->fd);
+            free(s);
+            return NULL;
+        }
+    }
+
+    if (sampler_read(s, &t) == -1) {
+        fprintf(stderr, "error: invalid stat file data: %s\n", path);
+        sampler_free(s);
+        return NULL;
+    }
+    memcpy(s->name, t.name, sizeof(s->name));
+
+    s->running = 1;
+    if (pthread_create(&s->thread, NULL, sampler_worker, s) != 0) {
+        fprintf(stderr, "error: cannot create sampler thread\n");
+        sampler_free(s);
+        return NULL;
+    }
+
+    if (!sampler_active) {
+        sampler_active = s;
+    }
+    return s;
+}
+
+void flb_sampler_destroy(struct flb_sampler *s)
+{
+    __atomic_store_n(&s->running, 0, __ATOMIC_RELAXED);
+    pthread_join(s->thread, NULL);
+
+    if (sampler_active == s) {
+        sampler_active = NULL;
+    }
+    sampler_free(s);
+}
+
+int flb_sampler_pop(struct flb_sampler *s, struct flb_sample *sample)
+{
+    uint64_t head;
+
+    head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+    if (s->tail == head) {
+        return 0;
+    }
+
+    *sample = s->ring[s->tail & (FLB_SAMPLER_RING - 1)];
+    __atomic_store_n(&s->tail, s->tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int flb_sampler_task(pid_t pid, struct flb_proc_task *t)
+{
+    int cpu_hz;
+    uint64_t head;
+    struct flb_sample *last;
+    struct flb_sampler *s = sampler_active;
+
+    if (!s || s->pid != pid ||
+        !__atomic_load_n(&s->running, __ATOMIC_ACQUIRE)) {
+        return -1;
+    }
+
+    /*
+     * The latest slot is not written again until the ring wraps, the
+     * reporter drains it every round so that's seconds away.
+     */
+    head = __atomic_load_n(&s->head, __ATOMIC_ACQUIRE);
+    if (head == 0) {
+        return -1;
+    }
+    last = &s->ring[(head - 1) & (FLB_SAMPLER_RING - 1)];
+
+    cpu_hz = sysconf(_SC_CLK_TCK);
+    memcpy(t->name, s->name, sizeof(t->name));
+    t->ts = last->ts;
+    t->utime = last->utime;
+    t->stime = last->stime;
+    t->minflt = last->minflt;
+    t->majflt = last->majflt;
+    t->run_ns = last->run_ns;
+    t->wait_ns = last->wait_ns;
+    t->timeslices = last->timeslices;
+    t->r_rss = last->r_rss;
+    t->rss = last->r_rss / getpagesize();
+    t->r_utime_s  = (t->utime / cpu_hz);
+    t->r_utime_ms = ((t->utime * 1000) / cpu_hz);
+    t->r_stime_s  = (t->stime / cpu_hz);
+    t->r_stime_ms = ((t->stime * 1000) / cpu_hz);
+    return 0;
+}
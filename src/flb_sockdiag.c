@@ -0,0 +1,352 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+
+#include "flb_sockdiag.h"
+
+#define SOCKDIAG_BUF_SIZE  32768
+
+/* TCP states, from include/net/tcp_states.h */
+#define SOCKDIAG_ESTABLISHED   1
+#define SOCKDIAG_LISTEN       10
+
+/* One TCP socket owned by the process */
+struct sockdiag_entry {
+    int state;
+    uint16_t sport;
+    uint32_t recv_q;
+    uint32_t send_q;
+    uint32_t drops;
+    uint32_t retrans;
+    uint32_t rcv_space;
+};
+
+struct sockdiag_list {
+    int count;
+    int size;
+    struct sockdiag_entry *entries;
+};
+
+static int inode_cmp(const void *a, const void *b)
+{
+    ino_t x = *(const ino_t *) a;
+    ino_t y = *(const ino_t *) b;
+
+    return (x > y) - (x < y);
+}
+
+/* Sorted inodes of the sockets found in /proc/PID/fd */
+static int socket_inodes(pid_t pid, ino_t **out)
+{
+    int n;
+    int count = 0;
+    int size = 64;
+    DIR *dir;
+    ino_t *tmp;
+    ino_t *inodes;
+    unsigned long ino;
+    char path[256];
+    char link[64];
+    struct dirent *ent;
+
+    snprintf(path, sizeof(path), "/proc/%i/fd", pid);
+    dir = opendir(path);
+    if (!dir) {
+        perror("opendir");
+        return -1;
+    }
+
+    inodes = malloc(sizeof(ino_t) * size);
+    if (!inodes) {
+        perror("malloc");
+        closedir(dir);
+        return -1;
+    }
+
+    while ((ent = readdir(dir)) != NULL) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        snprintf(path, sizeof(path), "/proc/%i/fd/%s", pid, ent->d_name);
+        n = readlink(path, link, sizeof(link) - 1);
+        if (n <= 0) {
+            continue;
+        }
+        link[n] = '\0';
+        if (sscanf(link, "socket:[%lu]", &ino) != 1) {
+            continue;
+        }
+
+        if (count == size) {
+            tmp = realloc(inodes, sizeof(ino_t) * size * 2);
+            if (!tmp) {
+                perror("realloc");
+                free(inodes);
+                closedir(dir);
+                return -1;
+            }
+            inodes = tmp;
+            size *= 2;
+        }
+        inodes[count++] = ino;
+    }
+    closedir(dir);
+
+    qsort(inodes, count, sizeof(ino_t), inode_cmp);
+    *out = inodes;
+    return count;
+}
+
+static int list_add(struct sockdiag_list *list, struct sockdiag_entry *e)
+{
+    struct sockdiag_entry *tmp;
+
+    if (list->count == list->size) {
+        list->size = list->size ? list->size * 2 : 64;
+        tmp = realloc(list->entries, sizeof(struct sockdiag_entry) * list->size);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        list->entries = tmp;
+    }
+    list->entries[list->count++] = *e;
+    return 0;
+}
+
+/* Parse one inet_diag message and keep it if the process owns it */
+static int diag_msg(struct nlmsghdr *nlh, ino_t *inodes, int n_inodes,
+                    struct sockdiag_list *list)
+{
+    int len;
+    ino_t ino;
+    uint32_t *mem;
+    struct rtattr *attr;
+    struct tcp_info *info;
+    struct inet_diag_msg *msg;
+    struct sockdiag_entry e;
+
+    msg = NLMSG_DATA(nlh);
+    ino = msg->idiag_inode;
+    if (!bsearch(&ino, inodes, n_inodes, sizeof(ino_t), inode_cmp)) {
+        return 0;
+    }
+
+    memset(&e, 0, sizeof(e));
+    e.state = msg->idiag_state;
+    e.sport = ntohs(msg->id.idiag_sport);
+    e.recv_q = msg->idiag_rqueue;
+    e.send_q = msg->idiag_wqueue;
+
+    len = nlh->nlmsg_len - NLMSG_LENGTH(sizeof(*msg));
+    for (attr = (struct rtattr *) (msg + 1); RTA_OK(attr, len);
+         attr = RTA_NEXT(attr, len)) {
+        if (attr->rta_type == INET_DIAG_SKMEMINFO &&
+            RTA_PAYLOAD(attr) >= sizeof(uint32_t) * (SK_MEMINFO_DROPS + 1)) {
+            mem = RTA_DATA(attr);
+            e.drops = mem[SK_MEMINFO_DROPS];
+        }
+        else if (attr->rta_type == INET_DIAG_INFO &&
+                 RTA_PAYLOAD(attr) >= offsetof(struct tcp_info,
+                                               tcpi_total_retrans) + 4) {
+            info = RTA_DATA(attr);
+            e.retrans = info->tcpi_total_retrans;
+            e.rcv_space = info->tcpi_rcv_space;
+        }
+    }
+
+    return list_add(list, &e);
+}
+
+/*
+ * Dump the IPv4 and IPv6 TCP sockets at once: SOCK_DIAG_BY_FAMILY needs
+ * one dump per family, the older TCPDIAG_GETSOCK request covers both.
+ */
+static int diag_dump(ino_t *inodes, int n_inodes, struct sockdiag_list *list)
+{
+    int fd;
+    int done = 0;
+    ssize_t n;
+    char *buf;
+    struct nlmsghdr *nlh;
+    struct sockaddr_nl sa;
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req req;
+    } msg;
+
+    fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (fd == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.nlh.nlmsg_len = sizeof(msg);
+    msg.nlh.nlmsg_type = TCPDIAG_GETSOCK;
+    msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    msg.req.idiag_states = (1 << SOCKDIAG_ESTABLISHED) | (1 << SOCKDIAG_LISTEN);
+    msg.req.idiag_ext = (1 << (INET_DIAG_INFO - 1)) |
+        (1 << (INET_DIAG_SKMEMINFO - 1));
+
+    memset(&sa, 0, sizeof(sa));
+    sa.nl_family = AF_NETLINK;
+    if (sendto(fd, &msg, sizeof(msg), 0,
+               (struct sockaddr *) &sa, sizeof(sa)) == -1) {
+        perror("sendto");
+        close(fd);
+        return -1;
+    }
+
+    buf = malloc(SOCKDIAG_BUF_SIZE);
+    if (!buf) {
+        perror("malloc");
+        close(fd);
+        return -1;
+    }
+
+    while (!done) {
+        n = recv(fd, buf, SOCKDIAG_BUF_SIZE, 0);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("recv");
+            break;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        for (nlh = (struct nlmsghdr *) buf; NLMSG_OK(nlh, n);
+             nlh = NLMSG_NEXT(nlh, n)) {
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                done = 1;
+                break;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                fprintf(stderr, "error: sock_diag dump failed\n");
+                free(buf);
+                close(fd);
+                return -1;
+            }
+            if (diag_msg(nlh, inodes, n_inodes, list) == -1) {
+                free(buf);
+                close(fd);
+                return -1;
+            }
+        }
+    }
+
+    free(buf);
+    close(fd);
+    return done ? 0 : -1;
+}
+
+int flb_sockdiag_sample(pid_t pid, struct flb_sockdiag *sd)
+{
+    int i;
+    int j;
+    int ret = 0;
+    int n_inodes;
+    ino_t *inodes;
+    struct sockdiag_entry *e;
+    struct sockdiag_list list = {0, 0, NULL};
+
+    memset(sd, 0, sizeof(struct flb_sockdiag));
+
+    n_inodes = socket_inodes(pid, &inodes);
+    if (n_inodes == -1) {
+        return -1;
+    }
+    if (n_inodes == 0) {
+        free(inodes);
+        return 0;
+    }
+
+    if (diag_dump(inodes, n_inodes, &list) == -1) {
+        ret = -1;
+    }
+    free(inodes);
+
+    /* listening sockets first, their ports identify accepted connections */
+    for (i = 0; i < list.count; i++) {
+        e = &list.entries[i];
+        if (e->state != SOCKDIAG_LISTEN) {
+            continue;
+        }
+        sd->listeners++;
+        if (sd->n_ports < FLB_SOCKDIAG_PORTS) {
+            sd->ports[sd->n_ports++] = e->sport;
+        }
+        sd->accept_q += e->recv_q;
+        sd->drops += e->drops;
+    }
+
+    for (i = 0; i < list.count; i++) {
+        e = &list.entries[i];
+        if (e->state != SOCKDIAG_ESTABLISHED) {
+            continue;
+        }
+        for (j = 0; j < list.count; j++) {
+            if (list.entries[j].state == SOCKDIAG_LISTEN &&
+                list.entries[j].sport == e->sport) {
+                break;
+            }
+        }
+        if (j == list.count) {
+            /* outgoing connection */
+            continue;
+        }
+
+        sd->accepted++;
+        sd->recv_q += e->recv_q;
+        sd->send_q += e->send_q;
+        sd->drops += e->drops;
+        sd->retrans += e->retrans;
+        if (e->recv_q > sd->max_recv_q) {
+            sd->max_recv_q = e->recv_q;
+        }
+        if (e->rcv_space > 0 &&
+            (sd->rcv_space == 0 || e->rcv_space < sd->rcv_space)) {
+            sd->rcv_space = e->rcv_space;
+        }
+    }
+
+    free(list.entries);
+    return ret;
+}
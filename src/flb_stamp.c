@@ -0,0 +1,316 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "flb_histogram.h"
+#include "flb_msgpack.h"
+#include "flb_stamp.h"
+
+uint64_t flb_stamp_now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* Write the fixed size stamp, it includes the trailing comma */
+void flb_stamp_write(char *dst, uint64_t seq, uint64_t ts)
+{
+    char tmp[FLB_STAMP_SIZE + 1];
+
+    snprintf(tmp, sizeof(tmp), "%s%*lu,%s%*lu,",
+             FLB_STAMP_SEQ_KEY, FLB_STAMP_DIGITS, seq,
+             FLB_STAMP_TS_KEY, FLB_STAMP_DIGITS, ts);
+    memcpy(dst, tmp, FLB_STAMP_SIZE);
+}
+
+/*
+ * Copy a JSON map record into 'dst' with the stamp as its first keys.
+ * 'dst' must have room for len + FLB_STAMP_SIZE bytes, returns the new
+ * record length or zero if the record is not a map.
+ */
+size_t flb_stamp_record(char *dst, const char *rec, size_t len,
+                        uint64_t seq, uint64_t ts)
+{
+    size_t i;
+    const char *p;
+
+    p = memchr(rec, '{', len);
+    if (!p) {
+        return 0;
+    }
+    i = (p - rec) + 1;
+
+    memcpy(dst, rec, i);
+    flb_stamp_write(dst + i, seq, ts);
+
+    /* empty map: the trailing comma becomes a space */
+    p++;
+    while (p < rec + len && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+    if (p < rec + len && *p == '}') {
+        dst[i + FLB_STAMP_SIZE - 1] = ' ';
+    }
+
+    memcpy(dst + i + FLB_STAMP_SIZE, rec + i, len - i);
+    return len + FLB_STAMP_SIZE;
+}
+
+static const char *stamp_value(const char *p, const char *end, uint64_t *val)
+{
+    uint64_t v = 0;
+
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '"' || *p == '\\')) {
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') {
+        return NULL;
+    }
+    while (p < end && *p >= '0' && *p <= '9') {
+        v = (v * 10) + (*p - '0');
+        p++;
+    }
+    *val = v;
+    return p;
+}
+
+/*
+ * Find the next stamp starting at 'off'. The receiving side gets the
+ * records after the agent re-encoded them, so keys are searched for and
+ * any spacing is accepted. Records serialized as a JSON string (e.g. Loki
+ * lines) have their quotes escaped, backslashes are skipped as well.
+ * Returns 1 when found, 0 otherwise.
+ */
+int flb_stamp_find(const char *buf, size_t len, size_t *off,
+                   uint64_t *seq, uint64_t *ts)
+{
+    const char *p;
+    const char *end = buf + len;
+    const char *ts_key;
+
+    while (*off < len) {
+        p = memmem(buf + *off, len - *off, "_flb_seq", 8);
+        if (!p) {
+            *off = len;
+            return 0;
+        }
+        *off = (p - buf) + 1;
+
+        p += 8;
+        while (p < end && (*p == ' ' || *p == ':' || *p == '"' || *p == '\\')) {
+            p++;
+        }
+        p = stamp_value(p, end, seq);
+        if (!p) {
+            continue;
+        }
+
+        /* the timestamp key follows closely */
+        ts_key = memmem(p, (end - p) < 64 ? (end - p) : 64, "_flb_ts", 7);
+        if (!ts_key) {
+            continue;
+        }
+        p = ts_key + 7;
+        while (p < end && (*p == ' ' || *p == ':' || *p == '"' || *p == '\\')) {
+            p++;
+        }
+        p = stamp_value(p, end, ts);
+        if (!p) {
+            continue;
+        }
+
+        *off = p - buf;
+        return 1;
+    }
+
+    return 0;
+}
+
+/* msgpack fixstr keys, as received through the Forward protocol */
+#define STAMP_MP_SEQ_KEY   "\xa8_flb_seq"
+#define STAMP_MP_TS_KEY    "\xa7_flb_ts"
+
+static int stamp_mp_uint(const char *buf, size_t len, size_t *off,
+                         uint64_t *val)
+{
+    struct flb_mp_obj obj;
+
+    if (flb_mp_unpack_next(buf, len, off, &obj) != FLB_MP_OK) {
+        return -1;
+    }
+    if (obj.type == FLB_MP_UINT) {
+        *val = obj.via.u64;
+    }
+    else if (obj.type == FLB_MP_INT && obj.via.i64 >= 0) {
+        *val = obj.via.i64;
+    }
+    else {
+        return -1;
+    }
+    return 0;
+}
+
+/* Same as flb_stamp_find() for msgpack encoded records */
+int flb_stamp_find_mp(const char *buf, size_t len, size_t *off,
+                      uint64_t *seq, uint64_t *ts)
+{
+    size_t o;
+    const char *p;
+
+    while (*off < len) {
+        p = memmem(buf + *off, len - *off, STAMP_MP_SEQ_KEY,
+                   sizeof(STAMP_MP_SEQ_KEY) - 1);
+        if (!p) {
+            *off = len;
+            return 0;
+        }
+        *off = (p - buf) + 1;
+
+        o = (p - buf) + sizeof(STAMP_MP_SEQ_KEY) - 1;
+        if (stamp_mp_uint(buf, len, &o, seq) == -1) {
+            continue;
+        }
+
+        /* the agent keeps the keys order, the timestamp comes next */
+        if (len - o < sizeof(STAMP_MP_TS_KEY) - 1 ||
+            memcmp(buf + o, STAMP_MP_TS_KEY, sizeof(STAMP_MP_TS_KEY) - 1) != 0) {
+            continue;
+        }
+        o += sizeof(STAMP_MP_TS_KEY) - 1;
+        if (stamp_mp_uint(buf, len, &o, ts) == -1) {
+            continue;
+        }
+
+        *off = o;
+        return 1;
+    }
+
+    return 0;
+}
+
+int flb_stamp_stats_init(struct flb_stamp_stats *st)
+{
+    memset(st, 0, sizeof(struct flb_stamp_stats));
+
+    st->bits_size = 1024 * 1024;
+    st->bits = calloc(1, st->bits_size);
+    st->hist = flb_histogram_create();
+    if (!st->bits || !st->hist) {
+        perror("calloc");
+        flb_stamp_stats_destroy(st);
+        return -1;
+    }
+    return 0;
+}
+
+void flb_stamp_stats_destroy(struct flb_stamp_stats *st)
+{
+    free(st->bits);
+    if (st->hist) {
+        flb_histogram_destroy(st->hist);
+    }
+    st->bits = NULL;
+    st->hist = NULL;
+}
+
+int flb_stamp_track(struct flb_stamp_stats *st, uint64_t seq, uint64_t ts,
+                    uint64_t now)
+{
+    size_t size;
+    uint8_t *tmp;
+
+    st->received++;
+
+    if (seq >= FLB_STAMP_SEQ_MAX) {
+        st->invalid++;
+        return 0;
+    }
+
+    /* grow the bitmap of seen sequence numbers */
+    if (seq / 8 >= st->bits_size) {
+        size = st->bits_size;
+        while (seq / 8 >= size) {
+            size *= 2;
+        }
+        if (size > FLB_STAMP_SEQ_MAX / 8) {
+            size = FLB_STAMP_SEQ_MAX / 8;
+        }
+        tmp = realloc(st->bits, size);
+        if (!tmp) {
+            perror("realloc");
+            return -1;
+        }
+        memset(tmp + st->bits_size, 0, size - st->bits_size);
+        st->bits = tmp;
+        st->bits_size = size;
+    }
+
+    if (st->bits[seq / 8] & (1 << (seq % 8))) {
+        st->dups++;
+        return 0;
+    }
+    st->bits[seq / 8] |= (1 << (seq % 8));
+    st->unique++;
+
+    if (st->unique > 1 && seq < st->max_seq) {
+        st->reordered++;
+    }
+    if (seq > st->max_seq) {
+        st->max_seq = seq;
+    }
+
+    flb_histogram_record(st->hist, now > ts ? now - ts : 0);
+    return 0;
+}
+
+/*
+ * Print the delivery summary, 'expected' is the number of records sent or
+ * zero to assume every sequence number up to the highest one seen.
+ */
+void flb_stamp_print(struct flb_stamp_stats *st, int fd, uint64_t expected)
+{
+    uint64_t lost;
+
+    if (expected == 0 && st->unique > 0) {
+        expected = st->max_seq + 1;
+    }
+    lost = expected > st->unique ? expected - st->unique : 0;
+
+    dprintf(fd, "\n- Delivery\n");
+    dprintf(fd, "  - Expected    : %lu\n", expected);
+    dprintf(fd, "  - Received    : %lu\n", st->received);
+    dprintf(fd, "  - Lost        : %lu (%.4lf%%)\n", lost,
+            expected > 0 ? (lost * 100.0) / expected : 0.0);
+    dprintf(fd, "  - Duplicated  : %lu\n", st->dups);
+    dprintf(fd, "  - Reordered   : %lu\n", st->reordered);
+    if (st->invalid > 0) {
+        dprintf(fd, "  - Invalid     : %lu (sequence above %llu)\n",
+                st->invalid, FLB_STAMP_SEQ_MAX);
+    }
+
+    flb_histogram_print(st->hist, fd, "Delivery Latency");
+}
@@ -0,0 +1,58 @@
+/* -*- Mode: C; tab-width: 4; indent-tabs-mode: nil; c-basic-offset: 4 -*- */
+
+/*  Fluent Bit
+ *  ==========
+ *  Copyright (C) 2019      The Fluent Bit Authors
+ *  Copyright (C) 2015-2018 Treasure Data Inc.
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <time.h>
+
+#include "flb_time.h"
+
+uint64_t flb_time_now_us()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/* t2 - t1, callers comparing against a later t1 cast it to int64_t */
+uint64_t flb_time_diff_us(struct timespec *t1, struct timespec *t2)
+{
+    return ((int64_t) (t2->tv_sec - t1->tv_sec) * 1000000) +
+        ((t2->tv_nsec - t1->tv_nsec) / 1000);
+}
+
+int flb_time_sleep_until(struct timespec *start, int ms)
+{
+    struct timespec ts;
+
+    ts.tv_sec = start->tv_sec + (ms / 1000);
+    ts.tv_nsec = start->tv_nsec + ((long) (ms % 1000) * 1000000);
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+
+    /* a time already in the past returns right away */
+    if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+        return -1;
+    }
+    return 0;
+}